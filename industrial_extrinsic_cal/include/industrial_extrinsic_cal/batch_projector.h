@@ -0,0 +1,83 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BATCH_PROJECTOR_H_
+#define BATCH_PROJECTOR_H_
+
+#include <vector>
+#include <industrial_extrinsic_cal/basic_types.h>
+
+namespace industrial_extrinsic_cal
+{
+
+/** @brief Projects a set of points into the images of many cameras, with the same lens model as
+ *         CameraReprjErrorWithDistortion. The points are stored as separate x, y and z arrays and each camera's rotation
+ *         is converted to a matrix once, so the per point loop has no branches and can be vectorized by the compiler.
+ *         Used to generate simulated observations and ground truth for tests and benchmarks.
+ */
+class BatchProjector
+{
+public:
+  /** @brief Constructor */
+  BatchProjector(){};
+
+  /** @brief Constructor
+   *  @param points the points to project, in the frame the camera extrinsics map from
+   */
+  BatchProjector(const std::vector<Point3d>& points);
+
+  /** @brief Destructor */
+  ~BatchProjector(){};
+
+  /** @brief replaces the points to project
+   *  @param points the points, in the frame the camera extrinsics map from
+   */
+  void setPoints(const std::vector<Point3d>& points);
+
+  /** @brief number of points */
+  int numPoints() const { return (int)x_.size(); }
+
+  /** @brief projects every point into one camera's image
+   *  @param camera extrinsics map points into the camera frame, distortion is applied as in the cost functions
+   *  @param image_x numPoints() image x locations
+   *  @param image_y numPoints() image y locations
+   *  @param visible if not NULL, numPoints() flags set to 1 for points in front of the camera whose projections lie
+   *         within the camera's width and height, 0 otherwise
+   *  @return number of visible points
+   */
+  int project(const CameraParameters& camera, double* image_x, double* image_y, unsigned char* visible = NULL) const;
+
+  /** @brief projects every point into the images of all cameras
+   *  @param cameras the cameras
+   *  @param image_x cameras.size() x numPoints() image x locations, camera major
+   *  @param image_y image y locations, laid out as image_x
+   *  @param visible visibility flags, laid out as image_x
+   *  @return number of visible observations
+   */
+  int project(const std::vector<CameraParameters>& cameras, std::vector<double>& image_x, std::vector<double>& image_y,
+              std::vector<unsigned char>& visible) const;
+
+private:
+  std::vector<double> x_; /**< x of each point */
+  std::vector<double> y_; /**< y of each point */
+  std::vector<double> z_; /**< z of each point */
+};
+
+} // end namespace industrial_extrinsic_cal
+
+#endif /* BATCH_PROJECTOR_H_ */
@@ -25,12 +25,15 @@
 #include <industrial_extrinsic_cal/camera_definition.h>
 #include <industrial_extrinsic_cal/observation_scene.h>
 #include <industrial_extrinsic_cal/observation_data_point.h>
+#include <industrial_extrinsic_cal/observation_archive.h>
 #include <industrial_extrinsic_cal/ceres_blocks.h>
 #include <industrial_extrinsic_cal/ros_camera_observer.h>
 #include <industrial_extrinsic_cal/ceres_costs_utils.hpp>
 #include <industrial_extrinsic_cal/circle_cost_utils.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
 #include "ceres/types.h"
@@ -38,6 +41,7 @@
 #include <yaml-cpp/yaml.h>
 #include <fstream>
 #include <iostream>
+#include <map>
 
 
 namespace industrial_extrinsic_cal
@@ -65,6 +69,21 @@ namespace industrial_extrinsic_cal
    */
   covariance_requests::CovarianceRequestType intToCovRequest(int request);
 
+  /*! @brief how far a running calibration job has come */
+  struct CalibrationProgress
+  {
+    std::string stage; /**< "observing" or "optimizing" */
+    int scene; /**< scene being observed */
+    int num_scenes; /**< scenes in the job */
+    int iteration; /**< optimizer iteration, 0 is the initial state */
+    double cost; /**< cost after the iteration */
+    double gradient_norm; /**< max norm of the gradient after the iteration */
+    double time_seconds; /**< time since the optimization started */
+  };
+
+  /*! @brief called as a job observes each scene and after each optimizer iteration, from the thread running the job */
+  typedef boost::function<void (const CalibrationProgress&)> ProgressCallback;
+
 /*! @brief defines and executes the calibration script */
 class CalibrationJob
 {
@@ -75,11 +94,12 @@ public:
     target_def_file_name_(target_fn), 
     caljob_def_file_name_(caljob_fn), 
     solved_(false), problem_(NULL),
-    post_proc_on_(false)
+    post_proc_on_(false), pose_initialization_on_(true), stop_requested_(false),
+    max_iterations_(1000), max_solver_time_(1.0e9), solver_threads_(1)
   {  } ;
 
-  /** @brief default destructor */
-  ~CalibrationJob() {  } ;
+  /** @brief destructor, frees the optimization problem */
+  ~CalibrationJob() { if(problem_ != NULL) delete(problem_); } ;
 
   /** @brief reads input files to create a calibration job
    * @return true if successful
@@ -87,9 +107,12 @@ public:
   bool load();
 
   /** @brief stores calibration job as 3 files
+   * @param file_path launch file the static transform publishers are written to, when empty
+   *    launch/target_to_camera_optical_transform_publisher.launch of this package. Jobs stored concurrently each need
+   *    their own.
    * @return true if successful
    */
-  bool store();
+  bool store(const std::string &file_path = "");
 
   /** @brief shows the current poses of all cameras and targets
    * @return true if successful
@@ -101,6 +124,47 @@ public:
    */
   bool run();
 
+  /** @brief runs the optimization on the observations of an archive written by saveArchive(), without triggers,
+   *    cameras or transform interfaces. The archived cameras and targets replace those of the job, starting from the
+   *    values the recorded optimization started from. Transforms are not pushed.
+   *  @param archive_file the archive
+   *  @return true if the archive was read and the optimization succeeded
+   */
+  bool replay(const std::string &archive_file);
+
+  /** @brief replaces the job's cameras, targets and observations by those of an archive, ready for the optimization
+   *  @param archive an archive read from a file written by saveArchive()
+   *  @return false if an observation refers to a parameter block the archive does not describe
+   */
+  bool loadArchive(const ObservationArchive &archive);
+
+  /** @brief sets the function told of the job's progress, an empty function turns progress reports off */
+  void setProgressCallback(ProgressCallback callback){ progress_callback_ = callback; };
+
+  /** @brief asks a running job to stop, from any thread. Observation stops before the next scene and the optimization
+   *    after the current iteration, leaving the parameter blocks as they were before it. run() then returns false,
+   *    at once if the request came before it started. The request holds until resetStop().
+   */
+  void requestStop();
+
+  /** @brief clears a stop request, called when a run is accepted so that a stop requested before run() starts is kept */
+  void resetStop();
+
+  /** @brief true once requestStop() has been called since the last resetStop() */
+  bool stopRequested();
+
+  /** @brief bounds the resources the job's optimization may use, for jobs sharing a machine
+   *  @param max_iterations the most solver iterations, 1000 by default
+   *  @param max_solver_time the most seconds the solver may take, a solve cut short does not converge
+   *  @param solver_threads threads the solver may use to evaluate the problem, 1 by default
+   */
+  void setSolverLimits(int max_iterations, double max_solver_time, int solver_threads)
+  {
+    max_iterations_ = max_iterations;
+    max_solver_time_ = max_solver_time;
+    solver_threads_ = solver_threads;
+  };
+
   /** @brief removes all camera observers from job
    *  @return true if successful
    */
@@ -132,12 +196,30 @@ public:
    **/
   double initialCostPerObservation();
 
+  /** @brief get the summary of the last optimization, iterations, timing and costs
+   *   @returns the ceres solver summary
+   **/
+  const ceres::Solver::Summary& getSolverSummary() const { return ceres_summary_; };
+
   /** @brief This is a diagnostics routine to compute the covariance of the results for the requested variables
    *    @param variables a list of cameras and targets
    *    @param covariance_file_name name of file to store the resulting matrix in
    */
   bool computeCovariance(std::vector<CovarianceVariableRequest> &variables, std::string &covariance_file_name);
 
+  /** @brief gathers the job's observations, parameter blocks and the summary of its optimization into an archive.
+   *    If the optimization has run, the initial values are those it started from and the final values its result,
+   *    otherwise the initial values are the current ones and there are no final values.
+   *    @param archive filled with the job
+   */
+  void buildArchive(ObservationArchive &archive);
+
+  /** @brief writes the job to an observation archive, so it can be solved again or analyzed without the cameras
+   *    @param file_name name of the archive file
+   *    @return true if the file was written
+   */
+  bool saveArchive(const std::string &file_name);
+
   /** @brief set the flag to save observation data to a file indicated for post processing
    *    @param post_proc_file_name the name of the file to put the post processing data
    */
@@ -146,6 +228,13 @@ public:
   /** @brief clears the flag that saves observation data to a file for post processing */
   void postProcessingOff();
 
+  /** @brief sets the flag to replace the camera and target poses from the yaml files by closed form estimates from the
+   *    observations before optimizing, on by default */
+  void poseInitializationOn(){ pose_initialization_on_ = true; };
+
+  /** @brief clears the flag, the optimization starts from the poses in the yaml files */
+  void poseInitializationOff(){ pose_initialization_on_ = false; };
+
 /*@brief get pointer to the blocks moving and static cameras and targets */
   CeresBlocks * getBlocks(){return &ceres_blocks_; }; 
 
@@ -182,6 +271,11 @@ protected:
    */
   bool runOptimization();
 
+  /** @brief estimates the camera extrinsics and target poses that are refined by the optimization from the observations
+   *  of targets with known points. Every parameter block is set once, by the first scene that can determine it.
+   */
+  void initializePoses();
+
   /** @brief Adds a new camera
    *  @param camera_to_add camera to add
    *  @return true if successful
@@ -218,8 +312,10 @@ protected:
    */
   bool appendNewScene(boost::shared_ptr<Trigger> trig);
 
-  /** @brief each camera and each target have a transform interface, push the current values to the interface */
-  void pushTransforms();
+  /** @brief each camera and each target have a transform interface, push the current values to the interface
+   *  @return false if the values could not all be sent
+   */
+  bool pushTransforms();
 
   /** @brief each camera and each target have a transform interface, pull the current values from the interface 
    *    @param scene_id the id for the scene, only pull transforms from targets and cameras of this scene
@@ -241,6 +337,14 @@ private:
   bool solved_; /*< set once the problem has been solved, allows covariance to be computed*/
   bool post_proc_on_; /*< flag indicating to save the observation data for post processing */
   std::string post_proc_data_file_; /*< file name for observation data for post processing */ 
+  bool pose_initialization_on_; /*< flag indicating to estimate the initial poses from the observations */
+  std::map<P_BLOCK, std::vector<double> > initial_block_values_; /*< parameter blocks as the last optimization got them */
+  ProgressCallback progress_callback_; /*< told of the progress of a run, may be empty */
+  boost::mutex stop_mutex_; /*< guards stop_requested_ */
+  bool stop_requested_; /*< set to stop the running job */
+  int max_iterations_; /*< most iterations of an optimization */
+  double max_solver_time_; /*< most seconds of an optimization */
+  int solver_threads_; /*< threads of an optimization */
 };//end class
 
 }//end namespace industrial_extrinsic_cal
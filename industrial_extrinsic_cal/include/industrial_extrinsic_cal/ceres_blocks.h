@@ -182,8 +182,10 @@ public:
     displayMovingTargets();
   };
 
-  /*! @brief sends transform to the interface*/
-  void pushTransforms();
+  /*! @brief sends transform to the interface
+   *    @return false if the mutable joint values could not be sent
+   */
+  bool pushTransforms();
 
   /*! @brief gets transform from interface 
    *    @param scene_id the current scene's id. Pulls from all static cameras, static targets, and those from this scene
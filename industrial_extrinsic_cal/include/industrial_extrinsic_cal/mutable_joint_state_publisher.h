@@ -24,17 +24,24 @@
 #include <industrial_extrinsic_cal/set_mutable_joint_states.h>
 #include <industrial_extrinsic_cal/get_mutable_joint_states.h>
 #include <industrial_extrinsic_cal/store_mutable_joint_states.h>
+#include <industrial_extrinsic_cal/batch_mutable_joint_states.h>
 #include <industrial_extrinsic_cal/yaml_utils.h>
 #include <sensor_msgs/JointState.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 namespace industrial_extrinsic_cal
 {
 
   /** @brief 
-   *        This object continuously broadcasts a vector of joint states
-   *        It provides 3 services
+   *        This object broadcasts a vector of joint states on a latched topic whenever a value changes,
+   *        and again at keepalive_rate (Hz, default 1.0, 0 disables it) for subscribers that expect a steady stream
+   *        It provides 4 services
    *        get the joint values
    *        set the joint values
-   *        store the joint names and current values to a yaml file
+   *        set any number of joint values and get all of them back in one call
+   *        store the joint names and current values to a yaml file, the file is written by a background thread
+   *        to a temporary file which is then renamed over the old one, so a reader never sees a partial file
    *        The intent is to provide a seamless interface for extrinsic calibration of "static" transforms
    *        The static transform publisher does not allow updating its values, typically this involves updating the urdf
    *        Instead, if the urdf defines a chain of x_trans, y_trans, z_trans, roll, pitch and yaw joints
@@ -54,9 +61,9 @@ namespace industrial_extrinsic_cal
     MutableJointStatePublisher(ros::NodeHandle nh);
 
     /**
-     * @brief Default destructor
+     * @brief destructor, finishes any pending store before returning
      */
-    ~MutableJointStatePublisher()  {  } ;
+    ~MutableJointStatePublisher();
 
     /** @brief  set the values of all 6 joints
      *
@@ -68,16 +75,31 @@ namespace industrial_extrinsic_cal
     bool getCallBack(industrial_extrinsic_cal::get_mutable_joint_states::Request &req,
 					       industrial_extrinsic_cal::get_mutable_joint_states::Response &res);
 
-    /** @brief writes the mutable joint states to the yaml file*/
+    /** @brief sets the joints named in the request, then returns the names and values of every mutable joint
+     *   so a client can keep all of them in a local cache with a single call
+     */
+    bool batchCallBack(industrial_extrinsic_cal::batch_mutable_joint_states::Request &req,
+		       industrial_extrinsic_cal::batch_mutable_joint_states::Response &res);
+
+    /** @brief queues the mutable joint states for the writer thread, which stores them in the yaml file*/
     bool storeCallBack(industrial_extrinsic_cal::store_mutable_joint_states::Request &req,
 						 industrial_extrinsic_cal::store_mutable_joint_states::Response &res);
 
     /** @brief publishes the joint states as a joint state message*/
     bool publishJointStates();
 
+    /** @brief republishes the joint states if nothing has been published for a keepalive period */
+    void keepAliveCallBack(const ros::TimerEvent &event);
 
   private:
     bool loadFromYamlFile();
+
+    /** @brief writer thread, stores the most recently queued joint states until shut down */
+    void storeThread();
+
+    /** @brief writes joints to file_name through a temporary file and a rename */
+    bool writeYamlFile(const std::map<std::string, double> &joints, const std::string &file_name);
+
     std::string yaml_file_name_;
     std::map<std::string, double> joints_;
     ros::NodeHandle nh_;
@@ -85,7 +107,18 @@ namespace industrial_extrinsic_cal
     ros::ServiceServer get_server_;
     ros::ServiceServer set_server_;
     ros::ServiceServer store_server_;
+    ros::ServiceServer batch_server_;
     std::string node_name_;
+    ros::Timer keepalive_timer_;
+    ros::Duration keepalive_period_; /**< zero when keepalive publication is disabled */
+    ros::Time last_publish_time_;
+    boost::thread store_thread_;
+    boost::mutex store_mutex_; /**< guards the members below, shared with the writer thread */
+    boost::condition_variable store_condition_;
+    std::map<std::string, double> store_joints_; /**< snapshot waiting to be written */
+    std::string store_file_name_;
+    bool store_pending_;
+    bool store_shutdown_;
   };
 
 } //end industrial_extrinsic_cal namespace
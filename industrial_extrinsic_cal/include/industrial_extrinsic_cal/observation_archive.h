@@ -0,0 +1,144 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBSERVATION_ARCHIVE_H_
+#define OBSERVATION_ARCHIVE_H_
+
+#include <string>
+#include <vector>
+#include <industrial_extrinsic_cal/basic_types.h>
+#include <industrial_extrinsic_cal/ceres_costs_utils.h>
+
+namespace industrial_extrinsic_cal
+{
+  namespace archive_blocks{
+    /** @brief what an archived parameter block holds, which also fixes its size */
+    enum BlockType{
+      CameraIntrinsics=0, /**< 9 values, fx, fy, cx, cy, k1, k2, k3, p1, p2 */
+      CameraExtrinsics, /**< 6 values, angle axis then position */
+      TargetPose, /**< 6 values, angle axis then position */
+      PointPosition /**< 3 values, x, y, z in the target frame */
+    };
+  } // end of namespace archive_blocks
+  typedef archive_blocks::BlockType ArchiveBlockType;
+
+  /** @brief number of values in a parameter block of the given type */
+  int archiveBlockSize(ArchiveBlockType type);
+
+  /** @brief a camera of an archived job */
+  struct ArchiveCamera
+  {
+    std::string name; /**< camera name */
+    bool is_moving; /**< moving cameras have one extrinsics block per scene */
+    int width; /**< image width */
+    int height; /**< image height */
+  };
+
+  /** @brief a target of an archived job */
+  struct ArchiveTarget
+  {
+    std::string name; /**< target name */
+    unsigned int target_type; /**< pattern type */
+    bool is_moving; /**< moving targets have one pose block per scene */
+  };
+
+  /** @brief a parameter block of an archived job */
+  struct ArchiveBlock
+  {
+    ArchiveBlockType type; /**< what the block holds */
+    int owner; /**< index of the camera (intrinsics, extrinsics) or target (pose, point) owning the block */
+    int scene_id; /**< scene of a moving camera's extrinsics or a moving target's pose, -1 otherwise */
+    int point_id; /**< point of a point block, -1 otherwise */
+    std::vector<double> initial_values; /**< values before the optimization and its pose initialization */
+    std::vector<double> final_values; /**< values the optimization ended with, empty if it was not run */
+  };
+
+  /** @brief an observation of an archived job, the blocks are indices into the archive's blocks */
+  struct ArchiveObservation
+  {
+    int scene_id; /**< scene of the observation */
+    int point_id; /**< point observed */
+    int camera; /**< index of the observing camera */
+    int target; /**< index of the observed target */
+    Cost_function cost_type; /**< cost function of the observation */
+    int intrinsics; /**< intrinsics block */
+    int extrinsics; /**< extrinsics block */
+    int target_pose; /**< target pose block */
+    int point_position; /**< point position block */
+    double image_x; /**< observed image location */
+    double image_y; /**< observed image location */
+    double circle_dia; /**< circle diameter, circle targets only */
+    Pose6d intermediate_frame; /**< identity unless the camera was mounted on a robot link */
+  };
+
+  /** @brief the parts of a solver summary worth keeping with an archive */
+  struct ArchiveSolverSummary
+  {
+    bool solved; /**< false if no optimization was run */
+    double initial_cost; /**< cost before optimization */
+    double final_cost; /**< cost after optimization */
+    int num_successful_steps; /**< iterations which reduced the cost */
+    int num_unsuccessful_steps; /**< iterations which did not */
+    int termination_type; /**< ceres termination type */
+    double total_time_in_seconds; /**< solver wall time */
+    int num_parameters; /**< number of parameters in the problem */
+    int num_residuals; /**< number of residuals in the problem */
+  };
+
+  /** @brief everything needed to solve a calibration job again without its cameras, its observations, parameter blocks
+   *   and cost types, and the summary of the optimization run on it.
+   *
+   *   It is stored as a versioned binary file of fixed size, naturally aligned records in host byte order, so the file
+   *   can be memory mapped and read in place. read() checks the magic number, version, byte order and every offset
+   *   before copying the records out.
+   */
+  class ObservationArchive
+  {
+  public:
+    /** @brief constructor, an empty archive */
+    ObservationArchive();
+
+    /** @brief empties the archive */
+    void clear();
+
+    /** @brief writes the archive
+     *  @param file_name the file to write, replaced if it exists
+     *  @return true on success
+     */
+    bool write(const std::string &file_name) const;
+
+    /** @brief replaces the archive's contents with those of a file
+     *  @param file_name the file, memory mapped while it is read
+     *  @return false if the file can't be mapped or is not a valid archive of this version, the archive is then empty
+     */
+    bool read(const std::string &file_name);
+
+    static const unsigned int version = 1; /**< format version written, and the only one read */
+
+    std::string reference_frame_; /**< reference frame of the job */
+    int num_scenes_; /**< scenes in the job */
+    std::vector<ArchiveCamera> cameras_; /**< cameras, referenced by index */
+    std::vector<ArchiveTarget> targets_; /**< targets, referenced by index */
+    std::vector<ArchiveBlock> blocks_; /**< parameter blocks, referenced by index */
+    std::vector<ArchiveObservation> observations_; /**< all observations of all scenes */
+    ArchiveSolverSummary summary_; /**< summary of the optimization */
+  };
+
+} // end namespace industrial_extrinsic_cal
+
+#endif /* OBSERVATION_ARCHIVE_H_ */
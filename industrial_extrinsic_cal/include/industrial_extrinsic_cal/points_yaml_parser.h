@@ -7,7 +7,8 @@
 
 namespace industrial_extrinsic_cal {
 
-  /** @brief parse a list of points from a file
+  /** @brief parse a list of points from a file, a yaml file with points, a points_file or a point_grid,
+   *         or any other file is read as a points file
    *  @param points_input_file, the stream from which to parse the points
    *  @param points the returned vector of points
    *  @return true if success, false otherwise
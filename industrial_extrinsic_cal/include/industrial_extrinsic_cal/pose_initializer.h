@@ -0,0 +1,62 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef POSE_INITIALIZER_H_
+#define POSE_INITIALIZER_H_
+
+#include <vector>
+#include <industrial_extrinsic_cal/basic_types.h>
+#include <industrial_extrinsic_cal/camera_observer.hpp>
+
+namespace industrial_extrinsic_cal
+{
+
+/** @brief Closed form estimate of the pose of a set of known points relative to a camera, used to start a nonlinear
+ *         refinement near its solution. Coplanar points are solved from the homography between their plane and the
+ *         normalized image plane, other point sets with EPnP. Lens distortion is ignored.
+ *  @param points the points, in the frame whose pose is estimated
+ *  @param image_x observed image x location of each point
+ *  @param image_y observed image y location of each point
+ *  @param fx focal length in x
+ *  @param fy focal length in y
+ *  @param cx optical center x
+ *  @param cy optical center y
+ *  @param pose transforms the points into the camera's optical frame, the same convention as camera extrinsics
+ *  @return false with fewer than 4 points, or when the points or observations are degenerate
+ */
+bool initialPoseFromObservations(const std::vector<Point3d>& points, const std::vector<double>& image_x,
+                                 const std::vector<double>& image_y, double fx, double fy, double cx, double cy,
+                                 Pose6d& pose);
+
+/** @brief Closed form estimate of the pose of a target relative to a camera
+ *  @param target the observed target, its points are looked up by the observations' point_id
+ *  @param observations the camera's observations of the target
+ *  @param fx focal length in x
+ *  @param fy focal length in y
+ *  @param cx optical center x
+ *  @param cy optical center y
+ *  @param pose transforms target points into the camera's optical frame
+ *  @return false with fewer than 4 observations, or when they are degenerate
+ */
+bool initialTargetPose(const Target& target, const CameraObservations& observations, double fx, double fy, double cx,
+                       double cy, Pose6d& pose);
+
+} // end namespace industrial_extrinsic_cal
+
+#endif /* POSE_INITIALIZER_H_ */
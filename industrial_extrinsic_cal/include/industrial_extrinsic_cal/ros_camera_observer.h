@@ -102,6 +102,14 @@ namespace industrial_extrinsic_cal
     /** @brief tells observer to process next incomming image to find the targets in list */
     void triggerCamera();
 
+    /**
+     * @brief use an image for the next observations instead of waiting for one on the image topic, so that a node
+     *        with its own image subscription can make observations of every frame
+     * @param image the image to observe
+     * @return false if the image could not be converted
+     */
+    bool setImage(const sensor_msgs::ImageConstPtr &image);
+
     /** @brief tells when camera has completed its observations */
     bool observationsDone();
 
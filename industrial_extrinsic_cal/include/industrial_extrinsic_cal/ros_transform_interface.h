@@ -22,17 +22,110 @@
 #include <stdio.h>
 #include <ros/ros.h> 
 #include <tf/transform_listener.h>
-#include <tf/transform_broadcaster.h>
+#include <tf/transform_datatypes.h>
 
 #include <industrial_extrinsic_cal/transform_interface.hpp>
 #include <industrial_extrinsic_cal/basic_types.h> // for Pose6d
 #include <industrial_extrinsic_cal/get_mutable_joint_states.h>
 #include <industrial_extrinsic_cal/set_mutable_joint_states.h>
 #include <industrial_extrinsic_cal/store_mutable_joint_states.h>
+#include <industrial_extrinsic_cal/batch_mutable_joint_states.h>
 #include <boost/make_shared.hpp>
 
 namespace industrial_extrinsic_cal
 {
+  typedef std::pair<std::string, std::string> TFFramePair; /**< (from frame, to frame) of a transform looked up in tf */
+
+  /** @brief the one tf listener shared by all transform interfaces, so tf data is buffered once per process
+   *   instead of once per interface
+   */
+  tf::TransformListener & sharedTFListener();
+
+  /** @brief uses the shared tf listener to get a Pose6d. The pose returned transforms points in the to_frame into the
+   *   from_frame. If a TFBatch holds the pair, its pose is returned without waiting on tf.
+   *   @param from_frame the starting frame
+   *   @param to_frame  the ending frame
+   */
+  Pose6d getPoseFromTF(const std::string &from_frame, const std::string &to_frame);
+
+  /** @brief publishes transform on the one latched /tf_static publisher of the process. The publisher keeps the
+   *   latest transform of every (parent, child) pair sent to it and republishes them all together, so a late
+   *   subscriber receives every one and an update reaches tf at once without any periodic traffic.
+   */
+  void sendStaticTransform(const tf::StampedTransform &transform);
+
+  /** @brief resolves a set of transforms from the shared tf listener at one common stamp, waiting once for all of
+   *   them rather than once each. While the batch exists getPoseFromTF() answers these pairs from it.
+   *   Batches may nest, an inner batch only resolves the pairs an outer one does not hold. Batches belong to the
+   *   thread that creates them, getPoseFromTF() on another thread does not see them.
+   */
+  class TFBatch
+  {
+  public:
+    /**
+     * @brief constructor, waits until every transform is available at a common stamp
+     * @param frame_pairs the (from, to) pairs to resolve
+     * @param timeout seconds to wait for a stamp before trying again with a newer one
+     */
+    TFBatch(const std::vector<TFFramePair> &frame_pairs, double timeout = 1.0);
+
+    /** @brief destructor, releases the pairs this batch resolved */
+    ~TFBatch();
+
+  private:
+    std::vector<TFFramePair> resolved_; /**< pairs this batch added to its thread's cache */
+  };
+
+  /** @brief blocks until the mutable joint state publisher's batch service is advertised
+   *   @param timeout seconds to wait, a negative value waits for as long as ros is ok
+   *   @return true if the service is available
+   */
+  bool waitForMutableJointStates(double timeout = -1.0);
+
+  /** @brief reads joint values from the process wide cache of the mutable joint state publisher's joints.
+   *   Outside a MutableJointBatch the cache is refreshed first, inside one it is refreshed at most once.
+   *   Either way every joint arrives in one service call, however many are asked for.
+   *   @param joint_names the joints to read
+   *   @param joint_values filled with one value per name
+   *   @return false if the publisher could not be reached or a joint is unknown
+   */
+  bool getMutableJointValues(const std::vector<std::string> &joint_names, std::vector<double> &joint_values);
+
+  /** @brief writes joint values to the cache. Outside a MutableJointBatch they are sent at once, inside one they
+   *   are held until the outermost batch closes and then sent together in one service call
+   *   @param joint_names the joints to write
+   *   @param joint_values one value per name
+   *   @return false if the values were sent and the publisher could not be reached
+   */
+  bool setMutableJointValues(const std::vector<std::string> &joint_names, const std::vector<double> &joint_values);
+
+  /** @brief sends the joint values this thread has queued in a MutableJointBatch now, rather than when the batch
+   *   closes. Called before asking the publisher to store its joints.
+   *   @return false if there were values to send and the publisher could not be reached
+   */
+  bool flushMutableJoints();
+
+  /** @brief groups the mutable joint state traffic of many transform interfaces. While a batch exists pulls read
+   *   a cache refreshed once from the publisher and pushes are queued, the queue is sent when the outermost
+   *   batch is destroyed. Batches may nest. Batches belong to the thread that creates them, so jobs running on
+   *   different threads queue and send their values independently.
+   */
+  class MutableJointBatch
+  {
+  public:
+    /** @brief constructor, the outermost batch marks the cache for one refresh */
+    MutableJointBatch();
+
+    /** @brief sends the queued joint values now if this is the outermost batch, so the caller learns whether they
+     *   reached the publisher. An inner batch leaves them to the outermost one.
+     *   @return false if the values could not be sent
+     */
+    bool commit();
+
+    /** @brief destructor, the outermost batch sends every joint value still queued in one call, logging a failure */
+    ~MutableJointBatch();
+  };
+
 
   /** @brief this object is intened to be used for targets, not cameras
    *            It simply listens to a pose from ref to transform frame, this must be set in a urdf
@@ -61,6 +154,9 @@ namespace industrial_extrinsic_cal
     /** @brief get the transform from tf */
     Pose6d pullTransform();
 
+    /** @brief appends the frame pairs pullTransform() looks up in tf */
+    void getTFFramePairs(std::vector<TFFramePair> &frame_pairs);
+
     /** @brief this is a listener interface, does nothing */
     bool store(std::string &filePath) { return(true);};
 
@@ -72,7 +168,6 @@ namespace industrial_extrinsic_cal
 
   private:
     Pose6d pose_;
-    tf::TransformListener tf_listener_;
     tf::StampedTransform transform_;
   };
 
@@ -104,6 +199,9 @@ namespace industrial_extrinsic_cal
     /** @brief this returns the transform from the optical frame to the reference frame as returned by tf */
     Pose6d pullTransform();
 
+    /** @brief appends the frame pairs pullTransform() looks up in tf */
+    void getTFFramePairs(std::vector<TFFramePair> &frame_pairs);
+
     /** @brief as a listener interface, this does nothing because transform defined by urdf*/
     bool store(std::string &filePath) {return(true);};
 
@@ -115,7 +213,6 @@ namespace industrial_extrinsic_cal
 
   private:
     Pose6d pose_;
-    tf::TransformListener tf_listener_;
     tf::StampedTransform transform_;
   };
 
@@ -148,6 +245,9 @@ namespace industrial_extrinsic_cal
     /** @brief get the transform from the hardware or display */
     Pose6d pullTransform();
 
+    /** @brief appends the frame pairs pullTransform() looks up in tf */
+    void getTFFramePairs(std::vector<TFFramePair> &frame_pairs);
+
     /** @brief as a listener interface, this does nothing. Transform is defined by urdf */
     bool store(std::string &filePath){ return(true);};
 
@@ -160,13 +260,12 @@ namespace industrial_extrinsic_cal
   private:
     std::string housing_frame_; /**< housing frame name note, this is not used, but kept be symetry with broadcaster param list */
     Pose6d pose_; /**< pose associated with the transform from reference frame to housing frame */
-    tf::TransformListener tf_listener_; /**< listener used to get the transform/pose_ from tf */
   };
 
   /** @brief This transform interface is used when the pose determined through calibration
       /* The urdf should not define this transform, otherwise there will be a conflict
-      /* the pose from the yaml file is broadcast immediately 
-      /* Once calibrated, the pose may be pushed, then the updated pose will be observed by tf
+      /* the pose from the yaml file is broadcast immediately as a static transform
+      /* Once calibrated, the pose may be pushed, then the updated pose will be observed by tf at once
   */
   class ROSBroadcastTransInterface : public TransformInterface
   {
@@ -195,19 +294,17 @@ namespace industrial_extrinsic_cal
     /** @brief sets the reference frame of the transform interface, sometimes not used */
     void setReferenceFrame(std::string &ref_frame);
 
-    /** @brief a timer callback that continuously broadcast the current pose as a tf */
-    void timerCallback(const ros::TimerEvent & timer_event);
-   
   private:
+    /** @brief sends the current pose to /tf_static, once the reference frame is known */
+    void broadcast();
+
     Pose6d pose_; /**< pose associated with the transform */
-    ros::Timer timer_; /**< need a timer to initiate broadcast of transform */
     tf::StampedTransform transform_; /**< the broadcaster needs this which we get values from pose_ */
-    tf::TransformBroadcaster tf_broadcaster_; /**< the broadcaster to tf */
   };
 
   /** @brief This transform interface is used when the camera pose  is determined through calibration
       /* The urdf should not define this transform, otherwise there will be a conflict
-      /* the pose in the camera yaml file is broadcast imediately 
+      /* the pose in the camera yaml file is broadcast imediately as a static transform
       /* Once calibrated, the pose may be pushed to tf
   */
 
@@ -238,20 +335,18 @@ namespace industrial_extrinsic_cal
     /** @brief sets the reference frame of the transform interface, sometimes not used */
     void setReferenceFrame(std::string &ref_frame);
 
-    /** @brief a timer callback that continuously broadcast the current pose as a tf */
-    void timerCallback(const ros::TimerEvent & timer_event);
-   
   private:
+    /** @brief sends the current pose to /tf_static, once the reference frame is known */
+    void broadcast();
+
     Pose6d pose_; /**< pose associated with the transform */
-    ros::Timer timer_; /**< need a timer to initiate broadcast of transform */
     tf::StampedTransform transform_; /**< the broadcaster needs this which we get values from pose_ */
-    tf::TransformBroadcaster tf_broadcaster_; /**< the broadcaster to tf */
   };
 
 
   /** @brief This transform interface is used when the camera pose  is determined through calibration
       /* The urdf should not define this transform, otherwise there will be a conflict
-      /* the pose in the camera yaml file is broadcast imediately 
+      /* the pose in the camera yaml file is broadcast imediately as a static transform
       /* Once calibrated, the pose may be pushed to tf
   */
   class ROSCameraHousingBroadcastTInterface : public TransformInterface
@@ -280,21 +375,21 @@ namespace industrial_extrinsic_cal
     /** @brief returns the pose used in construction, or the one most recently pushed */
     Pose6d pullTransform();
 
+    /** @brief appends the frame pairs pullTransform() looks up in tf */
+    void getTFFramePairs(std::vector<TFFramePair> &frame_pairs);
+
     /** @brief appends pose as a static transform publisher to the file */
     bool store(std::string &filePath);
 
     /** @brief sets the reference frame of the transform interface, sometimes not used */
     void setReferenceFrame(std::string &ref_frame);
 
-    /** @brief a timer callback that continuously broadcast the current pose as a tf */
-    void timerCallback(const ros::TimerEvent & timer_event);
-   
   private:
+    /** @brief sends the current pose to /tf_static, once the reference frame is known */
+    void broadcast();
+
     Pose6d pose_; /**< pose associated with the transform */
-    ros::Timer timer_; /**< need a timer to initiate broadcast of transform */
     tf::StampedTransform transform_; /**< the broadcaster needs this which we get values from pose_ */
-    tf::TransformBroadcaster tf_broadcaster_; /**< the broadcaster to tf */
-    tf::TransformListener tf_listener_; // need this to get the tranform from housing to optical frame from tf
     std::string housing_frame_; /**< frame name for the housing */
     std::string mounting_frame_; /**< mounting frame name */
   };
@@ -309,8 +404,8 @@ namespace industrial_extrinsic_cal
    *             {child}_roll_joint:
    *             it is expected that the launch file for the workcell will include a mutable_joint_state_publisher
    *             and that these joints are defined in the file whose name is held in the  mutableJointStateYamlFile parameter
-   *             push updates the joint states by calling the set_mutable_joint_states service
-   *             pull listens to the joint states by calling the get_mutable_joint_states service, and computes the transform
+   *             push updates the joint states through the batch_mutable_joint_states service
+   *             pull reads the joint states from the local joint cache, and computes the transform
    *             store updates the yaml file by calling the store_mutable_joint_states service
    */
   class ROSCameraHousingCalTInterface : public TransformInterface
@@ -346,6 +441,9 @@ namespace industrial_extrinsic_cal
     /** @brief get the transform from the mutable transform publisher, and compute the optical to reference frame pose*/
     Pose6d pullTransform();
 
+    /** @brief appends the frame pairs pullTransform() and getIntermediateFrame() look up in tf */
+    void getTFFramePairs(std::vector<TFFramePair> &frame_pairs);
+
     /** @brief as a listener interface, tells the mutable transform publisher to store its current values in its yaml file */
     bool store(std::string &filePath);
 
@@ -362,16 +460,9 @@ namespace industrial_extrinsic_cal
     std::string housing_frame_; /**< housing frame name */
     std::string mounting_frame_; /**< mounting frame name */
     Pose6d pose_; /**< pose associated with the transform from reference frame to housing frame */
-    tf::TransformListener tf_listener_; /**< listener used to get the transform/pose_ from tf */
-    ros::ServiceClient get_client_; /**< a client for calling the service to get the joint values associated with the transform */
-    ros::ServiceClient set_client_; /**< a client for calling the service to set the joint values associated with the transform */
     ros::ServiceClient store_client_; /**< a client for calling the service to store the joint values associated with the transform */
     std::vector<std::string> joint_names_; /**< names of joints  */
-    std::vector<double> joint_values_; /**< values of joints  */
-    industrial_extrinsic_cal::get_mutable_joint_states::Request get_request_; /**< request when transform is part of a mutable set */
-    industrial_extrinsic_cal::get_mutable_joint_states::Response get_response_; /**< response when transform is part of a mutable set */
-    industrial_extrinsic_cal::set_mutable_joint_states::Request set_request_; /**< request when transform is part of a mutable set */
-    industrial_extrinsic_cal::set_mutable_joint_states::Response set_response_; /**< response when transform is part of a mutable set */
+    std::vector<double> joint_values_; /**< last values pulled or pushed, x, y, z, yaw, pitch, roll */
     industrial_extrinsic_cal::store_mutable_joint_states::Request store_request_; /**< request to store when  part of a mutable set */
     industrial_extrinsic_cal::store_mutable_joint_states::Response  store_response_;/**< response to store when  part of a mutable set */
   };
@@ -386,8 +477,8 @@ namespace industrial_extrinsic_cal
    *             {child}_roll_joint:
    *             it is expected that the launch file for the workcell will include a mutable_joint_state_publisher
    *             and that these joints are defined in the file whose name is held in the  mutableJointStateYamlFile parameter
-   *             push updates the joint states by calling the set_mutable_joint_states service
-   *             pull listens to the joint states by calling the get_mutable_joint_states service, and computes the transform
+   *             push updates the joint states through the batch_mutable_joint_states service
+   *             pull reads the joint states from the local joint cache, and computes the transform
    *             store updates the yaml file by calling the store_mutable_joint_states service
    */
   class ROSSimpleCalTInterface : public TransformInterface
@@ -426,15 +517,9 @@ namespace industrial_extrinsic_cal
     std::string transform_frame_; /**< transform frame name */
     std::string parent_frame_; /**< parent's frame name */
     Pose6d pose_; /**< pose associated with the transform from reference frame to housing frame */
-    ros::ServiceClient get_client_; /**< a client for calling the service to get the joint values associated with the transform */
-    ros::ServiceClient set_client_; /**< a client for calling the service to set the joint values associated with the transform */
     ros::ServiceClient store_client_; /**< a client for calling the service to store the joint values associated with the transform */
     std::vector<std::string> joint_names_; /**< names of joints  */
-    std::vector<double> joint_values_; /**< values of joints  */
-    industrial_extrinsic_cal::get_mutable_joint_states::Request get_request_;
-    industrial_extrinsic_cal::get_mutable_joint_states::Response get_response_;
-    industrial_extrinsic_cal::set_mutable_joint_states::Request set_request_;
-    industrial_extrinsic_cal::set_mutable_joint_states::Response set_response_;
+    std::vector<double> joint_values_; /**< last values pulled or pushed, x, y, z, yaw, pitch, roll */
     industrial_extrinsic_cal::store_mutable_joint_states::Request store_request_;
     industrial_extrinsic_cal::store_mutable_joint_states::Response  store_response_;
   };
@@ -449,8 +534,8 @@ namespace industrial_extrinsic_cal
    *             {child}_roll_joint:
    *             it is expected that the launch file for the workcell will include a mutable_joint_state_publisher
    *             and that these joints are defined in the file whose name is held in the  mutableJointStateYamlFile parameter
-   *             push updates the joint states by calling the set_mutable_joint_states service
-   *             pull listens to the joint states by calling the get_mutable_joint_states service, and computes the transform
+   *             push updates the joint states through the batch_mutable_joint_states service
+   *             pull reads the joint states from the local joint cache, and computes the transform
    *             store updates the yaml file by calling the store_mutable_joint_states service
    */
   class ROSSimpleCameraCalTInterface : public TransformInterface
@@ -489,15 +574,9 @@ namespace industrial_extrinsic_cal
     std::string transform_frame_; /**< transform frame name */
     std::string parent_frame_; /**< parent's frame name */
     Pose6d pose_; /**< pose associated with the transform from reference frame to housing frame */
-    ros::ServiceClient get_client_; /**< a client for calling the service to get the joint values associated with the transform */
-    ros::ServiceClient set_client_; /**< a client for calling the service to set the joint values associated with the transform */
     ros::ServiceClient store_client_; /**< a client for calling the service to store the joint values associated with the transform */
     std::vector<std::string> joint_names_; /**< names of joints  */
-    std::vector<double> joint_values_; /**< values of joints  */
-    industrial_extrinsic_cal::get_mutable_joint_states::Request get_request_;
-    industrial_extrinsic_cal::get_mutable_joint_states::Response get_response_;
-    industrial_extrinsic_cal::set_mutable_joint_states::Request set_request_;
-    industrial_extrinsic_cal::set_mutable_joint_states::Response set_response_;
+    std::vector<double> joint_values_; /**< last values pulled or pushed, x, y, z, yaw, pitch, roll */
     industrial_extrinsic_cal::store_mutable_joint_states::Request store_request_;
     industrial_extrinsic_cal::store_mutable_joint_states::Response  store_response_;
   };
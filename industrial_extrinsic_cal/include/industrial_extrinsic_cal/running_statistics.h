@@ -0,0 +1,96 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RUNNING_STATISTICS_H_
+#define RUNNING_STATISTICS_H_
+
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+
+namespace industrial_extrinsic_cal
+{
+
+/** @brief Online mean and covariance of vector valued samples, computed with Welford's update so that memory does not
+ *         grow with the number of samples. Optionally keeps a uniform random reservoir of samples to estimate quantiles.
+ *         Accumulators filled on different threads may be combined with merge().
+ */
+class RunningStatistics
+{
+public:
+  /** @brief Constructor
+   *  @param dimension number of elements of each sample
+   *  @param reservoir_size number of samples kept for quantiles, 0 for none
+   *  @param seed seed of the reservoir's sample selection
+   */
+  RunningStatistics(int dimension = 1, int reservoir_size = 0, unsigned int seed = 0);
+
+  /** @brief Destructor */
+  ~RunningStatistics(){};
+
+  /** @brief adds one sample
+   *  @param sample dimension() values
+   */
+  void add(const double* sample);
+
+  /** @brief adds all samples of another accumulator of the same dimension, as if they had been added to this one
+   *  @param other the accumulator to merge
+   */
+  void merge(const RunningStatistics& other);
+
+  /** @brief forgets all samples */
+  void clear();
+
+  /** @brief number of elements of each sample */
+  int dimension() const { return dimension_; }
+
+  /** @brief number of samples added */
+  long count() const { return count_; }
+
+  /** @brief mean of element i */
+  double mean(int i) const { return mean_[i]; }
+
+  /** @brief sample covariance of elements i and j, 0 with fewer than two samples */
+  double covariance(int i, int j) const;
+
+  /** @brief sample variance of element i */
+  double variance(int i) const { return covariance(i, i); }
+
+  /** @brief sample standard deviation of element i */
+  double sigma(int i) const;
+
+  /** @brief estimates a quantile of element i from the reservoir
+   *  @param i the element
+   *  @param q the quantile, between 0 and 1
+   *  @param value the estimate, interpolated between the reservoir samples
+   *  @return false if there is no reservoir or it is empty
+   */
+  bool quantile(int i, double q, double& value) const;
+
+private:
+  int dimension_;                /**< number of elements of each sample */
+  long count_;                   /**< number of samples added */
+  std::vector<double> mean_;     /**< running mean of each element */
+  std::vector<double> comoment_; /**< sums of products of deviations from the mean, dimension_ x dimension_ */
+  int reservoir_size_;           /**< largest number of samples kept */
+  std::vector<double> reservoir_;/**< kept samples, dimension_ values each */
+  boost::mt19937 rng_;           /**< selects the kept samples */
+};
+
+} // end namespace industrial_extrinsic_cal
+
+#endif /* RUNNING_STATISTICS_H_ */
@@ -0,0 +1,73 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TARGET_POINTS_H_
+#define TARGET_POINTS_H_
+
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include <industrial_extrinsic_cal/basic_types.h>
+
+namespace industrial_extrinsic_cal
+{
+  /** @brief reads a points file, either binary as written by writePointsFile() or text with one point per line.
+   *    The file is memory mapped. Text lines hold x, y and z separated by commas or white space, empty lines and lines
+   *    starting with # are skipped.
+   *  @param file_name the points file
+   *  @param points the points read
+   *  @return false if the file can't be read or has a malformed line or record
+   */
+  bool readPointsFile(const std::string &file_name, std::vector<Point3d> &points);
+
+  /** @brief writes points to a binary points file, 3 doubles per point after a short header
+   *  @param file_name the points file
+   *  @param points the points
+   *  @return true if written
+   */
+  bool writePointsFile(const std::string &file_name, const std::vector<Point3d> &points);
+
+  /** @brief generates the points of a grid in the plane z=0, a row at a time, x along the columns and y along the
+   *    rows. As for modified circle grids, the last row comes first unless ascending_rows is set.
+   *  @param rows number of rows
+   *  @param cols number of columns
+   *  @param spacing distance between neighboring points
+   *  @param ascending_rows start with the row at y=0
+   *  @param points the grid points
+   */
+  void gridPoints(int rows, int cols, double spacing, bool ascending_rows, std::vector<Point3d> &points);
+
+  /** @brief parses the points of a target or point set from whichever of the three definitions a node has,
+   *    "points" a list of pnt: [x, y, z], "points_file" a file read by readPointsFile(),
+   *    or "point_grid" a map of rows, cols, spacing and optionally ascending_rows.
+   *  @param node the node holding the definition
+   *  @param base_directory directory of the yaml file, a relative points_file is relative to it
+   *  @param points the points
+   *  @return false if there is no definition or it is malformed
+   */
+  bool parsePointSource(const YAML::Node &node, const std::string &base_directory, std::vector<Point3d> &points);
+
+  /** @brief true if the node's points are defined outside of the yaml, by a points_file or a point_grid */
+  bool hasExternalPoints(const YAML::Node &node);
+
+  /** @brief the directory of a file, for resolving file names relative to it */
+  std::string fileDirectory(const std::string &file_name);
+
+} // end namespace industrial_extrinsic_cal
+
+#endif /* TARGET_POINTS_H_ */
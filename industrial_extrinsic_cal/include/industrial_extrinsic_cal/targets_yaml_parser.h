@@ -15,10 +15,11 @@ namespace industrial_extrinsic_cal {
    *    @return true if successful
    */
   bool parseTargets(std::string &targets_input_file, std::vector<boost::shared_ptr<Target> > & targets);
-  /** @brief parse a single target
+  /** @brief parse a single target, its points are listed, in a points_file or a point_grid
    *    @param node, the yaml node from which to parse the target
+   *    @param base_directory, directory a relative points_file is in, usually that of the target file
    */
-  boost::shared_ptr<Target> parseSingleTarget(const YAML::Node &node);
+  boost::shared_ptr<Target> parseSingleTarget(const YAML::Node &node, const std::string &base_directory="");
 }// end industrial_extrinsic_cal namespace
 
 #endif
@@ -21,6 +21,9 @@
 
 #include <industrial_extrinsic_cal/basic_types.h> /* Pose6d,Roi,Observation,CameraObservations */
 #include <ros/ros.h>
+#include <string>
+#include <utility>
+#include <vector>
 namespace industrial_extrinsic_cal
 {
 
@@ -70,6 +73,12 @@ namespace industrial_extrinsic_cal
       return(Identity);
       };
 
+    /** @brief appends the frame pairs (from, to) this interface looks up in tf when pulling, so that every interface of
+     *    a scene can be resolved together with one wait. Interfaces that don't listen to tf append nothing.
+     *    @param frame_pairs the list to append to
+     */
+    virtual void getTFFramePairs(std::vector<std::pair<std::string, std::string> > &frame_pairs) { };
+
     /** @brief  checks to see if the reference frame has been initialized */
     bool isRefFrameInitialized(){ 
       return(ref_frame_initialized_);
@@ -0,0 +1,74 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef YAML_CACHE_H_
+#define YAML_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <industrial_extrinsic_cal/basic_types.h>
+
+namespace industrial_extrinsic_cal
+{
+  /** @brief a target as compiled from a target file, its points apart from the rest of its definition */
+  struct CompiledTarget
+  {
+    bool is_moving; /**< listed under moving_targets */
+    std::string definition; /**< the target's yaml without its points */
+    std::vector<Point3d> points; /**< the target's points */
+  };
+
+  /** @brief reads a whole file
+   *  @param file_name the file
+   *  @param contents the file's bytes
+   *  @return false if the file can't be read
+   */
+  bool readFileContents(const std::string &file_name, std::string &contents);
+
+  /** @brief 64 bit FNV-1a hash of a file's contents, the key of its compiled form */
+  uint64_t yamlContentHash(const std::string &contents);
+
+  /** @brief the cache file holding the compiled form of a yaml file with the given hash.
+   *    Caches live in $ROS_HOME/industrial_extrinsic_cal_cache, ~/.ros when ROS_HOME is not set, which is created if
+   *    it does not exist.
+   *  @param hash hash of the yaml file's contents
+   *  @param kind what the yaml file defines, the cache file's extension
+   *  @return the cache file name, empty if there is no place to keep it
+   */
+  std::string yamlCacheFileName(uint64_t hash, const std::string &kind);
+
+  /** @brief reads the compiled targets of a target file
+   *  @param cache_file the cache file
+   *  @param hash hash of the target file's contents, a cache compiled from other contents is not read
+   *  @param targets the compiled targets
+   *  @return false if there is no valid cache for these contents
+   */
+  bool readTargetCache(const std::string &cache_file, uint64_t hash, std::vector<CompiledTarget> &targets);
+
+  /** @brief writes the compiled targets of a target file, replacing the cache file at once
+   *  @param cache_file the cache file
+   *  @param hash hash of the target file's contents
+   *  @param targets the compiled targets
+   *  @return true if the cache was written
+   */
+  bool writeTargetCache(const std::string &cache_file, uint64_t hash, const std::vector<CompiledTarget> &targets);
+
+} // end namespace industrial_extrinsic_cal
+
+#endif /* YAML_CACHE_H_ */
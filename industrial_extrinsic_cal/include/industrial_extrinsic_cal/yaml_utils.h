@@ -15,8 +15,9 @@ namespace industrial_extrinsic_cal
   
   inline bool parseDouble(const YAML::Node &node, char const * var_name, double &var_value)
   {
-    if(node[var_name]){
-      var_value = node[var_name].as<double> ();
+    const YAML::Node value = node[var_name];
+    if(value){
+      var_value = value.as<double> ();
       return true;
     }
     return false;
@@ -24,16 +25,18 @@ namespace industrial_extrinsic_cal
 
   inline bool parseInt(const YAML::Node &node, char const * var_name, int &var_value)
   {
-    if(node[var_name]){
-      var_value = node[var_name].as<int> ();
+    const YAML::Node value = node[var_name];
+    if(value){
+      var_value = value.as<int> ();
       return true;
     }
     return false;
   }
   inline bool parseUInt(const YAML::Node &node, char const * var_name, unsigned int &var_value)
   {
-    if(node[var_name]){
-      var_value = node[var_name].as<unsigned int> ();
+    const YAML::Node value = node[var_name];
+    if(value){
+      var_value = value.as<unsigned int> ();
       return true;
     }
     return false;
@@ -41,8 +44,9 @@ namespace industrial_extrinsic_cal
 
   inline bool parseString(const YAML::Node &node, char const * var_name, std::string &var_value)
   {
-    if(node[var_name]){
-      var_value = node[var_name].as<std::string> ();
+    const YAML::Node value = node[var_name];
+    if(value){
+      var_value = value.as<std::string> ();
       return true;
     }
     return false;
@@ -50,8 +54,9 @@ namespace industrial_extrinsic_cal
 
   inline bool parseBool(const YAML::Node &node, char const * var_name, bool &var_value)
   {
-    if(node[var_name]){
-      var_value = node[var_name];
+    const YAML::Node value = node[var_name];
+    if(value){
+      var_value = value.as<bool> ();
       return true;
     }
     return false;
@@ -59,19 +64,43 @@ namespace industrial_extrinsic_cal
 
   inline bool parseVectorD(const YAML::Node &node, char const * var_name, std::vector<double> &var_value)
   {
-    if(node[var_name]){
+    const YAML::Node n = node[var_name];
+    if(n){
       var_value.clear();
-      const YAML::Node n = node[var_name];
-      for(int i=0; i<(int) n.size(); i++){
-	double value;
-	value = n[i].as<double> ();
-	var_value.push_back(value);
+      var_value.reserve(n.size());
+      for(YAML::const_iterator it = n.begin(); it != n.end(); ++it){
+	var_value.push_back(it->as<double> ());
       }
       return true;
     }
     return false;
   }
 
+  /** @brief parses a list of points, each a map with a "pnt" of 3 coordinates, in one pass over the list
+   *  @param node the list
+   *  @param points the points, up to the first malformed one
+   *  @return false if a point does not have exactly 3 coordinates
+   */
+  inline bool parsePointList(const YAML::Node &node, std::vector<Point3d> &points)
+  {
+    points.clear();
+    points.reserve(node.size());
+    for(YAML_ITERATOR it = node.begin(); it != node.end(); ++it){
+      const YAML::Node pnt = (*it)["pnt"];
+      if(!pnt || !pnt.IsSequence() || pnt.size() != 3){
+	ROS_ERROR("point %d needs a pnt of 3 coordinates", (int) points.size());
+	return false;
+      }
+      Point3d point;
+      int i=0;
+      for(YAML::const_iterator c = pnt.begin(); c != pnt.end(); ++c){
+	point.pb[i++] = c->as<double> ();
+      }
+      points.push_back(point);
+    }
+    return true;
+  }
+
   inline const YAML::Node  parseNode(const YAML::Node &node, char const * var_name)
   {
     if(!node[var_name]){
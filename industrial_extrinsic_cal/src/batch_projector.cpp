@@ -0,0 +1,107 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <industrial_extrinsic_cal/batch_projector.h>
+
+#include "ceres/rotation.h"
+
+namespace industrial_extrinsic_cal
+{
+
+BatchProjector::BatchProjector(const std::vector<Point3d>& points)
+{
+  setPoints(points);
+}
+
+void BatchProjector::setPoints(const std::vector<Point3d>& points)
+{
+  int n = (int)points.size();
+  x_.resize(n);
+  y_.resize(n);
+  z_.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    x_[i] = points[i].x;
+    y_[i] = points[i].y;
+    z_[i] = points[i].z;
+  }
+}
+
+int BatchProjector::project(const CameraParameters& camera, double* image_x, double* image_y,
+                            unsigned char* visible) const
+{
+  double R[9];
+  ceres::AngleAxisToRotationMatrix(camera.angle_axis, ceres::RowMajorAdapter3x3(R));
+  const double tx = camera.position[0], ty = camera.position[1], tz = camera.position[2];
+  const double fx = camera.focal_length_x, fy = camera.focal_length_y;
+  const double cx = camera.center_x, cy = camera.center_y;
+  const double k1 = camera.distortion_k1, k2 = camera.distortion_k2, k3 = camera.distortion_k3;
+  const double p1 = camera.distortion_p1, p2 = camera.distortion_p2;
+  const double width = camera.width, height = camera.height;
+
+  int n = numPoints();
+  const double* x = n > 0 ? &x_[0] : NULL;
+  const double* y = n > 0 ? &y_[0] : NULL;
+  const double* z = n > 0 ? &z_[0] : NULL;
+  int num_visible = 0;
+  for (int i = 0; i < n; i++)
+  {
+    double px = R[0] * x[i] + R[1] * y[i] + R[2] * z[i] + tx;
+    double py = R[3] * x[i] + R[4] * y[i] + R[5] * z[i] + ty;
+    double pz = R[6] * x[i] + R[7] * y[i] + R[8] * z[i] + tz;
+
+    // same model as cameraPntResidualDist()
+    double xp = px / pz;
+    double yp = py / pz;
+    double xp2 = xp * xp;
+    double yp2 = yp * yp;
+    double r2 = xp2 + yp2;
+    double radial = 1.0 + r2 * (k1 + r2 * (k2 + r2 * k3));
+    double xpp = xp * radial + p2 * (r2 + 2.0 * xp2) + p1 * xp * yp * 2.0;
+    double ypp = yp * radial + p1 * (r2 + 2.0 * yp2) + p2 * xp * yp * 2.0;
+    double u = fx * xpp + cx;
+    double v = fy * ypp + cy;
+    image_x[i] = u;
+    image_y[i] = v;
+
+    int in_view = (pz > 0.0) & (u >= 0.0) & (u <= width) & (v >= 0.0) & (v <= height);
+    num_visible += in_view;
+    if (visible != NULL)
+    {
+      visible[i] = (unsigned char)in_view;
+    }
+  }
+  return num_visible;
+}
+
+int BatchProjector::project(const std::vector<CameraParameters>& cameras, std::vector<double>& image_x,
+                            std::vector<double>& image_y, std::vector<unsigned char>& visible) const
+{
+  int n = numPoints();
+  image_x.resize(cameras.size() * n);
+  image_y.resize(cameras.size() * n);
+  visible.resize(cameras.size() * n);
+  int num_visible = 0;
+  for (int k = 0; k < (int)cameras.size() && n > 0; k++)
+  {
+    num_visible += project(cameras[k], &image_x[k * n], &image_y[k * n], &visible[k * n]);
+  }
+  return num_visible;
+}
+
+} // end namespace industrial_extrinsic_cal
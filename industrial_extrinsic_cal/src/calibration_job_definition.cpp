@@ -30,6 +30,11 @@
 #include <industrial_extrinsic_cal/camera_yaml_parser.h>
 #include <industrial_extrinsic_cal/targets_yaml_parser.h>
 #include <industrial_extrinsic_cal/caljob_yaml_parser.h>
+#include <industrial_extrinsic_cal/pose_initializer.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
 
 using std::string;
 using boost::shared_ptr;
@@ -81,6 +86,62 @@ namespace industrial_extrinsic_cal
   }
   fclose(fp);
 } 
+  /** @brief the index of a parameter block in an archive, adding the block the first time it is seen */
+  int archiveBlockIndex(ObservationArchive &archive, std::map<P_BLOCK, int> &block_index,
+			const std::map<P_BLOCK, std::vector<double> > &initial_values,
+			P_BLOCK block, ArchiveBlockType type, int owner, int scene_id, int point_id)
+  {
+    std::map<P_BLOCK, int>::iterator found = block_index.find(block);
+    if(found != block_index.end()) return(found->second);
+
+    ArchiveBlock archive_block;
+    archive_block.type = type;
+    archive_block.owner = owner;
+    archive_block.scene_id = scene_id;
+    archive_block.point_id = point_id;
+    std::vector<double> current(block, block + archiveBlockSize(type));
+    std::map<P_BLOCK, std::vector<double> >::const_iterator initial = initial_values.find(block);
+    if(initial != initial_values.end()){ // optimized, the block now holds the result
+      archive_block.initial_values = initial->second;
+      archive_block.final_values = current;
+    }
+    else{
+      archive_block.initial_values = current;
+    }
+    block_index[block] = archive.blocks_.size();
+    archive.blocks_.push_back(archive_block);
+    return(block_index[block]);
+  }
+
+  /** @brief reports each iteration of an optimization, and ends it when the job is asked to stop */
+  class ProgressIterationCallback : public ceres::IterationCallback
+  {
+  public:
+    ProgressIterationCallback(CalibrationJob *job, const ProgressCallback &progress_callback, int num_scenes) :
+      job_(job), progress_callback_(progress_callback), num_scenes_(num_scenes) {};
+
+    ceres::CallbackReturnType operator()(const ceres::IterationSummary& summary)
+    {
+      if(progress_callback_){
+	CalibrationProgress progress;
+	progress.stage = "optimizing";
+	progress.scene = num_scenes_;
+	progress.num_scenes = num_scenes_;
+	progress.iteration = summary.iteration;
+	progress.cost = summary.cost;
+	progress.gradient_norm = summary.gradient_max_norm;
+	progress.time_seconds = summary.cumulative_time_in_seconds;
+	progress_callback_(progress);
+      }
+      return(job_->stopRequested() ? ceres::SOLVER_ABORT : ceres::SOLVER_CONTINUE);
+    }
+
+  private:
+    CalibrationJob *job_;
+    const ProgressCallback &progress_callback_;
+    int num_scenes_;
+  };
+
   CovarianceRequestType intToCovRequest(int request)
   {
     switch (request){
@@ -110,6 +171,7 @@ namespace industrial_extrinsic_cal
 
   bool CalibrationJob::load()
   {
+    MutableJointBatch joint_batch; // transform interfaces created while parsing share one read of the joint values
     if(!CalibrationJob::loadCamera())
       {
 	ROS_ERROR_STREAM("Camera file parsing failed");
@@ -129,6 +191,87 @@ namespace industrial_extrinsic_cal
     return (true);
   } // end load()
 
+  void CalibrationJob::buildArchive(ObservationArchive &archive)
+  {
+    archive.clear();
+    archive.reference_frame_ = ceres_blocks_.reference_frame_;
+    archive.num_scenes_ = observation_data_point_list_.size();
+    std::map<std::string, int> camera_index;
+    std::map<std::string, int> target_index;
+    std::map<P_BLOCK, int> block_index;
+    for(int i=0; i<(int)observation_data_point_list_.size(); i++){
+      BOOST_FOREACH(const ObservationDataPoint &ODP, observation_data_point_list_[i].items_){
+	if(camera_index.find(ODP.camera_name_) == camera_index.end()){
+	  shared_ptr<Camera> camera = ceres_blocks_.getCameraByName(ODP.camera_name_);
+	  ArchiveCamera archive_camera;
+	  archive_camera.name = ODP.camera_name_;
+	  archive_camera.is_moving = camera->is_moving_;
+	  archive_camera.width = camera->camera_parameters_.width;
+	  archive_camera.height = camera->camera_parameters_.height;
+	  camera_index[ODP.camera_name_] = archive.cameras_.size();
+	  archive.cameras_.push_back(archive_camera);
+	}
+	int camera = camera_index[ODP.camera_name_];
+	bool camera_moving = archive.cameras_[camera].is_moving;
+	if(target_index.find(ODP.target_name_) == target_index.end()){
+	  shared_ptr<Target> target = ceres_blocks_.getTargetByName(ODP.target_name_, ODP.scene_id_);
+	  ArchiveTarget archive_target;
+	  archive_target.name = ODP.target_name_;
+	  archive_target.target_type = ODP.target_type_;
+	  archive_target.is_moving = target->is_moving_;
+	  target_index[ODP.target_name_] = archive.targets_.size();
+	  archive.targets_.push_back(archive_target);
+	}
+	int target = target_index[ODP.target_name_];
+	bool target_moving = archive.targets_[target].is_moving;
+
+	ArchiveObservation observation;
+	observation.scene_id = ODP.scene_id_;
+	observation.point_id = ODP.point_id_;
+	observation.camera = camera;
+	observation.target = target;
+	observation.cost_type = ODP.cost_type_;
+	observation.intrinsics = archiveBlockIndex(archive, block_index, initial_block_values_, ODP.camera_intrinsics_,
+						   archive_blocks::CameraIntrinsics, camera, -1, -1);
+	observation.extrinsics = archiveBlockIndex(archive, block_index, initial_block_values_, ODP.camera_extrinsics_,
+						   archive_blocks::CameraExtrinsics, camera,
+						   camera_moving ? ODP.scene_id_ : -1, -1);
+	observation.target_pose = archiveBlockIndex(archive, block_index, initial_block_values_, ODP.target_pose_,
+						    archive_blocks::TargetPose, target,
+						    target_moving ? ODP.scene_id_ : -1, -1);
+	observation.point_position = archiveBlockIndex(archive, block_index, initial_block_values_, ODP.point_position_,
+						       archive_blocks::PointPosition, target, -1, ODP.point_id_);
+	observation.image_x = ODP.image_x_;
+	observation.image_y = ODP.image_y_;
+	observation.circle_dia = ODP.circle_dia_;
+	observation.intermediate_frame = ODP.intermediate_frame_;
+	archive.observations_.push_back(observation);
+      }
+    }
+
+    archive.summary_.solved = !initial_block_values_.empty();
+    if(archive.summary_.solved){
+      archive.summary_.initial_cost = ceres_summary_.initial_cost;
+      archive.summary_.final_cost = ceres_summary_.final_cost;
+      archive.summary_.num_successful_steps = ceres_summary_.num_successful_steps;
+      archive.summary_.num_unsuccessful_steps = ceres_summary_.num_unsuccessful_steps;
+      archive.summary_.termination_type = ceres_summary_.termination_type;
+      archive.summary_.total_time_in_seconds = ceres_summary_.total_time_in_seconds;
+      archive.summary_.num_parameters = ceres_summary_.num_parameters;
+      archive.summary_.num_residuals = ceres_summary_.num_residuals;
+    }
+  }
+
+  bool CalibrationJob::saveArchive(const std::string &file_name)
+  {
+    ObservationArchive archive;
+    buildArchive(archive);
+    if(!archive.write(file_name)) return(false);
+    ROS_INFO("wrote %d observations of %d scenes to %s", (int)archive.observations_.size(), archive.num_scenes_,
+	     file_name.c_str());
+    return(true);
+  }
+
   void CalibrationJob::postProcessingOn(std::string post_proc_file_name)
   {
     post_proc_on_ = true;
@@ -191,14 +334,44 @@ namespace industrial_extrinsic_cal
     return rtn;
 }
 
+  void CalibrationJob::requestStop()
+  {
+    boost::mutex::scoped_lock lock(stop_mutex_);
+    stop_requested_ = true;
+  }
+
+  bool CalibrationJob::stopRequested()
+  {
+    boost::mutex::scoped_lock lock(stop_mutex_);
+    return(stop_requested_);
+  }
+
+  void CalibrationJob::resetStop()
+  {
+    boost::mutex::scoped_lock lock(stop_mutex_);
+    stop_requested_ = false;
+  }
+
   bool CalibrationJob::run()
   {
+    if(stopRequested()){ // stopped before it started
+      ROS_ERROR("Calibration stopped before observing");
+      solved_ = false;
+      return(false);
+    }
     ROS_INFO("Collecting observations");
-    runObservations();
+    if(!runObservations()){
+      ROS_ERROR("Observations stopped");
+      solved_ = false;
+      return(false);
+    }
     ROS_INFO("Running optimization");
     solved_ = runOptimization();
     if(solved_){
-      pushTransforms(); // sends updated transforms to their intefaces
+      if(!pushTransforms()){ // sends updated transforms to their intefaces
+	ROS_ERROR("Could not send the calibrated transforms to their interfaces");
+	return(false);
+      }
     }
     else{
       ROS_ERROR("Optimization failed");
@@ -206,6 +379,125 @@ namespace industrial_extrinsic_cal
     return(solved_);
   }
 
+  bool CalibrationJob::replay(const std::string &archive_file)
+  {
+    ObservationArchive archive;
+    if(!archive.read(archive_file) || !loadArchive(archive)) return(false);
+    ROS_INFO("Replaying %d observations of %d scenes from %s", (int)archive.observations_.size(), archive.num_scenes_,
+	     archive_file.c_str());
+    solved_ = runOptimization();
+    if(!solved_){
+      ROS_ERROR("Optimization failed");
+    }
+    else if(archive.summary_.solved){
+      ROS_INFO("final cost %lf, the recorded optimization ended at %lf", ceres_summary_.final_cost,
+	       archive.summary_.final_cost);
+    }
+    return(solved_);
+  }
+
+  bool CalibrationJob::loadArchive(const ObservationArchive &archive)
+  {
+    solved_ = false;
+    observation_data_point_list_.clear();
+    initial_block_values_.clear();
+    ceres_blocks_.clearCamerasTargets();
+
+    // cameras, one copy per scene for moving cameras as runObservations() makes them
+    for(int c=0; c<(int)archive.cameras_.size(); c++){
+      const ArchiveCamera &archive_camera = archive.cameras_[c];
+      CameraParameters camera_parameters;
+      memset(&camera_parameters, 0, sizeof(camera_parameters));
+      camera_parameters.width = archive_camera.width;
+      camera_parameters.height = archive_camera.height;
+      BOOST_FOREACH(const ArchiveBlock &block, archive.blocks_){
+	if(block.owner == c && block.type == archive_blocks::CameraIntrinsics){
+	  memcpy(camera_parameters.pb_intrinsics, &block.initial_values[0], 9*sizeof(double));
+	}
+      }
+      shared_ptr<Camera> camera = make_shared<Camera>(archive_camera.name, camera_parameters, archive_camera.is_moving);
+      camera->setTransformInterface(make_shared<DefaultTransformInterface>());
+      BOOST_FOREACH(const ArchiveBlock &block, archive.blocks_){
+	if(block.owner != c || block.type != archive_blocks::CameraExtrinsics) continue;
+	memcpy(camera->camera_parameters_.pb_extrinsics, &block.initial_values[0], 6*sizeof(double));
+	if(archive_camera.is_moving) ceres_blocks_.addMovingCamera(camera, block.scene_id);
+      }
+      if(!archive_camera.is_moving) ceres_blocks_.addStaticCamera(camera);
+    }
+
+    // targets, with the points observed, one copy per scene for moving targets
+    for(int t=0; t<(int)archive.targets_.size(); t++){
+      const ArchiveTarget &archive_target = archive.targets_[t];
+      shared_ptr<Target> target = make_shared<Target>();
+      target->target_name_ = archive_target.name;
+      target->target_type_ = archive_target.target_type;
+      target->is_moving_ = archive_target.is_moving;
+      target->setTransformInterface(make_shared<DefaultTransformInterface>());
+      BOOST_FOREACH(const ArchiveBlock &block, archive.blocks_){
+	if(block.owner != t || block.type != archive_blocks::PointPosition || block.point_id < 0) continue;
+	if(block.point_id >= (int)target->pts_.size()) target->pts_.resize(block.point_id + 1);
+	memcpy(target->pts_[block.point_id].pb, &block.initial_values[0], 3*sizeof(double));
+      }
+      target->num_points_ = target->pts_.size();
+      BOOST_FOREACH(const ArchiveBlock &block, archive.blocks_){
+	if(block.owner != t || block.type != archive_blocks::TargetPose) continue;
+	memcpy(target->pose_.pb_pose, &block.initial_values[0], 6*sizeof(double));
+	if(archive_target.is_moving) ceres_blocks_.addMovingTarget(target, block.scene_id);
+      }
+      if(!archive_target.is_moving) ceres_blocks_.addStaticTarget(target);
+    }
+    ceres_blocks_.setReferenceFrame(archive.reference_frame_);
+
+    // the parameter block now holding each archived block
+    std::vector<P_BLOCK> blocks(archive.blocks_.size(), (P_BLOCK) NULL);
+    for(int i=0; i<(int)archive.blocks_.size(); i++){
+      const ArchiveBlock &block = archive.blocks_[i];
+      bool camera_block = (block.type == archive_blocks::CameraIntrinsics || block.type == archive_blocks::CameraExtrinsics);
+      const std::string &name = camera_block ? archive.cameras_[block.owner].name : archive.targets_[block.owner].name;
+      bool moving = camera_block ? archive.cameras_[block.owner].is_moving : archive.targets_[block.owner].is_moving;
+      switch(block.type){
+      case archive_blocks::CameraIntrinsics:
+	blocks[i] = moving ? ceres_blocks_.getMovingCameraParameterBlockIntrinsics(name) :
+	  ceres_blocks_.getStaticCameraParameterBlockIntrinsics(name);
+	break;
+      case archive_blocks::CameraExtrinsics:
+	blocks[i] = moving ? ceres_blocks_.getMovingCameraParameterBlockExtrinsics(name, block.scene_id) :
+	  ceres_blocks_.getStaticCameraParameterBlockExtrinsics(name);
+	break;
+      case archive_blocks::TargetPose:
+	blocks[i] = moving ? ceres_blocks_.getMovingTargetPoseParameterBlock(name, block.scene_id) :
+	  ceres_blocks_.getStaticTargetPoseParameterBlock(name);
+	break;
+      case archive_blocks::PointPosition:
+	if(block.point_id >= 0){
+	  blocks[i] = moving ? ceres_blocks_.getMovingTargetPointParameterBlock(name, block.point_id) :
+	    ceres_blocks_.getStaticTargetPointParameterBlock(name, block.point_id);
+	}
+	break;
+      }
+    }
+
+    // the observations, in the per scene lists runObservations() fills
+    observation_data_point_list_.resize(std::max(archive.num_scenes_, 0));
+    BOOST_FOREACH(const ArchiveObservation &obs, archive.observations_){
+      if(obs.scene_id < 0 || obs.scene_id >= (int)observation_data_point_list_.size() ||
+	 obs.intrinsics < 0 || obs.extrinsics < 0 || obs.target_pose < 0 || obs.point_position < 0 ||
+	 blocks[obs.intrinsics] == NULL || blocks[obs.extrinsics] == NULL ||
+	 blocks[obs.target_pose] == NULL || blocks[obs.point_position] == NULL){
+	ROS_ERROR("archived observation of scene %d is missing its parameter blocks", obs.scene_id);
+	observation_data_point_list_.clear();
+	return(false);
+      }
+      const ArchiveTarget &archive_target = archive.targets_[obs.target];
+      ObservationDataPoint temp_ODP(archive.cameras_[obs.camera].name, archive_target.name, archive_target.target_type,
+				    obs.scene_id, blocks[obs.intrinsics], blocks[obs.extrinsics], obs.point_id,
+				    blocks[obs.target_pose], blocks[obs.point_position], obs.image_x, obs.image_y,
+				    obs.cost_type, obs.intermediate_frame, obs.circle_dia);
+      observation_data_point_list_[obs.scene_id].addObservationPoint(temp_ODP);
+    }
+    return(true);
+  }
+
   bool CalibrationJob::runObservations()
   {
     // the result of this function are twofold
@@ -215,13 +507,36 @@ namespace industrial_extrinsic_cal
     // The whole target for once every static target (parameter blocks are in  Pose6d and an array of points)
     // The whole target once a scene for each moving target
     observation_data_point_list_.clear(); // clear previously recorded observations
+    initial_block_values_.clear();
 
     // For each scene
     BOOST_FOREACH(ObservationScene current_scene, scene_list_)
       {
 	int scene_id = current_scene.get_id();
 	ROS_DEBUG_STREAM("Processing Scene " << scene_id+1<<" of "<< scene_list_.size());
+	if(stopRequested()) return(false);
+	if(progress_callback_){
+	  CalibrationProgress progress;
+	  progress.stage = "observing";
+	  progress.scene = scene_id;
+	  progress.num_scenes = scene_list_.size();
+	  progress.iteration = 0;
+	  progress.cost = progress.gradient_norm = progress.time_seconds = 0.0;
+	  progress_callback_(progress);
+	}
 	current_scene.get_trigger()->waitForTrigger(); // this indicates scene is ready to capture
+
+	// one tf wait covers every pull and intermediate frame of this scene
+	std::vector<TFFramePair> frame_pairs;
+	BOOST_FOREACH(shared_ptr<Camera> current_camera, current_scene.cameras_in_scene_)
+	  {
+	    current_camera->getTransformInterface()->getTFFramePairs(frame_pairs);
+	  }
+	BOOST_FOREACH(ObservationCmd o_command, current_scene.observation_command_list_)
+	  {
+	    o_command.target->getTransformInterface()->getTFFramePairs(frame_pairs);
+	  }
+	TFBatch tf_batch(frame_pairs);
 	pullTransforms(scene_id); // gets transforms of targets and cameras from their interfaces
 	BOOST_FOREACH(shared_ptr<Camera> current_camera, current_scene.cameras_in_scene_)
 	  {			// clear camera of existing observations
@@ -313,6 +628,96 @@ namespace industrial_extrinsic_cal
     return true;
   }
 
+  void CalibrationJob::initializePoses()
+  {
+    std::set<P_BLOCK> initialized; // blocks already set, or anchoring another block's estimate
+    int num_initialized=0;
+    for(int i=0; i<(int)observation_data_point_list_.size(); i++){
+      // gather the points each camera saw of each target in this scene
+      typedef std::pair<P_BLOCK, P_BLOCK> CameraTarget;
+      std::map<CameraTarget, std::vector<const ObservationDataPoint*> > groups;
+      std::vector<CameraTarget> group_order; // keeps the result independent of the pointer values
+      for(int j=0; j<(int)observation_data_point_list_[i].items_.size(); j++){
+	const ObservationDataPoint &ODP = observation_data_point_list_[i].items_[j];
+	switch(ODP.cost_type_){
+	case cost_functions::CameraReprjErrorPK:
+	case cost_functions::CircleCameraReprjErrorPK:
+	case cost_functions::PosedTargetCameraReprjErrorPK:
+	case cost_functions::TargetCameraReprjErrorPK:
+	case cost_functions::CircleTargetCameraReprjErrorPK:
+	  {
+	    CameraTarget key(ODP.camera_extrinsics_, ODP.target_pose_);
+	    if(groups.find(key) == groups.end()) group_order.push_back(key);
+	    groups[key].push_back(&ODP);
+	  }
+	  break;
+	default: // point positions, intermediate frames or intrinsics are unknown, keep the given poses
+	  break;
+	}
+      }
+
+      BOOST_FOREACH(CameraTarget key, group_order){
+	const std::vector<const ObservationDataPoint*> &group = groups[key];
+	P_BLOCK extrinsics  = key.first;
+	P_BLOCK target_pose_params = key.second;
+	bool target_free = (group[0]->cost_type_ == cost_functions::TargetCameraReprjErrorPK ||
+			    group[0]->cost_type_ == cost_functions::CircleTargetCameraReprjErrorPK);
+	bool extrinsics_set = initialized.count(extrinsics) > 0;
+	bool target_set = !target_free || initialized.count(target_pose_params) > 0;
+	if(extrinsics_set && target_set) continue;
+
+	std::vector<Point3d> points;
+	std::vector<double> image_x, image_y;
+	BOOST_FOREACH(const ObservationDataPoint *ODP, group){
+	  Point3d point;
+	  point.x = ODP->point_position_[0];
+	  point.y = ODP->point_position_[1];
+	  point.z = ODP->point_position_[2];
+	  points.push_back(point);
+	  image_x.push_back(ODP->image_x_);
+	  image_y.push_back(ODP->image_y_);
+	}
+	P_BLOCK intrinsics = group[0]->camera_intrinsics_;
+	Pose6d camera_to_points;
+	if(!initialPoseFromObservations(points, image_x, image_y, intrinsics[0], intrinsics[1], intrinsics[2], intrinsics[3],
+					camera_to_points)){
+	  ROS_WARN("Could not initialize pose of %s relative to %s in scene %d", group[0]->target_name_.c_str(),
+		   group[0]->camera_name_.c_str(), group[0]->scene_id_);
+	  continue;
+	}
+
+	Pose6d camera_pose, target_pose;
+	camera_pose.setAngleAxis(extrinsics[0], extrinsics[1], extrinsics[2]);
+	camera_pose.setOrigin(extrinsics[3], extrinsics[4], extrinsics[5]);
+	target_pose.setAngleAxis(target_pose_params[0], target_pose_params[1], target_pose_params[2]);
+	target_pose.setOrigin(target_pose_params[3], target_pose_params[4], target_pose_params[5]);
+	if(!target_free){ // points in world frame, or a target at a known pose
+	  if(group[0]->cost_type_ == cost_functions::PosedTargetCameraReprjErrorPK){
+	    camera_pose = camera_to_points * target_pose.getInverse();
+	  }
+	  else{
+	    camera_pose = camera_to_points;
+	  }
+	  memcpy(extrinsics, camera_pose.pb_pose, 6*sizeof(double));
+	  initialized.insert(extrinsics);
+	}
+	else if(!target_set){ // the camera's pose anchors the target
+	  target_pose = camera_pose.getInverse() * camera_to_points;
+	  memcpy(target_pose_params, target_pose.pb_pose, 6*sizeof(double));
+	  initialized.insert(target_pose_params);
+	  initialized.insert(extrinsics);
+	}
+	else{ // the target was placed by an earlier scene, place the camera relative to it
+	  camera_pose = camera_to_points * target_pose.getInverse();
+	  memcpy(extrinsics, camera_pose.pb_pose, 6*sizeof(double));
+	  initialized.insert(extrinsics);
+	}
+	num_initialized++;
+      }
+    }
+    ROS_INFO("initialized %d poses from observations", num_initialized);
+  }
+
   bool CalibrationJob::runOptimization()
   {
     if(post_proc_on_) writeObservationData(post_proc_data_file_, observation_data_point_list_);
@@ -324,6 +729,17 @@ namespace industrial_extrinsic_cal
     }
     problem_ = new ceres::Problem; /*!< This is the object which solves non-linear optimization problems */
 
+    // remember what the optimization starts from, so an archive can replay it
+    initial_block_values_.clear();
+    for(int i=0;i<(int)observation_data_point_list_.size();i++){
+      BOOST_FOREACH(const ObservationDataPoint &ODP, observation_data_point_list_[i].items_){
+	initial_block_values_[ODP.camera_intrinsics_].assign(ODP.camera_intrinsics_, ODP.camera_intrinsics_ + 9);
+	initial_block_values_[ODP.camera_extrinsics_].assign(ODP.camera_extrinsics_, ODP.camera_extrinsics_ + 6);
+	initial_block_values_[ODP.target_pose_].assign(ODP.target_pose_, ODP.target_pose_ + 6);
+	initial_block_values_[ODP.point_position_].assign(ODP.point_position_, ODP.point_position_ + 3);
+      }
+    }
+
     total_observations_ =0;
     for(int i=0;i<observation_data_point_list_.size();i++){
       total_observations_ += observation_data_point_list_[i].items_.size();
@@ -348,12 +764,14 @@ namespace industrial_extrinsic_cal
     
     // TODO remove commented code     ceres_blocks_.displayMovingCameras();
 
+    if(pose_initialization_on_) initializePoses();
+
     // take all the data collected and create a Ceres optimization problem and run it
-    ROS_INFO("Running Optimization with %d scenes",(int)scene_list_.size());
-    ROS_DEBUG_STREAM("Optimizing "<<scene_list_.size()<<" scenes");
-    BOOST_FOREACH(ObservationScene current_scene, scene_list_)
+    // the lists are indexed by scene id, a replayed job has them without a scene list
+    ROS_INFO("Running Optimization with %d scenes",(int)observation_data_point_list_.size());
+    ROS_DEBUG_STREAM("Optimizing "<<observation_data_point_list_.size()<<" scenes");
+    for(int scene_id=0; scene_id<(int)observation_data_point_list_.size(); scene_id++)
       {
-	int scene_id = current_scene.get_id();
 	ROS_DEBUG_STREAM("Current observation data point list size: "<<observation_data_point_list_.at(scene_id).items_.size());
 	// take all the data collected and create a Ceres optimization problem and run it
 	P_BLOCK extrinsics;
@@ -769,9 +1187,21 @@ namespace industrial_extrinsic_cal
   ceres::Solver::Options options;
   options.linear_solver_type = ceres::DENSE_SCHUR;
   options.minimizer_progress_to_stdout = true;
-  options.max_num_iterations = 1000;
+  options.max_num_iterations = max_iterations_;
+  options.max_solver_time_in_seconds = max_solver_time_;
+  options.num_threads = solver_threads_;
+  ProgressIterationCallback iteration_callback(this, progress_callback_, observation_data_point_list_.size());
+  options.callbacks.push_back(&iteration_callback);
   ceres::Solve(options, problem_, &ceres_summary_);
 
+  if(stopRequested()){ // put back what the optimization started from
+    ROS_ERROR("Optimization stopped after %d iterations", (int) ceres_summary_.iterations.size());
+    std::map<P_BLOCK, std::vector<double> >::iterator it;
+    for(it = initial_block_values_.begin(); it != initial_block_values_.end(); ++it){
+      memcpy(it->first, &it->second[0], it->second.size()*sizeof(double));
+    }
+    return false;
+  }
   if(ceres_summary_.termination_type != ceres::NO_CONVERGENCE ){
       ROS_INFO("Problem Solved");
       double error_per_observation = ceres_summary_.initial_cost/total_observations_;
@@ -780,6 +1210,7 @@ namespace industrial_extrinsic_cal
     }
     else{
       ROS_ERROR("Problem Not Solved termination type = %d success = %d", ceres_summary_.termination_type, ceres::USER_SUCCESS);
+      return false;
     }
 
 
@@ -850,7 +1281,11 @@ namespace industrial_extrinsic_cal
 	  covariance_pairs.push_back(std::make_pair(covariance_blocks[i],covariance_blocks[j]) );
 	}
       }
-      covariance.Compute(covariance_pairs, problem_);
+      if(!covariance.Compute(covariance_pairs, problem_)){
+	ROS_ERROR("could not compute covariance, the problem may be rank deficient");
+	fclose(fp);
+	return(false);
+      }
 
       fprintf(fp,"covariance blocks:\n");
       for(int i=0; i<(int)covariance_blocks.size(); i++){
@@ -859,16 +1294,20 @@ namespace industrial_extrinsic_cal
 	  int N = block_sizes[i];
 	  int M = block_sizes[j];
 	  double ij_cov_block[N*M];
+	  double ii_cov_block[N*N];
+	  double jj_cov_block[M*M];
 	  covariance.GetCovarianceBlock(covariance_blocks[i], covariance_blocks[j], ij_cov_block);
-	  for(int q=0; q<N;i++){
+	  covariance.GetCovarianceBlock(covariance_blocks[i], covariance_blocks[i], ii_cov_block);
+	  covariance.GetCovarianceBlock(covariance_blocks[j], covariance_blocks[j], jj_cov_block);
+	  for(int q=0; q<N;q++){
 	    for(int k=0;k<M;k++){
-	      double sigma_i = sqrt(ij_cov_block[q*N+q]);
-	      double sigma_j = sqrt(ij_cov_block[k*N+k]);
-	      if(q==k){
+	      double sigma_i = sqrt(ii_cov_block[q*N+q]);
+	      double sigma_j = sqrt(jj_cov_block[k*M+k]);
+	      if(i==j && q==k){
 		fprintf(fp,"%6.3f ", sigma_i);
 	      }
 	      else{
-		fprintf(fp,"%6.3lf ", ij_cov_block[q*N + k]/(sigma_i * sigma_j));
+		fprintf(fp,"%6.3lf ", ij_cov_block[q*M + k]/(sigma_i * sigma_j));
 	      }
 	    }// end of k loop
 	    fprintf(fp,"\n");
@@ -884,11 +1323,13 @@ namespace industrial_extrinsic_cal
     return(true);
   } // end computeCovariance
 
-  bool CalibrationJob::store()
+  bool CalibrationJob::store(const std::string &file_path)
   {
-    std::string path = ros::package::getPath("industrial_extrinsic_cal");
-    std::string file_path = "/launch/target_to_camera_optical_transform_publisher.launch";
-    std::string filepath = path+file_path;
+    std::string filepath = file_path;
+    if(filepath.empty()){
+      std::string path = ros::package::getPath("industrial_extrinsic_cal");
+      filepath = path + "/launch/target_to_camera_optical_transform_publisher.launch";
+    }
 
     bool rnt =  ceres_blocks_.writeAllStaticTransforms(filepath);
     bool rtn = true;
@@ -904,9 +1345,9 @@ namespace industrial_extrinsic_cal
   {
     ceres_blocks_.pullTransforms( scene_id);
   }
-  void CalibrationJob::pushTransforms()
+  bool CalibrationJob::pushTransforms()
   {
-    ceres_blocks_.pushTransforms();
+    return(ceres_blocks_.pushTransforms());
   }
   double CalibrationJob::finalCostPerObservation()
   {
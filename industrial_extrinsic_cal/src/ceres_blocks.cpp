@@ -18,6 +18,7 @@
 
 
 #include <industrial_extrinsic_cal/ceres_blocks.h>
+#include <industrial_extrinsic_cal/ros_transform_interface.h>
 #include <boost/shared_ptr.hpp>
 
 using std::string;
@@ -489,8 +490,9 @@ bool CeresBlocks::writeAllStaticTransforms(string filePath)
   return(rtn);
 }
 
-void CeresBlocks::pushTransforms()
+bool CeresBlocks::pushTransforms()
 {
+  MutableJointBatch joint_batch; // every interface's joint values go to the mutable joint state publisher in one call
   BOOST_FOREACH(shared_ptr<Camera> cam, static_cameras_)
     {
       cam->pushTransform();
@@ -518,10 +520,31 @@ void CeresBlocks::pushTransforms()
 	mtarg->targ_->pushTransform();
       }
     }
-
+  return(joint_batch.commit());
 }
 void CeresBlocks::pullTransforms(int scene_id)
 {
+  // resolve every tf lookup of the scene together rather than waiting on each interface in turn
+  std::vector<TFFramePair> frame_pairs;
+  BOOST_FOREACH(shared_ptr<Camera> cam, static_cameras_)
+    {
+      cam->getTransformInterface()->getTFFramePairs(frame_pairs);
+    }
+  BOOST_FOREACH(shared_ptr<MovingCamera> mcam, moving_cameras_)
+    {
+      if(mcam->scene_id == scene_id) mcam->cam->getTransformInterface()->getTFFramePairs(frame_pairs);
+    }
+  BOOST_FOREACH(shared_ptr<Target> targ, static_targets_)
+    {
+      targ->getTransformInterface()->getTFFramePairs(frame_pairs);
+    }
+  BOOST_FOREACH(shared_ptr<MovingTarget> mtarg, moving_targets_)
+    {
+      if(mtarg->scene_id_ == scene_id) mtarg->targ_->getTransformInterface()->getTFFramePairs(frame_pairs);
+    }
+  TFBatch tf_batch(frame_pairs);
+  MutableJointBatch joint_batch; // and read every mutable joint value with a single call
+
   BOOST_FOREACH(shared_ptr<Camera> cam, static_cameras_)
     {
       cam->pullTransform();
@@ -0,0 +1,556 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <vector>
+#include <string>
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include "ceres/rotation.h"
+
+#include <industrial_extrinsic_cal/basic_types.h>
+#include <industrial_extrinsic_cal/batch_projector.h>
+#include <industrial_extrinsic_cal/calibration_job_definition.h>
+#include <industrial_extrinsic_cal/camera_observer.hpp>
+#include <industrial_extrinsic_cal/ceres_costs_utils.h>
+#include <industrial_extrinsic_cal/observation_archive.h>
+#include <industrial_extrinsic_cal/transform_interface.hpp>
+#include <industrial_extrinsic_cal/trigger.h>
+
+using std::string;
+using std::vector;
+using boost::shared_ptr;
+using boost::make_shared;
+using industrial_extrinsic_cal::BatchProjector;
+using industrial_extrinsic_cal::CalibrationJob;
+using industrial_extrinsic_cal::Camera;
+using industrial_extrinsic_cal::CameraObservations;
+using industrial_extrinsic_cal::CameraObserver;
+using industrial_extrinsic_cal::CameraParameters;
+using industrial_extrinsic_cal::Cost_function;
+using industrial_extrinsic_cal::CovarianceVariableRequest;
+using industrial_extrinsic_cal::DefaultTransformInterface;
+using industrial_extrinsic_cal::Observation;
+using industrial_extrinsic_cal::ObservationScene;
+using industrial_extrinsic_cal::P_BLOCK;
+using industrial_extrinsic_cal::Point3d;
+using industrial_extrinsic_cal::Pose6d;
+using industrial_extrinsic_cal::Roi;
+using industrial_extrinsic_cal::Target;
+using industrial_extrinsic_cal::Trigger;
+namespace cost_functions = industrial_extrinsic_cal::cost_functions;
+namespace covariance_requests = industrial_extrinsic_cal::covariance_requests;
+
+typedef boost::variate_generator<boost::mt19937, boost::normal_distribution<> > NormalGenerator;
+typedef boost::variate_generator<boost::mt19937, boost::uniform_real<> > UniformGenerator;
+
+/*! Brief the scene trigger stands in for the robot or operator, it places the target where the scene wants it */
+class PlaceTargetTrigger : public Trigger
+{
+public:
+  PlaceTargetTrigger(shared_ptr<Pose6d> placed_pose, const Pose6d& scene_pose) :
+    placed_pose_(placed_pose), scene_pose_(scene_pose)
+  {
+  }
+  bool waitForTrigger()
+  {
+    *placed_pose_ = scene_pose_;
+    return (true);
+  }
+
+private:
+  shared_ptr<Pose6d> placed_pose_; /*!< true pose of the target, shared with the observers */
+  Pose6d scene_pose_; /*!< true pose of the target during this trigger's scene */
+};
+
+/*! Brief a camera observer that finds every target point by projecting it with the true camera and target poses */
+class SyntheticCameraObserver : public CameraObserver
+{
+public:
+  SyntheticCameraObserver(const CameraParameters& truth, shared_ptr<Pose6d> placed_pose, double image_noise,
+                          unsigned int seed) :
+    truth_(truth), placed_pose_(placed_pose), noise_(boost::mt19937(seed), boost::normal_distribution<>(0.0, image_noise)),
+    image_noise_(image_noise)
+  {
+  }
+  bool addTarget(shared_ptr<Target> targ, Roi& roi, Cost_function cost_type)
+  {
+    targets_.push_back(targ);
+    cost_types_.push_back(cost_type);
+    return (true);
+  }
+  void clearTargets()
+  {
+    targets_.clear();
+    cost_types_.clear();
+  }
+  void clearObservations() { observations_.clear(); }
+  int getObservations(CameraObservations& camera_observations)
+  {
+    camera_observations = observations_;
+    return ((int)observations_.size());
+  }
+  void triggerCamera()
+  {
+    observations_.clear();
+    for (int t = 0; t < (int)targets_.size(); t++)
+    {
+      // move the target's points to where the target was placed, then look at them
+      vector<Point3d> points(targets_[t]->pts_.size());
+      for (int i = 0; i < (int)points.size(); i++)
+      {
+        industrial_extrinsic_cal::transformPoint3d(placed_pose_->pb_pose, &placed_pose_->pb_pose[3], targets_[t]->pts_[i],
+                                                   points[i].pb);
+      }
+      if (points.empty()) continue;
+      projector_.setPoints(points);
+      vector<double> image_x(points.size()), image_y(points.size());
+      vector<unsigned char> visible(points.size());
+      projector_.project(truth_, &image_x[0], &image_y[0], &visible[0]);
+      for (int i = 0; i < (int)points.size(); i++)
+      {
+        if (!visible[i]) continue;
+        Observation obs;
+        obs.target = targets_[t];
+        obs.point_id = i;
+        obs.image_loc_x = image_x[i] + (image_noise_ > 0.0 ? noise_() : 0.0);
+        obs.image_loc_y = image_y[i] + (image_noise_ > 0.0 ? noise_() : 0.0);
+        obs.cost_type = cost_types_[t];
+        observations_.push_back(obs);
+      }
+    }
+  }
+  bool observationsDone() { return (true); }
+  bool pushCameraInfo(double& fx, double& fy, double& cx, double& cy, double& k1, double& k2, double& k3, double& p1,
+                      double& p2)
+  {
+    return (true);
+  }
+  bool pullCameraInfo(double& fx, double& fy, double& cx, double& cy, double& k1, double& k2, double& k3, double& p1,
+                      double& p2)
+  {
+    int width, height;
+    return (pullCameraInfo(fx, fy, cx, cy, k1, k2, k3, p1, p2, width, height));
+  }
+  bool pullCameraInfo(double& fx, double& fy, double& cx, double& cy, double& k1, double& k2, double& k3, double& p1,
+                      double& p2, int& width, int& height)
+  {
+    industrial_extrinsic_cal::extractCameraIntrinsics(truth_.pb_intrinsics, fx, fy, cx, cy, k1, k2, k3, p1, p2);
+    width = truth_.width;
+    height = truth_.height;
+    return (true);
+  }
+
+private:
+  CameraParameters truth_; /*!< true intrinsics and extrinsics */
+  shared_ptr<Pose6d> placed_pose_; /*!< true pose of the target in the current scene */
+  NormalGenerator noise_; /*!< image noise */
+  double image_noise_; /*!< standard deviation of the image noise in pixels */
+  BatchProjector projector_;
+  vector<shared_ptr<Target> > targets_;
+  vector<Cost_function> cost_types_;
+  CameraObservations observations_;
+};
+
+/*! Brief benchmark settings */
+struct BenchmarkConfig
+{
+  int num_cameras;
+  int num_scenes;
+  int target_rows;
+  int target_cols;
+  double target_spacing;
+  string cost_type;
+  double image_noise;
+  double initial_position_noise;
+  double initial_degree_noise;
+  unsigned int seed;
+};
+
+/*! Brief a calibration job built in memory from a synthetic rig instead of from yaml files and ROS topics */
+class SyntheticCalibrationJob : public CalibrationJob
+{
+public:
+  SyntheticCalibrationJob() : CalibrationJob("", "", "") {}
+
+  /*! Brief builds cameras looking down at the target from an arc, and one scene per target placement
+   *  When the target moves, scene 0 places it at the reference frame and only the first camera sees it there,
+   *  this fixes the reference frame. Every other scene places the target at random and every camera sees it.
+   *  When the target is static, it stays at the reference frame and every camera sees it in every scene.
+   */
+  bool build(const BenchmarkConfig& config)
+  {
+    string cost_type_string = config.cost_type;
+    Cost_function cost_type = industrial_extrinsic_cal::string2CostType(cost_type_string);
+    bool moving_target;
+    if (cost_type == cost_functions::TargetCameraReprjErrorPK)
+    {
+      moving_target = true;
+    }
+    else if (cost_type == cost_functions::CameraReprjErrorPK)
+    {
+      moving_target = false;
+    }
+    else
+    {
+      ROS_ERROR("cost type %s is not supported, use TargetCameraReprjErrorPK or CameraReprjErrorPK",
+                config.cost_type.c_str());
+      return (false);
+    }
+    moving_target_ = moving_target;
+    boost::mt19937 rng(config.seed);
+    NormalGenerator randn(rng, boost::normal_distribution<>(0.0, 1.0));
+    UniformGenerator randu(boost::mt19937(config.seed + 1), boost::uniform_real<>(-1.0, 1.0));
+    getBlocks()->setReferenceFrame("world");
+
+    // the target, a centered grid of points
+    shared_ptr<Target> target = make_shared<Target>();
+    target->target_name_ = "synthetic_grid";
+    target->target_frame_ = "synthetic_grid_frame";
+    target->target_type_ = industrial_extrinsic_cal::pattern_options::Chessboard;
+    target->checker_board_parameters_.pattern_rows = config.target_rows;
+    target->checker_board_parameters_.pattern_cols = config.target_cols;
+    target->is_moving_ = moving_target;
+    for (int i = 0; i < config.target_rows; i++)
+    {
+      for (int j = 0; j < config.target_cols; j++)
+      {
+        Point3d p;
+        p.x = (j - (config.target_cols - 1) / 2.0) * config.target_spacing;
+        p.y = (i - (config.target_rows - 1) / 2.0) * config.target_spacing;
+        p.z = 0.0;
+        target->pts_.push_back(p);
+      }
+    }
+    target->num_points_ = target->pts_.size();
+    shared_ptr<DefaultTransformInterface> target_ti = make_shared<DefaultTransformInterface>();
+    target_ti->pushTransform(target->pose_); // the reference frame, pose initialization finds the rest
+    target->setTransformInterface(target_ti);
+    if (moving_target)
+    {
+      getBlocks()->addMovingTarget(target, 0);
+    }
+    else
+    {
+      getBlocks()->addStaticTarget(target);
+    }
+
+    // the cameras, on an arc looking at the reference frame
+    shared_ptr<Pose6d> placed_pose = make_shared<Pose6d>();
+    double arc = M_PI * std::min(1.0, config.num_cameras / 6.0);
+    for (int k = 0; k < config.num_cameras; k++)
+    {
+      double theta = config.num_cameras > 1 ? -arc / 2.0 + arc * k / (config.num_cameras - 1) : 0.0;
+      CameraParameters truth;
+      lookAt(0.6 * cos(theta), 0.6 * sin(theta), 1.0, truth);
+      truth.focal_length_x = 1000.0;
+      truth.focal_length_y = 1000.0;
+      truth.center_x = 640.0;
+      truth.center_y = 480.0;
+      truth.distortion_k1 = truth.distortion_k2 = truth.distortion_k3 = 0.0;
+      truth.distortion_p1 = truth.distortion_p2 = 0.0;
+      truth.width = 1280;
+      truth.height = 960;
+      true_cameras_.push_back(truth);
+
+      // start from a perturbed pose
+      CameraParameters guess = truth;
+      double radians = config.initial_degree_noise * M_PI / 180.0;
+      for (int j = 0; j < 3; j++)
+      {
+        guess.angle_axis[j] += radians * randn();
+        guess.position[j] += config.initial_position_noise * randn();
+      }
+      char name[32];
+      sprintf(name, "camera_%d", k);
+      shared_ptr<Camera> camera = make_shared<Camera>(string(name), guess, false);
+      camera->trigger_ = make_shared<industrial_extrinsic_cal::NoWaitTrigger>();
+      camera->camera_observer_ =
+          make_shared<SyntheticCameraObserver>(truth, placed_pose, config.image_noise, config.seed + 100 + k);
+      shared_ptr<DefaultTransformInterface> camera_ti = make_shared<DefaultTransformInterface>();
+      camera->setTransformInterface(camera_ti);
+      camera->pushTransform();
+      getBlocks()->addStaticCamera(camera);
+      cameras_.push_back(camera);
+    }
+
+    // the scenes
+    Roi roi;
+    roi.x_min = 0;
+    roi.y_min = 0;
+    roi.x_max = 1280;
+    roi.y_max = 960;
+    for (int s = 0; s < config.num_scenes; s++)
+    {
+      Pose6d scene_pose; // the reference frame
+      if (moving_target && s > 0)
+      {
+        scene_pose.setOrigin(0.1 * randu(), 0.1 * randu(), 0.05 * randu());
+        scene_pose.setAngleAxis(0.3 * randu(), 0.3 * randu(), 0.3 * randu());
+      }
+      ObservationScene scene(make_shared<PlaceTargetTrigger>(placed_pose, scene_pose), s);
+      for (int k = 0; k < (int)cameras_.size(); k++)
+      {
+        if (moving_target && s == 0 && k > 0) break;
+        scene.addCameraToScene(cameras_[k]);
+        Cost_function scene_cost = (moving_target && s == 0) ? cost_functions::CameraReprjErrorPK : cost_type;
+        scene.populateObsCmdList(cameras_[k], target, roi, scene_cost);
+      }
+      getScenes()->push_back(scene);
+    }
+    return (true);
+  }
+
+  /*! Brief collects the synthetic observations */
+  bool observe() { return (runObservations()); }
+
+  /*! Brief solves for the camera extrinsics and target poses */
+  bool optimize() { return (runOptimization()); }
+
+  /*! Brief covariance of every camera pose, and of the target pose in every scene that estimates it */
+  bool covariance(string& covariance_file)
+  {
+    vector<CovarianceVariableRequest> requests;
+    BOOST_FOREACH (shared_ptr<Camera> camera, cameras_)
+    {
+      CovarianceVariableRequest req;
+      req.request_type = covariance_requests::StaticCameraExtrinsicParams;
+      req.object_name = camera->camera_name_;
+      req.scene_id = 0;
+      requests.push_back(req);
+    }
+    if (moving_target_)
+    {
+      for (int s = 1; s < (int)getScenes()->size(); s++)
+      {
+        CovarianceVariableRequest req;
+        req.request_type = covariance_requests::MovingTargetPoseParams;
+        req.object_name = "synthetic_grid";
+        req.scene_id = s;
+        requests.push_back(req);
+      }
+    }
+    return (computeCovariance(requests, covariance_file));
+  }
+
+  /*! Brief largest distance between a solved camera position and its true position */
+  double maxCameraPositionError()
+  {
+    double max_error = 0.0;
+    for (int k = 0; k < (int)cameras_.size(); k++)
+    {
+      P_BLOCK extrinsics = getBlocks()->getStaticCameraParameterBlockExtrinsics(cameras_[k]->camera_name_);
+      // compare camera origins in the reference frame, -R^T t
+      double solved[3], truth[3];
+      cameraOrigin(extrinsics, solved);
+      cameraOrigin(true_cameras_[k].pb_extrinsics, truth);
+      double dx = solved[0] - truth[0];
+      double dy = solved[1] - truth[1];
+      double dz = solved[2] - truth[2];
+      max_error = std::max(max_error, sqrt(dx * dx + dy * dy + dz * dz));
+    }
+    return (max_error);
+  }
+
+private:
+  /*! Brief sets the extrinsics of a camera at (x,y,z) whose optical axis points at the origin */
+  static void lookAt(double x, double y, double z, CameraParameters& C)
+  {
+    double c[3] = { x, y, z };
+    double zc[3] = { -x, -y, -z };
+    normalize(zc);
+    double up[3] = { 0.0, 0.0, 1.0 };
+    double xc[3];
+    cross(zc, up, xc);
+    normalize(xc);
+    double yc[3];
+    cross(zc, xc, yc);
+    double R[9] = { xc[0], xc[1], xc[2], yc[0], yc[1], yc[2], zc[0], zc[1], zc[2] }; // rows are the camera axes
+    ceres::RotationMatrixToAngleAxis(ceres::RowMajorAdapter3x3((const double*)R), C.angle_axis);
+    for (int i = 0; i < 3; i++)
+    {
+      C.position[i] = -(R[3 * i] * c[0] + R[3 * i + 1] * c[1] + R[3 * i + 2] * c[2]);
+    }
+  }
+  static void normalize(double v[3])
+  {
+    double n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] /= n;
+    v[1] /= n;
+    v[2] /= n;
+  }
+  static void cross(const double a[3], const double b[3], double c[3])
+  {
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+  }
+  static void cameraOrigin(const double extrinsics[6], double origin[3])
+  {
+    double inverse_aa[3] = { -extrinsics[0], -extrinsics[1], -extrinsics[2] };
+    double t[3] = { -extrinsics[3], -extrinsics[4], -extrinsics[5] };
+    ceres::AngleAxisRotatePoint(inverse_aa, t, origin);
+  }
+
+  vector<shared_ptr<Camera> > cameras_;
+  vector<CameraParameters> true_cameras_;
+  bool moving_target_;
+};
+
+/*! Brief peak resident memory of this process in megabytes */
+double peakMemoryMB()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_maxrss / 1024.0); // kilobytes on linux
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "calibration_benchmark");
+  ros::NodeHandle pnh("~");
+
+  BenchmarkConfig config;
+  int seed;
+  int repetitions;
+  bool compute_covariance;
+  string covariance_file;
+  string results_file;
+  string archive_file;
+  pnh.param<int>("num_cameras", config.num_cameras, 4);
+  pnh.param<int>("num_scenes", config.num_scenes, 10);
+  pnh.param<int>("target_rows", config.target_rows, 7);
+  pnh.param<int>("target_cols", config.target_cols, 9);
+  pnh.param<double>("target_spacing", config.target_spacing, 0.03);
+  pnh.param<string>("cost_type", config.cost_type, "TargetCameraReprjErrorPK");
+  pnh.param<double>("image_noise", config.image_noise, 0.25);
+  pnh.param<double>("initial_position_noise", config.initial_position_noise, 0.05);
+  pnh.param<double>("initial_degree_noise", config.initial_degree_noise, 3.0);
+  pnh.param<int>("seed", seed, 42);
+  pnh.param<int>("repetitions", repetitions, 3);
+  pnh.param<bool>("compute_covariance", compute_covariance, true);
+  pnh.param<string>("covariance_file", covariance_file, "/tmp/calibration_benchmark_covariance.txt");
+  pnh.param<string>("results_file", results_file, "");
+  pnh.param<string>("archive_file", archive_file, "");
+  config.seed = (unsigned int)seed;
+
+  if (config.num_cameras < 1 || config.num_scenes < 2 || config.target_rows < 2 || config.target_cols < 2)
+  {
+    ROS_ERROR("need at least one camera, two scenes and a 2x2 target");
+    return (1);
+  }
+
+  // replaying a recorded job solves its observations instead of synthetic ones
+  industrial_extrinsic_cal::ObservationArchive archive;
+  if (archive_file != "")
+  {
+    if (!archive.read(archive_file))
+    {
+      return (1);
+    }
+    compute_covariance = false;
+    config.num_cameras = archive.cameras_.size();
+    config.num_scenes = archive.num_scenes_;
+    config.cost_type = "replay";
+    ROS_INFO("benchmark: replaying %d observations of %d cameras and %d scenes from %s, %d repetitions",
+             (int)archive.observations_.size(), config.num_cameras, config.num_scenes, archive_file.c_str(),
+             repetitions);
+  }
+  else
+  {
+    ROS_INFO("benchmark: %d cameras, %d scenes, %d points per target, %s, %d repetitions", config.num_cameras,
+             config.num_scenes, config.target_rows * config.target_cols, config.cost_type.c_str(), repetitions);
+  }
+  FILE* results_fp = NULL;
+  if (results_file != "")
+  {
+    results_fp = fopen(results_file.c_str(), "a");
+    if (results_fp == NULL)
+    {
+      ROS_ERROR("could not open results file %s", results_file.c_str());
+      return (1);
+    }
+    fprintf(results_fp, "# cameras scenes points cost_type repetition observations setup_ms solve_ms covariance_ms "
+                        "iterations final_cost_per_observation max_camera_position_error peak_memory_mb\n");
+  }
+
+  double total_setup = 0.0, total_solve = 0.0, total_covariance = 0.0;
+  int failures = 0;
+  for (int r = 0; r < repetitions && ros::ok(); r++)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    SyntheticCalibrationJob job;
+    bool ready = archive_file != "" ? job.loadArchive(archive) : job.build(config) && job.observe();
+    if (!ready)
+    {
+      ROS_ERROR("could not set up the calibration job");
+      return (1);
+    }
+    ros::WallTime setup_done = ros::WallTime::now();
+    bool solved = job.optimize();
+    ros::WallTime solve_done = ros::WallTime::now();
+    bool covariance_ok = true;
+    if (solved && compute_covariance)
+    {
+      covariance_ok = job.covariance(covariance_file);
+    }
+    ros::WallTime covariance_done = ros::WallTime::now();
+    if (!solved || !covariance_ok) failures++;
+
+    const ceres::Solver::Summary& summary = job.getSolverSummary();
+    int observations = summary.num_residuals / 2;
+    int iterations = summary.num_successful_steps + summary.num_unsuccessful_steps;
+    double setup_ms = (setup_done - start).toSec() * 1000.0;
+    double solve_ms = (solve_done - setup_done).toSec() * 1000.0;
+    double covariance_ms = (covariance_done - solve_done).toSec() * 1000.0;
+    double cost_per_observation = observations > 0 ? summary.final_cost / observations : 0.0;
+    double position_error = job.maxCameraPositionError();
+    double memory = peakMemoryMB();
+    total_setup += setup_ms;
+    total_solve += solve_ms;
+    total_covariance += covariance_ms;
+
+    ROS_INFO("repetition %d: %d observations, setup %.1f ms, solve %.1f ms, covariance %.1f ms, %d iterations, "
+             "final cost per observation %.4f, max camera position error %.5f m, peak memory %.1f MB",
+             r, observations, setup_ms, solve_ms, covariance_ms, iterations, cost_per_observation, position_error,
+             memory);
+    if (results_fp != NULL)
+    {
+      fprintf(results_fp, "%d %d %d %s %d %d %.3f %.3f %.3f %d %.6f %.6f %.1f\n", config.num_cameras, config.num_scenes,
+              config.target_rows * config.target_cols, config.cost_type.c_str(), r, observations, setup_ms, solve_ms,
+              covariance_ms, iterations, cost_per_observation, position_error, memory);
+    }
+  }
+  if (results_fp != NULL) fclose(results_fp);
+
+  if (repetitions > 0)
+  {
+    ROS_INFO("mean of %d repetitions: setup %.1f ms, solve %.1f ms, covariance %.1f ms, peak memory %.1f MB, %d failed",
+             repetitions, total_setup / repetitions, total_solve / repetitions, total_covariance / repetitions,
+             peakMemoryMB(), failures);
+  }
+  return (failures > 0 ? 1 : 0);
+}
@@ -18,6 +18,7 @@
 
 #include <ros/ros.h>
 #include <ros/package.h>
+#include <boost/thread/mutex.hpp>
 #include <industrial_extrinsic_cal/calibration_job_definition.h>
 #include <actionlib/server/simple_action_server.h>
 #include <industrial_extrinsic_cal/calibrationAction.h>
@@ -25,6 +26,8 @@
 #include <industrial_extrinsic_cal/covariance.h>
 
 using industrial_extrinsic_cal::CovarianceVariableRequest;
+using industrial_extrinsic_cal::CalibrationProgress;
+using industrial_extrinsic_cal::ProgressCallback;
 
 class CalibrationServiceNode
 {
@@ -50,6 +53,7 @@ public:
     priv_nh.getParam("cal_job_file", caljob_file);
     priv_nh.getParam("post_proc_on", post_proc_on);
     priv_nh.getParam("observation_data_file", observation_data_file);
+    priv_nh.getParam("archive_file", archive_file_);
     ROS_INFO("yaml_file_path: %s",yaml_file_path.c_str());
     ROS_INFO("camera_file: %s",camera_file.c_str());
     ROS_INFO("target_file: %s",target_file.c_str());
@@ -64,6 +68,7 @@ public:
       {
 	ROS_INFO_STREAM("Calibration job (cal_job, target and camera) yaml parameters loaded.");
       }
+    action_server_.registerPreemptCallback(boost::bind(&CalibrationServiceNode::preemptCallback, this));
     action_server_.start();
   };
 
@@ -73,14 +78,20 @@ public:
   }
   bool callback(industrial_extrinsic_cal::calibrate::Request& req, industrial_extrinsic_cal::calibrate::Response& resp);
   bool actionCallback(const industrial_extrinsic_cal::calibrationGoalConstPtr& goal);
+  void preemptCallback();
+  void publishProgress(const CalibrationProgress& progress);
   bool is_calibrated(){return(calibrated_);};
   bool covarianceCallback(industrial_extrinsic_cal::covariance::Request & req, industrial_extrinsic_cal::covariance::Response & res);
 
 private:
   ros::NodeHandle nh_;
   bool calibrated_;
+  std::string archive_file_; /*< when set, each calibration run is archived here */
   industrial_extrinsic_cal::CalibrationJob * cal_job_;
+  boost::mutex job_mutex_; /*< held while the job runs or computes covariance, one at a time */
   CalibrationActionServer action_server_;
+
+  bool runJob(double allowable_cost_per_observation, double &cost_per_observation);
 };
 
 bool CalibrationServiceNode::covarianceCallback(industrial_extrinsic_cal::covariance::Request & req, industrial_extrinsic_cal::covariance::Response & res)
@@ -98,6 +109,12 @@ bool CalibrationServiceNode::covarianceCallback(industrial_extrinsic_cal::covari
   request2.scene_id       = req.scene_id2;
   requests.push_back(request2);
   std::string file_name = req.file_name;
+  boost::mutex::scoped_try_lock lock(job_mutex_);
+  if (!lock)
+    {
+      ROS_ERROR("Covariance is not available while a calibration is running");
+      return(false);
+    }
   bool ret = cal_job_->computeCovariance(requests, file_name);
   // set results and return
   res.result = 1; // just a placeholder
@@ -106,7 +123,23 @@ bool CalibrationServiceNode::covarianceCallback(industrial_extrinsic_cal::covari
 
 bool CalibrationServiceNode::callback(industrial_extrinsic_cal::calibrate::Request& req, industrial_extrinsic_cal::calibrate::Response& res)
 {
-  
+  boost::mutex::scoped_try_lock lock(job_mutex_);
+  if (!lock)
+    {
+      ROS_ERROR("A calibration is already running");
+      return(false);
+    }
+  cal_job_->resetStop();
+  double cost_per_observation;
+  bool ok = runJob(req.allowable_cost_per_observation, cost_per_observation);
+  res.cost_per_observation = cost_per_observation;
+  return(ok);
+}
+
+bool CalibrationServiceNode::runJob(double allowable_cost_per_observation, double &cost_per_observation)
+{
+  cost_per_observation = 0.0;
+
 // Display initial state
   ROS_INFO("State prior to optimization");
   cal_job_->show();
@@ -115,11 +148,15 @@ bool CalibrationServiceNode::callback(industrial_extrinsic_cal::calibrate::Reque
   ROS_INFO("RUNNING");
   if (cal_job_->run())
     {
-      res.cost_per_observation = cal_job_->finalCostPerObservation();
+      if(!archive_file_.empty() && !cal_job_->saveArchive(archive_file_))
+	{
+	  ROS_ERROR("Trouble writing observation archive %s", archive_file_.c_str());
+	}
+      cost_per_observation = cal_job_->finalCostPerObservation();
       ROS_INFO("Calibration Sucessful. Initial cost per observation = %lf final cost per observation %lf", 
 		      cal_job_->initialCostPerObservation(), 
 		      cal_job_->finalCostPerObservation());
-      if(cal_job_->finalCostPerObservation() <= req.allowable_cost_per_observation){
+      if(cal_job_->finalCostPerObservation() <= allowable_cost_per_observation){
 	calibrated_ = true;
 	if (!cal_job_->store())
 	  {
@@ -146,17 +183,67 @@ bool CalibrationServiceNode::callback(industrial_extrinsic_cal::calibrate::Reque
 
 bool CalibrationServiceNode::actionCallback(const industrial_extrinsic_cal::calibrationGoalConstPtr& goal)
 {
-  industrial_extrinsic_cal::calibrate::Request request;
-  industrial_extrinsic_cal::calibrate::Response response;
-  request.allowable_cost_per_observation = goal->allowable_cost_per_observation;
-  if(callback(request, response)){
-    action_server_.setSucceeded();
-    return(true);
-  }
-  action_server_.setAborted();
+  // runs on the action server's own thread, so the node keeps serving while the job observes and optimizes
+  industrial_extrinsic_cal::calibrationResult result;
+  boost::mutex::scoped_try_lock lock(job_mutex_);
+  if (!lock)
+    {
+      action_server_.setAborted(result, "a calibration is already running");
+      return(false);
+    }
+  // a preempt from here on stops the run, even one that comes before run() starts
+  cal_job_->resetStop();
+  if (action_server_.isPreemptRequested())
+    {
+      action_server_.setPreempted(result);
+      return(false);
+    }
+
+  cal_job_->setProgressCallback(boost::bind(&CalibrationServiceNode::publishProgress, this, _1));
+  double cost_per_observation;
+  bool ok = runJob(goal->allowable_cost_per_observation, cost_per_observation);
+  cal_job_->setProgressCallback(ProgressCallback());
+  result.cost_per_observation = cost_per_observation;
+
+  if (action_server_.isPreemptRequested() || !ros::ok())
+    {
+      ROS_INFO("Calibration preempted");
+      action_server_.setPreempted(result);
+      return(false);
+    }
+  if (ok)
+    {
+      action_server_.setSucceeded(result);
+      return(true);
+    }
+  action_server_.setAborted(result);
   return(false);
 }
 
+void CalibrationServiceNode::preemptCallback()
+{
+  // the job stops before its next scene or solver iteration and leaves its blocks as they were
+  cal_job_->requestStop();
+}
+
+void CalibrationServiceNode::publishProgress(const CalibrationProgress& progress)
+{
+  industrial_extrinsic_cal::calibrationFeedback feedback;
+  feedback.stage = progress.stage;
+  feedback.scene = progress.scene;
+  feedback.num_scenes = progress.num_scenes;
+  feedback.iteration = progress.iteration;
+  feedback.cost = progress.cost;
+  feedback.gradient_norm = progress.gradient_norm;
+  feedback.time_seconds = progress.time_seconds;
+  feedback.percent_complete = 100.0;
+  if (progress.num_scenes > 0 && progress.stage == "observing")
+    {
+      feedback.percent_complete = 100.0 * progress.scene / progress.num_scenes;
+    }
+  action_server_.publishFeedback(feedback);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -3,6 +3,7 @@
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
 #include <iostream>
+#include <industrial_extrinsic_cal/batch_projector.h>
 typedef struct
 {
   int p_id; // point's id
@@ -56,49 +57,37 @@ void print_AATasH(double x, double y, double z, double tx, double ty, double tz)
 void print_AATasHI(double x, double y, double z, double tx, double ty, double tz);
 void print_AAasEuler(double x, double y, double z);
 void print_camera(Camera C, std::string words);
-observation project_point(Camera C, point P);
+void project_points(const Camera& C, const std::vector<point>& Pts, std::vector<observation>& O);
 
-// computes image of point in cameras image plane
-observation project_point(Camera C, point P)
+// computes image of each point in cameras image plane
+void project_points(const Camera& C, const std::vector<point>& Pts, std::vector<observation>& O)
 {
-  double p[3];
-  double pt[3];
-  pt[0] = P.x;
-  pt[1] = P.y;
-  pt[2] = P.z;
-
-  // transform point into camera frame
-  // note, camera transform takes points from camera frame into world frame
-
-  ceres::AngleAxisRotatePoint(C.aa, pt, p);
-  printf("point %6.3lf %6.3lf %6.3lf rotated: %6.3lf %6.3lf %6.3lf ", P.x, P.y, P.z, p[0], p[1], p[2]);
-  p[0] += C.pos[0];
-  p[1] += C.pos[1];
-  p[2] += C.pos[2];
-  printf("translated: %6.3lf %6.3lf %6.3lf\n", p[0], p[1], p[2]);
-  //  printf("PPP %6.3lf  %6.3lf %6.3lf \n",p[0],p[1],p[2]);
-  double xp = p[0] / p[2];
-  double yp = p[1] / p[2];
-
-  //  printf("xp yp %6.3lf  %6.3lf\n",xp,yp);
-  // calculate terms for polynomial distortion
-  double r2 = xp * xp + yp * yp;
-  double r4 = r2 * r2;
-  double r6 = r2 * r4;
-
-  double xp2 = xp * xp; // temporary variables square of others
-  double yp2 = yp * yp;
-
-  //apply the distortion coefficients to refine pixel location
-  double xpp = xp + C.k1 * r2 * xp + C.k2 * r4 * xp + C.k3 * r6 * xp + C.p2 * (r2 + 2 * xp2) + 2 * C.p1 * xp * yp;
-  double ypp = yp + C.k1 * r2 * yp + C.k2 * r4 * yp + C.k3 * r6 * yp + C.p1 * (r2 + 2 * yp2) + 2 * C.p2 * xp * yp;
-
-  // perform projection using focal length and camera center into image plane
-  observation O;
-  O.p_id = 0;
-  O.x = C.fx * xpp + C.cx;
-  O.y = C.fy * ypp + C.cy;
-  return (O);
+  std::vector<industrial_extrinsic_cal::Point3d> pts(Pts.size());
+  for (int i = 0; i < (int)Pts.size(); i++)
+  {
+    pts[i].x = Pts[i].x;
+    pts[i].y = Pts[i].y;
+    pts[i].z = Pts[i].z;
+  }
+
+  // same layout, extrinsics followed by intrinsics
+  industrial_extrinsic_cal::CameraParameters CP;
+  for (int i = 0; i < 6; i++) CP.pb_extrinsics[i] = C.PB_extrinsics[i];
+  for (int i = 0; i < 9; i++) CP.pb_intrinsics[i] = C.PB_intrinsics[i];
+  CP.width = 0; // image size unknown, visibility is not used
+  CP.height = 0;
+
+  std::vector<double> x(Pts.size()), y(Pts.size());
+  industrial_extrinsic_cal::BatchProjector projector(pts);
+  O.resize(Pts.size());
+  if (Pts.empty()) return;
+  projector.project(CP, &x[0], &y[0]);
+  for (int i = 0; i < (int)Pts.size(); i++)
+  {
+    O[i].p_id = i;
+    O[i].x = x[i];
+    O[i].y = y[i];
+  }
 }
 
 struct Camera_reprj_error
@@ -357,9 +346,10 @@ int main(int argc, char** argv)
   /* used to create sample data with known solution
    FILE *fp6 = fopen("new_observations.txt","w");
    fprintf(fp6,"%d\n",num_points);
+   std::vector<observation> P;
+   project_points(C,Pts,P);
    for(int i=0;i<num_points;i++){
-   o = project_point(C,Pts[i]);
-   fprintf(fp6,"%lf %lf\n",o.x,o.y);
+   fprintf(fp6,"%lf %lf\n",P[i].x,P[i].y);
    }
    fclose(fp6); 
    exit(1);
@@ -374,9 +364,11 @@ int main(int argc, char** argv)
   fprintf(fp_temp1, "O = [ ");
   fprintf(fp_temp2, "R = [ ");
   fprintf(fp_temp3, "F = [ ");
+  std::vector<observation> projections;
+  project_points(C, Pts, projections);
   for (int i = 0; i < num_points; i++)
   {
-    o = project_point(C, Pts[i]);
+    o = projections[i];
     printf("Errors %d  = %lf %lf\n", i, Ob[i].x - o.x, Ob[i].y - o.y);
     fprintf(fp_temp1, "%lf %lf;\n", Ob[i].x, Ob[i].y);
     fprintf(fp_temp2, "%lf %lf;\n", o.x, o.y);
@@ -422,9 +414,10 @@ int main(int argc, char** argv)
 
 #ifdef MONO_EXCAL_DEBUG
   /* Print final errors */
+  project_points(C, Pts, projections);
   for (int i = 0; i < num_points; i++)
   {
-    o = project_point(C, Pts[i]);
+    o = projections[i];
     printf("%d : Ob= %6.3lf %6.3lf ", i, Ob[i].x, Ob[i].y);
     printf("%d : o= %6.3lf %6.3lf Errors = %10.3lf %10.3lf\n", i, o.x, o.y, Ob[i].x - o.x, Ob[i].y - o.y);
     fprintf(fp_temp3, "%lf %lf;\n", o.x, o.y);
@@ -0,0 +1,368 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ros/ros.h>
+#include <ros/package.h>
+#include <algorithm>
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <industrial_extrinsic_cal/calibration_job_definition.h>
+#include <actionlib/server/simple_action_server.h>
+#include <industrial_extrinsic_cal/calibrationAction.h>
+#include <industrial_extrinsic_cal/calibrate.h>
+
+using industrial_extrinsic_cal::CalibrationJob;
+using industrial_extrinsic_cal::CalibrationProgress;
+
+typedef actionlib::SimpleActionServer<industrial_extrinsic_cal::calibrationAction> CalibrationActionServer;
+
+/** @brief one calibration job hosted by the node, with the services and action that run it */
+struct HostedJob
+{
+  std::string name; /*< the job's name, the namespace of its services and action */
+  boost::shared_ptr<CalibrationJob> job; /*< the job, with its own blocks and problem */
+  std::string archive_file; /*< when set, each run of the job is archived here */
+  std::string store_file; /*< launch file the job's results are stored in */
+  double allowable_cost_per_observation; /*< cost a run must reach to be stored */
+  bool busy; /*< queued or running */
+  bool succeeded; /*< the last run reached the allowable cost */
+  double cost_per_observation; /*< final cost of the last run */
+  boost::shared_ptr<CalibrationActionServer> action_server; /*< <name>/run_calibration */
+  ros::ServiceServer service; /*< <name>/calibration_service */
+};
+
+/** @brief hosts several named calibration jobs and solves them concurrently on a fixed number of worker threads.
+ *    Each job is run by its own calibrate service and calibration action, calibration_service runs all of them.
+ *    A job is queued until a worker is free, so at most num_threads jobs observe and optimize at once.
+ */
+class MultiJobCalibrationNode
+{
+public:
+  explicit MultiJobCalibrationNode(const ros::NodeHandle& nh) :
+    nh_(nh), shutdown_(false)
+  {
+    ros::NodeHandle priv_nh("~");
+    std::string default_path = ros::package::getPath("industrial_extrinsic_cal") + "/yaml/";
+    std::vector<std::string> job_names;
+    int num_threads = boost::thread::hardware_concurrency();
+    priv_nh.getParam("yaml_file_path", default_path);
+    priv_nh.getParam("jobs", job_names);
+    priv_nh.getParam("num_threads", num_threads);
+    if (num_threads < 1) num_threads = 1;
+
+    for (int i = 0; i < (int) job_names.size(); i++)
+      {
+	if (!loadJob(job_names[i], default_path))
+	  {
+	    ROS_ERROR("Calibration job %s not loaded", job_names[i].c_str());
+	  }
+      }
+    ROS_INFO("%d calibration jobs on %d threads", (int) jobs_.size(), num_threads);
+
+    for (int i = 0; i < num_threads; i++)
+      {
+	workers_.create_thread(boost::bind(&MultiJobCalibrationNode::worker, this));
+      }
+    all_service_ = nh_.advertiseService("calibration_service", &MultiJobCalibrationNode::allCallback, this);
+  };
+
+  ~MultiJobCalibrationNode()
+  {
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      shutdown_ = true;
+      queue_.clear();
+      for (int i = 0; i < (int) jobs_.size(); i++) jobs_[i]->job->requestStop();
+    }
+    queue_cond_.notify_all();
+    done_cond_.notify_all();
+    workers_.join_all();
+  }
+
+  /** @brief number of jobs hosted */
+  int numJobs(){ return((int) jobs_.size()); };
+
+private:
+  ros::NodeHandle nh_;
+  std::vector<boost::shared_ptr<HostedJob> > jobs_; /*< the hosted jobs */
+  std::deque<HostedJob*> queue_; /*< jobs waiting for a worker */
+  boost::mutex queue_mutex_; /*< guards queue_, shutdown_ and the busy, succeeded and cost of every job */
+  boost::condition_variable queue_cond_; /*< signaled when a job is queued */
+  boost::condition_variable done_cond_; /*< signaled when a job finishes */
+  bool shutdown_; /*< workers exit once set */
+  boost::thread_group workers_; /*< the pool shared by all jobs */
+  ros::ServiceServer all_service_; /*< runs every job */
+
+  bool loadJob(const std::string &name, const std::string &default_path);
+  void worker();
+  bool submit(HostedJob *hosted, double allowable_cost_per_observation);
+  bool waitFor(HostedJob *hosted);
+  bool runJob(HostedJob *hosted);
+  bool callback(HostedJob *hosted, industrial_extrinsic_cal::calibrate::Request& req,
+		industrial_extrinsic_cal::calibrate::Response& res);
+  bool allCallback(industrial_extrinsic_cal::calibrate::Request& req, industrial_extrinsic_cal::calibrate::Response& res);
+  void actionCallback(HostedJob *hosted, const industrial_extrinsic_cal::calibrationGoalConstPtr& goal);
+  void preemptCallback(HostedJob *hosted);
+  void publishProgress(HostedJob *hosted, const CalibrationProgress& progress);
+};
+
+bool MultiJobCalibrationNode::loadJob(const std::string &name, const std::string &default_path)
+{
+  ros::NodeHandle job_nh("~/" + name);
+  std::string yaml_file_path = default_path;
+  std::string camera_file, target_file, caljob_file;
+  int max_iterations, solver_threads;
+  double max_solver_time;
+  job_nh.getParam("yaml_file_path", yaml_file_path);
+  if (!job_nh.getParam("camera_file", camera_file) || !job_nh.getParam("target_file", target_file) ||
+      !job_nh.getParam("cal_job_file", caljob_file))
+    {
+      ROS_ERROR("Calibration job %s needs a camera_file, target_file and cal_job_file", name.c_str());
+      return(false);
+    }
+  job_nh.param("max_iterations", max_iterations, 1000);
+  job_nh.param("max_solver_time", max_solver_time, 1.0e9);
+  job_nh.param("solver_threads", solver_threads, 1);
+
+  boost::shared_ptr<HostedJob> hosted(new HostedJob());
+  hosted->name = name;
+  hosted->job = boost::shared_ptr<CalibrationJob>(new CalibrationJob(yaml_file_path + camera_file,
+									 yaml_file_path + target_file,
+									 yaml_file_path + caljob_file));
+  job_nh.getParam("archive_file", hosted->archive_file);
+  // jobs finishing together must not write the same launch file
+  job_nh.param("store_file", hosted->store_file, ros::package::getPath("industrial_extrinsic_cal") + "/launch/" + name +
+	       "_transform_publisher.launch");
+  hosted->allowable_cost_per_observation = 0.0;
+  hosted->busy = false;
+  hosted->succeeded = false;
+  hosted->cost_per_observation = 0.0;
+  if (!hosted->job->load())
+    {
+      return(false);
+    }
+  hosted->job->setSolverLimits(max_iterations, max_solver_time, solver_threads);
+  ROS_INFO("Calibration job %s loaded, at most %d iterations and %.1lf seconds on %d threads",
+	   name.c_str(), max_iterations, max_solver_time, solver_threads);
+
+  ros::NodeHandle ns_nh(nh_, name);
+  HostedJob *h = hosted.get();
+  hosted->service = ns_nh.advertiseService<industrial_extrinsic_cal::calibrate::Request,
+					   industrial_extrinsic_cal::calibrate::Response>
+    ("calibration_service", boost::bind(&MultiJobCalibrationNode::callback, this, h, _1, _2));
+  hosted->action_server = boost::shared_ptr<CalibrationActionServer>
+    (new CalibrationActionServer(ns_nh, "run_calibration",
+				 boost::bind(&MultiJobCalibrationNode::actionCallback, this, h, _1), false));
+  hosted->action_server->registerPreemptCallback(boost::bind(&MultiJobCalibrationNode::preemptCallback, this, h));
+  hosted->job->setProgressCallback(boost::bind(&MultiJobCalibrationNode::publishProgress, this, h, _1));
+  hosted->action_server->start();
+  jobs_.push_back(hosted);
+  return(true);
+}
+
+void MultiJobCalibrationNode::worker()
+{
+  while (true)
+    {
+      HostedJob *hosted;
+      {
+	boost::mutex::scoped_lock lock(queue_mutex_);
+	while (!shutdown_ && queue_.empty()) queue_cond_.wait(lock);
+	if (shutdown_) return;
+	hosted = queue_.front();
+	queue_.pop_front();
+      }
+      bool succeeded = runJob(hosted);
+      {
+	boost::mutex::scoped_lock lock(queue_mutex_);
+	hosted->succeeded = succeeded;
+	hosted->cost_per_observation = hosted->job->finalCostPerObservation();
+	hosted->busy = false;
+      }
+      done_cond_.notify_all();
+    }
+}
+
+bool MultiJobCalibrationNode::submit(HostedJob *hosted, double allowable_cost_per_observation)
+{
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    if (hosted->busy || shutdown_) return(false);
+    hosted->busy = true;
+    hosted->succeeded = false;
+    hosted->allowable_cost_per_observation = allowable_cost_per_observation;
+    hosted->job->resetStop(); // a preempt once queued stops the run, even before run() starts
+    queue_.push_back(hosted);
+  }
+  queue_cond_.notify_one();
+  return(true);
+}
+
+bool MultiJobCalibrationNode::waitFor(HostedJob *hosted)
+{
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  while (hosted->busy && !shutdown_) done_cond_.wait(lock);
+  return(hosted->succeeded && !hosted->busy);
+}
+
+bool MultiJobCalibrationNode::runJob(HostedJob *hosted)
+{
+  CalibrationJob *job = hosted->job.get();
+  ROS_INFO("Running calibration job %s", hosted->name.c_str());
+  if (!job->run())
+    {
+      ROS_ERROR("Calibration job %s failed", hosted->name.c_str());
+      return(false);
+    }
+  if (!hosted->archive_file.empty() && !job->saveArchive(hosted->archive_file))
+    {
+      ROS_ERROR("Trouble writing observation archive %s", hosted->archive_file.c_str());
+    }
+  ROS_INFO("Calibration job %s: initial cost per observation = %lf final cost per observation %lf",
+	   hosted->name.c_str(), job->initialCostPerObservation(), job->finalCostPerObservation());
+  if (job->finalCostPerObservation() > hosted->allowable_cost_per_observation)
+    {
+      ROS_ERROR("Calibration job %s ran successfully, but error was larger than allowed by caller",
+		hosted->name.c_str());
+      return(false);
+    }
+  if (!job->store(hosted->store_file))
+    {
+      ROS_ERROR("Trouble storing results of calibration job %s", hosted->name.c_str());
+    }
+  return(true);
+}
+
+bool MultiJobCalibrationNode::callback(HostedJob *hosted, industrial_extrinsic_cal::calibrate::Request& req,
+				       industrial_extrinsic_cal::calibrate::Response& res)
+{
+  if (!submit(hosted, req.allowable_cost_per_observation))
+    {
+      ROS_ERROR("Calibration job %s is already running", hosted->name.c_str());
+      return(false);
+    }
+  bool calibrated = waitFor(hosted);
+  res.cost_per_observation = hosted->cost_per_observation;
+  return(calibrated);
+}
+
+bool MultiJobCalibrationNode::allCallback(industrial_extrinsic_cal::calibrate::Request& req,
+					  industrial_extrinsic_cal::calibrate::Response& res)
+{
+  std::vector<HostedJob*> submitted;
+  for (int i = 0; i < (int) jobs_.size(); i++)
+    {
+      if (submit(jobs_[i].get(), req.allowable_cost_per_observation))
+	{
+	  submitted.push_back(jobs_[i].get());
+	}
+      else
+	{
+	  ROS_ERROR("Calibration job %s is already running, not run again", jobs_[i]->name.c_str());
+	}
+    }
+
+  // the response holds the worst cost of the jobs run
+  bool calibrated = submitted.size() == jobs_.size();
+  res.cost_per_observation = 0.0;
+  for (int i = 0; i < (int) submitted.size(); i++)
+    {
+      calibrated = waitFor(submitted[i]) && calibrated;
+      res.cost_per_observation = std::max(res.cost_per_observation, submitted[i]->cost_per_observation);
+    }
+  return(calibrated);
+}
+
+void MultiJobCalibrationNode::actionCallback(HostedJob *hosted,
+					     const industrial_extrinsic_cal::calibrationGoalConstPtr& goal)
+{
+  industrial_extrinsic_cal::calibrationResult result;
+  if (!submit(hosted, goal->allowable_cost_per_observation))
+    {
+      hosted->action_server->setAborted(result, "the calibration job is already running");
+      return;
+    }
+  // submit() cleared any stop, a preempt that came before it is passed on here
+  if (hosted->action_server->isPreemptRequested()) preemptCallback(hosted);
+  bool calibrated = waitFor(hosted);
+  result.cost_per_observation = hosted->cost_per_observation;
+  if (hosted->action_server->isPreemptRequested() || !ros::ok())
+    {
+      hosted->action_server->setPreempted(result);
+    }
+  else if (calibrated)
+    {
+      hosted->action_server->setSucceeded(result);
+    }
+  else
+    {
+      hosted->action_server->setAborted(result);
+    }
+}
+
+void MultiJobCalibrationNode::preemptCallback(HostedJob *hosted)
+{
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  std::deque<HostedJob*>::iterator it = std::find(queue_.begin(), queue_.end(), hosted);
+  if (it != queue_.end())
+    { // not started yet, a worker will never pick it up
+      queue_.erase(it);
+      hosted->busy = false;
+      done_cond_.notify_all();
+    }
+  else
+    {
+      hosted->job->requestStop();
+    }
+}
+
+void MultiJobCalibrationNode::publishProgress(HostedJob *hosted, const CalibrationProgress& progress)
+{
+  if (!hosted->action_server->isActive()) return; // run by a service
+  industrial_extrinsic_cal::calibrationFeedback feedback;
+  feedback.stage = progress.stage;
+  feedback.scene = progress.scene;
+  feedback.num_scenes = progress.num_scenes;
+  feedback.iteration = progress.iteration;
+  feedback.cost = progress.cost;
+  feedback.gradient_norm = progress.gradient_norm;
+  feedback.time_seconds = progress.time_seconds;
+  feedback.percent_complete = 100.0;
+  if (progress.num_scenes > 0 && progress.stage == "observing")
+    {
+      feedback.percent_complete = 100.0 * progress.scene / progress.num_scenes;
+    }
+  hosted->action_server->publishFeedback(feedback);
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "multi_job_calibration_service_node");
+  ros::NodeHandle nh;
+  MultiJobCalibrationNode node(nh);
+
+  // services wait for their job, so each job's service and the run-all service get a thread of their own,
+  // with one more left for the subscriptions the jobs' triggers and observers depend on
+  ros::AsyncSpinner spinner(node.numJobs() + 2);
+  spinner.start();
+  ros::waitForShutdown();
+  spinner.stop();
+}
@@ -22,12 +22,15 @@
 #include <industrial_extrinsic_cal/yaml_utils.h>
 #include <iostream>
 #include <fstream>
+#include <cstdio>
+#include <boost/bind.hpp>
 namespace industrial_extrinsic_cal
 {
   using std::string;
   using std::vector;
 
-  MutableJointStatePublisher::MutableJointStatePublisher(ros::NodeHandle nh): nh_(nh)
+  MutableJointStatePublisher::MutableJointStatePublisher(ros::NodeHandle nh): 
+    nh_(nh), store_pending_(false), store_shutdown_(false)
   {
     ros::NodeHandle pnh("~");
 
@@ -45,21 +48,45 @@ namespace industrial_extrinsic_cal
     set_server_ = nh_.advertiseService( "set_mutable_joint_states", &MutableJointStatePublisher::setCallBack, this);
     get_server_ = nh_.advertiseService("get_mutable_joint_states", &MutableJointStatePublisher::getCallBack,this);
     store_server_ = nh_.advertiseService("store_mutable_joint_states", &MutableJointStatePublisher::storeCallBack, this);
+    batch_server_ = nh_.advertiseService("batch_mutable_joint_states", &MutableJointStatePublisher::batchCallBack, this);
 
-    // advertise the topic for continious publication of all the mutable joint states
+    // advertise the latched topic for publication of all the mutable joint states, late subscribers get the last values
     int queue_size = 10;
-    joint_state_pub_ = nh_.advertise<sensor_msgs::JointState>("mutable_joint_states", queue_size);
+    joint_state_pub_ = nh_.advertise<sensor_msgs::JointState>("mutable_joint_states", queue_size, true);
     if(!joint_state_pub_){
       ROS_ERROR("ADVERTISE DID NOT RETURN A VALID PUBLISHER");
     }
+    publishJointStates();
+
+    // values are published when they change, the keepalive only covers subscribers wanting a steady stream
+    double keepalive_rate = 1.0;
+    pnh.param("keepalive_rate", keepalive_rate, keepalive_rate);
+    if(keepalive_rate > 0.0){
+      keepalive_period_ = ros::Duration(1.0/keepalive_rate);
+      keepalive_timer_ = nh_.createTimer(keepalive_period_, &MutableJointStatePublisher::keepAliveCallBack, this);
+    }
+
+    store_thread_ = boost::thread(boost::bind(&MutableJointStatePublisher::storeThread, this));
+  }
+
+  MutableJointStatePublisher::~MutableJointStatePublisher()
+  {
+    {
+      boost::mutex::scoped_lock lock(store_mutex_);
+      store_shutdown_ = true;
+    }
+    store_condition_.notify_one();
+    store_thread_.join();
   }
 
   bool MutableJointStatePublisher::setCallBack(industrial_extrinsic_cal::set_mutable_joint_states::Request &req,
 					       industrial_extrinsic_cal::set_mutable_joint_states::Response &res)
   {
     bool return_val= true;
+    bool changed = false;
     for(int i=0; i<(int)req.joint_names.size(); i++){
       if(joints_.find(req.joint_names[i]) != joints_.end()){
+	changed = changed || joints_[req.joint_names[i]] != req.joint_values[i];
 	joints_[req.joint_names[i]] = req.joint_values[i];
 	ROS_INFO("setting %s to %lf",req.joint_names[i].c_str(), req.joint_values[i]);
       }
@@ -68,6 +95,7 @@ namespace industrial_extrinsic_cal
 	return_val= false;
       }
     }
+    if(changed) publishJointStates();
 
     return(return_val);
   }
@@ -91,6 +119,36 @@ namespace industrial_extrinsic_cal
     return(return_val);
   }
 
+  bool MutableJointStatePublisher::batchCallBack(industrial_extrinsic_cal::batch_mutable_joint_states::Request &req,
+						 industrial_extrinsic_cal::batch_mutable_joint_states::Response &res)
+  {
+    if(req.joint_names.size() != req.joint_values.size()){
+      ROS_ERROR("%s batch request has %d joint names but %d values",node_name_.c_str(),
+		(int) req.joint_names.size(), (int) req.joint_values.size());
+      return(false);
+    }
+    // an unknown name is reported but does not fail the call, the response still lists every joint that exists
+    bool changed = false;
+    for(int i=0; i<(int)req.joint_names.size(); i++){
+      if(joints_.find(req.joint_names[i]) != joints_.end()){
+	changed = changed || joints_[req.joint_names[i]] != req.joint_values[i];
+	joints_[req.joint_names[i]] = req.joint_values[i];
+      }
+      else{
+	ROS_ERROR("%s does not have joint named %s",node_name_.c_str(),req.joint_names[i].c_str());
+      }
+    }
+    if(changed) publishJointStates();
+
+    res.joint_names.clear();
+    res.joint_values.clear();
+    for (std::map<std::string, double>::iterator it= joints_.begin(); it != joints_.end(); ++it){
+      res.joint_names.push_back(it->first);
+      res.joint_values.push_back(it->second);
+    }
+    return(true);
+  }
+
   bool MutableJointStatePublisher::storeCallBack(industrial_extrinsic_cal::store_mutable_joint_states::Request &req,
 						 industrial_extrinsic_cal::store_mutable_joint_states::Response &res)
   {
@@ -100,18 +158,64 @@ namespace industrial_extrinsic_cal
     pnh.getParam("overwrite_mutable_values", overwrite);
     if(!overwrite) new_file_name = yaml_file_name_ + "new";
 
-    std::ofstream fout(new_file_name.c_str());
+    // hand a snapshot to the writer thread, a store queued before it got to the last one replaces it
+    {
+      boost::mutex::scoped_lock lock(store_mutex_);
+      store_joints_ = joints_;
+      store_file_name_ = new_file_name;
+      store_pending_ = true;
+    }
+    store_condition_.notify_one();
+    for (std::map<std::string, double>::iterator it= joints_.begin(); it != joints_.end(); ++it){
+      ROS_INFO("mutable joint %s has value %lf",it->first.c_str(), it->second);
+    }
+    return(true);
+  }
+
+  void MutableJointStatePublisher::storeThread()
+  {
+    boost::mutex::scoped_lock lock(store_mutex_);
+    while(true){
+      while(!store_pending_ && !store_shutdown_) store_condition_.wait(lock);
+      if(!store_pending_) return; // shut down with nothing left to write
+      std::map<std::string, double> joints;
+      joints.swap(store_joints_);
+      std::string file_name = store_file_name_;
+      store_pending_ = false;
+
+      lock.unlock();
+      writeYamlFile(joints, file_name);
+      lock.lock();
+    }
+  }
+
+  bool MutableJointStatePublisher::writeYamlFile(const std::map<std::string, double> &joints, const std::string &file_name)
+  {
     YAML::Emitter yaml_emitter;
     yaml_emitter << YAML::BeginMap;
-    for (std::map<std::string, double>::iterator it= joints_.begin(); it != joints_.end(); ++it){
+    for (std::map<std::string, double>::const_iterator it= joints.begin(); it != joints.end(); ++it){
       yaml_emitter << YAML::Key << it->first.c_str() << YAML::Value << it->second;
-      ROS_INFO("mutable joint %s has value %lf",it->first.c_str(), it->second);
     }
     yaml_emitter << YAML::EndMap;
+
+    // write beside the target and rename over it, so the file is always either the old or the new version
+    std::string temp_file_name = file_name + ".tmp";
+    std::ofstream fout(temp_file_name.c_str());
     fout << yaml_emitter.c_str();
     fout.close();
+    if(fout.fail()){
+      ROS_ERROR("could not write mutable joint states to %s", temp_file_name.c_str());
+      std::remove(temp_file_name.c_str());
+      return(false);
+    }
+    if(std::rename(temp_file_name.c_str(), file_name.c_str()) != 0){
+      ROS_ERROR("could not rename %s to %s", temp_file_name.c_str(), file_name.c_str());
+      std::remove(temp_file_name.c_str());
+      return(false);
+    }
+    ROS_INFO("stored mutable joint states in %s", file_name.c_str());
     return(true);
-}
+  }
 
   bool  MutableJointStatePublisher::loadFromYamlFile()
   {
@@ -162,6 +266,16 @@ namespace industrial_extrinsic_cal
         joint_states.effort.push_back(0.0);
       }
       joint_state_pub_.publish(joint_states);
+      last_publish_time_ = ros::Time::now();
+      return(true);
+  }
+
+  void MutableJointStatePublisher::keepAliveCallBack(const ros::TimerEvent &event)
+  {
+    // a change published since the last tick already served as the keepalive
+    if(ros::Time::now() - last_publish_time_ >= keepalive_period_*0.5){
+      publishJointStates();
+    }
   }
 } // end namespace mutable_joint_state_publisher
 
@@ -170,12 +284,7 @@ int main(int argc, char **argv)
   ros::init(argc, argv, "mutable_joint_state_publisher");
   ros::NodeHandle nh;
   industrial_extrinsic_cal::MutableJointStatePublisher MJSP(nh);
-  ros::Rate loop_rate(1);
-  while(ros::ok()){
-    MJSP.publishJointStates();
-    ros::spinOnce();
-    loop_rate.sleep();
-  }
+  ros::spin();
 }
 
 
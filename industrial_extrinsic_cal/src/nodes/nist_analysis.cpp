@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <ostream>
 #include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
 #include <fstream>
 #include <yaml-cpp/yaml.h>
 #include <vector>
@@ -11,17 +13,25 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/random/normal_distribution.hpp>
-#include <boost/random/linear_congruential.hpp>
+#include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int.hpp>
 #include <boost/random/uniform_real.hpp>
 #include <boost/random/variate_generator.hpp>
 #include <boost/generator_iterator.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <industrial_extrinsic_cal/basic_types.h>
+#include <industrial_extrinsic_cal/batch_projector.h>
 #include <industrial_extrinsic_cal/camera_definition.h>
 #include <industrial_extrinsic_cal/camera_yaml_parser.h>
 #include <industrial_extrinsic_cal/targets_yaml_parser.h>
 #include <industrial_extrinsic_cal/points_yaml_parser.h>
+#include <industrial_extrinsic_cal/running_statistics.h>
 #include <industrial_extrinsic_cal/observation_data_point.h>
 #include <industrial_extrinsic_cal/ceres_costs_utils.hpp>
 #include <industrial_extrinsic_cal/ceres_costs_utils.h>
@@ -41,11 +51,31 @@ using industrial_extrinsic_cal::transformPoint;
 using industrial_extrinsic_cal::projectPntNoDistortion;
 using industrial_extrinsic_cal::string2CostType;
 using industrial_extrinsic_cal::Cost_function;
+using industrial_extrinsic_cal::RunningStatistics;
 
-typedef boost::minstd_rand base_gen_type;
-base_gen_type gen(42);
-boost::normal_distribution<> normal_dist(0,1); // zero mean unit variance
-boost::variate_generator<base_gen_type&, boost::normal_distribution<> > randn(gen, normal_dist);
+// Every thread draws from its own generator. Each Monte Carlo trial reseeds it with a stream derived from the seed and
+// the trial number, so a trial sees the same noise no matter which thread runs it.
+typedef boost::mt19937 base_gen_type;
+typedef boost::variate_generator<base_gen_type, boost::normal_distribution<> > randn_gen_type;
+boost::thread_specific_ptr<randn_gen_type> randn_gen;
+
+/*! Brief starts random stream number stream of seed on the calling thread */
+void seedRandomStream(unsigned int seed, unsigned int stream)
+{
+  // splitmix64 finalizer, so neighboring streams get unrelated generator seeds
+  uint64_t z = ((uint64_t) seed << 32 | stream) + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  randn_gen.reset(new randn_gen_type(base_gen_type((uint32_t) z), boost::normal_distribution<>(0,1)));
+}
+
+/*! Brief zero mean unit variance sample from the calling thread's random stream */
+double randn()
+{
+  if(randn_gen.get() == NULL) seedRandomStream(42, 0);
+  return (*randn_gen)();
+}
 
 typedef struct observation
 {
@@ -64,9 +94,10 @@ typedef struct scene
 class CameraWithHistory: public Camera
 {
 public:
+  CameraWithHistory() : pose_stats(6) {}
   int height;
   int width;
-  vector<Pose6d> pose_history;
+  RunningStatistics pose_stats; // deviations x,y,z,ax,ay,az of recovered poses from the nominal pose
   double pose_position_mean_error;
   double pose_position_sigma;
   double pose_orientation_mean_error;
@@ -79,10 +110,9 @@ public:
 class Point3dWithHistory 
 {
 public:
+  Point3dWithHistory() : position_stats(3) {}
   Point3d point;
-  vector<double> x_history;
-  vector<double> y_history;
-  vector<double> z_history;
+  RunningStatistics position_stats; // triangulated positions x,y,z
   double mean_x;
   double mean_y;
   double mean_z;
@@ -109,10 +139,15 @@ void perturbPose(Pose6d &pose, double position_noise, double degree_noise);
 void independentlyPerturbCameras(vector<CameraWithHistory> &cameras);
 void copyCamerasWoHistory(vector<CameraWithHistory> &original_cameras, vector<CameraWithHistory> & cameras);
 void copyPoints(vector<Point3dWithHistory> &original_points, vector<Point3dWithHistory> & points);
-void addPoseToHistory(vector<CameraWithHistory> &cameras, vector<CameraWithHistory> &original_cameras);
-void computeHistoricPoseStatistics(vector<CameraWithHistory> &cameras);
-void addPointsToHistory(vector<Point3dWithHistory> &points, vector<Point3dWithHistory> &original_points);
-void computeHistoricPointStatistics(vector<Point3dWithHistory> & points);
+void resetCameraPoses(vector<CameraWithHistory> &original_cameras, vector<CameraWithHistory> &cameras);
+void resetPoints(vector<Point3dWithHistory> &original_points, vector<Point3dWithHistory> &points);
+void addPoseResiduals(vector<ObservationDataPoint> &observations, ceres::Problem &problem,
+		      vector<industrial_extrinsic_cal::CameraReprjErrorPK*> &reprojection_errors);
+void addPoseToStatistics(vector<CameraWithHistory> &cameras, vector<CameraWithHistory> &original_cameras,
+			 vector<RunningStatistics> &pose_stats);
+void computePoseStatistics(vector<CameraWithHistory> &cameras);
+void addPointsToStatistics(vector<Point3dWithHistory> &points, vector<RunningStatistics> &position_stats);
+void computePointStatistics(vector<Point3dWithHistory> & points);
 void compareCameras(vector<CameraWithHistory> &C1, vector<CameraWithHistory> &C2);
 void compareObservations(vector<ObservationDataPoint> &O1, vector<ObservationDataPoint> &O2);
 bool  parseScenes(std::string &scene_file_name, std::vector<Scene> &scenes);
@@ -125,13 +160,13 @@ void computeObservationsFromScenes(vector<Scene> &scenes, // pose of target, and
 				      double image_noise,  // amount of noise to add to each observation
 				      vector<ObservationDataPoint> &observations, // returned data
 				      vector<Point3dWithHistory> &points); // returned target points
-ObservationDataPoint predictObservationOfPoint(CameraWithHistory &C,
-					       Point3dWithHistory &P, 
-					       Pose6d &target_pose, 
-					       int scene_id, 
-					       int point_id, 
-					       double image_noise,
-					       bool &results_within_image);
+void predictObservationsOfPoints(CameraWithHistory &C,
+				 vector<Point3dWithHistory> &points,
+				 int first_point,
+				 Pose6d &target_pose,
+				 int scene_id,
+				 double image_noise,
+				 vector<ObservationDataPoint> &observations);
 void computeObservationsOfPoints(vector<CameraWithHistory> &cameras,
 				 vector<Point3dWithHistory> &points,
 				 Pose6d &target_pose,
@@ -141,6 +176,241 @@ void computeObservationsOfPoints(vector<CameraWithHistory> &cameras,
 				 double camera_degree_noise = 0.0,
 				 double image_noise=0.0);
 
+/*! Brief one thread's share of a Monte Carlo study, owns working copies of everything a trial modifies */
+class TrialWorker
+{
+public:
+  virtual ~TrialWorker(){}
+  virtual void runTrial() = 0;
+  boost::mutex stats_lock_; /*!< held while a trial's results are added to the worker's statistics */
+};
+
+/*! Brief progress of a study, shared by its threads */
+struct TrialProgress
+{
+  boost::mutex lock;
+  int completed;
+  int report_every; // report after every this many test cases, 0 for no intermediate reports
+  boost::function<void (int)> report; // called with the number of completed test cases
+};
+
+/*! Brief runs test cases first_case, first_case+stride, ... of a study on the calling thread */
+void runWorkerTrials(shared_ptr<TrialWorker> worker, int first_case, int stride, int num_test_cases,
+		     unsigned int seed, unsigned int first_stream, TrialProgress *progress)
+{
+  for(int test_case=first_case; test_case<num_test_cases; test_case+=stride){
+    seedRandomStream(seed, first_stream + test_case);
+    worker->runTrial();
+    boost::mutex::scoped_lock lock(progress->lock);
+    progress->completed++;
+    if(progress->report_every > 0 && progress->completed % progress->report_every == 0 &&
+       progress->completed < num_test_cases && progress->report){
+      progress->report(progress->completed);
+    }
+  }
+}
+
+/*! Brief spreads num_test_cases trials over the workers, one thread each, and waits for all of them
+ *  test cases are dealt out round robin, so statistics merged in worker order are reproducible for a given seed
+ *  and number of workers
+ */
+void runTrials(vector<shared_ptr<TrialWorker> > &workers, int num_test_cases, unsigned int seed, unsigned int first_stream,
+	       int report_every = 0, boost::function<void (int)> report = boost::function<void (int)>())
+{
+  TrialProgress progress;
+  progress.completed = 0;
+  progress.report_every = report_every;
+  progress.report = report;
+  int stride = (int) workers.size();
+  boost::thread_group threads;
+  for(int i=1; i<stride; i++){
+    threads.create_thread(boost::bind(&runWorkerTrials, workers[i], i, stride, num_test_cases, seed, first_stream, &progress));
+  }
+  runWorkerTrials(workers[0], 0, stride, num_test_cases, seed, first_stream, &progress);
+  threads.join_all();
+}
+
+/*! Brief trial of the camera pose study: perturb cameras, observe the scenes with image noise and recover the poses
+ *  the observations and the problem are built once, a trial only changes the observed locations and the initial poses
+ */
+class PoseTrialWorker : public TrialWorker
+{
+public:
+  PoseTrialWorker(vector<Scene> &scenes, vector<CameraWithHistory> &original_cameras, double image_noise,
+		  double camera_pos_noise, double camera_or_noise, const ceres::Solver::Options &options,
+		  int reservoir_size, unsigned int stats_seed) :
+    original_cameras_(original_cameras), image_noise_(image_noise),
+    camera_pos_noise_(camera_pos_noise), camera_or_noise_(camera_or_noise), options_(options)
+  {
+    for(int i=0; i<(int)original_cameras.size(); i++){
+      pose_stats_.push_back(RunningStatistics(6, reservoir_size, stats_seed + i));
+    }
+    // noiseless observations, their locations are the mean of each trial's noisy observations
+    copyCamerasWoHistory(original_cameras_, cameras_);
+    computeObservationsFromScenes(scenes, cameras_, 0.0, 0.0, 0.0, observations_, points_);
+    addPoseResiduals(observations_, problem_, reprojection_errors_);
+  }
+
+  void runTrial()
+  {
+    double pnoise = image_noise_/sqrt(1.58085);// same magic number as predictObservationsOfPoints()
+    resetCameraPoses(original_cameras_, cameras_);
+    for(int i=0; i<(int)observations_.size(); i++){
+      reprojection_errors_[i]->ox_ = observations_[i].image_x_ + pnoise*randn();
+      reprojection_errors_[i]->oy_ = observations_[i].image_y_ + pnoise*randn();
+    }
+    perturbCameras(cameras_, camera_pos_noise_, camera_or_noise_);
+
+    ceres::Solver::Summary summary;
+    ceres::Solve(options_, &problem_, &summary);
+    boost::mutex::scoped_lock lock(stats_lock_);
+    addPoseToStatistics(cameras_, original_cameras_, pose_stats_);
+  }
+
+  vector<RunningStatistics> pose_stats_; /*!< this worker's statistics of each camera */
+
+private:
+  vector<CameraWithHistory> &original_cameras_;
+  double image_noise_;
+  double camera_pos_noise_;
+  double camera_or_noise_;
+  ceres::Solver::Options options_;
+  vector<CameraWithHistory> cameras_; // the problem's parameter blocks, never reallocated
+  vector<Point3dWithHistory> points_;
+  vector<ObservationDataPoint> observations_;
+  ceres::Problem problem_;
+  vector<industrial_extrinsic_cal::CameraReprjErrorPK*> reprojection_errors_; // owned by problem_, one per observation
+};
+
+/*! Brief trial of the field point study: observe from the actual cameras, then triangulate from perturbed ones
+ *  the observations are noiseless, so they and the problem are built once, a trial only changes the camera poses the
+ *  points are triangulated from and the initial point locations
+ */
+class FieldTrialWorker : public TrialWorker
+{
+public:
+  FieldTrialWorker(vector<CameraWithHistory> &original_cameras, vector<Point3dWithHistory> &original_field_points,
+		   double point_pos_noise, const ceres::Solver::Options &options, int reservoir_size, unsigned int stats_seed) :
+    original_cameras_(original_cameras), original_field_points_(original_field_points),
+    point_pos_noise_(point_pos_noise), options_(options)
+  {
+    for(int i=0; i<(int)original_field_points.size(); i++){
+      position_stats_.push_back(RunningStatistics(3, reservoir_size, stats_seed + i));
+    }
+    copyPoints(original_field_points_, field_points_); // working copy of field points
+    copyCamerasWoHistory(original_cameras_, cameras_); // working copy of cameras
+
+    // noiseless ideal observations of cameras at their actual locations, these observation now point toward field points
+    computeObservationsOfPoints(cameras_, field_points_, target_pose_, 0, observations_);
+    BOOST_FOREACH(ObservationDataPoint &obs, observations_){
+      int camera_index = 0;
+      while(cameras_[camera_index].camera_parameters_.pb_extrinsics != obs.camera_extrinsics_) camera_index++;
+      double fx, fy, cx, cy, k1, k2, k3, p1, p2;
+      extractCameraIntrinsics(obs.camera_intrinsics_, fx, fy, cx, cy, k1, k2, k3, p1, p2);
+      industrial_extrinsic_cal::TriangulationError *error =
+	new industrial_extrinsic_cal::TriangulationError(obs.image_x_, obs.image_y_, fx, fy, cx, cy, Pose6d());
+      problem_.AddResidualBlock(new ceres::AutoDiffCostFunction<industrial_extrinsic_cal::TriangulationError, 2, 3>(error),
+				NULL, obs.point_position_);
+      triangulation_errors_.push_back(error);
+      observing_cameras_.push_back(camera_index);
+    }
+  }
+
+  void runTrial()
+  {
+    resetPoints(original_field_points_, field_points_);
+    resetCameraPoses(original_cameras_, cameras_);
+
+    // cameras independently perturbed from their actual locations for triangulation
+    independentlyPerturbCameras(cameras_);
+    perturbPoints(field_points_, point_pos_noise_);
+    for(int i=0; i<(int)triangulation_errors_.size(); i++){
+      double tx, ty, tz, ax, ay, az;
+      industrial_extrinsic_cal::extractCameraExtrinsics(cameras_[observing_cameras_[i]].camera_parameters_.pb_extrinsics,
+							 tx, ty, tz, ax, ay, az);
+      triangulation_errors_[i]->camera_pose_ = Pose6d(tx, ty, tz, ax, ay, az); // note this is the pose from camera to world
+    }
+
+    ceres::Solver::Summary summary;
+    ceres::Solve(options_, &problem_, &summary);
+    boost::mutex::scoped_lock lock(stats_lock_);
+    addPointsToStatistics(field_points_, position_stats_);
+  }
+
+  vector<RunningStatistics> position_stats_; /*!< this worker's statistics of each field point */
+
+private:
+  vector<CameraWithHistory> &original_cameras_;
+  vector<Point3dWithHistory> &original_field_points_;
+  double point_pos_noise_;
+  ceres::Solver::Options options_;
+  Pose6d target_pose_; // not used, but needed to fill out the observation data structure
+  vector<CameraWithHistory> cameras_;
+  vector<Point3dWithHistory> field_points_; // the problem's parameter blocks, never reallocated
+  vector<ObservationDataPoint> observations_;
+  ceres::Problem problem_;
+  vector<industrial_extrinsic_cal::TriangulationError*> triangulation_errors_; // owned by problem_, one per observation
+  vector<int> observing_cameras_; // index of the camera making each observation
+};
+
+/*! Brief combines the statistics of all pose workers into the cameras, safe while the workers are running */
+void mergePoseStatistics(vector<shared_ptr<PoseTrialWorker> > &workers, vector<CameraWithHistory> &cameras)
+{
+  for(int w=0; w<(int)workers.size(); w++){
+    boost::mutex::scoped_lock lock(workers[w]->stats_lock_);
+    for(int i=0; i<(int)cameras.size(); i++){
+      if(w == 0) cameras[i].pose_stats = workers[w]->pose_stats_[i];
+      else cameras[i].pose_stats.merge(workers[w]->pose_stats_[i]);
+    }
+  }
+  computePoseStatistics(cameras);
+}
+
+/*! Brief combines the statistics of all field workers into the points, safe while the workers are running */
+void mergePointStatistics(vector<shared_ptr<FieldTrialWorker> > &workers, vector<Point3dWithHistory> &points)
+{
+  for(int w=0; w<(int)workers.size(); w++){
+    boost::mutex::scoped_lock lock(workers[w]->stats_lock_);
+    for(int i=0; i<(int)points.size(); i++){
+      if(w == 0) points[i].position_stats = workers[w]->position_stats_[i];
+      else points[i].position_stats.merge(workers[w]->position_stats_[i]);
+    }
+  }
+  computePointStatistics(points);
+}
+
+/*! Brief intermediate report of the camera pose study */
+void reportPoseProgress(vector<shared_ptr<PoseTrialWorker> > *workers, vector<CameraWithHistory> *original_cameras,
+			int completed)
+{
+  vector<CameraWithHistory> cameras = *original_cameras;
+  mergePoseStatistics(*workers, cameras);
+  ROS_INFO("after %d test cases:", completed);
+  BOOST_FOREACH(CameraWithHistory &C, cameras){
+    ROS_INFO("%s\t:mean_pos_error = %7.5lf sigma=  %7.5lf angular %7.5lf",
+	     C.camera_name_.c_str(), C.pose_position_mean_error, C.pose_position_sigma, C.pose_orientation_sigma*180/3.1415);
+  }
+}
+
+/*! Brief intermediate report of the field point study */
+void reportFieldProgress(vector<shared_ptr<FieldTrialWorker> > *workers, vector<Point3dWithHistory> *original_points,
+			 int completed)
+{
+  vector<Point3dWithHistory> points = *original_points;
+  mergePointStatistics(*workers, points);
+  double mean_sigma = 0.0, max_sigma = 0.0;
+  int n = 0;
+  BOOST_FOREACH(Point3dWithHistory &P, points){
+    if(P.num_observations < 2) continue; // can't be triangulated
+    double sigma = sqrt(P.sigma_x*P.sigma_x + P.sigma_y*P.sigma_y + P.sigma_z*P.sigma_z);
+    mean_sigma += sigma;
+    max_sigma = std::max(max_sigma, sigma);
+    n++;
+  }
+  ROS_INFO("after %d test cases: %d triangulated field points, mean sigma = %9.5lf max sigma = %9.5lf",
+	   completed, n, n > 0 ? mean_sigma/n : 0.0, max_sigma);
+}
+
 int main(int argc, char** argv)
 {
   ros::init(argc, argv, "nist_analysis");
@@ -153,7 +423,6 @@ int main(int argc, char** argv)
   vector<Point3dWithHistory> points; // working copy of original points
   vector<Point3d> original_field_points_nh;// test points for accuracy estimation
   vector<Point3dWithHistory> original_field_points;// test points for accuracy estimation
-  vector<Point3dWithHistory> field_points; // working copy of original field points
 
   vector<CameraWithHistory>  cameras; // working copy of original cameras
   vector<ObservationDataPoint> original_observations; // noisless observations of original points
@@ -169,13 +438,24 @@ int main(int argc, char** argv)
   double target_or_noise     = 1.0; // degrees
   double image_noise          = 0.1; // pixels
   int num_test_cases          = 100; // each test case is a statistical sample
+  int num_threads             = std::max(1, (int) boost::thread::hardware_concurrency());
+  unsigned int seed           = 42; // same seed, same noise in every test case
+  int reservoir_size          = 0; // samples kept per camera and point for quantiles, 0 for none
+  int report_every            = 0; // report intermediate statistics after this many test cases, 0 for never
 
   google::InitGoogleLogging(argv[0]);
-  if (argc != 4)
+  if (argc < 4 || argc > 9)
     {
-      std::cerr << "usage: NistAnalysis <scene_file> <cameras_file> <fieldpoints_file\n";
+      std::cerr << "usage: NistAnalysis <scene_file> <cameras_file> <fieldpoints_file> "
+		<< "[num_test_cases [num_threads [seed [reservoir_size [report_every]]]]]\n";
       return 1;
     }
+  if(argc > 4) num_test_cases = atoi(argv[4]);
+  if(argc > 5) num_threads    = std::max(1, atoi(argv[5]));
+  if(argc > 6) seed           = (unsigned int) strtoul(argv[6], NULL, 10);
+  if(argc > 7) reservoir_size = std::max(0, atoi(argv[7]));
+  if(argc > 8) report_every   = std::max(0, atoi(argv[8]));
+  seedRandomStream(seed, 0);
 
   std::string scene_file_name;
   ifstream scene_file(argv[1]);
@@ -268,18 +548,8 @@ int main(int argc, char** argv)
   // each observation is noisy and points to cameras whose extrinsics are perturbed
   // each point is a fiducial in a known/surveyed location
   ROS_INFO("solving with %d observations",(int)observations.size());
-  int b1o=0, b2o=0, b3o=0, b4o=0, b5o=0, b6o=0, b7o=0;
-  BOOST_FOREACH(ObservationDataPoint obs, observations){
-    double *extrinsics = obs.camera_extrinsics_;
-    Point3d point;
-    point.x= obs.point_position_[0];
-    point.y= obs.point_position_[1];
-    point.z= obs.point_position_[2];
-    double fx, fy, cx, cy, k1, k2, k3, p1, p2;
-    industrial_extrinsic_cal::extractCameraIntrinsics(obs.camera_intrinsics_, fx, fy, cx, cy, k1, k2, k3, p1, p2);
-    ceres::CostFunction* cost_function = industrial_extrinsic_cal::CameraReprjErrorPK::Create(obs.image_x_,obs.image_y_,fx,fy,cx,cy,point);
-    problem1.AddResidualBlock(cost_function, NULL, extrinsics);
-  }
+  vector<industrial_extrinsic_cal::CameraReprjErrorPK*> reprojection_errors;
+  addPoseResiduals(observations, problem1, reprojection_errors);
   BOOST_FOREACH(CameraWithHistory &C, cameras){
     ROS_INFO("%s has %d observations", C.camera_name_.c_str(),C.num_observations);
   }
@@ -311,17 +581,7 @@ int main(int argc, char** argv)
   computeObservationsFromScenes(scenes, cameras, 0.0, 0.0, image_noise, observations, points);
   perturbCameras(cameras,camera_pos_noise,camera_or_noise);
   ceres::Problem problem2;
-  BOOST_FOREACH(ObservationDataPoint obs, observations){
-    double *extrinsics = obs.camera_extrinsics_;
-    Point3d point;
-    point.x= obs.point_position_[0];
-    point.y= obs.point_position_[1];
-    point.z= obs.point_position_[2];
-    double fx, fy, cx, cy, k1, k2, k3, p1, p2;
-    industrial_extrinsic_cal::extractCameraIntrinsics(obs.camera_intrinsics_, fx, fy, cx, cy, k1, k2, k3, p1, p2);
-    ceres::CostFunction* cost_function = industrial_extrinsic_cal::CameraReprjErrorPK::Create(obs.image_x_,obs.image_y_,fx,fy,cx,cy,point);
-    problem2.AddResidualBlock(cost_function, NULL, extrinsics);
-  }
+  addPoseResiduals(observations, problem2, reprojection_errors);
   // solve problem
   ceres::Solve(options, &problem2, &summary);
   if(SHOW_DEBUG){  // display results
@@ -341,30 +601,20 @@ int main(int argc, char** argv)
   // use them to generate estimates of the accuracy of field point localization
 
   // compute poses for cameras for a bunch of test cases
+  // test case i draws its noise from random stream 1+i
   options.minimizer_progress_to_stdout = false;
-  for(int test_case=0; test_case<num_test_cases; test_case++){
-    copyCamerasWoHistory(original_cameras, cameras);
-    computeObservationsFromScenes(scenes, cameras, 0.0, 0.0, image_noise, observations, points);
-    perturbCameras(cameras,camera_pos_noise,camera_or_noise);
-
-    ceres::Problem problem;
-    BOOST_FOREACH(ObservationDataPoint obs, observations){
-      double x  = obs.image_x_;
-      double y  = obs.image_y_;
-      double *extrinsics = obs.camera_extrinsics_;
-      Point3d point;
-      point.x= obs.point_position_[0];
-      point.y= obs.point_position_[1];
-      point.z= obs.point_position_[2];
-      double fx, fy, cx, cy, k1, k2, k3, p1, p2;
-      industrial_extrinsic_cal::extractCameraIntrinsics(obs.camera_intrinsics_, fx, fy, cx, cy, k1, k2, k3, p1, p2);
-      ceres::CostFunction* cost_function = industrial_extrinsic_cal::CameraReprjErrorPK::Create(x,y,fx,fy,cx,cy,point);
-      problem.AddResidualBlock(cost_function, NULL, extrinsics);
-    }
-    ceres::Solve(options, &problem, &summary);
-    addPoseToHistory(cameras, original_cameras);
-  }// end of test cases
-  computeHistoricPoseStatistics(original_cameras);
+  ROS_INFO("running %d camera pose test cases on %d threads", num_test_cases, num_threads);
+  vector<shared_ptr<TrialWorker> > workers;
+  vector<shared_ptr<PoseTrialWorker> > pose_workers;
+  for(int i=0; i<num_threads; i++){
+    pose_workers.push_back(boost::make_shared<PoseTrialWorker>(boost::ref(scenes), boost::ref(original_cameras),
+							       image_noise, camera_pos_noise, camera_or_noise, options,
+							       reservoir_size, seed + 1000*i));
+    workers.push_back(pose_workers.back());
+  }
+  runTrials(workers, num_test_cases, seed, 1, report_every,
+	    boost::bind(&reportPoseProgress, &pose_workers, &original_cameras, _1));
+  mergePoseStatistics(pose_workers, original_cameras);
   
   BOOST_FOREACH(CameraWithHistory &C, original_cameras){
     ROS_INFO("%s\t:mean_pos_error = %7.5lf sigma=  %7.5lf angular %7.5lf number_observations = %d",
@@ -373,6 +623,13 @@ int main(int argc, char** argv)
 	   C.pose_position_sigma,
 	   C.pose_orientation_sigma*180/3.1415,
 	   C.num_observations);
+    double q05[3], q95[3];
+    if(C.pose_stats.quantile(0, 0.05, q05[0]) && C.pose_stats.quantile(0, 0.95, q95[0]) &&
+       C.pose_stats.quantile(1, 0.05, q05[1]) && C.pose_stats.quantile(1, 0.95, q95[1]) &&
+       C.pose_stats.quantile(2, 0.05, q05[2]) && C.pose_stats.quantile(2, 0.95, q95[2])){
+      ROS_INFO("%s\t:5%%..95%% position error x [%7.5lf %7.5lf] y [%7.5lf %7.5lf] z [%7.5lf %7.5lf]",
+	       C.camera_name_.c_str(), q05[0], q95[0], q05[1], q95[1], q05[2], q95[2]);
+    }
   } 
 
   // at this point cameras each have an uncertianty model.
@@ -406,38 +663,18 @@ int main(int argc, char** argv)
   ROS_ERROR("comparing original camera poses to those using independent perturbations\n");
   compareCameras(original_cameras,cameras); // will have some agregate overall statistics
 
-  for(int test_case=0; test_case<num_test_cases; test_case++){
-    copyPoints(original_field_points, field_points); // working copy of field points
-    copyCamerasWoHistory(original_cameras,cameras); // working copy of cameras
-
-    // noiseless ideal observations of cameras at their actual locations, these observation now point toward field points
-    computeObservationsOfPoints(cameras, field_points, target_pose, scene_id, observations);
-    // noisey ideal observations of cameras at their actual locations
-    // computeObservationsOfPoints(cameras, field_points, target_pose, scene_id, observations, 0.0, 0.0, image_noise);
-
-    // cameras independently perturbed from their actual locations for triangulation
-    independentlyPerturbCameras(cameras); 
-    perturbPoints(field_points, point_pos_noise); 
-
-    ceres::Problem problem;
-    options.minimizer_progress_to_stdout = false;
-    BOOST_FOREACH(ObservationDataPoint obs, observations){
-      double x  = obs.image_x_;
-      double y  = obs.image_y_;
-      double *points     = obs.point_position_; // this is perturbed from ideal by point_pos_noise
-      double fx, fy, cx, cy, k1, k2, k3, p1, p2;
-      industrial_extrinsic_cal::extractCameraIntrinsics(obs.camera_intrinsics_, fx, fy, cx, cy, k1, k2, k3, p1, p2);
-      double tx, ty, tz, ax, ay, az;
-      industrial_extrinsic_cal::extractCameraExtrinsics(obs.camera_extrinsics_, tx, ty, tz, ax, ay, az);
-      Pose6d camera_pose(tx, ty, tz, ax, ay, az); // note this is the pose from camera to world
-      ceres::CostFunction* cost_function = industrial_extrinsic_cal::TriangulationError::Create(x,y,fx,fy,cx,cy,camera_pose);
-      problem.AddResidualBlock(cost_function, NULL, points);
-    }
-    ceres::Solve(options, &problem, &summary);
-
-    addPointsToHistory(field_points, original_field_points);
+  // test case i draws its noise from random stream 1+num_test_cases+i
+  ROS_INFO("running %d field point test cases on %d threads", num_test_cases, num_threads);
+  workers.clear();
+  vector<shared_ptr<FieldTrialWorker> > field_workers;
+  for(int i=0; i<num_threads; i++){
+    field_workers.push_back(boost::make_shared<FieldTrialWorker>(boost::ref(original_cameras), boost::ref(original_field_points),
+								 point_pos_noise, options, reservoir_size, seed + 1000*i));
+    workers.push_back(field_workers.back());
   }
-  computeHistoricPointStatistics(original_field_points);
+  runTrials(workers, num_test_cases, seed, 1 + num_test_cases, report_every,
+	    boost::bind(&reportFieldProgress, &field_workers, &original_field_points, _1));
+  mergePointStatistics(field_workers, original_field_points);
   FILE *fp = fopen("field_results.m","w");
   fprintf(fp,"f = [\n");
   BOOST_FOREACH(Point3dWithHistory P, original_field_points){
@@ -449,6 +686,13 @@ int main(int argc, char** argv)
 	   P.sigma_y,
 	   P.sigma_z,
 	   P.num_observations);
+    double q05[3], q95[3];
+    if(P.position_stats.quantile(0, 0.05, q05[0]) && P.position_stats.quantile(0, 0.95, q95[0]) &&
+       P.position_stats.quantile(1, 0.05, q05[1]) && P.position_stats.quantile(1, 0.95, q95[1]) &&
+       P.position_stats.quantile(2, 0.05, q05[2]) && P.position_stats.quantile(2, 0.95, q95[2])){
+      printf("  5%%..95%% x [%9.5lf %9.5lf] y [%9.5lf %9.5lf] z [%9.5lf %9.5lf]\n",
+	     q05[0], q95[0], q05[1], q95[1], q05[2], q95[2]);
+    }
     fprintf(fp,"%9.5lf %9.5lf %9.5lf %9.5lf %9.5lf %9.5lf %9.5lf %9.5lf %9.5lf;\n",
 	    P.point.x,
 	    P.point.y,
@@ -654,7 +898,7 @@ void copyCamerasWoHistory(vector<CameraWithHistory> &original_cameras, vector<Ca
   cameras.clear();
   BOOST_FOREACH(CameraWithHistory &C, original_cameras){
     CameraWithHistory newC = C;
-    newC.pose_history.clear();
+    newC.pose_stats.clear();
     newC.num_observations = 0;
     cameras.push_back(newC);
   }
@@ -668,125 +912,95 @@ void copyPoints(vector<Point3dWithHistory> &original_points, vector<Point3dWithH
   }
 } 
 
-void addPoseToHistory(vector<CameraWithHistory> &cameras, vector<CameraWithHistory> & original_cameras)
+void resetCameraPoses(vector<CameraWithHistory> &original_cameras, vector<CameraWithHistory> &cameras)
+{
+  // in place, so that parameter blocks pointing into cameras stay valid
+  for(int i=0;i<(int)cameras.size();i++){
+    for(int j=0; j<3; j++){
+      cameras[i].camera_parameters_.position[j]   = original_cameras[i].camera_parameters_.position[j];
+      cameras[i].camera_parameters_.angle_axis[j] = original_cameras[i].camera_parameters_.angle_axis[j];
+    }
+  }
+}
+
+void resetPoints(vector<Point3dWithHistory> &original_points, vector<Point3dWithHistory> &points)
 {
-  if(cameras.size() != original_cameras.size())
+  // in place, so that parameter blocks pointing into points stay valid
+  for(int i=0;i<(int)points.size();i++){
+    points[i].point = original_points[i].point;
+  }
+}
+
+void addPoseResiduals(vector<ObservationDataPoint> &observations, ceres::Problem &problem,
+		      vector<industrial_extrinsic_cal::CameraReprjErrorPK*> &reprojection_errors)
+{
+  // the cost functors are returned so that the observed locations may be changed before solving again
+  reprojection_errors.clear();
+  BOOST_FOREACH(ObservationDataPoint &obs, observations){
+    Point3d point;
+    point.x= obs.point_position_[0];
+    point.y= obs.point_position_[1];
+    point.z= obs.point_position_[2];
+    double fx, fy, cx, cy, k1, k2, k3, p1, p2;
+    extractCameraIntrinsics(obs.camera_intrinsics_, fx, fy, cx, cy, k1, k2, k3, p1, p2);
+    industrial_extrinsic_cal::CameraReprjErrorPK *error =
+      new industrial_extrinsic_cal::CameraReprjErrorPK(obs.image_x_, obs.image_y_, fx, fy, cx, cy, point);
+    problem.AddResidualBlock(new ceres::AutoDiffCostFunction<industrial_extrinsic_cal::CameraReprjErrorPK, 2, 6>(error),
+			     NULL, obs.camera_extrinsics_);
+    reprojection_errors.push_back(error);
+  }
+}
+
+void addPoseToStatistics(vector<CameraWithHistory> &cameras, vector<CameraWithHistory> & original_cameras,
+			 vector<RunningStatistics> &pose_stats)
+{
+  if(cameras.size() != original_cameras.size() || cameras.size() != pose_stats.size())
     ROS_ERROR_STREAM("number of cameras in vectors do not match");
 
   for(int i=0;i<(int)cameras.size();i++){
-    Pose6d pose;
-    pose.x  = cameras[i].camera_parameters_.position[0];
-    pose.y  = cameras[i].camera_parameters_.position[1];
-    pose.z  = cameras[i].camera_parameters_.position[2];
-    pose.ax = cameras[i].camera_parameters_.angle_axis[0];
-    pose.ay = cameras[i].camera_parameters_.angle_axis[1];
-    pose.az = cameras[i].camera_parameters_.angle_axis[2];
-    original_cameras[i].pose_history.push_back(pose);
+    double deviation[6];
+    for(int j=0; j<3; j++){
+      deviation[j]   = cameras[i].camera_parameters_.position[j]   - original_cameras[i].camera_parameters_.position[j];
+      deviation[j+3] = cameras[i].camera_parameters_.angle_axis[j] - original_cameras[i].camera_parameters_.angle_axis[j];
+    }
+    pose_stats[i].add(deviation);
   }
 }
 
-void computeHistoricPoseStatistics(vector<CameraWithHistory> & cameras)
+void computePoseStatistics(vector<CameraWithHistory> & cameras)
 {
-  // calculate statistics of test case
-  double mean_x, mean_y, mean_z, mean_ax, mean_ay, mean_az;
-  double sigma_x, sigma_y, sigma_z, sigma_ax, sigma_ay, sigma_az;
+  // calculate statistics of test cases from the accumulated deviations from each camera's pose
   BOOST_FOREACH(CameraWithHistory &C, cameras){
-    mean_x  = 0.0;
-    mean_y  = 0.0;
-    mean_z  = 0.0;
-    mean_ax = 0.0;
-    mean_ay = 0.0;
-    mean_az = 0.0;
-    BOOST_FOREACH(Pose6d &p, C.pose_history){
-      mean_x  += p.x;
-      mean_y  += p.y;
-      mean_z  += p.z;
-      mean_ax += p.ax;
-      mean_ay += p.ay;
-      mean_az += p.az;
-    }
-    int num_poses = (int) C.pose_history.size();
-    mean_x  = mean_x/num_poses;
-    mean_y  = mean_y/num_poses;
-    mean_z  = mean_z/num_poses;
-    mean_ax = mean_ax/num_poses;
-    mean_ay = mean_ay/num_poses;
-    mean_az = mean_az/num_poses;
-
-    double d_x = mean_x - C.camera_parameters_.position[0];
-    double d_y = mean_y - C.camera_parameters_.position[1];
-    double d_z = mean_z - C.camera_parameters_.position[2];
-    C.pose_position_mean_error = sqrt(d_x*d_x + d_y*d_y + d_z*d_z);
-    double d_ax = mean_ax - C.camera_parameters_.angle_axis[0];
-    double d_ay = mean_ay - C.camera_parameters_.angle_axis[1];
-    double d_az = mean_az - C.camera_parameters_.angle_axis[2];
-    C.pose_orientation_mean_error = sqrt(d_ax*d_ax + d_ay*d_ay + d_az*d_az);
-
-    sigma_x = 0.0;
-    sigma_y = 0.0;
-    sigma_z = 0.0;
-    sigma_ax = 0.0;
-    sigma_ay = 0.0;
-    sigma_az = 0.0;
-    BOOST_FOREACH(Pose6d &p, C.pose_history){
-      sigma_x  += (mean_x  - p.x)*(mean_x - p.x);;
-      sigma_y  += (mean_y  - p.y)*(mean_y - p.y);;
-      sigma_z  += (mean_z  - p.z)*(mean_z - p.z);;
-      sigma_ax += (mean_ax - p.ax)*(mean_ax - p.ax);;
-      sigma_ay += (mean_ay - p.ay)*(mean_ay - p.ay);;
-      sigma_az += (mean_az - p.az)*(mean_az - p.az);;
+    double mean[6], sigma[6];
+    for(int j=0; j<6; j++){
+      mean[j]  = C.pose_stats.mean(j);
+      sigma[j] = C.pose_stats.sigma(j);
     }
-    sigma_x  = sqrt(sigma_x/(num_poses - 1.0));
-    sigma_y  = sqrt(sigma_y/(num_poses - 1.0));
-    sigma_z  = sqrt(sigma_z/(num_poses - 1.0));
-    C.sigma_ax = sigma_ax = sqrt(sigma_ax/(num_poses - 1.0));
-    C.sigma_ay = sigma_ay = sqrt(sigma_ay/(num_poses - 1.0));
-    C.sigma_az = sigma_az = sqrt(sigma_az/(num_poses - 1.0));
-
-    double dv = sqrt(sigma_x*sigma_x + sigma_y*sigma_y + sigma_z*sigma_z);
-    double av = sqrt(sigma_ax*sigma_ax + sigma_ay*sigma_ay + sigma_az*sigma_az);
-
-    C.pose_position_sigma    = dv;
-    C.pose_orientation_sigma = av;
+    C.pose_position_mean_error    = sqrt(mean[0]*mean[0] + mean[1]*mean[1] + mean[2]*mean[2]);
+    C.pose_orientation_mean_error = sqrt(mean[3]*mean[3] + mean[4]*mean[4] + mean[5]*mean[5]);
+    C.sigma_ax = sigma[3];
+    C.sigma_ay = sigma[4];
+    C.sigma_az = sigma[5];
+    C.pose_position_sigma    = sqrt(sigma[0]*sigma[0] + sigma[1]*sigma[1] + sigma[2]*sigma[2]);
+    C.pose_orientation_sigma = sqrt(sigma[3]*sigma[3] + sigma[4]*sigma[4] + sigma[5]*sigma[5]);
   } // end for each camera
 }
 
-void computeHistoricPointStatistics(vector<Point3dWithHistory> & points)
+void computePointStatistics(vector<Point3dWithHistory> & points)
 {
-  // calculate statistics of test case
-  double mean_x, mean_y, mean_z;
-
+  // calculate statistics of test cases from the accumulated positions
   BOOST_FOREACH(Point3dWithHistory &P, points){
-    P.mean_x = P.mean_y = P.mean_z = 0.0;
-    BOOST_FOREACH(double &p, P.x_history){
-      P.mean_x  += p;
-    }
-    BOOST_FOREACH(double &p, P.y_history){
-      P.mean_y  += p;
+    const RunningStatistics &S = P.position_stats;
+    if(S.count() == 0){
+      P.mean_x = P.mean_y = P.mean_z = 0.0;
     }
-    BOOST_FOREACH(double &p, P.z_history){
-      P.mean_z  += p;
-    }
-    int num_values = (int) P.x_history.size();
-    if(num_values == 0){ 
-      num_values=1.0;
+    else{
+      P.mean_x = S.mean(0);
+      P.mean_y = S.mean(1);
+      P.mean_z = S.mean(2);
     }
-    P.mean_x  = P.mean_x/num_values;
-    P.mean_y  = P.mean_y/num_values;
-    P.mean_z  = P.mean_z/num_values;
 
-    P.sigma_x = P.sigma_y = P.sigma_z = 0.0;
-    BOOST_FOREACH(double &p, P.x_history){
-      P.sigma_x  += (P.mean_x - p)*(P.mean_x - p);;
-    }
-    BOOST_FOREACH(double &p, P.y_history){
-      P.sigma_y  += (P.mean_y - p)*(P.mean_y - p);;
-    }
-    BOOST_FOREACH(double &p, P.z_history){
-      P.sigma_z  += (P.mean_z - p)*(P.mean_z - p);;
-    }
-    double denom = num_values-1.0;
-    if(denom==0 || P.num_observations ==0){
+    if(S.count() < 2 || P.num_observations ==0){
       P.sigma_x = 1000;
       P.sigma_y = 1000;
       P.sigma_z = 1000;
@@ -797,9 +1011,9 @@ void computeHistoricPointStatistics(vector<Point3dWithHistory> & points)
       P.sigma_z = 0.4;
     }
     else{
-      P.sigma_x  = sqrt(P.sigma_x/denom);
-      P.sigma_y  = sqrt(P.sigma_y/denom);
-      P.sigma_z  = sqrt(P.sigma_z/denom);
+      P.sigma_x  = S.sigma(0);
+      P.sigma_y  = S.sigma(1);
+      P.sigma_z  = S.sigma(2);
     }
   } // end for each point
 }
@@ -887,15 +1101,13 @@ void compareObservations(vector<ObservationDataPoint> &O1, vector<ObservationDat
   ROS_INFO("mean distance between observations = %9.5lf pixels sigma= %9.5lf ", mean_dist, sigma_dist);
 }
 
-void addPointsToHistory(vector<Point3dWithHistory> &points, vector<Point3dWithHistory> &original_points)
+void addPointsToStatistics(vector<Point3dWithHistory> &points, vector<RunningStatistics> &position_stats)
 {
-  if(points.size() != original_points.size())
+  if(points.size() != position_stats.size())
     ROS_ERROR_STREAM("number of points in vectors do not match");
 
   for(int i=0;i<(int)points.size();i++){
-    original_points[i].x_history.push_back(points[i].point.x);
-    original_points[i].y_history.push_back(points[i].point.y);
-    original_points[i].z_history.push_back(points[i].point.z);
+    position_stats[i].add(points[i].point.pb);
   }
 }
 
@@ -979,15 +1191,7 @@ void computeObservationsOfPoints(vector<CameraWithHistory> &cameras,
 {
   observations.clear();
   BOOST_FOREACH(CameraWithHistory &C, cameras){
-    int q=0;
-    BOOST_FOREACH(Point3dWithHistory &P, points){
-      bool good_observation;
-      ObservationDataPoint obs = predictObservationOfPoint(C, P, target_pose, scene_id, q++, image_noise, good_observation);
-      if(good_observation) {
-	observations.push_back(obs);
-	P.num_observations++;
-      }
-    }
+    predictObservationsOfPoints(C, points, 0, target_pose, scene_id, image_noise, observations);
   }
 }
 void computeObservationsFromScenes(vector<Scene> &scenes, // pose of target, and which cameras observed it
@@ -1024,68 +1228,64 @@ void computeObservationsFromScenes(vector<Scene> &scenes, // pose of target, and
       if(current_camera_ptr == NULL){
 	ROS_ERROR("Couldn't find camera %s",camera_name.c_str());
       }
-      for(int i=target_point_offset; i<(int)points.size(); i++){// for each new point
-	bool good_observation;
-	ObservationDataPoint obs =predictObservationOfPoint(*current_camera_ptr, points[i], S.target_pose, S.scene_id, i, image_noise, good_observation);
-	if(good_observation){
-	  observations.push_back(obs);
-	  current_camera_ptr->num_observations++;
-	  points[i].num_observations++;
-	}
-      }
+      predictObservationsOfPoints(*current_camera_ptr, points, target_point_offset, S.target_pose, S.scene_id,
+				  image_noise, observations);
     }// end for each camera in scene
   }      // end for each scene
 }// end
 
-ObservationDataPoint predictObservationOfPoint(CameraWithHistory &C,
-					       Point3dWithHistory &P, 
-					       Pose6d &target_pose, 
-					       int scene_id, 
-					       int point_id, 
-					       double image_noise,
-					       bool &results_within_image)
+void predictObservationsOfPoints(CameraWithHistory &C,
+				 vector<Point3dWithHistory> &points,
+				 int first_point,
+				 Pose6d &target_pose,
+				 int scene_id,
+				 double image_noise,
+				 vector<ObservationDataPoint> &observations)
 {
   double pnoise = image_noise/sqrt(1.58085);// magic number found by trial and error
-  double fx,fy,cx,cy,k1,k2,k3,p1,p2;
-  double aa[3], tx[3];
-  double ox, oy;
-  double world_point[3];
   std::string t_name("modified_circle_grid");
-  Pose6d dummy_target_pose;
   Pose6d dummy_intermediate_pose;
   std::string cost_type_string("CameraReprjErrorPK");
   Cost_function cost_type = string2CostType(cost_type_string);
-  
-  extractCameraIntrinsics(C.camera_parameters_.pb_intrinsics,  fx,  fy,  cx,  cy,  k1,  k2,  k3,  p1,  p2);
-  aa[0] = C.camera_parameters_.angle_axis[0];
-  aa[1] = C.camera_parameters_.angle_axis[1];
-  aa[2] = C.camera_parameters_.angle_axis[2];
-  tx[0] = C.camera_parameters_.position[0];
-  tx[1] = C.camera_parameters_.position[1];
-  tx[2] = C.camera_parameters_.position[2];
-  transformPoint(aa, tx, P.point.pb, world_point);// move to world coordinates
-  projectPntNoDistortion(world_point,  fx,  fy,  cx,  cy,  ox,  oy); // project point into camera's image plane 
-  ox += pnoise*randn(); // add observation noise
-  oy += pnoise*randn();
-  results_within_image = true;
-  if(ox<0.0 || ox>C.camera_parameters_.width || oy<0.0 || oy>C.camera_parameters_.height){
-    results_within_image = false;
-  }    
-  ObservationDataPoint obs(C.camera_name_,
-			   t_name, // target_name
-			   2, // target type
-			   scene_id,
-			   C.camera_parameters_.pb_intrinsics,
-			   C.camera_parameters_.pb_extrinsics,
-			   point_id,
-			   target_pose.pb_pose,
-			   P.point.pb,
-			   ox,
-			   oy,
-			   cost_type,
-			   dummy_intermediate_pose,
-			   0.0);
-  return(obs);
+
+  int num_points = (int)points.size() - first_point;
+  if(num_points <= 0) return;
+
+  // project all the points at once, observations are simulated for a CameraReprjErrorPK so ignore distortion
+  vector<Point3d> pts(num_points);
+  for(int i=0; i<num_points; i++) pts[i] = points[first_point+i].point;
+  BatchProjector projector(pts);
+  CameraParameters no_distortion = C.camera_parameters_;
+  no_distortion.distortion_k1 = no_distortion.distortion_k2 = no_distortion.distortion_k3 = 0.0;
+  no_distortion.distortion_p1 = no_distortion.distortion_p2 = 0.0;
+  vector<double> image_x(num_points), image_y(num_points);
+  projector.project(no_distortion, &image_x[0], &image_y[0]);
+
+  for(int i=0; i<num_points; i++){
+    Point3dWithHistory &P = points[first_point+i];
+    double ox = image_x[i] + pnoise*randn(); // add observation noise
+    double oy = image_y[i] + pnoise*randn();
+    if(ox<0.0 || ox>C.camera_parameters_.width || oy<0.0 || oy>C.camera_parameters_.height){
+      continue;
+    }
+    ObservationDataPoint obs(C.camera_name_,
+			     t_name, // target_name
+			     2, // target type
+			     scene_id,
+			     C.camera_parameters_.pb_intrinsics,
+			     C.camera_parameters_.pb_extrinsics,
+			     first_point+i, // point_id
+			     target_pose.pb_pose,
+			     P.point.pb,
+			     ox,
+			     oy,
+			     cost_type,
+			     dummy_intermediate_pose,
+			     0.0);
+    observations.push_back(obs);
+    C.num_observations++;
+    P.num_observations++;
+  }
 }
 
 void addTargetPoints(int rows, int cols, double spacing, vector<Point3dWithHistory> &points, Pose6d &target_pose)
@@ -0,0 +1,527 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <industrial_extrinsic_cal/observation_archive.h>
+#include <ros/console.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace industrial_extrinsic_cal
+{
+namespace
+{
+// On disk records. Every field is naturally aligned and every record is a multiple of 8 bytes, so the sections can be
+// used in place from a mapping of the file.
+const char archive_magic[8] = { 'I', 'E', 'C', 'A', 'R', 'C', 'H', '\0' };
+const uint32_t archive_byte_order = 0x01020304;
+const uint64_t no_final_values = ~(uint64_t)0; /* BlockRecord::final_values of a block never optimized */
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t num_cameras;
+  uint32_t num_targets;
+  uint32_t num_blocks;
+  uint32_t num_observations;
+  int32_t num_scenes;
+  uint32_t reference_frame; // offset in the string table
+  uint64_t num_values; // doubles in the value section
+  uint64_t string_table_size;
+  uint64_t cameras_offset; // byte offsets of the sections from the start of the file
+  uint64_t targets_offset;
+  uint64_t blocks_offset;
+  uint64_t observations_offset;
+  uint64_t summary_offset;
+  uint64_t values_offset;
+  uint64_t strings_offset;
+};
+
+struct CameraRecord
+{
+  uint32_t name;
+  uint32_t is_moving;
+  int32_t width;
+  int32_t height;
+};
+
+struct TargetRecord
+{
+  uint32_t name;
+  uint32_t target_type;
+  uint32_t is_moving;
+  uint32_t unused;
+};
+
+struct BlockRecord
+{
+  uint32_t type;
+  int32_t owner;
+  int32_t scene_id;
+  int32_t point_id;
+  uint64_t initial_values; // index of the first value in the value section
+  uint64_t final_values; // as initial_values, or no_final_values
+};
+
+struct ObservationRecord
+{
+  int32_t scene_id;
+  int32_t point_id;
+  int32_t camera;
+  int32_t target;
+  uint32_t cost_type; // offset of the cost type's name in the string table, the enumeration may be reordered
+  int32_t intrinsics;
+  int32_t extrinsics;
+  int32_t target_pose;
+  int32_t point_position;
+  uint32_t unused;
+  double image_x;
+  double image_y;
+  double circle_dia;
+  double intermediate_frame[6];
+};
+
+struct SummaryRecord
+{
+  uint32_t solved;
+  int32_t num_successful_steps;
+  int32_t num_unsuccessful_steps;
+  int32_t termination_type;
+  int32_t num_parameters;
+  int32_t num_residuals;
+  double initial_cost;
+  double final_cost;
+  double total_time_in_seconds;
+};
+
+/* builds the string table, each distinct string is stored once */
+class StringTable
+{
+public:
+  uint32_t add(const std::string &s)
+  {
+    std::map<std::string, uint32_t>::iterator it = offsets_.find(s);
+    if (it != offsets_.end()) return (it->second);
+    uint32_t offset = (uint32_t)data_.size();
+    data_.insert(data_.end(), s.begin(), s.end());
+    data_.push_back('\0');
+    offsets_[s] = offset;
+    return (offset);
+  }
+  std::vector<char> data_;
+
+private:
+  std::map<std::string, uint32_t> offsets_;
+};
+
+uint64_t align8(uint64_t offset)
+{
+  return ((offset + 7) & ~(uint64_t)7);
+}
+
+bool validSection(uint64_t offset, uint64_t count, uint64_t record_size, uint64_t file_size)
+{
+  if (offset % 8 != 0 || offset > file_size) return (false);
+  return (count <= (file_size - offset) / record_size);
+}
+
+/* reads a string from the table, false unless it is null terminated within the table */
+bool tableString(const char *table, uint64_t table_size, uint32_t offset, std::string &s)
+{
+  if (offset >= table_size) return (false);
+  const void *end = memchr(table + offset, '\0', table_size - offset);
+  if (end == NULL) return (false);
+  s.assign(table + offset, (const char *)end);
+  return (true);
+}
+
+/* zero pads the file up to offset, then writes bytes, false on a write error */
+bool writeSection(FILE *fp, const void *data, uint64_t bytes, uint64_t offset, uint64_t &written)
+{
+  const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  while (written < offset)
+  {
+    uint64_t n = std::min(offset - written, (uint64_t)sizeof(padding));
+    if (fwrite(padding, 1, n, fp) != n) return (false);
+    written += n;
+  }
+  if (bytes > 0 && fwrite(data, 1, bytes, fp) != bytes) return (false);
+  written += bytes;
+  return (true);
+}
+
+/* unmaps the file however read() returns */
+class FileMapping
+{
+public:
+  FileMapping() : data_(NULL), size_(0) {}
+  ~FileMapping()
+  {
+    if (data_ != NULL) munmap(data_, size_);
+  }
+  bool map(const std::string &file_name)
+  {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) return (false);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(FileHeader))
+    {
+      close(fd);
+      return (false);
+    }
+    void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return (false);
+    data_ = data;
+    size_ = file_stat.st_size;
+    return (true);
+  }
+  const char *data() const { return ((const char *)data_); }
+  size_t size() const { return (size_); }
+
+private:
+  void *data_;
+  size_t size_;
+};
+}  // end anonymous namespace
+
+int archiveBlockSize(ArchiveBlockType type)
+{
+  switch (type)
+  {
+    case archive_blocks::CameraIntrinsics:
+      return (9);
+    case archive_blocks::CameraExtrinsics:
+    case archive_blocks::TargetPose:
+      return (6);
+    case archive_blocks::PointPosition:
+      return (3);
+  }
+  return (0);
+}
+
+ObservationArchive::ObservationArchive()
+{
+  clear();
+}
+
+void ObservationArchive::clear()
+{
+  reference_frame_.clear();
+  num_scenes_ = 0;
+  cameras_.clear();
+  targets_.clear();
+  blocks_.clear();
+  observations_.clear();
+  memset(&summary_, 0, sizeof(summary_));
+  summary_.solved = false;
+}
+
+bool ObservationArchive::write(const std::string &file_name) const
+{
+  StringTable strings;
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, archive_magic, sizeof(archive_magic));
+  header.version = version;
+  header.byte_order = archive_byte_order;
+  header.num_cameras = cameras_.size();
+  header.num_targets = targets_.size();
+  header.num_blocks = blocks_.size();
+  header.num_observations = observations_.size();
+  header.num_scenes = num_scenes_;
+  header.reference_frame = strings.add(reference_frame_);
+
+  std::vector<CameraRecord> cameras(cameras_.size());
+  for (int i = 0; i < (int)cameras_.size(); i++)
+  {
+    cameras[i].name = strings.add(cameras_[i].name);
+    cameras[i].is_moving = cameras_[i].is_moving;
+    cameras[i].width = cameras_[i].width;
+    cameras[i].height = cameras_[i].height;
+  }
+
+  std::vector<TargetRecord> targets(targets_.size());
+  for (int i = 0; i < (int)targets_.size(); i++)
+  {
+    targets[i].name = strings.add(targets_[i].name);
+    targets[i].target_type = targets_[i].target_type;
+    targets[i].is_moving = targets_[i].is_moving;
+    targets[i].unused = 0;
+  }
+
+  // initial values of every block first, then final values, so each half is contiguous
+  std::vector<BlockRecord> blocks(blocks_.size());
+  std::vector<double> values;
+  for (int i = 0; i < (int)blocks_.size(); i++)
+  {
+    const ArchiveBlock &block = blocks_[i];
+    if ((int)block.initial_values.size() != archiveBlockSize(block.type) ||
+        (!block.final_values.empty() && block.final_values.size() != block.initial_values.size()))
+    {
+      ROS_ERROR("archive block %d has the wrong number of values", i);
+      return (false);
+    }
+    blocks[i].type = block.type;
+    blocks[i].owner = block.owner;
+    blocks[i].scene_id = block.scene_id;
+    blocks[i].point_id = block.point_id;
+    blocks[i].initial_values = values.size();
+    values.insert(values.end(), block.initial_values.begin(), block.initial_values.end());
+  }
+  for (int i = 0; i < (int)blocks_.size(); i++)
+  {
+    if (blocks_[i].final_values.empty())
+    {
+      blocks[i].final_values = no_final_values;
+      continue;
+    }
+    blocks[i].final_values = values.size();
+    values.insert(values.end(), blocks_[i].final_values.begin(), blocks_[i].final_values.end());
+  }
+  header.num_values = values.size();
+
+  std::vector<ObservationRecord> observations(observations_.size());
+  for (int i = 0; i < (int)observations_.size(); i++)
+  {
+    const ArchiveObservation &obs = observations_[i];
+    ObservationRecord &record = observations[i];
+    record.scene_id = obs.scene_id;
+    record.point_id = obs.point_id;
+    record.camera = obs.camera;
+    record.target = obs.target;
+    record.cost_type = strings.add(costType2String(obs.cost_type));
+    record.intrinsics = obs.intrinsics;
+    record.extrinsics = obs.extrinsics;
+    record.target_pose = obs.target_pose;
+    record.point_position = obs.point_position;
+    record.unused = 0;
+    record.image_x = obs.image_x;
+    record.image_y = obs.image_y;
+    record.circle_dia = obs.circle_dia;
+    memcpy(record.intermediate_frame, obs.intermediate_frame.pb_pose, 6 * sizeof(double));
+  }
+
+  SummaryRecord summary;
+  memset(&summary, 0, sizeof(summary));
+  summary.solved = summary_.solved;
+  summary.num_successful_steps = summary_.num_successful_steps;
+  summary.num_unsuccessful_steps = summary_.num_unsuccessful_steps;
+  summary.termination_type = summary_.termination_type;
+  summary.num_parameters = summary_.num_parameters;
+  summary.num_residuals = summary_.num_residuals;
+  summary.initial_cost = summary_.initial_cost;
+  summary.final_cost = summary_.final_cost;
+  summary.total_time_in_seconds = summary_.total_time_in_seconds;
+  header.string_table_size = strings.data_.size();
+
+  // lay out the sections
+  uint64_t offset = align8(sizeof(FileHeader));
+  header.cameras_offset = offset;
+  offset = align8(offset + cameras.size() * sizeof(CameraRecord));
+  header.targets_offset = offset;
+  offset = align8(offset + targets.size() * sizeof(TargetRecord));
+  header.blocks_offset = offset;
+  offset = align8(offset + blocks.size() * sizeof(BlockRecord));
+  header.observations_offset = offset;
+  offset = align8(offset + observations.size() * sizeof(ObservationRecord));
+  header.summary_offset = offset;
+  offset = align8(offset + sizeof(SummaryRecord));
+  header.values_offset = offset;
+  offset = align8(offset + values.size() * sizeof(double));
+  header.strings_offset = offset;
+
+  FILE *fp = fopen(file_name.c_str(), "wb");
+  if (fp == NULL)
+  {
+    ROS_ERROR("Could not open %s", file_name.c_str());
+    return (false);
+  }
+  uint64_t written = 0;
+  bool ok = writeSection(fp, &header, sizeof(header), 0, written) &&
+            writeSection(fp, cameras.empty() ? NULL : &cameras[0], cameras.size() * sizeof(CameraRecord),
+                         header.cameras_offset, written) &&
+            writeSection(fp, targets.empty() ? NULL : &targets[0], targets.size() * sizeof(TargetRecord),
+                         header.targets_offset, written) &&
+            writeSection(fp, blocks.empty() ? NULL : &blocks[0], blocks.size() * sizeof(BlockRecord),
+                         header.blocks_offset, written) &&
+            writeSection(fp, observations.empty() ? NULL : &observations[0],
+                         observations.size() * sizeof(ObservationRecord), header.observations_offset, written) &&
+            writeSection(fp, &summary, sizeof(summary), header.summary_offset, written) &&
+            writeSection(fp, values.empty() ? NULL : &values[0], values.size() * sizeof(double), header.values_offset,
+                         written) &&
+            writeSection(fp, strings.data_.empty() ? NULL : &strings.data_[0], strings.data_.size(),
+                         header.strings_offset, written);
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) ROS_ERROR("Could not write %s", file_name.c_str());
+  return (ok);
+}
+
+bool ObservationArchive::read(const std::string &file_name)
+{
+  clear();
+  FileMapping mapping;
+  if (!mapping.map(file_name))
+  {
+    ROS_ERROR("Could not map %s", file_name.c_str());
+    return (false);
+  }
+  const char *data = mapping.data();
+  uint64_t size = mapping.size();
+  const FileHeader &header = *(const FileHeader *)data;
+  if (memcmp(header.magic, archive_magic, sizeof(archive_magic)) != 0)
+  {
+    ROS_ERROR("%s is not an observation archive", file_name.c_str());
+    return (false);
+  }
+  if (header.byte_order != archive_byte_order)
+  {
+    ROS_ERROR("%s was written on a machine of the other byte order", file_name.c_str());
+    return (false);
+  }
+  if (header.version != version)
+  {
+    ROS_ERROR("%s is archive version %u, can only read version %u", file_name.c_str(), header.version, version);
+    return (false);
+  }
+  if (!validSection(header.cameras_offset, header.num_cameras, sizeof(CameraRecord), size) ||
+      !validSection(header.targets_offset, header.num_targets, sizeof(TargetRecord), size) ||
+      !validSection(header.blocks_offset, header.num_blocks, sizeof(BlockRecord), size) ||
+      !validSection(header.observations_offset, header.num_observations, sizeof(ObservationRecord), size) ||
+      !validSection(header.summary_offset, 1, sizeof(SummaryRecord), size) ||
+      !validSection(header.values_offset, header.num_values, sizeof(double), size) ||
+      !validSection(header.strings_offset, header.string_table_size, 1, size))
+  {
+    ROS_ERROR("%s is truncated or corrupt", file_name.c_str());
+    return (false);
+  }
+  const CameraRecord *cameras = (const CameraRecord *)(data + header.cameras_offset);
+  const TargetRecord *targets = (const TargetRecord *)(data + header.targets_offset);
+  const BlockRecord *blocks = (const BlockRecord *)(data + header.blocks_offset);
+  const ObservationRecord *observations = (const ObservationRecord *)(data + header.observations_offset);
+  const SummaryRecord &summary = *(const SummaryRecord *)(data + header.summary_offset);
+  const double *values = (const double *)(data + header.values_offset);
+  const char *strings = data + header.strings_offset;
+  uint64_t strings_size = header.string_table_size;
+
+  bool ok = tableString(strings, strings_size, header.reference_frame, reference_frame_);
+  num_scenes_ = header.num_scenes;
+
+  cameras_.resize(header.num_cameras);
+  for (int i = 0; ok && i < (int)header.num_cameras; i++)
+  {
+    ok = tableString(strings, strings_size, cameras[i].name, cameras_[i].name);
+    cameras_[i].is_moving = cameras[i].is_moving != 0;
+    cameras_[i].width = cameras[i].width;
+    cameras_[i].height = cameras[i].height;
+  }
+
+  targets_.resize(header.num_targets);
+  for (int i = 0; ok && i < (int)header.num_targets; i++)
+  {
+    ok = tableString(strings, strings_size, targets[i].name, targets_[i].name);
+    targets_[i].target_type = targets[i].target_type;
+    targets_[i].is_moving = targets[i].is_moving != 0;
+  }
+
+  blocks_.resize(header.num_blocks);
+  for (int i = 0; ok && i < (int)header.num_blocks; i++)
+  {
+    const BlockRecord &record = blocks[i];
+    ArchiveBlock &block = blocks_[i];
+    block.type = (ArchiveBlockType)record.type;
+    uint64_t n = archiveBlockSize(block.type);
+    bool is_camera_block = (block.type == archive_blocks::CameraIntrinsics ||
+                            block.type == archive_blocks::CameraExtrinsics);
+    uint64_t num_owners = is_camera_block ? header.num_cameras : header.num_targets;
+    ok = n > 0 && record.owner >= 0 && (uint64_t)record.owner < num_owners && record.initial_values < header.num_values &&
+         n <= header.num_values - record.initial_values;
+    if (ok && record.final_values != no_final_values)
+    {
+      ok = record.final_values < header.num_values && n <= header.num_values - record.final_values;
+    }
+    if (!ok) break;
+    block.owner = record.owner;
+    block.scene_id = record.scene_id;
+    block.point_id = record.point_id;
+    block.initial_values.assign(values + record.initial_values, values + record.initial_values + n);
+    block.final_values.clear();
+    if (record.final_values != no_final_values)
+    {
+      block.final_values.assign(values + record.final_values, values + record.final_values + n);
+    }
+  }
+
+  observations_.resize(header.num_observations);
+  for (int i = 0; ok && i < (int)header.num_observations; i++)
+  {
+    const ObservationRecord &record = observations[i];
+    ArchiveObservation &obs = observations_[i];
+    std::string cost_type_string;
+    ok = tableString(strings, strings_size, record.cost_type, cost_type_string);
+    int block_ids[4] = { record.intrinsics, record.extrinsics, record.target_pose, record.point_position };
+    for (int j = 0; ok && j < 4; j++)
+    {
+      ok = block_ids[j] >= -1 && block_ids[j] < (int)header.num_blocks;
+    }
+    ok = ok && record.camera >= 0 && record.camera < (int)header.num_cameras && record.target >= 0 &&
+         record.target < (int)header.num_targets;
+    if (!ok) break;
+    obs.scene_id = record.scene_id;
+    obs.point_id = record.point_id;
+    obs.camera = record.camera;
+    obs.target = record.target;
+    obs.cost_type = string2CostType(cost_type_string);
+    obs.intrinsics = record.intrinsics;
+    obs.extrinsics = record.extrinsics;
+    obs.target_pose = record.target_pose;
+    obs.point_position = record.point_position;
+    obs.image_x = record.image_x;
+    obs.image_y = record.image_y;
+    obs.circle_dia = record.circle_dia;
+    memcpy(obs.intermediate_frame.pb_pose, record.intermediate_frame, 6 * sizeof(double));
+  }
+
+  summary_.solved = summary.solved != 0;
+  summary_.num_successful_steps = summary.num_successful_steps;
+  summary_.num_unsuccessful_steps = summary.num_unsuccessful_steps;
+  summary_.termination_type = summary.termination_type;
+  summary_.num_parameters = summary.num_parameters;
+  summary_.num_residuals = summary.num_residuals;
+  summary_.initial_cost = summary.initial_cost;
+  summary_.final_cost = summary.final_cost;
+  summary_.total_time_in_seconds = summary.total_time_in_seconds;
+
+  if (!ok)
+  {
+    ROS_ERROR("%s has a record referring outside the archive", file_name.c_str());
+    clear();
+    return (false);
+  }
+  return (true);
+}
+
+}  // end namespace industrial_extrinsic_cal
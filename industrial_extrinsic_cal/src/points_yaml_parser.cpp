@@ -7,6 +7,7 @@
 #include <ros/ros.h>
 #include <yaml-cpp/yaml.h>
 #include <industrial_extrinsic_cal/points_yaml_parser.h>
+#include <industrial_extrinsic_cal/target_points.h>
 
 using std::ifstream;
 using std::string;
@@ -17,8 +18,15 @@ namespace industrial_extrinsic_cal {
 
   bool parsePoints(std::string &points_input_file,vector<Point3d> &points)
   {
-    // parse points
+    // a points file is read directly, a yaml file may list the points or refer to a points file or grid
     bool return_value = true;
+    size_t dot = points_input_file.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : points_input_file.substr(dot);
+    if(extension != ".yaml" && extension != ".yml"){
+      return_value = readPointsFile(points_input_file, points);
+      ROS_INFO_STREAM("Successfully read in " <<(int) points.size() << " points");
+      return(return_value);
+    }
     try
       {
 	YAML::Node points_doc;
@@ -26,19 +34,11 @@ namespace industrial_extrinsic_cal {
 	  ROS_ERROR("Can't parse yaml file %s", points_input_file.c_str());
 	}
 	// read in all points
-	points.clear();
-	const YAML::Node& points_node = parseNode(points_doc, "points");
-	for (int j = 0; j < points_node.size(); j++){
-	  vector<double> temp_pnt;
-	  parseVectorD(points_node[j], "pnt", temp_pnt);
-	  Point3d temp_pnt3d;
-	  temp_pnt3d.x = temp_pnt[0];
-	  temp_pnt3d.y = temp_pnt[1];
-	  temp_pnt3d.z = temp_pnt[2];
-	  points.push_back(temp_pnt3d);
+	if(!parsePointSource(points_doc, fileDirectory(points_input_file), points)){
+	  return_value = false;
 	}
       }
-    catch (YAML::ParserException& e){
+    catch (YAML::Exception& e){
       ROS_INFO_STREAM("Failed to read points file ");
       return_value = false;
     }
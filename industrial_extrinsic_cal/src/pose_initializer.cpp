@@ -0,0 +1,216 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <industrial_extrinsic_cal/pose_initializer.h>
+
+#include <cmath>
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+namespace industrial_extrinsic_cal
+{
+
+namespace
+{
+/** relative size of the smallest principal axis below which a point set is treated as planar */
+const double PLANARITY_TOLERANCE = 1.0e-6;
+
+/** @brief a point as a 3x1 column */
+cv::Mat toColumn(const Point3d& point)
+{
+  return (cv::Mat_<double>(3, 1) << point.x, point.y, point.z);
+}
+
+/** @brief pose of coplanar points from the homography of their plane onto the normalized image plane
+ *  @param points the points, centered on their centroid and expressed in a frame whose z axis is the plane normal
+ *  @param normalized the observations with the intrinsics removed
+ *  @param R rotation of the plane frame into the camera frame
+ *  @param t translation of the plane frame into the camera frame
+ */
+bool planarPose(const std::vector<cv::Point2d>& points, const std::vector<cv::Point2d>& normalized, cv::Mat& R,
+                cv::Mat& t)
+{
+  int n = (int)points.size();
+
+  // scale the plane coordinates to an average distance of sqrt(2) from the centroid to condition the linear system
+  double mean_distance = 0.0;
+  for (int i = 0; i < n; i++)
+  {
+    mean_distance += sqrt(points[i].x * points[i].x + points[i].y * points[i].y);
+  }
+  if (mean_distance <= 0.0)
+  {
+    return false;
+  }
+  double scale = sqrt(2.0) * n / mean_distance;
+
+  // direct linear transform, h is the null vector of A
+  cv::Mat A = cv::Mat::zeros(2 * n, 9, CV_64F);
+  for (int i = 0; i < n; i++)
+  {
+    double a = points[i].x * scale;
+    double b = points[i].y * scale;
+    double u = normalized[i].x;
+    double v = normalized[i].y;
+    double* row = A.ptr<double>(2 * i);
+    row[0] = a;  row[1] = b;  row[2] = 1.0;
+    row[6] = -u * a;  row[7] = -u * b;  row[8] = -u;
+    row = A.ptr<double>(2 * i + 1);
+    row[3] = a;  row[4] = b;  row[5] = 1.0;
+    row[6] = -v * a;  row[7] = -v * b;  row[8] = -v;
+  }
+  cv::Mat w, u, vt;
+  cv::SVD::compute(A, w, u, vt, cv::SVD::FULL_UV);
+  cv::Mat H = vt.row(8).reshape(1, 3).clone();
+  cv::Mat h0 = H.col(0);
+  cv::Mat h1 = H.col(1);
+  h0 *= scale;
+  h1 *= scale;
+
+  // H = lambda [r1 r2 t], with the sign of lambda putting the points in front of the camera
+  double norm = cv::norm(H.col(0)) + cv::norm(H.col(1));
+  if (norm <= 0.0)
+  {
+    return false;
+  }
+  double lambda = 2.0 / norm;
+  if (H.at<double>(2, 2) < 0.0)
+  {
+    lambda = -lambda;
+  }
+  cv::Mat r1 = lambda * H.col(0);
+  cv::Mat r2 = lambda * H.col(1);
+  cv::Mat M(3, 3, CV_64F);
+  r1.copyTo(M.col(0));
+  r2.copyTo(M.col(1));
+  cv::Mat r3 = r1.cross(r2);
+  r3.copyTo(M.col(2));
+
+  // closest rotation to the noisy estimate
+  cv::SVD::compute(M, w, u, vt);
+  R = u * vt;
+  t = lambda * H.col(2);
+  return true;
+}
+} // end anonymous namespace
+
+bool initialPoseFromObservations(const std::vector<Point3d>& points, const std::vector<double>& image_x,
+                                 const std::vector<double>& image_y, double fx, double fy, double cx, double cy,
+                                 Pose6d& pose)
+{
+  int n = (int)points.size();
+  if (n < 4 || (int)image_x.size() != n || (int)image_y.size() != n || fx == 0.0 || fy == 0.0)
+  {
+    return false;
+  }
+
+  std::vector<cv::Point2d> normalized(n);
+  cv::Mat centroid = cv::Mat::zeros(3, 1, CV_64F);
+  for (int i = 0; i < n; i++)
+  {
+    normalized[i] = cv::Point2d((image_x[i] - cx) / fx, (image_y[i] - cy) / fy);
+    centroid += toColumn(points[i]);
+  }
+  centroid /= n;
+
+  // principal axes of the points, the last one is the normal when they are coplanar
+  cv::Mat scatter = cv::Mat::zeros(3, 3, CV_64F);
+  for (int i = 0; i < n; i++)
+  {
+    cv::Mat d = toColumn(points[i]) - centroid;
+    scatter += d * d.t();
+  }
+  cv::Mat w, u, vt;
+  cv::SVD::compute(scatter, w, u, vt);
+
+  cv::Mat R, t;
+  if (w.at<double>(2) <= PLANARITY_TOLERANCE * w.at<double>(0))
+  {
+    // rows of B are the plane frame's axes, made right handed
+    cv::Mat B(3, 3, CV_64F);
+    cv::Mat e0 = u.col(0).t();
+    cv::Mat e1 = u.col(1).t();
+    e0.copyTo(B.row(0));
+    e1.copyTo(B.row(1));
+    cv::Mat e2 = e0.cross(e1);
+    e2.copyTo(B.row(2));
+
+    std::vector<cv::Point2d> plane_points(n);
+    for (int i = 0; i < n; i++)
+    {
+      cv::Mat d = B * (toColumn(points[i]) - centroid);
+      plane_points[i] = cv::Point2d(d.at<double>(0), d.at<double>(1));
+    }
+    cv::Mat plane_R, plane_t;
+    if (!planarPose(plane_points, normalized, plane_R, plane_t))
+    {
+      return false;
+    }
+    R = plane_R * B;
+    t = plane_t - R * centroid;
+  }
+  else
+  {
+    std::vector<cv::Point3f> object_points(n);
+    std::vector<cv::Point2f> image_points(n);
+    for (int i = 0; i < n; i++)
+    {
+      object_points[i] = cv::Point3f(points[i].x, points[i].y, points[i].z);
+      image_points[i] = cv::Point2f(normalized[i].x, normalized[i].y);
+    }
+    cv::Mat rvec, tvec;
+    if (!cv::solvePnP(object_points, image_points, cv::Mat::eye(3, 3, CV_64F), cv::Mat(), rvec, tvec, false, CV_EPNP))
+    {
+      return false;
+    }
+    cv::Rodrigues(rvec, R);
+    tvec.convertTo(t, CV_64F);
+  }
+
+  cv::Mat rvec;
+  cv::Rodrigues(R, rvec);
+  if (!cv::checkRange(rvec) || !cv::checkRange(t))
+  {
+    return false;
+  }
+  pose.setAngleAxis(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2));
+  pose.setOrigin(t.at<double>(0), t.at<double>(1), t.at<double>(2));
+  return true;
+}
+
+bool initialTargetPose(const Target& target, const CameraObservations& observations, double fx, double fy, double cx,
+                       double cy, Pose6d& pose)
+{
+  std::vector<Point3d> points;
+  std::vector<double> image_x, image_y;
+  for (int i = 0; i < (int)observations.size(); i++)
+  {
+    int id = observations[i].point_id;
+    if (id < 0 || id >= (int)target.pts_.size())
+    {
+      continue;
+    }
+    points.push_back(target.pts_[id]);
+    image_x.push_back(observations[i].image_loc_x);
+    image_y.push_back(observations[i].image_loc_y);
+  }
+  return initialPoseFromObservations(points, image_x, image_y, fx, fy, cx, cy, pose);
+}
+
+} // end namespace industrial_extrinsic_cal
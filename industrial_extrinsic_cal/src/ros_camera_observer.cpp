@@ -654,45 +654,49 @@ void ROSCameraObserver::triggerCamera()
     bool done=false;
     while(!done){
       sensor_msgs::ImageConstPtr recent_image = ros::topic::waitForMessage<sensor_msgs::Image>(image_topic_);
-      
       ROS_DEBUG("captured image in trigger");
-      try
-      {
-        if(recent_image->encoding == "mono16"){  // asus and kinect ir images are mono16, bridge mishandles conversion to mono8
-          input_bridge_ = cv_bridge::toCvCopy(recent_image, "mono16");
-          input_bridge_->image.convertTo(input_bridge_->image, CV_8UC1, 1.0, 0.0);
-        }
-        else{
-          input_bridge_ = cv_bridge::toCvCopy(recent_image, "mono8");
-        }
-        output_bridge_ = cv_bridge::toCvCopy(recent_image, "bgr8");
-        last_raw_image_ = output_bridge_->image.clone();
-        out_bridge_ = cv_bridge::toCvCopy(recent_image, "mono8");
-        new_image_collected_ = true;
-        ROS_DEBUG("cv image created based on ros image");
-        done = true;
-        ROS_DEBUG("height = %d width=%d step=%d encoding=%s", 
-                  recent_image->height, 
-                  recent_image->width, 
-                  recent_image->step,  
-                  recent_image->encoding.c_str());
-        
-      }
-      catch (cv_bridge::Exception& ex)
-      {
-        ROS_ERROR("Failed to convert image");
-	  ROS_ERROR("height = %d width=%d step=%d encoding=%s", 
-		    recent_image->height, 
-		    recent_image->width, 
-		    recent_image->step,  
-		    recent_image->encoding.c_str());
-	  ROS_WARN_STREAM("cv_bridge exception: "<<ex.what());
-	}
+      done = setImage(recent_image);
     }
   }
   image_number_++;
 }
 
+bool ROSCameraObserver::setImage(const sensor_msgs::ImageConstPtr &recent_image)
+{
+  try
+  {
+    if(recent_image->encoding == "mono16"){  // asus and kinect ir images are mono16, bridge mishandles conversion to mono8
+      input_bridge_ = cv_bridge::toCvCopy(recent_image, "mono16");
+      input_bridge_->image.convertTo(input_bridge_->image, CV_8UC1, 1.0, 0.0);
+    }
+    else{
+      input_bridge_ = cv_bridge::toCvCopy(recent_image, "mono8");
+    }
+    output_bridge_ = cv_bridge::toCvCopy(recent_image, "bgr8");
+    last_raw_image_ = output_bridge_->image.clone();
+    out_bridge_ = cv_bridge::toCvCopy(recent_image, "mono8");
+    new_image_collected_ = true;
+    ROS_DEBUG("cv image created based on ros image");
+    ROS_DEBUG("height = %d width=%d step=%d encoding=%s", 
+              recent_image->height, 
+              recent_image->width, 
+              recent_image->step,  
+              recent_image->encoding.c_str());
+    return true;
+  }
+  catch (cv_bridge::Exception& ex)
+  {
+    ROS_ERROR("Failed to convert image");
+    ROS_ERROR("height = %d width=%d step=%d encoding=%s", 
+              recent_image->height, 
+              recent_image->width, 
+              recent_image->step,  
+              recent_image->encoding.c_str());
+    ROS_WARN_STREAM("cv_bridge exception: "<<ex.what());
+    return false;
+  }
+}
+
 bool ROSCameraObserver::observationsDone()
 {
   if(!new_image_collected_)
@@ -19,16 +19,125 @@
 #include <industrial_extrinsic_cal/ros_transform_interface.h>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <tf2_msgs/TFMessage.h>
 namespace industrial_extrinsic_cal
 {
-  /*! @brief uses tf listener to get a Pose6d. The pose returned transform points in the to_frame into the from_frame.
-   *   @param from_frame the starting frame
-   *   @param to_frame  the ending frame
-   *   @param tf_listener  the listener object, so we don't have to keep creating it
-   */
-  Pose6d getPoseFromTF(const std::string &from_frame, const std::string &to_frame, const tf::TransformListener &tf_listener)
+  namespace
   {
+    boost::mutex tf_mutex; /* guards the shared listener's creation */
+    boost::shared_ptr<tf::TransformListener> shared_tf_listener;
+
+    /* poses resolved by the TFBatch objects in scope on this thread, so concurrent jobs each see their own stamp */
+    boost::thread_specific_ptr<std::map<TFFramePair, Pose6d> > tf_batch_cache_ptr;
+    std::map<TFFramePair, Pose6d> & tfBatchCache()
+    {
+      if(tf_batch_cache_ptr.get() == NULL) tf_batch_cache_ptr.reset(new std::map<TFFramePair, Pose6d>());
+      return(*tf_batch_cache_ptr);
+    }
+
+    boost::mutex static_tf_mutex; /* guards the static transform publisher and what it has sent */
+    boost::shared_ptr<ros::Publisher> static_tf_pub;
+    std::map<TFFramePair, geometry_msgs::TransformStamped> static_transforms; /* latest transform of each (parent, child) */
+
+    boost::mutex joint_mutex; /* guards the joint cache, and serializes calls to the mutable joint state publisher */
+    std::map<std::string, double> joint_cache; /* every mutable joint, as of the last call plus our own writes */
+    const char *batch_joint_service = "batch_mutable_joint_states";
+
+    /* the MutableJointBatch state of one thread, a batch on one thread neither holds back nor sends another's values */
+    struct JointBatchState
+    {
+      JointBatchState() : depth(0), cache_valid(false) {}
+      int depth; /* MutableJointBatch objects in scope */
+      bool cache_valid; /* the cache was refreshed since the outermost batch opened */
+      std::map<std::string, double> pending_joints; /* written inside a batch but not yet sent */
+    };
+    boost::thread_specific_ptr<JointBatchState> joint_batch_state_ptr;
+    JointBatchState & jointBatchState()
+    {
+      if(joint_batch_state_ptr.get() == NULL) joint_batch_state_ptr.reset(new JointBatchState());
+      return(*joint_batch_state_ptr);
+    }
+
+    /* sends this thread's pending joints and refreshes the whole cache in one call, joint_mutex must be held */
+    bool syncMutableJoints()
+    {
+      std::map<std::string, double> &pending_joints = jointBatchState().pending_joints;
+      industrial_extrinsic_cal::batch_mutable_joint_states srv;
+      for(std::map<std::string, double>::iterator it=pending_joints.begin(); it!=pending_joints.end(); ++it){
+	srv.request.joint_names.push_back(it->first);
+	srv.request.joint_values.push_back(it->second);
+      }
+      if(!ros::service::call(batch_joint_service, srv)){
+	ROS_ERROR("could not call %s", batch_joint_service);
+	return(false);
+      }
+      pending_joints.clear();
+      joint_cache.clear();
+      for(int i=0; i<(int)srv.response.joint_names.size() && i<(int)srv.response.joint_values.size(); i++){
+	joint_cache[srv.response.joint_names[i]] = srv.response.joint_values[i];
+      }
+      jointBatchState().cache_valid = true;
+      return(true);
+    }
+
+    /* the joints of the calibration xacro macro for frame, in the order x, y, z, yaw, pitch, roll */
+    std::vector<std::string> calibrationJointNames(const std::string &frame)
+    {
+      std::vector<std::string> joint_names;
+      joint_names.push_back(frame+"_x_joint");
+      joint_names.push_back(frame+"_y_joint");
+      joint_names.push_back(frame+"_z_joint");
+      joint_names.push_back(frame+"_yaw_joint");
+      joint_names.push_back(frame+"_pitch_joint");
+      joint_names.push_back(frame+"_roll_joint");
+      return(joint_names);
+    }
+
+    /* the joint values of pose, in the order of calibrationJointNames() */
+    std::vector<double> calibrationJointValues(Pose6d &pose)
+    {
+      double ez,ey,ex;
+      pose.getEulerZYX(ez,ey,ex);
+      std::vector<double> joint_values;
+      joint_values.push_back(pose.x);
+      joint_values.push_back(pose.y);
+      joint_values.push_back(pose.z);
+      joint_values.push_back(ez);
+      joint_values.push_back(ey);
+      joint_values.push_back(ex);
+      return(joint_values);
+    }
+
+    Pose6d poseFromStampedTransform(const tf::StampedTransform &tf_transform)
+    {
+      Pose6d pose;
+      pose.setBasis(tf_transform.getBasis());
+      pose.setOrigin(tf_transform.getOrigin());
+      return(pose);
+    }
+  }
+
+  tf::TransformListener & sharedTFListener()
+  {
+    boost::mutex::scoped_lock lock(tf_mutex);
+    if(!shared_tf_listener){
+      shared_tf_listener = boost::make_shared<tf::TransformListener>();
+    }
+    return(*shared_tf_listener);
+  }
+
+  Pose6d getPoseFromTF(const std::string &from_frame, const std::string &to_frame)
+  {
+    std::map<TFFramePair, Pose6d> &tf_batch_cache = tfBatchCache();
+    std::map<TFFramePair, Pose6d>::iterator cached = tf_batch_cache.find(TFFramePair(from_frame, to_frame));
+    if(cached != tf_batch_cache.end()) return(cached->second);
+
     // get all the information from tf and from the mutable joint state publisher
+    tf::TransformListener &tf_listener = sharedTFListener();
     tf::StampedTransform tf_transform; 
     ros::Time now = ros::Time::now();
     while(!tf_listener.waitForTransform(from_frame, to_frame, now, ros::Duration(1.0))){
@@ -41,10 +150,169 @@ namespace industrial_extrinsic_cal
     catch (tf::TransformException &ex) {
       ROS_ERROR("%s",ex.what());
     }
-    Pose6d pose;
-    pose.setBasis(tf_transform.getBasis());
-    pose.setOrigin(tf_transform.getOrigin());
-    return(pose);
+    return(poseFromStampedTransform(tf_transform));
+  }
+
+  void sendStaticTransform(const tf::StampedTransform &transform)
+  {
+    boost::mutex::scoped_lock lock(static_tf_mutex);
+    if(!static_tf_pub){
+      ros::NodeHandle nh;
+      static_tf_pub = boost::make_shared<ros::Publisher>(nh.advertise<tf2_msgs::TFMessage>("/tf_static", 100, true));
+    }
+    geometry_msgs::TransformStamped msg;
+    tf::transformStampedTFToMsg(transform, msg);
+    static_transforms[TFFramePair(transform.frame_id_, transform.child_frame_id_)] = msg;
+
+    // a latched topic only keeps the last message, so it must carry every static transform of the process
+    tf2_msgs::TFMessage tf_message;
+    for(std::map<TFFramePair, geometry_msgs::TransformStamped>::iterator it=static_transforms.begin();
+	it != static_transforms.end(); ++it){
+      tf_message.transforms.push_back(it->second);
+    }
+    static_tf_pub->publish(tf_message);
+  }
+
+  TFBatch::TFBatch(const std::vector<TFFramePair> &frame_pairs, double timeout)
+  {
+    // only resolve the pairs no enclosing batch holds
+    std::map<TFFramePair, Pose6d> &tf_batch_cache = tfBatchCache();
+    std::vector<TFFramePair> needed;
+    for(int i=0; i<(int)frame_pairs.size(); i++){
+      if(tf_batch_cache.count(frame_pairs[i]) == 0 &&
+	 std::find(needed.begin(), needed.end(), frame_pairs[i]) == needed.end()){
+	needed.push_back(frame_pairs[i]);
+      }
+    }
+    if(needed.empty()) return;
+
+    // wait for all of them at one stamp, the wait for the first pair usually covers the rest
+    tf::TransformListener &tf_listener = sharedTFListener();
+    ros::Time stamp;
+    bool all_available = false;
+    while(!all_available && ros::ok()){
+      stamp = ros::Time::now();
+      ros::Time deadline = stamp + ros::Duration(timeout);
+      all_available = true;
+      for(int i=0; i<(int)needed.size() && all_available; i++){
+	ros::Duration remaining = deadline - ros::Time::now();
+	if(remaining > ros::Duration(0.0)){
+	  all_available = tf_listener.waitForTransform(needed[i].first, needed[i].second, stamp, remaining);
+	}
+	else{
+	  all_available = tf_listener.canTransform(needed[i].first, needed[i].second, stamp);
+	}
+	if(!all_available){
+	  ROS_INFO("waiting for tranform from %s to %s",needed[i].first.c_str(),needed[i].second.c_str());
+	}
+      }
+    }
+
+    std::vector<Pose6d> poses(needed.size());
+    for(int i=0; i<(int)needed.size(); i++){
+      tf::StampedTransform tf_transform;
+      try{
+	tf_listener.lookupTransform(needed[i].first, needed[i].second, stamp, tf_transform);
+      }
+      catch (tf::TransformException &ex) {
+	ROS_ERROR("%s",ex.what());
+      }
+      poses[i] = poseFromStampedTransform(tf_transform);
+    }
+    for(int i=0; i<(int)needed.size(); i++){
+      tf_batch_cache[needed[i]] = poses[i];
+      resolved_.push_back(needed[i]);
+    }
+  }
+
+  TFBatch::~TFBatch()
+  {
+    std::map<TFFramePair, Pose6d> &tf_batch_cache = tfBatchCache();
+    for(int i=0; i<(int)resolved_.size(); i++){
+      tf_batch_cache.erase(resolved_[i]);
+    }
+  }
+
+  bool waitForMutableJointStates(double timeout)
+  {
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(timeout >= 0.0 ? timeout : 0.0);
+    while(ros::ok()){
+      if(ros::service::waitForService(batch_joint_service, ros::Duration(1.0))) return(true);
+      if(timeout >= 0.0 && ros::WallTime::now() >= deadline) break;
+      ROS_INFO("Waiting for mutable joint state publisher to come up");
+    }
+    return(false);
+  }
+
+  bool getMutableJointValues(const std::vector<std::string> &joint_names, std::vector<double> &joint_values)
+  {
+    boost::mutex::scoped_lock lock(joint_mutex);
+    JointBatchState &batch = jointBatchState();
+    if(batch.depth == 0 || !batch.cache_valid){
+      if(!syncMutableJoints()) return(false);
+    }
+    std::vector<double> values;
+    for(int i=0; i<(int)joint_names.size(); i++){
+      // this thread's unsent values, another thread's refresh of the cache does not hold them
+      std::map<std::string, double>::iterator it = batch.pending_joints.find(joint_names[i]);
+      if(it != batch.pending_joints.end()){
+	values.push_back(it->second);
+	continue;
+      }
+      it = joint_cache.find(joint_names[i]);
+      if(it == joint_cache.end()){
+	ROS_ERROR("mutable joint state publisher does not have joint named %s", joint_names[i].c_str());
+	return(false);
+      }
+      values.push_back(it->second);
+    }
+    joint_values = values;
+    return(true);
+  }
+
+  bool setMutableJointValues(const std::vector<std::string> &joint_names, const std::vector<double> &joint_values)
+  {
+    boost::mutex::scoped_lock lock(joint_mutex);
+    JointBatchState &batch = jointBatchState();
+    for(int i=0; i<(int)joint_names.size() && i<(int)joint_values.size(); i++){
+      joint_cache[joint_names[i]] = joint_values[i];
+      batch.pending_joints[joint_names[i]] = joint_values[i];
+    }
+    if(batch.depth == 0) return(syncMutableJoints());
+    return(true);
+  }
+
+  bool flushMutableJoints()
+  {
+    boost::mutex::scoped_lock lock(joint_mutex);
+    if(jointBatchState().pending_joints.empty()) return(true);
+    return(syncMutableJoints());
+  }
+
+  MutableJointBatch::MutableJointBatch()
+  {
+    boost::mutex::scoped_lock lock(joint_mutex);
+    JointBatchState &batch = jointBatchState();
+    if(batch.depth++ == 0) batch.cache_valid = false; // refreshed by the first pull, so a batch without one costs nothing
+  }
+
+  bool MutableJointBatch::commit()
+  {
+    boost::mutex::scoped_lock lock(joint_mutex);
+    JointBatchState &batch = jointBatchState();
+    if(batch.depth > 1 || batch.pending_joints.empty()) return(true);
+    return(syncMutableJoints());
+  }
+
+  MutableJointBatch::~MutableJointBatch()
+  {
+    boost::mutex::scoped_lock lock(joint_mutex);
+    JointBatchState &batch = jointBatchState();
+    if(--batch.depth == 0 && !batch.pending_joints.empty() && !syncMutableJoints()){
+      ROS_ERROR("%d mutable joint values were not sent to the mutable joint state publisher",
+		(int) batch.pending_joints.size());
+      batch.pending_joints.clear();
+    }
   }
 
   using std::string;
@@ -64,11 +332,16 @@ namespace industrial_extrinsic_cal
       return(pose);
     }
     else{
-      pose_ = getPoseFromTF(ref_frame_, transform_frame_, tf_listener_);
+      pose_ = getPoseFromTF(ref_frame_, transform_frame_);
       return(pose_);
     }
   }
 
+  void ROSListenerTransInterface::getTFFramePairs(std::vector<TFFramePair> &frame_pairs)
+  {
+    if(ref_frame_initialized_) frame_pairs.push_back(TFFramePair(ref_frame_, transform_frame_));
+  }
+
   ROSCameraListenerTransInterface::ROSCameraListenerTransInterface(const string & transform_frame) 
   {
     transform_frame_ = transform_frame;
@@ -84,11 +357,16 @@ namespace industrial_extrinsic_cal
       return(pose);
     }
     else{
-      pose_ = getPoseFromTF(transform_frame_, ref_frame_, tf_listener_);
+      pose_ = getPoseFromTF(transform_frame_, ref_frame_);
       return(pose_);
     }
   }
 
+  void ROSCameraListenerTransInterface::getTFFramePairs(std::vector<TFFramePair> &frame_pairs)
+  {
+    if(ref_frame_initialized_) frame_pairs.push_back(TFFramePair(transform_frame_, ref_frame_));
+  }
+
   /** @brief this object is intened to be used for cameras not targets
    *            It simply listens to a pose from camera's optical frame to reference frame, this must be set in a urdf
    *            This is the inverse of the transform from world to camera's optical frame
@@ -110,11 +388,16 @@ namespace industrial_extrinsic_cal
       return(pose);
     }
     else{
-      pose_ = getPoseFromTF(transform_frame_, ref_frame_, tf_listener_);
+      pose_ = getPoseFromTF(transform_frame_, ref_frame_);
       return(pose_);
     }
   }
 
+  void ROSCameraHousingListenerTInterface::getTFFramePairs(std::vector<TFFramePair> &frame_pairs)
+  {
+    if(ref_frame_initialized_) frame_pairs.push_back(TFFramePair(transform_frame_, ref_frame_));
+  }
+
   ROSBroadcastTransInterface::ROSBroadcastTransInterface(const string & transform_frame)
   {
     transform_frame_                = transform_frame;
@@ -126,8 +409,9 @@ namespace industrial_extrinsic_cal
   {
     pose_ = pose; 
     if(!ref_frame_initialized_){ 
-      return(false);		// timer won't start publishing until ref_frame_ is defined
+      return(false);		// nothing is published until ref_frame_ is defined
     }
+    broadcast();
     return(true);
   }
 
@@ -157,19 +441,18 @@ namespace industrial_extrinsic_cal
 
   void  ROSBroadcastTransInterface::setReferenceFrame(string &ref_frame)
   {
-    static ros::NodeHandle nh;
     ref_frame_              = ref_frame;
     ref_frame_initialized_ = true;
-    timer_                     = nh.createTimer(ros::Rate(1.0),&ROSBroadcastTransInterface::timerCallback, this);
+    broadcast();
   }
 
-  void  ROSBroadcastTransInterface::timerCallback(const ros::TimerEvent & timer_event)
-  { // broadcast current value of pose as a transform each time called
+  void  ROSBroadcastTransInterface::broadcast()
+  { // broadcast current value of pose as a static transform
     transform_.setBasis(pose_.getBasis());
     transform_.setOrigin(pose_.getOrigin());
     transform_.child_frame_id_ = transform_frame_;
     transform_.frame_id_ = ref_frame_;
-    tf_broadcaster_.sendTransform(tf::StampedTransform(transform_, ros::Time::now(), ref_frame_, transform_frame_));
+    sendStaticTransform(tf::StampedTransform(transform_, ros::Time::now(), ref_frame_, transform_frame_));
   }
 
   ROSCameraBroadcastTransInterface::ROSCameraBroadcastTransInterface(const string & transform_frame)
@@ -183,8 +466,9 @@ namespace industrial_extrinsic_cal
   {
     pose_ = pose; 
     if(!ref_frame_initialized_){ 
-      return(false);		// timer won't start publishing until ref_frame_ is defined
+      return(false);		// nothing is published until ref_frame_ is defined
     }
+    broadcast();
     return(true);
   }
 
@@ -214,20 +498,19 @@ namespace industrial_extrinsic_cal
 
   void ROSCameraBroadcastTransInterface::setReferenceFrame(string &ref_frame)
   {
-    static ros::NodeHandle nh;
     ref_frame_              = ref_frame;
     ref_frame_initialized_ = true;
-    timer_                     = nh.createTimer(ros::Rate(1.0),&ROSCameraBroadcastTransInterface::timerCallback, this);
+    broadcast();
   }
 
-  void  ROSCameraBroadcastTransInterface::timerCallback(const ros::TimerEvent & timer_event)
-  { // broadcast current value of pose.inverse() as a transform each time called
+  void  ROSCameraBroadcastTransInterface::broadcast()
+  { // broadcast current value of pose.inverse() as a static transform
     transform_.setBasis(pose_.getInverse().getBasis());
     transform_.setOrigin(pose_.getInverse().getOrigin());
     transform_.child_frame_id_ = transform_frame_;
     transform_.frame_id_ = ref_frame_;
     //    ROS_INFO("broadcasting %s in %s",transform_frame_.c_str(),ref_frame_.c_str());
-    tf_broadcaster_.sendTransform(tf::StampedTransform(transform_, ros::Time::now(), transform_frame_, ref_frame_));
+    sendStaticTransform(tf::StampedTransform(transform_, ros::Time::now(), transform_frame_, ref_frame_));
   }
 
   ROSCameraHousingBroadcastTInterface::ROSCameraHousingBroadcastTInterface(const string & transform_frame,
@@ -245,12 +528,13 @@ namespace industrial_extrinsic_cal
   bool   ROSCameraHousingBroadcastTInterface::pushTransform(Pose6d & pose)
   {
     Pose6d mountingMVoptical = pose.getInverse();
-    Pose6d opticalMVhousing = getPoseFromTF(transform_frame_, housing_frame_, tf_listener_);
+    Pose6d opticalMVhousing = getPoseFromTF(transform_frame_, housing_frame_);
     Pose6d mountingMVhousing = mountingMVoptical * opticalMVhousing;
     pose_ = mountingMVhousing;
     if(!ref_frame_initialized_){ 
-      return(false);		// timer won't start publishing until ref_frame_ is defined
+      return(false);		// nothing is published until ref_frame_ is defined
     }
+    broadcast();
     return(true);
   }
 
@@ -285,20 +569,19 @@ namespace industrial_extrinsic_cal
 
   void  ROSCameraHousingBroadcastTInterface::setReferenceFrame(std::string &ref_frame)
   {
-    static ros::NodeHandle nh;
     ref_frame_              = ref_frame;
     ref_frame_initialized_ = true;
-    timer_                     = nh.createTimer(ros::Rate(1.0),&ROSCameraHousingBroadcastTInterface::timerCallback, this);
+    broadcast();
   }
 
-  void  ROSCameraHousingBroadcastTInterface::timerCallback(const ros::TimerEvent & timer_event)
-  { // broadcast current value of pose.inverse() as a transform each time called
+  void  ROSCameraHousingBroadcastTInterface::broadcast()
+  { // broadcast current value of pose as a static transform
 
     Pose6d ref2housing = pose_;
     
     transform_.setBasis(ref2housing.getBasis());
     transform_.setOrigin(ref2housing.getOrigin());
-    tf_broadcaster_.sendTransform(tf::StampedTransform(transform_, ros::Time::now(), ref_frame_, housing_frame_));
+    sendStaticTransform(tf::StampedTransform(transform_, ros::Time::now(), ref_frame_, housing_frame_));
   }
 
   Pose6d ROSCameraHousingBroadcastTInterface::pullTransform()
@@ -309,13 +592,18 @@ namespace industrial_extrinsic_cal
       return(pose);
     }
 
-    Pose6d opticalMVhousing = getPoseFromTF(transform_frame_, housing_frame_, tf_listener_);
+    Pose6d opticalMVhousing = getPoseFromTF(transform_frame_, housing_frame_);
     Pose6d mountingMVhousing = pose_;
     Pose6d housingMVmounting = mountingMVhousing.getInverse();
     Pose6d opticalMVmounting = opticalMVhousing * housingMVmounting;
     return(opticalMVmounting);
   }
 
+  void ROSCameraHousingBroadcastTInterface::getTFFramePairs(std::vector<TFFramePair> &frame_pairs)
+  {
+    if(ref_frame_initialized_) frame_pairs.push_back(TFFramePair(transform_frame_, housing_frame_));
+  }
+
   ROSCameraHousingCalTInterface::ROSCameraHousingCalTInterface(const string &transform_frame, 
 							       const string &housing_frame, 
 							       const string &mounting_frame) 
@@ -326,30 +614,13 @@ namespace industrial_extrinsic_cal
     ref_frame_initialized_         = false;    // still need to initialize ref_frame_
     nh_ = new ros::NodeHandle;
 
-    get_client_    = nh_->serviceClient<industrial_extrinsic_cal::get_mutable_joint_states>("get_mutable_joint_states");
-    set_client_    = nh_->serviceClient<industrial_extrinsic_cal::set_mutable_joint_states>("set_mutable_joint_states");
     store_client_ = nh_->serviceClient<industrial_extrinsic_cal::store_mutable_joint_states>("store_mutable_joint_states");
 
-    get_request_.joint_names.push_back(housing_frame+"_x_joint");
-    get_request_.joint_names.push_back(housing_frame+"_y_joint");
-    get_request_.joint_names.push_back(housing_frame+"_z_joint");
-    get_request_.joint_names.push_back(housing_frame+"_yaw_joint");
-    get_request_.joint_names.push_back(housing_frame+"_pitch_joint");
-    get_request_.joint_names.push_back(housing_frame+"_roll_joint");
-
-    set_request_.joint_names.push_back(housing_frame+"_x_joint");
-    set_request_.joint_names.push_back(housing_frame+"_y_joint");
-    set_request_.joint_names.push_back(housing_frame+"_z_joint");
-    set_request_.joint_names.push_back(housing_frame+"_yaw_joint");
-    set_request_.joint_names.push_back(housing_frame+"_pitch_joint");
-    set_request_.joint_names.push_back(housing_frame+"_roll_joint");
-
-    while(!get_client_.call(get_request_,get_response_)){
-      sleep(1);
-      ROS_INFO("Waiting for mutable joint state publisher to come up");
-    }
-    for(int i=0;i<(int) get_response_.joint_values.size();i++){
-      joint_values_.push_back(get_response_.joint_values[i]);
+    joint_names_ = calibrationJointNames(housing_frame);
+    joint_values_.assign(joint_names_.size(), 0.0);
+    waitForMutableJointStates();
+    if(!getMutableJointValues(joint_names_, joint_values_)){
+      ROS_ERROR("could not get the joint values of %s", housing_frame.c_str());
     }
   }				
 
@@ -361,13 +632,15 @@ namespace industrial_extrinsic_cal
     // there is also an intermediate frame from the mount point to the reference frame which we don't need here
 
     // get all the information from tf and from the mutable joint state publisher
-    Pose6d optical2housing = getPoseFromTF( transform_frame_, housing_frame_, tf_listener_);
+    Pose6d optical2housing = getPoseFromTF( transform_frame_, housing_frame_);
 
-    // get the transform from housing 2 mount  from the client
+    // get the transform from housing 2 mount from the joint cache
     Pose6d mount2housing;
-    get_client_.call(get_request_,get_response_);
-    mount2housing.setOrigin(get_response_.joint_values[0],get_response_.joint_values[1],get_response_.joint_values[2]);
-    mount2housing.setEulerZYX(get_response_.joint_values[3],get_response_.joint_values[4],get_response_.joint_values[5]);
+    if(!getMutableJointValues(joint_names_, joint_values_)){
+      ROS_ERROR("using the last known joint values of %s", housing_frame_.c_str());
+    }
+    mount2housing.setOrigin(joint_values_[0],joint_values_[1],joint_values_[2]);
+    mount2housing.setEulerZYX(joint_values_[3],joint_values_[4],joint_values_[5]);
     Pose6d housing2mount = mount2housing.getInverse();
     Pose6d optical2mount = optical2housing * housing2mount;
     pose_ = optical2mount;
@@ -381,29 +654,20 @@ namespace industrial_extrinsic_cal
     pose_inverse.show("results being pushed");
 
     // get transform from optical frame to housing frame from tf
-    Pose6d optical2housing = getPoseFromTF(transform_frame_, housing_frame_, tf_listener_);
+    Pose6d optical2housing = getPoseFromTF(transform_frame_, housing_frame_);
     
     // compute the desired transform
     Pose6d mount2housing =  pose_inverse * optical2housing;
 
-    // convert to xyz, roll, pitch and yaw for client
-    double ez,ey,ex;
-    mount2housing.getEulerZYX(ez,ey,ex);
-
-    set_request_.joint_values.clear();
-    set_request_.joint_values.push_back(mount2housing.x);
-    set_request_.joint_values.push_back(mount2housing.y);
-    set_request_.joint_values.push_back(mount2housing.z);
-    set_request_.joint_values.push_back(ez);
-    set_request_.joint_values.push_back(ey);
-    set_request_.joint_values.push_back(ex);
-    set_client_.call(set_request_,set_response_);
-    return(true);
+    // convert to xyz, roll, pitch and yaw for the publisher
+    joint_values_ = calibrationJointValues(mount2housing);
+    return(setMutableJointValues(joint_names_, joint_values_));
   }
 
   bool ROSCameraHousingCalTInterface::store(std::string &filePath)
   {
     // NOTE, file_name is not used, but is kept here for consistency with store functions of other transform interfaces
+    if(!flushMutableJoints()) return(false); // the publisher must hold our values before it saves them
     store_client_.call(store_request_, store_response_);
     return(true);
   }
@@ -418,7 +682,7 @@ namespace industrial_extrinsic_cal
   {
     Pose6d pose(0,0,0,0,0,0);
     if(ref_frame_initialized_){
-      pose =  getPoseFromTF(ref_frame_, mounting_frame_, tf_listener_);
+      pose =  getPoseFromTF(ref_frame_, mounting_frame_);
     }
     else{
       ROS_ERROR("ROSCameraHousingCalTInterface requires ref_frame_ initialized before calling getIntermediateFrame()");
@@ -426,6 +690,12 @@ namespace industrial_extrinsic_cal
     return(pose);
   }
 
+  void ROSCameraHousingCalTInterface::getTFFramePairs(std::vector<TFFramePair> &frame_pairs)
+  {
+    frame_pairs.push_back(TFFramePair(transform_frame_, housing_frame_));
+    if(ref_frame_initialized_) frame_pairs.push_back(TFFramePair(ref_frame_, mounting_frame_));
+  }
+
   ROSSimpleCalTInterface::ROSSimpleCalTInterface(const string &transform_frame,  const string &parent_frame)
   {
     transform_frame_               = transform_frame;
@@ -433,33 +703,13 @@ namespace industrial_extrinsic_cal
     ref_frame_initialized_         = false;    // still need to initialize ref_frame_
     nh_ = new ros::NodeHandle;
 
-    get_client_    = nh_->serviceClient<industrial_extrinsic_cal::get_mutable_joint_states>("get_mutable_joint_states");
-    set_client_    = nh_->serviceClient<industrial_extrinsic_cal::set_mutable_joint_states>("set_mutable_joint_states");
     store_client_ = nh_->serviceClient<industrial_extrinsic_cal::store_mutable_joint_states>("store_mutable_joint_states");
 
-    get_request_.joint_names.push_back(transform_frame+"_x_joint");
-    get_request_.joint_names.push_back(transform_frame+"_y_joint");
-    get_request_.joint_names.push_back(transform_frame+"_z_joint");
-    get_request_.joint_names.push_back(transform_frame+"_yaw_joint");
-    get_request_.joint_names.push_back(transform_frame+"_pitch_joint");
-    get_request_.joint_names.push_back(transform_frame+"_roll_joint");
-
-    set_request_.joint_names.push_back(transform_frame+"_x_joint");
-    set_request_.joint_names.push_back(transform_frame+"_y_joint");
-    set_request_.joint_names.push_back(transform_frame+"_z_joint");
-    set_request_.joint_names.push_back(transform_frame+"_yaw_joint");
-    set_request_.joint_names.push_back(transform_frame+"_pitch_joint");
-    set_request_.joint_names.push_back(transform_frame+"_roll_joint");
-
-    if(get_client_.call(get_request_,get_response_)){
-      for(int i=0;i<(int) get_response_.joint_values.size();i++){
-	joint_values_.push_back(get_response_.joint_values[i]);
-      }
-    }
-    else{
-      ROS_ERROR("get_client_ returned false");
+    joint_names_ = calibrationJointNames(transform_frame);
+    joint_values_.assign(joint_names_.size(), 0.0);
+    if(!getMutableJointValues(joint_names_, joint_values_)){
+      ROS_ERROR("could not get the joint values of %s", transform_frame.c_str());
     }
-
   }				
 
   Pose6d  ROSSimpleCalTInterface::pullTransform()
@@ -476,32 +726,24 @@ namespace industrial_extrinsic_cal
       return(pose);
     }
 
-    get_client_.call(get_request_,get_response_);
-    pose_.setOrigin(get_response_.joint_values[0],get_response_.joint_values[1],get_response_.joint_values[2]);
-    pose_.setEulerZYX(get_response_.joint_values[3],get_response_.joint_values[4],get_response_.joint_values[5]);
+    if(!getMutableJointValues(joint_names_, joint_values_)){
+      ROS_ERROR("using the last known joint values of %s", transform_frame_.c_str());
+    }
+    pose_.setOrigin(joint_values_[0],joint_values_[1],joint_values_[2]);
+    pose_.setEulerZYX(joint_values_[3],joint_values_[4],joint_values_[5]);
     return(pose_);
   }
 
   bool  ROSSimpleCalTInterface::pushTransform(Pose6d &pose)
   {
-    double ez,ey,ex;
-    pose.getEulerZYX(ez,ey,ex);
-    
-    set_request_.joint_values.clear();
-    set_request_.joint_values.push_back(pose.x);
-    set_request_.joint_values.push_back(pose.y);
-    set_request_.joint_values.push_back(pose.z);
-    set_request_.joint_values.push_back(ez);
-    set_request_.joint_values.push_back(ey);
-    set_request_.joint_values.push_back(ex);
-    set_client_.call(set_request_,set_response_);
-
-    return(true);
+    joint_values_ = calibrationJointValues(pose);
+    return(setMutableJointValues(joint_names_, joint_values_));
   }
 
   bool ROSSimpleCalTInterface::store(std::string &filePath)
   {
     // NOTE, file_name is not used, but is kept here for consistency with store functions of other transform interfaces
+    if(!flushMutableJoints()) return(false); // the publisher must hold our values before it saves them
     store_client_.call(store_request_, store_response_);
     return(true);
   }
@@ -519,33 +761,13 @@ namespace industrial_extrinsic_cal
     ref_frame_initialized_         = false;    // still need to initialize ref_frame_
     nh_ = new ros::NodeHandle;
 
-    get_client_    = nh_->serviceClient<industrial_extrinsic_cal::get_mutable_joint_states>("get_mutable_joint_states");
-    set_client_    = nh_->serviceClient<industrial_extrinsic_cal::set_mutable_joint_states>("set_mutable_joint_states");
     store_client_ = nh_->serviceClient<industrial_extrinsic_cal::store_mutable_joint_states>("store_mutable_joint_states");
 
-    get_request_.joint_names.push_back(transform_frame+"_x_joint");
-    get_request_.joint_names.push_back(transform_frame+"_y_joint");
-    get_request_.joint_names.push_back(transform_frame+"_z_joint");
-    get_request_.joint_names.push_back(transform_frame+"_yaw_joint");
-    get_request_.joint_names.push_back(transform_frame+"_pitch_joint");
-    get_request_.joint_names.push_back(transform_frame+"_roll_joint");
-
-    set_request_.joint_names.push_back(transform_frame+"_x_joint");
-    set_request_.joint_names.push_back(transform_frame+"_y_joint");
-    set_request_.joint_names.push_back(transform_frame+"_z_joint");
-    set_request_.joint_names.push_back(transform_frame+"_yaw_joint");
-    set_request_.joint_names.push_back(transform_frame+"_pitch_joint");
-    set_request_.joint_names.push_back(transform_frame+"_roll_joint");
-
-    if(get_client_.call(get_request_,get_response_)){
-      for(int i=0;i<(int) get_response_.joint_values.size();i++){
-	joint_values_.push_back(get_response_.joint_values[i]);
-      }
+    joint_names_ = calibrationJointNames(transform_frame);
+    joint_values_.assign(joint_names_.size(), 0.0);
+    if(!getMutableJointValues(joint_names_, joint_values_)){
+      ROS_ERROR("could not get the joint values of %s", transform_frame.c_str());
     }
-    else{
-      ROS_ERROR("get_client_ returned false");
-    }
-
   }				
 
   Pose6d  ROSSimpleCameraCalTInterface::pullTransform()
@@ -562,33 +784,25 @@ namespace industrial_extrinsic_cal
       return(pose);
     }
 
-    get_client_.call(get_request_,get_response_);
-    pose_.setOrigin(get_response_.joint_values[0],get_response_.joint_values[1],get_response_.joint_values[2]);
-    pose_.setEulerZYX(get_response_.joint_values[3],get_response_.joint_values[4],get_response_.joint_values[5]);
+    if(!getMutableJointValues(joint_names_, joint_values_)){
+      ROS_ERROR("using the last known joint values of %s", transform_frame_.c_str());
+    }
+    pose_.setOrigin(joint_values_[0],joint_values_[1],joint_values_[2]);
+    pose_.setEulerZYX(joint_values_[3],joint_values_[4],joint_values_[5]);
     return(pose_.getInverse());
   }
 
   bool  ROSSimpleCameraCalTInterface::pushTransform(Pose6d &pose)
   {
-    double ez,ey,ex;
     Pose6d ipose = pose.getInverse();
-    ipose.getEulerZYX(ez,ey,ex);
-    
-    set_request_.joint_values.clear();
-    set_request_.joint_values.push_back(ipose.x);
-    set_request_.joint_values.push_back(ipose.y);
-    set_request_.joint_values.push_back(ipose.z);
-    set_request_.joint_values.push_back(ez);
-    set_request_.joint_values.push_back(ey);
-    set_request_.joint_values.push_back(ex);
-    set_client_.call(set_request_,set_response_);
-
-    return(true);
+    joint_values_ = calibrationJointValues(ipose);
+    return(setMutableJointValues(joint_names_, joint_values_));
   }
 
   bool ROSSimpleCameraCalTInterface::store(std::string &filePath)
   {
     // NOTE, file_name is not used, but is kept here for consistency with store functions of other transform interfaces
+    if(!flushMutableJoints()) return(false); // the publisher must hold our values before it saves them
     store_client_.call(store_request_, store_response_);
     return(true);
   }
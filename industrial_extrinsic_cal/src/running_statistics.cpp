@@ -0,0 +1,168 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <industrial_extrinsic_cal/running_statistics.h>
+
+#include <algorithm>
+#include <cmath>
+#include <boost/random/uniform_int_distribution.hpp>
+
+namespace industrial_extrinsic_cal
+{
+
+RunningStatistics::RunningStatistics(int dimension, int reservoir_size, unsigned int seed) :
+  dimension_(dimension), count_(0), mean_(dimension, 0.0), comoment_(dimension * dimension, 0.0),
+  reservoir_size_(reservoir_size), rng_(seed)
+{
+}
+
+void RunningStatistics::add(const double* sample)
+{
+  count_++;
+  std::vector<double> delta(dimension_);
+  for (int i = 0; i < dimension_; i++)
+  {
+    delta[i] = sample[i] - mean_[i];
+    mean_[i] += delta[i] / count_;
+  }
+  for (int i = 0; i < dimension_; i++)
+  {
+    for (int j = 0; j < dimension_; j++)
+    {
+      comoment_[i * dimension_ + j] += delta[i] * (sample[j] - mean_[j]);
+    }
+  }
+
+  if (reservoir_size_ <= 0)
+  {
+    return;
+  }
+  // reservoir sampling, every sample so far is kept with the same probability
+  if ((int)reservoir_.size() < reservoir_size_ * dimension_)
+  {
+    reservoir_.insert(reservoir_.end(), sample, sample + dimension_);
+  }
+  else
+  {
+    boost::random::uniform_int_distribution<long> pick(0, count_ - 1);
+    long slot = pick(rng_);
+    if (slot < reservoir_size_)
+    {
+      std::copy(sample, sample + dimension_, reservoir_.begin() + slot * dimension_);
+    }
+  }
+}
+
+void RunningStatistics::merge(const RunningStatistics& other)
+{
+  if (other.count_ == 0)
+  {
+    return;
+  }
+  long count = count_ + other.count_;
+  std::vector<double> delta(dimension_);
+  for (int i = 0; i < dimension_; i++)
+  {
+    delta[i] = other.mean_[i] - mean_[i];
+  }
+  double weight = double(count_) * double(other.count_) / count;
+  for (int i = 0; i < dimension_; i++)
+  {
+    for (int j = 0; j < dimension_; j++)
+    {
+      comoment_[i * dimension_ + j] += other.comoment_[i * dimension_ + j] + delta[i] * delta[j] * weight;
+    }
+    mean_[i] += delta[i] * other.count_ / count;
+  }
+
+  if (reservoir_size_ > 0)
+  {
+    // draw from each reservoir in proportion to the number of samples it stands for
+    int stored = reservoir_.size() / dimension_;
+    int other_stored = other.reservoir_.size() / dimension_;
+    int take_other = std::min(other_stored, int(std::floor(double(reservoir_size_) * other.count_ / count + 0.5)));
+    int take = std::min(stored, reservoir_size_ - take_other);
+    take_other = std::min(other_stored, reservoir_size_ - take);
+
+    std::vector<double> merged;
+    merged.reserve((take + take_other) * dimension_);
+    std::vector<int> rows(stored);
+    for (int i = 0; i < stored; i++) rows[i] = i;
+    for (int i = 0; i < take; i++)
+    {
+      boost::random::uniform_int_distribution<int> pick(i, stored - 1);
+      std::swap(rows[i], rows[pick(rng_)]);
+      merged.insert(merged.end(), reservoir_.begin() + rows[i] * dimension_, reservoir_.begin() + (rows[i] + 1) * dimension_);
+    }
+    rows.resize(other_stored);
+    for (int i = 0; i < other_stored; i++) rows[i] = i;
+    for (int i = 0; i < take_other; i++)
+    {
+      boost::random::uniform_int_distribution<int> pick(i, other_stored - 1);
+      std::swap(rows[i], rows[pick(rng_)]);
+      merged.insert(merged.end(), other.reservoir_.begin() + rows[i] * dimension_,
+                    other.reservoir_.begin() + (rows[i] + 1) * dimension_);
+    }
+    reservoir_.swap(merged);
+  }
+  count_ = count;
+}
+
+void RunningStatistics::clear()
+{
+  count_ = 0;
+  std::fill(mean_.begin(), mean_.end(), 0.0);
+  std::fill(comoment_.begin(), comoment_.end(), 0.0);
+  reservoir_.clear();
+}
+
+double RunningStatistics::covariance(int i, int j) const
+{
+  if (count_ < 2)
+  {
+    return 0.0;
+  }
+  return comoment_[i * dimension_ + j] / (count_ - 1.0);
+}
+
+double RunningStatistics::sigma(int i) const
+{
+  return sqrt(std::max(0.0, variance(i)));
+}
+
+bool RunningStatistics::quantile(int i, double q, double& value) const
+{
+  int stored = reservoir_.size() / dimension_;
+  if (stored == 0)
+  {
+    return false;
+  }
+  std::vector<double> values(stored);
+  for (int k = 0; k < stored; k++)
+  {
+    values[k] = reservoir_[k * dimension_ + i];
+  }
+  std::sort(values.begin(), values.end());
+  double position = std::min(1.0, std::max(0.0, q)) * (stored - 1);
+  int below = int(std::floor(position));
+  int above = std::min(below + 1, stored - 1);
+  value = values[below] + (position - below) * (values[above] - values[below]);
+  return true;
+}
+
+} // end namespace industrial_extrinsic_cal
@@ -0,0 +1,268 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <industrial_extrinsic_cal/target_points.h>
+#include <industrial_extrinsic_cal/yaml_utils.h>
+#include <ros/console.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace industrial_extrinsic_cal
+{
+namespace
+{
+const char points_magic[8] = { 'I', 'E', 'C', 'P', 'N', 'T', 'S', '\0' };
+const uint32_t points_version = 1;
+const uint32_t points_byte_order = 0x01020304;
+
+// a binary points file is this header followed by num_points x, y, z doubles
+struct PointsFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t num_points;
+};
+
+/* a read only mapping of a whole file, unmapped when it goes out of scope */
+class PointsFileMapping
+{
+public:
+  PointsFileMapping() : data_(NULL), size_(0) {}
+  ~PointsFileMapping()
+  {
+    if (data_ != NULL) munmap(data_, size_);
+  }
+  bool map(const std::string &file_name)
+  {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) return (false);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+      close(fd);
+      return (false);
+    }
+    size_ = file_stat.st_size;
+    if (size_ == 0)  // nothing to map, an empty text file
+    {
+      close(fd);
+      return (true);
+    }
+    void *data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+      size_ = 0;
+      return (false);
+    }
+    data_ = data;
+    return (true);
+  }
+  const char *data() const { return ((const char *)data_); }
+  size_t size() const { return (size_); }
+
+private:
+  void *data_;
+  size_t size_;
+};
+
+bool readBinaryPoints(const PointsFileMapping &mapping, const std::string &file_name, std::vector<Point3d> &points)
+{
+  PointsFileHeader header;
+  memcpy(&header, mapping.data(), sizeof(header));
+  if (header.byte_order != points_byte_order || header.version != points_version)
+  {
+    ROS_ERROR("%s is a points file of another version or byte order", file_name.c_str());
+    return (false);
+  }
+  if (header.num_points != (mapping.size() - sizeof(header)) / sizeof(Point3d) ||
+      (mapping.size() - sizeof(header)) % sizeof(Point3d) != 0)
+  {
+    ROS_ERROR("%s should hold %llu points, its size is %llu bytes", file_name.c_str(),
+              (unsigned long long)header.num_points, (unsigned long long)mapping.size());
+    return (false);
+  }
+  points.resize(header.num_points);
+  if (header.num_points > 0)
+  {
+    memcpy(&points[0], mapping.data() + sizeof(header), header.num_points * sizeof(Point3d));
+  }
+  return (true);
+}
+
+bool readTextPoints(const PointsFileMapping &mapping, const std::string &file_name, std::vector<Point3d> &points)
+{
+  const char *data = mapping.data();
+  size_t size = mapping.size();
+  points.reserve(size / 16);  // a rough guess, a short line of 3 values
+  size_t start = 0;
+  int line_number = 0;
+  while (start < size)
+  {
+    const char *line_end = (const char *)memchr(data + start, '\n', size - start);
+    size_t end = line_end != NULL ? line_end - data : size;
+    line_number++;
+    // copy the line, the mapping is not null terminated
+    char line[256];
+    size_t length = end - start;
+    if (length >= sizeof(line))
+    {
+      ROS_ERROR("%s line %d is too long", file_name.c_str(), line_number);
+      return (false);
+    }
+    memcpy(line, data + start, length);
+    line[length] = '\0';
+    start = end + 1;
+
+    char *p = line;
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    if (*p == '\0' || *p == '#') continue;
+    Point3d point;
+    for (int i = 0; i < 3; i++)
+    {
+      char *next;
+      point.pb[i] = strtod(p, &next);
+      if (next == p)
+      {
+        ROS_ERROR("%s line %d does not hold x, y and z", file_name.c_str(), line_number);
+        return (false);
+      }
+      p = next;
+      while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    }
+    if (*p != '\0' && *p != '\r')
+    {
+      ROS_ERROR("%s line %d has more than x, y and z", file_name.c_str(), line_number);
+      return (false);
+    }
+    points.push_back(point);
+  }
+  return (true);
+}
+}  // end anonymous namespace
+
+bool readPointsFile(const std::string &file_name, std::vector<Point3d> &points)
+{
+  points.clear();
+  PointsFileMapping mapping;
+  if (!mapping.map(file_name))
+  {
+    ROS_ERROR("Could not read points file %s", file_name.c_str());
+    return (false);
+  }
+  if (mapping.size() >= sizeof(PointsFileHeader) &&
+      memcmp(mapping.data(), points_magic, sizeof(points_magic)) == 0)
+  {
+    return (readBinaryPoints(mapping, file_name, points));
+  }
+  return (readTextPoints(mapping, file_name, points));
+}
+
+bool writePointsFile(const std::string &file_name, const std::vector<Point3d> &points)
+{
+  FILE *fp = fopen(file_name.c_str(), "wb");
+  if (fp == NULL)
+  {
+    ROS_ERROR("Could not open %s", file_name.c_str());
+    return (false);
+  }
+  PointsFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, points_magic, sizeof(points_magic));
+  header.version = points_version;
+  header.byte_order = points_byte_order;
+  header.num_points = points.size();
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            (points.empty() || fwrite(&points[0], sizeof(Point3d), points.size(), fp) == points.size());
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) ROS_ERROR("Could not write %s", file_name.c_str());
+  return (ok);
+}
+
+void gridPoints(int rows, int cols, double spacing, bool ascending_rows, std::vector<Point3d> &points)
+{
+  points.clear();
+  points.reserve(rows * cols);
+  for (int k = 0; k < rows; k++)
+  {
+    int i = ascending_rows ? k : rows - 1 - k;
+    for (int j = 0; j < cols; j++)
+    {
+      Point3d point;
+      point.x = j * spacing;
+      point.y = i * spacing;
+      point.z = 0.0;
+      points.push_back(point);
+    }
+  }
+}
+
+bool hasExternalPoints(const YAML::Node &node)
+{
+  return (node["points_file"] || node["point_grid"]);
+}
+
+std::string fileDirectory(const std::string &file_name)
+{
+  size_t slash = file_name.rfind('/');
+  if (slash == std::string::npos) return ("");
+  return (file_name.substr(0, slash + 1));
+}
+
+bool parsePointSource(const YAML::Node &node, const std::string &base_directory, std::vector<Point3d> &points)
+{
+  std::string points_file;
+  const YAML::Node grid = node["point_grid"];
+  if (node["points"])
+  {
+    return (parsePointList(node["points"], points));
+  }
+  else if (parseString(node, "points_file", points_file))
+  {
+    if (!points_file.empty() && points_file[0] != '/') points_file = base_directory + points_file;
+    return (readPointsFile(points_file, points));
+  }
+  else if (grid)
+  {
+    int rows, cols;
+    double spacing;
+    bool ascending_rows = false;
+    if (!parseInt(grid, "rows", rows) || !parseInt(grid, "cols", cols) || !parseDouble(grid, "spacing", spacing) ||
+        rows < 1 || cols < 1)
+    {
+      ROS_ERROR("point_grid needs rows and cols of at least 1, and a spacing");
+      points.clear();
+      return (false);
+    }
+    parseBool(grid, "ascending_rows", ascending_rows);
+    gridPoints(rows, cols, spacing, ascending_rows, points);
+    return (true);
+  }
+  ROS_ERROR("no points, points_file or point_grid");
+  points.clear();
+  return (false);
+}
+
+}  // end namespace industrial_extrinsic_cal
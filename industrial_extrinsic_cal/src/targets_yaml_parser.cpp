@@ -10,6 +10,9 @@
 #include <industrial_extrinsic_cal/targets_yaml_parser.h>
 #include <industrial_extrinsic_cal/camera_yaml_parser.h> // for parse_pose() and parse_transform_interface()
 #include <industrial_extrinsic_cal/ros_camera_observer.h> // for pattern options
+#include <industrial_extrinsic_cal/target_points.h>
+#include <industrial_extrinsic_cal/yaml_cache.h>
+#include <industrial_extrinsic_cal/yaml_utils.h>
 
 using std::ifstream;
 using std::string;
@@ -21,51 +24,129 @@ using YAML::Node;
 namespace industrial_extrinsic_cal {
 
   // prototypes
-  int parseTargetPoints(const Node &node, std::vector<Point3d> &points);
-
+  shared_ptr<Target> parseTargetDefinition(const Node &node);
+  bool checkTargetPoints(const shared_ptr<Target> &target);
+  bool compileTargets(const Node &node, bool is_moving, const std::string &base_directory,
+		      vector<shared_ptr<Target> > &targets, vector<CompiledTarget> &compiled);
+  void parseTargetPoints(const Node &node, const std::string &base_directory, const shared_ptr<Target> &target);
+  std::string targetDefinitionYaml(const Node &node);
 
   bool parseTargets(std::string &target_file,vector< boost::shared_ptr<Target> > & targets)
   {
     bool rtn = true;
-    Node target_doc;
+    targets.clear();
+    std::string contents;
+    if(!readFileContents(target_file, contents)){
+      ROS_ERROR("Can't read yaml file %s", target_file.c_str());
+      return(false);
+    }
+    // the points are most of a large target file, they come from its compiled form when it has been loaded before
+    uint64_t hash = yamlContentHash(contents);
+    std::string cache_file = yamlCacheFileName(hash, "targets");
+    vector<CompiledTarget> compiled;
+    std::string base_directory = fileDirectory(target_file); // of points files
     try{
-      YAML::Node target_doc;
-      if(!yamlNodeFromFileName(target_file, target_doc)){
-	ROS_ERROR("Can't parse yaml file %s", target_file.c_str());
+      if(readTargetCache(cache_file, hash, compiled)){
+	for(int i=0; i<(int)compiled.size(); i++){
+	  const Node definition = YAML::Load(compiled[i].definition);
+	  shared_ptr<Target> temp_target = parseTargetDefinition(definition);
+	  if(hasExternalPoints(definition)){ // the points file may have changed, it is cheap to read anyway
+	    parseTargetPoints(definition, base_directory, temp_target);
+	  }
+	  else{
+	    temp_target->pts_.swap(compiled[i].points);
+	    checkTargetPoints(temp_target);
+	  }
+	  temp_target->is_moving_ = compiled[i].is_moving;
+	  targets.push_back(temp_target);
+	}
+	ROS_DEBUG("targets of %s read from %s", target_file.c_str(), cache_file.c_str());
       }
-      // read in all static cameras
-      targets.clear();
-      int n_static =0;
-      const YAML::Node& target_parameters = parseNode(target_doc, "static_targets");
-      for (unsigned int i = 0; i < target_parameters.size(); i++){
-	shared_ptr<Target> temp_target = parseSingleTarget(target_parameters[i]);
-	temp_target->is_moving_ = false;
-	targets.push_back(temp_target);
-	n_static++;
+      else{
+	YAML::Node target_doc = YAML::Load(contents);
+	bool valid = compileTargets(parseNode(target_doc, "static_targets"), false, base_directory, targets, compiled);
+	valid &= compileTargets(parseNode(target_doc, "moving_targets"), true, base_directory, targets, compiled);
+	if(valid && !writeTargetCache(cache_file, hash, compiled)){
+	  ROS_DEBUG("could not cache the targets of %s", target_file.c_str());
+	}
       }
-
-
-
-      // read in all moving targets
       int n_moving=0;
-      const YAML::Node& target_parameters2 = parseNode(target_doc, "moving_targets");
-      for (unsigned int i = 0; i < target_parameters2.size(); i++){
-	shared_ptr<Target> temp_target = parseSingleTarget(target_parameters2[i]);
-	temp_target->is_moving_ = true;
-	targets.push_back(temp_target);
-	n_moving++;
+      for(int i=0; i<(int)targets.size(); i++){
+	if(targets[i]->is_moving_) n_moving++;
       }
-
-      ROS_INFO_STREAM((int) targets.size() << " targets " << n_static << " static " << n_moving << " moving");
+      ROS_INFO_STREAM((int) targets.size() << " targets " << (int) targets.size() - n_moving << " static " << n_moving << " moving");
     }
-    catch (YAML::ParserException& e){
+    catch (YAML::Exception& e){
       ROS_ERROR_STREAM("Failed to parse targets with exception "<< e.what());
       rtn = false;
     }
     return(rtn);
   }
 
-  shared_ptr<Target> parseSingleTarget(const Node &node)
+  /** @brief parses a list of targets, keeping the compiled form of each, returns false if one of them has errors */
+  bool compileTargets(const Node &node, bool is_moving, const std::string &base_directory,
+		      vector<shared_ptr<Target> > &targets, vector<CompiledTarget> &compiled)
+  {
+    bool valid = true;
+    for(YAML_ITERATOR it = node.begin(); it != node.end(); ++it){
+      shared_ptr<Target> temp_target = parseSingleTarget(*it, base_directory);
+      temp_target->is_moving_ = is_moving;
+      targets.push_back(temp_target);
+      valid &= (temp_target->num_points_ == temp_target->pts_.size());
+      CompiledTarget compiled_target;
+      compiled_target.is_moving = is_moving;
+      compiled_target.definition = targetDefinitionYaml(*it);
+      if(!hasExternalPoints(*it)) compiled_target.points = temp_target->pts_;
+      compiled.push_back(compiled_target);
+    }
+    return(valid);
+  }
+
+  /** @brief the target's yaml without its points */
+  std::string targetDefinitionYaml(const Node &node)
+  {
+    Node definition;
+    for(YAML_ITERATOR it = node.begin(); it != node.end(); ++it){
+      std::string key = it->first.as<std::string>();
+      if(key != "points") definition[key] = it->second;
+    }
+    return(YAML::Dump(definition));
+  }
+
+  /** @brief checks a target has the number of points it declares */
+  bool checkTargetPoints(const shared_ptr<Target> &target)
+  {
+    if(target->num_points_ != target->pts_.size()){
+      ROS_ERROR("Expecting %d points found %d", target->num_points_, (int) target->pts_.size());
+      return(false);
+    }
+    return(true);
+  }
+
+  shared_ptr<Target> parseSingleTarget(const Node &node, const std::string &base_directory)
+  {
+    shared_ptr<Target> temp_target = parseTargetDefinition(node);
+    parseTargetPoints(node, base_directory, temp_target);
+    return(temp_target);
+  }
+
+  /** @brief reads a target's points from its list, points file or grid, a file or grid may leave out num_points */
+  void parseTargetPoints(const Node &node, const std::string &base_directory, const shared_ptr<Target> &target)
+  {
+    try{
+      if(!parsePointSource(node, base_directory, target->pts_)){
+	ROS_ERROR("Failed to read the points of target %s", target->target_name_.c_str());
+      }
+    }
+    catch (YAML::Exception& e){
+      ROS_ERROR_STREAM("Failed to parse the points of target "<< target->target_name_ << " with exception "<< e.what());
+    }
+    if(!node["num_points"] && hasExternalPoints(node)) target->num_points_ = target->pts_.size();
+    checkTargetPoints(target);
+  }
+
+  /** @brief parses everything about a target except its points */
+  shared_ptr<Target> parseTargetDefinition(const Node &node)
   {
     shared_ptr<Target> temp_target = make_shared<Target>();
     shared_ptr<TransformInterface> temp_ti;
@@ -130,14 +211,10 @@ namespace industrial_extrinsic_cal {
 	}
       }
 
-      if(!parseUInt(node, "num_points", temp_target->num_points_)){
+      temp_target->num_points_ = 0;
+      if(!parseUInt(node, "num_points", temp_target->num_points_) && !hasExternalPoints(node)){
 	ROS_ERROR("must set target num_points");
       }
-      const YAML::Node& points_node = parseNode(node, "points");
-      int num_points = parseTargetPoints(points_node, temp_target->pts_);
-      if(num_points  != temp_target->num_points_  || num_points != (int)temp_target->pts_.size()){
-	ROS_ERROR("Expecting %d points found %d",temp_target->num_points_, num_points);
-      }
     }// end try
     catch (YAML::ParserException& e){
       ROS_ERROR_STREAM("Failed to parse single target with exception "<< e.what());
@@ -154,21 +231,6 @@ namespace industrial_extrinsic_cal {
       ROS_INFO_STREAM("position_z     = " << temp_target->pose_.z);
     }
     return(temp_target);
-  }// end parse_single_target
-  
-  int parseTargetPoints(const Node &node, std::vector<Point3d> &points)
-  {
-    points.clear();
-    for (int i = 0; i <(int) node.size(); i++){
-      std::vector<double> temp_pnt;
-      parseVectorD(node[i], "pnt", temp_pnt);
-      Point3d temp_pnt3d;
-      temp_pnt3d.x = temp_pnt[0];
-      temp_pnt3d.y = temp_pnt[1];
-      temp_pnt3d.z = temp_pnt[2];
-      points.push_back(temp_pnt3d);
-    }
-    return(node.size());
-  }
-  
+  }// end parseTargetDefinition
+
 }// end of industrial_extrinsic_cal namespace
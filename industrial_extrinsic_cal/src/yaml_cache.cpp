@@ -0,0 +1,194 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <industrial_extrinsic_cal/yaml_cache.h>
+#include <ros/console.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace industrial_extrinsic_cal
+{
+namespace
+{
+// A target cache is a header followed by one record per target, each record followed by the target's definition and
+// its points. Sizes are checked against the file before anything is copied out.
+const char target_cache_magic[8] = { 'I', 'E', 'C', 'T', 'G', 'T', 'S', '\0' };
+const uint32_t target_cache_version = 1;
+
+struct TargetCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t num_targets;
+  uint64_t hash; // of the target file's contents
+};
+
+struct TargetCacheRecord
+{
+  uint32_t is_moving;
+  uint32_t definition_size; // bytes of yaml
+  uint64_t num_points; // Point3d following the definition
+};
+
+bool makeDirectory(const std::string &path)
+{
+  return (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST);
+}
+}  // end anonymous namespace
+
+bool readFileContents(const std::string &file_name, std::string &contents)
+{
+  FILE *fp = fopen(file_name.c_str(), "rb");
+  if (fp == NULL) return (false);
+  contents.clear();
+  char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+  {
+    contents.append(buffer, n);
+  }
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return (ok);
+}
+
+uint64_t yamlContentHash(const std::string &contents)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < contents.size(); i++)
+  {
+    hash ^= (unsigned char)contents[i];
+    hash *= 1099511628211ULL;
+  }
+  return (hash);
+}
+
+std::string yamlCacheFileName(uint64_t hash, const std::string &kind)
+{
+  std::string directory;
+  const char *ros_home = getenv("ROS_HOME");
+  const char *home = getenv("HOME");
+  if (ros_home != NULL)
+  {
+    directory = ros_home;
+  }
+  else if (home != NULL)
+  {
+    directory = std::string(home) + "/.ros";
+  }
+  else
+  {
+    return ("");
+  }
+  if (!makeDirectory(directory)) return ("");
+  directory += "/industrial_extrinsic_cal_cache";
+  if (!makeDirectory(directory)) return ("");
+
+  char name[32];
+  sprintf(name, "/%016llx.", (unsigned long long)hash);
+  return (directory + name + kind);
+}
+
+bool readTargetCache(const std::string &cache_file, uint64_t hash, std::vector<CompiledTarget> &targets)
+{
+  targets.clear();
+  std::string contents;
+  if (cache_file.empty() || !readFileContents(cache_file, contents)) return (false);
+
+  const char *data = contents.data();
+  size_t size = contents.size();
+  if (size < sizeof(TargetCacheHeader)) return (false);
+  TargetCacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, target_cache_magic, sizeof(target_cache_magic)) != 0 ||
+      header.version != target_cache_version || header.hash != hash)
+  {
+    return (false);
+  }
+
+  size_t offset = sizeof(header);
+  // each target needs at least its record, a corrupt count must not size the vector
+  bool ok = header.num_targets <= (size - offset) / sizeof(TargetCacheRecord);
+  if (ok) targets.resize(header.num_targets);
+  for (int i = 0; ok && i < (int)header.num_targets; i++)
+  {
+    TargetCacheRecord record;
+    ok = size - offset >= sizeof(record);
+    if (!ok) break;
+    memcpy(&record, data + offset, sizeof(record));
+    offset += sizeof(record);
+    ok = size - offset >= record.definition_size;
+    if (!ok) break;
+    targets[i].is_moving = record.is_moving != 0;
+    targets[i].definition.assign(data + offset, record.definition_size);
+    offset += record.definition_size;
+    ok = record.num_points <= (size - offset) / sizeof(Point3d);
+    if (!ok) break;
+    targets[i].points.resize(record.num_points);
+    if (record.num_points > 0) memcpy(&targets[i].points[0], data + offset, record.num_points * sizeof(Point3d));
+    offset += record.num_points * sizeof(Point3d);
+  }
+  ok = ok && offset == size;
+  if (!ok)
+  {
+    ROS_ERROR("Target cache %s is truncated or corrupt, recompiling", cache_file.c_str());
+    targets.clear();
+  }
+  return (ok);
+}
+
+bool writeTargetCache(const std::string &cache_file, uint64_t hash, const std::vector<CompiledTarget> &targets)
+{
+  if (cache_file.empty()) return (false);
+  char suffix[32]; // several processes may compile the same file
+  sprintf(suffix, ".%d.tmp", (int)getpid());
+  std::string temp_file = cache_file + suffix;
+  FILE *fp = fopen(temp_file.c_str(), "wb");
+  if (fp == NULL) return (false);
+
+  TargetCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, target_cache_magic, sizeof(target_cache_magic));
+  header.version = target_cache_version;
+  header.num_targets = targets.size();
+  header.hash = hash;
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (int i = 0; ok && i < (int)targets.size(); i++)
+  {
+    TargetCacheRecord record;
+    record.is_moving = targets[i].is_moving;
+    record.definition_size = targets[i].definition.size();
+    record.num_points = targets[i].points.size();
+    ok = fwrite(&record, sizeof(record), 1, fp) == 1 &&
+         fwrite(targets[i].definition.data(), 1, record.definition_size, fp) == record.definition_size &&
+         (record.num_points == 0 ||
+          fwrite(&targets[i].points[0], sizeof(Point3d), record.num_points, fp) == record.num_points);
+  }
+  ok = (fclose(fp) == 0) && ok;
+  // readers see the old cache or the new one, never a partial file
+  if (ok) ok = rename(temp_file.c_str(), cache_file.c_str()) == 0;
+  if (!ok) remove(temp_file.c_str());
+  return (ok);
+}
+
+}  // end namespace industrial_extrinsic_cal
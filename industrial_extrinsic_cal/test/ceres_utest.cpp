@@ -26,6 +26,7 @@
 #include <Eigen/Geometry>
 #include <Eigen/Core>
 #include <industrial_extrinsic_cal/ceres_costs_utils.hpp>
+#include <industrial_extrinsic_cal/batch_projector.h>
 
 using namespace industrial_extrinsic_cal;
 
@@ -48,51 +49,20 @@ public:
   double image_loc_y;
 };
 
-Observation projectPoint(CameraParameters C, Point3d P)
+/* projects all the points into the camera, appending one observation per point */
+void projectPoints(CameraParameters C, std::vector<Point3d>& P, std::vector<Observation>& O)
 {
-  double p[3];
-  double pt[3];
-  pt[0] = P.x;
-  pt[1] = P.y;
-  pt[2] = P.z;
-
-  /* transform point into camera frame */
-  /* note, camera transform takes points from camera frame into world frame */
-  ceres::AngleAxisRotatePoint(C.angle_axis, pt, p);
-
-  p[0] += C.position[0];
-  p[1] += C.position[1];
-  p[2] += C.position[2];
-
-  double xp = p[0] / p[2];
-  double yp = p[1] / p[2];
-
-  double r2 = xp * xp + yp * yp;
-  double r4 = r2 * r2;
-  double r6 = r2 * r4;
-
-  double xp2 = xp * xp; /* temporary variables square of others */
-  double yp2 = yp * yp;
-
-  /* apply the distortion coefficients to refine pixel location */
-  double xpp = xp + C.distortion_k1 * r2 * xp 
-    + C.distortion_k2 * r4 * xp  
-    + C.distortion_k3 * r6 * xp  
-    + C.distortion_p2 * (r2 + 2 * xp2) 
-    + C.distortion_p1 * xp * yp * 2.0;
-  double ypp = yp + C.distortion_k1 * r2 * yp 
-    + C.distortion_k2 * r4 * yp 
-    + C.distortion_k3 * r6 * yp 
-    + C.distortion_p1 * (r2 + 2 * yp2) 
-    + C.distortion_p2 * xp * yp * 2.0;
-
-  /* perform projection using focal length and camera center into image plane */
-  Observation O;
-  O.point_id = 0;
-  O.image_loc_x = C.focal_length_x * xpp + C.center_x;
-  O.image_loc_y = C.focal_length_y * ypp + C.center_y;
-
-  return (O);
+  if (P.empty()) return;
+  std::vector<double> x(P.size()), y(P.size());
+  BatchProjector projector(P);
+  projector.project(C, &x[0], &y[0]);
+  for (int i = 0; i < (int)P.size(); i++)
+  {
+    Observation obs;
+    obs.image_loc_x = x[i];
+    obs.image_loc_y = y[i];
+    O.push_back(obs);
+  }
 }
 
 // GLOBAL VARIABLES FOR TESTING
@@ -401,15 +371,13 @@ TEST(IndustrialExtrinsicCalCeresSuite, create_points)
   C.distortion_p2=0.01;
 
   // transform points, and then project into image plane
-  Point3d t_point;
-  Observation o_point;
+  std::vector<Point3d> new_points;
   for (int i=0; i<created_points.size();i++)
     {
-      t_point = xformPoint(created_points.at(i), aa[0], aa[1], aa[2], p[0], p[1], p[2]);
-      o_point = projectPoint(C,t_point);
-      transformed_points.push_back(t_point);
-      observations.push_back(o_point);
+      new_points.push_back(xformPoint(created_points.at(i), aa[0], aa[1], aa[2], p[0], p[1], p[2]));
     }
+  transformed_points.insert(transformed_points.end(), new_points.begin(), new_points.end());
+  projectPoints(C, new_points, observations);
 }
 
 TEST(IndustrialExtrinsicCalCeresSuite, points_costfunction)
@@ -440,15 +408,13 @@ TEST(IndustrialExtrinsicCalCeresSuite, points_costfunction)
   C.distortion_p2=0.01;
 
   // transform points, and then project into image plane
-  Point3d t_point;
-  Observation o_point;
+  std::vector<Point3d> new_points;
   for (int i=0; i<created_points.size();i++)
     {
-      t_point = xformPoint(created_points.at(i), aa[0], aa[1], aa[2], p[0], p[1], p[2]);
-      o_point = projectPoint(C,t_point);
-      transformed_points.push_back(t_point);
-      observations.push_back(o_point);
+      new_points.push_back(xformPoint(created_points.at(i), aa[0], aa[1], aa[2], p[0], p[1], p[2]));
     }
+  transformed_points.insert(transformed_points.end(), new_points.begin(), new_points.end());
+  projectPoints(C, new_points, observations);
 
   double extrinsics[6];
   extrinsics[0] = C.angle_axis[0];
@@ -542,15 +508,13 @@ TEST(IndustrialExtrinsicCalCeresSuite, circle_cost)
   C.distortion_p2=0.01;
 
   // transform points, and then project into image plane
-  Point3d t_point;
-  Observation o_point;
+  std::vector<Point3d> new_points;
   for (int i=0; i<created_points.size();i++)
     {
-      t_point = xformPoint(created_points.at(i), aa[0], aa[1], aa[2], p[0], p[1], p[2]);
-      o_point = projectPoint(C,t_point);
-      transformed_points.push_back(t_point);
-      observations.push_back(o_point);
+      new_points.push_back(xformPoint(created_points.at(i), aa[0], aa[1], aa[2], p[0], p[1], p[2]));
     }
+  transformed_points.insert(transformed_points.end(), new_points.begin(), new_points.end());
+  projectPoints(C, new_points, observations);
 
   double extrinsics[6];
   extrinsics[0] = C.angle_axis[0];
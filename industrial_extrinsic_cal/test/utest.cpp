@@ -21,6 +21,14 @@
 #include <industrial_extrinsic_cal/observation_scene.h>
 #include <industrial_extrinsic_cal/target.h>
 #include <industrial_extrinsic_cal/camera_definition.h>
+#include <industrial_extrinsic_cal/running_statistics.h>
+#include <industrial_extrinsic_cal/pose_initializer.h>
+#include <industrial_extrinsic_cal/batch_projector.h>
+#include <industrial_extrinsic_cal/observation_archive.h>
+#include <industrial_extrinsic_cal/target_points.h>
+#include <industrial_extrinsic_cal/yaml_cache.h>
+#include <industrial_extrinsic_cal/yaml_utils.h>
+#include <industrial_extrinsic_cal/ceres_costs_utils.hpp>
 #include <gtest/gtest.h>
 #include <yaml-cpp/yaml.h>
 #include <fstream>
@@ -76,6 +84,274 @@ TEST(IndustrialExtrinsicCalSuite, loadCamera)
   
 }
 
+TEST(IndustrialExtrinsicCalSuite, runningStatistics)
+{
+  // samples (i, 2i, i%4) for i = 0..99, split over two accumulators as if filled on two threads
+  industrial_extrinsic_cal::RunningStatistics all(3, 100), first(3, 10, 1), second(3, 10, 2);
+  for(int i=0; i<100; i++){
+    double sample[3] = {(double) i, 2.0*i, (double)(i%4)};
+    all.add(sample);
+    if(i < 30) first.add(sample);
+    else second.add(sample);
+  }
+  first.merge(second);
+
+  double mean = 49.5;
+  double variance = 100*101/12.0; // sample variance of 0..99
+  EXPECT_EQ(first.count(), 100);
+  EXPECT_NEAR(first.mean(0), mean, 1e-9);
+  EXPECT_NEAR(first.mean(1), 2*mean, 1e-9);
+  EXPECT_NEAR(first.mean(2), 1.5, 1e-9);
+  EXPECT_NEAR(first.variance(0), variance, 1e-9);
+  EXPECT_NEAR(first.covariance(0,1), 2*variance, 1e-9);
+  EXPECT_NEAR(first.covariance(1,0), 2*variance, 1e-9);
+  EXPECT_NEAR(first.sigma(1), 2*sqrt(variance), 1e-9);
+  EXPECT_NEAR(first.variance(2), all.variance(2), 1e-9);
+
+  // a reservoir holding every sample gives exact quantiles
+  double median;
+  EXPECT_TRUE(all.quantile(0, 0.5, median));
+  EXPECT_NEAR(median, mean, 1e-9);
+  double q;
+  EXPECT_TRUE(first.quantile(0, 0.5, q));
+  EXPECT_FALSE(industrial_extrinsic_cal::RunningStatistics(3).quantile(0, 0.5, q));
+}
+
+TEST(IndustrialExtrinsicCalSuite, initialPoseFromObservations)
+{
+  using industrial_extrinsic_cal::Point3d;
+  using industrial_extrinsic_cal::Pose6d;
+  double fx = 1000.0, fy = 1000.0, cx = 640.0, cy = 480.0;
+  Pose6d truth(0.1, -0.05, 1.2, 0.3, -0.2, 0.1);
+  tf::Matrix3x3 R = truth.getBasis();
+
+  // a 5x7 grid, then the same grid with every other row raised out of its plane
+  for(int planar=1; planar>=0; planar--){
+    std::vector<Point3d> points;
+    std::vector<double> image_x, image_y;
+    for(int i=0; i<35; i++){
+      Point3d p;
+      p.x = 0.03*(i%7);
+      p.y = 0.03*(i/7);
+      p.z = (planar || (i/7)%2 == 0) ? 0.0 : 0.05;
+      points.push_back(p);
+      tf::Vector3 c = R*tf::Vector3(p.x, p.y, p.z) + truth.getOrigin();
+      image_x.push_back(fx*c.x()/c.z() + cx);
+      image_y.push_back(fy*c.y()/c.z() + cy);
+    }
+    Pose6d pose;
+    EXPECT_TRUE(industrial_extrinsic_cal::initialPoseFromObservations(points, image_x, image_y, fx, fy, cx, cy, pose));
+    for(int j=0; j<6; j++){
+      EXPECT_NEAR(pose.pb_pose[j], truth.pb_pose[j], 1e-4);
+    }
+    points.resize(3);
+    image_x.resize(3);
+    image_y.resize(3);
+    EXPECT_FALSE(industrial_extrinsic_cal::initialPoseFromObservations(points, image_x, image_y, fx, fy, cx, cy, pose));
+  }
+}
+
+TEST(IndustrialExtrinsicCalSuite, batchProjector)
+{
+  using industrial_extrinsic_cal::Point3d;
+  industrial_extrinsic_cal::CameraParameters C;
+  double pb_all[15] = {0.1, -0.2, 0.05, 0.02, -0.01, 1.0, 525.0, 520.0, 320.0, 240.0, 0.01, 0.02, 0.03, 0.01, 0.01};
+  for(int i=0; i<15; i++) C.pb_all[i] = pb_all[i];
+  C.width = 640;
+  C.height = 480;
+
+  // a grid in front of the camera, plus one point behind it
+  std::vector<Point3d> points;
+  for(int i=0; i<36; i++){
+    Point3d p;
+    p.x = 0.04*(i%6) - 0.1;
+    p.y = 0.04*(i/6) - 0.1;
+    p.z = 0.01*(i%3);
+    points.push_back(p);
+  }
+  Point3d behind;
+  behind.z = -2.0;
+  points.push_back(behind);
+
+  industrial_extrinsic_cal::BatchProjector projector(points);
+  EXPECT_EQ(projector.numPoints(), (int)points.size());
+  std::vector<industrial_extrinsic_cal::CameraParameters> cameras(2, C);
+  cameras[1].position[0] = 0.5;
+  std::vector<double> image_x, image_y;
+  std::vector<unsigned char> visible;
+  projector.project(cameras, image_x, image_y, visible);
+  ASSERT_EQ(image_x.size(), 2*points.size());
+
+  // a projection is an observation with zero residual
+  for(int k=0; k<2; k++){
+    double* in = cameras[k].pb_intrinsics;
+    for(int i=0; i<(int)points.size(); i++){
+      int q = k*points.size() + i;
+      double camera_point[3];
+      industrial_extrinsic_cal::transformPoint(cameras[k].angle_axis, cameras[k].position, points[i].pb, camera_point);
+      double residual[2];
+      industrial_extrinsic_cal::cameraPntResidualDist(camera_point, in[4], in[5], in[6], in[7], in[8], in[0], in[1], in[2], in[3],
+                                                     image_x[q], image_y[q], residual);
+      EXPECT_NEAR(residual[0], 0.0, 1e-9);
+      EXPECT_NEAR(residual[1], 0.0, 1e-9);
+      bool inside = camera_point[2] > 0 && image_x[q] >= 0 && image_x[q] <= 640 && image_y[q] >= 0 && image_y[q] <= 480;
+      EXPECT_EQ(visible[q], inside ? 1 : 0);
+    }
+  }
+  EXPECT_EQ(visible[points.size()-1], 0);
+}
+
+TEST(IndustrialExtrinsicCalSuite, observationArchive)
+{
+  using industrial_extrinsic_cal::ObservationArchive;
+  ObservationArchive archive;
+  archive.reference_frame_ = "world_frame";
+  archive.num_scenes_ = 2;
+  industrial_extrinsic_cal::ArchiveCamera camera;
+  camera.name = "asus1";
+  camera.is_moving = false;
+  camera.width = 640;
+  camera.height = 480;
+  archive.cameras_.push_back(camera);
+  industrial_extrinsic_cal::ArchiveTarget target;
+  target.name = "checkerboard";
+  target.target_type = 0;
+  target.is_moving = true;
+  archive.targets_.push_back(target);
+  for(int i=0; i<4; i++){
+    industrial_extrinsic_cal::ArchiveBlock block;
+    block.type = (industrial_extrinsic_cal::ArchiveBlockType) i;
+    block.owner = 0;
+    block.scene_id = (i==2) ? 1 : -1;
+    block.point_id = (i==3) ? 7 : -1;
+    for(int j=0; j<industrial_extrinsic_cal::archiveBlockSize(block.type); j++){
+      block.initial_values.push_back(i + 0.1*j);
+      if(i!=0) block.final_values.push_back(i + 0.2*j);
+    }
+    archive.blocks_.push_back(block);
+  }
+  industrial_extrinsic_cal::ArchiveObservation observation;
+  observation.scene_id = 1;
+  observation.point_id = 7;
+  observation.camera = 0;
+  observation.target = 0;
+  observation.cost_type = industrial_extrinsic_cal::cost_functions::CameraReprjErrorWithDistortion;
+  observation.intrinsics = 0;
+  observation.extrinsics = 1;
+  observation.target_pose = 2;
+  observation.point_position = 3;
+  observation.image_x = 320.5;
+  observation.image_y = 240.25;
+  observation.circle_dia = 0.0;
+  observation.intermediate_frame.setAngleAxis(0.0, 0.0, 0.0);
+  observation.intermediate_frame.setOrigin(0.1, 0.2, 0.3);
+  archive.observations_.push_back(observation);
+  archive.summary_.solved = true;
+  archive.summary_.initial_cost = 10.0;
+  archive.summary_.final_cost = 0.5;
+
+  std::string file_name = "/tmp/industrial_extrinsic_cal_utest.archive";
+  ASSERT_TRUE(archive.write(file_name));
+  ObservationArchive loaded;
+  ASSERT_TRUE(loaded.read(file_name));
+  EXPECT_EQ(loaded.reference_frame_, "world_frame");
+  EXPECT_EQ(loaded.num_scenes_, 2);
+  ASSERT_EQ((int)loaded.cameras_.size(), 1);
+  EXPECT_EQ(loaded.cameras_[0].name, "asus1");
+  EXPECT_EQ(loaded.cameras_[0].height, 480);
+  ASSERT_EQ((int)loaded.targets_.size(), 1);
+  EXPECT_TRUE(loaded.targets_[0].is_moving);
+  ASSERT_EQ((int)loaded.blocks_.size(), 4);
+  for(int i=0; i<4; i++){
+    EXPECT_EQ(loaded.blocks_[i].type, archive.blocks_[i].type);
+    EXPECT_EQ(loaded.blocks_[i].scene_id, archive.blocks_[i].scene_id);
+    EXPECT_EQ(loaded.blocks_[i].point_id, archive.blocks_[i].point_id);
+    EXPECT_TRUE(loaded.blocks_[i].initial_values == archive.blocks_[i].initial_values);
+    EXPECT_TRUE(loaded.blocks_[i].final_values == archive.blocks_[i].final_values);
+  }
+  ASSERT_EQ((int)loaded.observations_.size(), 1);
+  EXPECT_EQ(loaded.observations_[0].cost_type, observation.cost_type);
+  EXPECT_EQ(loaded.observations_[0].point_position, 3);
+  EXPECT_EQ(loaded.observations_[0].image_y, 240.25);
+  EXPECT_NEAR(loaded.observations_[0].intermediate_frame.y, 0.2, 1e-12);
+  EXPECT_TRUE(loaded.summary_.solved);
+  EXPECT_EQ(loaded.summary_.final_cost, 0.5);
+
+  // a truncated archive is rejected
+  std::ifstream in(file_name.c_str(), std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  in.close();
+  std::ofstream out(file_name.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(contents.data(), contents.size()/2);
+  out.close();
+  EXPECT_FALSE(loaded.read(file_name));
+  EXPECT_TRUE(loaded.observations_.empty());
+  remove(file_name.c_str());
+}
+
+TEST(IndustrialExtrinsicCalSuite, targetCache)
+{
+  using industrial_extrinsic_cal::CompiledTarget;
+  using industrial_extrinsic_cal::Point3d;
+  YAML::Node points_node = YAML::Load("[{pnt: [0.0, 0.1, 0.2]}, {pnt: [1.0, 1.1, 1.2]}]");
+  std::vector<Point3d> points;
+  ASSERT_TRUE(industrial_extrinsic_cal::parsePointList(points_node, points));
+  ASSERT_EQ((int)points.size(), 2);
+  EXPECT_EQ(points[1].z, 1.2);
+  std::vector<Point3d> bad_points;
+  EXPECT_FALSE(industrial_extrinsic_cal::parsePointList(YAML::Load("[{pnt: [0.0, 0.1]}]"), bad_points));
+
+  std::vector<CompiledTarget> targets(1);
+  targets[0].is_moving = true;
+  targets[0].definition = "target_name: checkerboard\nnum_points: 2\n";
+  targets[0].points = points;
+  uint64_t hash = industrial_extrinsic_cal::yamlContentHash("static_targets: []");
+  EXPECT_NE(hash, industrial_extrinsic_cal::yamlContentHash("static_targets: [ ]"));
+  std::string cache_file = "/tmp/industrial_extrinsic_cal_utest.targets";
+  ASSERT_TRUE(industrial_extrinsic_cal::writeTargetCache(cache_file, hash, targets));
+  std::vector<CompiledTarget> loaded;
+  ASSERT_TRUE(industrial_extrinsic_cal::readTargetCache(cache_file, hash, loaded));
+  ASSERT_EQ((int)loaded.size(), 1);
+  EXPECT_TRUE(loaded[0].is_moving);
+  EXPECT_EQ(loaded[0].definition, targets[0].definition);
+  ASSERT_EQ((int)loaded[0].points.size(), 2);
+  EXPECT_EQ(loaded[0].points[1].y, 1.1);
+  // a cache of other contents is not used
+  EXPECT_FALSE(industrial_extrinsic_cal::readTargetCache(cache_file, hash + 1, loaded));
+  EXPECT_TRUE(loaded.empty());
+  remove(cache_file.c_str());
+}
+
+TEST(IndustrialExtrinsicCalSuite, targetPointSources)
+{
+  using industrial_extrinsic_cal::Point3d;
+  std::vector<Point3d> grid;
+  ASSERT_TRUE(industrial_extrinsic_cal::parsePointSource(YAML::Load("point_grid: {rows: 5, cols: 7, spacing: 0.035}"),
+                                                         "", grid));
+  ASSERT_EQ((int)grid.size(), 35);
+  EXPECT_NEAR(grid[0].y, 0.14, 1e-12); // last row first, as modified circle grids are observed
+  EXPECT_NEAR(grid[6].x, 0.21, 1e-12);
+  EXPECT_EQ(grid[34].y, 0.0);
+
+  std::vector<Point3d> points;
+  ASSERT_TRUE(industrial_extrinsic_cal::writePointsFile("/tmp/industrial_extrinsic_cal_utest.pts", grid));
+  ASSERT_TRUE(industrial_extrinsic_cal::parsePointSource(YAML::Load("points_file: industrial_extrinsic_cal_utest.pts"),
+                                                         "/tmp/", points));
+  ASSERT_EQ(points.size(), grid.size());
+  EXPECT_EQ(points[20].x, grid[20].x);
+  EXPECT_EQ(points[20].y, grid[20].y);
+  remove("/tmp/industrial_extrinsic_cal_utest.pts");
+
+  std::ofstream csv("/tmp/industrial_extrinsic_cal_utest.csv");
+  csv << "# x, y, z\n0.1, 0.2, 0.3\n1 2 3\n";
+  csv.close();
+  ASSERT_TRUE(industrial_extrinsic_cal::readPointsFile("/tmp/industrial_extrinsic_cal_utest.csv", points));
+  ASSERT_EQ((int)points.size(), 2);
+  EXPECT_EQ(points[0].z, 0.3);
+  EXPECT_EQ(points[1].x, 1.0);
+  remove("/tmp/industrial_extrinsic_cal_utest.csv");
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
 {
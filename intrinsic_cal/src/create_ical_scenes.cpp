@@ -2,6 +2,199 @@
 #include <ros/ros.h>
 #include <ros/package.h>
 #include <ros/console.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <Eigen/Geometry>
+#include <industrial_extrinsic_cal/basic_types.h>
+#include <industrial_extrinsic_cal/ceres_costs_utils.hpp>
+
+using industrial_extrinsic_cal::Point3d;
+using industrial_extrinsic_cal::CameraReprjErrorWithDistortionPK;
+
+typedef Eigen::Matrix<double, 9, 9> IntrinsicInformation;
+
+/** A scene that may be added to the calibration job, the target fills the region of interest, possibly tilted **/
+struct CandidateScene
+{
+  int x, y;                 // upper left corner of roi
+  int roi_width, roi_height;
+  char tilt_axis;           // 'x' or 'y', the camera axis the target is tilted about
+  double tilt;              // tilt angle in degrees
+  IntrinsicInformation information; // information this scene adds on fx, fy, cx, cy, k1, k2, k3, p1, p2
+};
+
+/** writes one scene of the caljob file **/
+void writeScene(FILE *fp, const CandidateScene &scene, const std::string &image_topic, int target_type,
+		const std::string &camera_name, const std::string &target_name, const std::string &cost_type)
+{
+  int x = scene.x;
+  int y = scene.y;
+  fprintf(fp,"-\n");
+  fprintf(fp,"    trigger: ROS_CAMERA_OBSERVER_TRIGGER\n");
+  fprintf(fp,"    trigger_parameters:\n");
+  fprintf(fp,"    -\n");
+  fprintf(fp,"         service_name: ObserverTrigger\n");
+  if(scene.tilt == 0.0){
+    fprintf(fp,"         instructions: Center target within region of interest\n");
+  }
+  else{
+    fprintf(fp,"         instructions: Center target within region of interest tilted %.0f degrees about the camera %c axis\n",
+	    scene.tilt, scene.tilt_axis);
+  }
+  fprintf(fp,"         image_topic: %s\n", image_topic.c_str());
+  fprintf(fp,"         target_type: %d\n",target_type);
+  fprintf(fp,"         roi_min_x: %d\n", x);
+  fprintf(fp,"         roi_max_x: %d\n", x+scene.roi_width);
+  fprintf(fp,"         roi_min_y: %d\n", y);
+  fprintf(fp,"         roi_max_y: %d\n", y+scene.roi_height);
+  fprintf(fp,"    observations:\n");
+  fprintf(fp,"    -\n");
+  fprintf(fp,"        camera: %s\n", camera_name.c_str());
+  fprintf(fp,"        target: %s\n", target_name.c_str());
+  fprintf(fp,"        roi_x_min: %d\n", x);
+  fprintf(fp,"        roi_x_max: %d\n", x+scene.roi_width);
+  fprintf(fp,"        roi_y_min: %d\n", y);
+  fprintf(fp,"        roi_y_max: %d\n", y+scene.roi_height);
+  fprintf(fp,"        cost_type: %s\n", cost_type.c_str());
+}
+
+/** computes the information a scene adds on the intrinsics, from the Jacobian of the reprojection error of every target
+ *  point. The target's pose is unknown in each scene, so it is eliminated with the Schur complement.
+ *  @param scene the scene, its information is set
+ *  @param points the target's points, in the target frame
+ *  @param intrinsics nominal fx, fy, cx, cy, k1, k2, k3, p1, p2
+ *  @param image_width, image_height size of the image
+ *  @param image_noise standard deviation of the observed point locations in pixels
+ *  @return false when the target does not fit in the image or the pose is not observable
+ **/
+bool sceneInformation(CandidateScene &scene, const std::vector<Point3d> &points, double intrinsics[9],
+		      int image_width, int image_height, double image_noise)
+{
+  // the target's extent and center in its own frame
+  double min_x=points[0].x, max_x=points[0].x, min_y=points[0].y, max_y=points[0].y;
+  for(int i=1; i<(int)points.size(); i++){
+    min_x = std::min(min_x, points[i].x);  max_x = std::max(max_x, points[i].x);
+    min_y = std::min(min_y, points[i].y);  max_y = std::max(max_y, points[i].y);
+  }
+  Eigen::Vector3d target_center((min_x+max_x)/2.0, (min_y+max_y)/2.0, 0.0);
+
+  // place the target at the distance where it fills the roi, facing the camera with its y axis up in the image
+  double fx = intrinsics[0], fy = intrinsics[1], cx = intrinsics[2], cy = intrinsics[3];
+  double z = std::max(fx*(max_x-min_x)/scene.roi_width, fy*(max_y-min_y)/scene.roi_height);
+  double u = scene.x + scene.roi_width/2.0;
+  double v = scene.y + scene.roi_height/2.0;
+  Eigen::Vector3d roi_center(z*(u-cx)/fx, z*(v-cy)/fy, z);
+  Eigen::Vector3d tilt_axis = (scene.tilt_axis == 'x') ? Eigen::Vector3d::UnitX() : Eigen::Vector3d::UnitY();
+  Eigen::Matrix3d R = Eigen::AngleAxisd(scene.tilt*M_PI/180.0, tilt_axis).toRotationMatrix() *
+    Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitX()).toRotationMatrix();
+  Eigen::Vector3d t = roi_center - R*target_center;
+  Eigen::AngleAxisd aa(R);
+  double extrinsics[6];
+  extrinsics[0] = aa.angle()*aa.axis().x();
+  extrinsics[1] = aa.angle()*aa.axis().y();
+  extrinsics[2] = aa.angle()*aa.axis().z();
+  extrinsics[3] = t.x();
+  extrinsics[4] = t.y();
+  extrinsics[5] = t.z();
+
+  Eigen::Matrix<double, 6, 6> A = Eigen::Matrix<double, 6, 6>::Zero(); // pose, pose
+  Eigen::Matrix<double, 6, 9> B = Eigen::Matrix<double, 6, 9>::Zero(); // pose, intrinsics
+  IntrinsicInformation C = IntrinsicInformation::Zero();              // intrinsics, intrinsics
+  for(int i=0; i<(int)points.size(); i++){
+    Eigen::Vector3d p = R*Eigen::Vector3d(points[i].x, points[i].y, points[i].z) + t;
+    double px = fx*p.x()/p.z() + cx;
+    double py = fy*p.y()/p.z() + cy;
+    if(p.z() <= 0.0 || px < 0.0 || px >= image_width || py < 0.0 || py >= image_height){
+      return(false);
+    }
+
+    ceres::CostFunction *cost_function = CameraReprjErrorWithDistortionPK::Create(0.0, 0.0, points[i]);
+    Eigen::Matrix<double, 2, 6, Eigen::RowMajor> J_pose;
+    Eigen::Matrix<double, 2, 9, Eigen::RowMajor> J_intrinsics;
+    const double *parameters[2] = {extrinsics, intrinsics};
+    double *jacobians[2] = {J_pose.data(), J_intrinsics.data()};
+    double residual[2];
+    cost_function->Evaluate(parameters, residual, jacobians);
+    delete(cost_function);
+    A += J_pose.transpose()*J_pose;
+    B += J_pose.transpose()*J_intrinsics;
+    C += J_intrinsics.transpose()*J_intrinsics;
+  }
+
+  Eigen::LDLT<Eigen::Matrix<double, 6, 6> > pose_information(A);
+  if(pose_information.info() != Eigen::Success){
+    return(false);
+  }
+  scene.information = (C - B.transpose()*pose_information.solve(B))/(image_noise*image_noise);
+  return(true);
+}
+
+/** log determinant of a positive definite matrix, or -infinity if it is not positive definite **/
+double logDeterminant(const IntrinsicInformation &M)
+{
+  Eigen::LLT<IntrinsicInformation> llt(M);
+  if(llt.info() != Eigen::Success){
+    return(-HUGE_VAL);
+  }
+  double log_det = 0.0;
+  for(int i=0; i<9; i++){
+    log_det += 2.0*log(llt.matrixL()(i,i));
+  }
+  return(log_det);
+}
+
+/** true when the standard deviations of the intrinsics predicted by the information are within the bounds **/
+bool meetsCovariance(const IntrinsicInformation &M, double max_sigma[9])
+{
+  Eigen::LLT<IntrinsicInformation> llt(M);
+  if(llt.info() != Eigen::Success){
+    return(false);
+  }
+  IntrinsicInformation covariance = llt.solve(IntrinsicInformation::Identity());
+  for(int i=0; i<9; i++){
+    if(sqrt(covariance(i,i)) > max_sigma[i]) return(false);
+  }
+  return(true);
+}
+
+/** greedily selects the scene adding the most information, measured by the log determinant of the intrinsics'
+ *  information matrix, until the predicted covariance meets the bounds
+ *  @param candidates the scenes to choose from
+ *  @param prior information on the intrinsics before any scene
+ *  @param max_sigma largest allowed standard deviation of each intrinsic parameter
+ *  @param selected indices of the chosen candidates, in the order chosen
+ *  @return true if the bounds were met
+ **/
+bool planScenes(const std::vector<CandidateScene> &candidates, const IntrinsicInformation &prior, double max_sigma[9],
+		std::vector<int> &selected)
+{
+  IntrinsicInformation M = prior;
+  std::vector<bool> used(candidates.size(), false);
+  selected.clear();
+  while(!meetsCovariance(M, max_sigma)){
+    int best = -1;
+    double best_log_det = logDeterminant(M);
+    for(int i=0; i<(int)candidates.size(); i++){
+      if(used[i]) continue;
+      double log_det = logDeterminant(M + candidates[i].information);
+      if(log_det > best_log_det){
+	best = i;
+	best_log_det = log_det;
+      }
+    }
+    if(best < 0){
+      return(false); // no scene adds information
+    }
+    used[best] = true;
+    selected.push_back(best);
+    M += candidates[best].information;
+  }
+  return(true);
+}
+
 /** This function creates a set of calibration scenes for intrinsic calibration **/
 int main(int argc, char** argv)
 {
@@ -72,6 +265,35 @@ int main(int argc, char** argv)
   nh.getParam("reference_frame", ref_frame);
   nh.getParam("target_type", target_type);
   nh.getParam("cost_type", cost_type);
+
+  // scene planning, keeps the fewest scenes predicted to reach the requested intrinsic covariance
+  bool plan_scenes = false;
+  int target_rows, target_cols;
+  double target_spacing, focal_length;
+  double image_noise = 0.5;
+  double max_focal_sigma = 1.0;
+  double max_center_sigma = 1.0;
+  double max_distortion_sigma = 0.05;
+  std::vector<double> tilt_angles;
+  nh.getParam("plan_scenes", plan_scenes);
+  if(plan_scenes){
+    if(!nh.getParam("target_rows", target_rows) || !nh.getParam("target_cols", target_cols) ||
+       !nh.getParam("target_spacing", target_spacing)){
+      ROS_ERROR("Need to define ros parameters: target_rows, target_cols and target_spacing to plan scenes");
+      exit(1);
+    }
+    if(!nh.getParam("focal_length", focal_length)){
+      ROS_ERROR("Need to define ros parameter: focal_length to plan scenes");
+      exit(1);
+    }
+    nh.getParam("image_noise", image_noise);
+    nh.getParam("max_focal_sigma", max_focal_sigma);
+    nh.getParam("max_center_sigma", max_center_sigma);
+    nh.getParam("max_distortion_sigma", max_distortion_sigma);
+    if(!nh.getParam("tilt_angles", tilt_angles)){
+      tilt_angles.push_back(20.0);
+    }
+  }
     
   // check for valid parameters
   if(min_image_percent <1.0 || min_image_percent > 99.0){
@@ -96,10 +318,11 @@ int main(int argc, char** argv)
   fprintf(fp,"---\n");
   fprintf(fp,"reference_frame: %s\n", ref_frame.c_str());
   fprintf(fp,"scenes:\n");
-  int scene_id = 0;
   int roi_width;
   int roi_height;
   
+  // candidate scenes, the target filling each roi of each layer, with each tilt
+  std::vector<CandidateScene> candidates;
   double percent_change = (max_image_percent - min_image_percent)/100/(sample_layers -1.0);
   double portion;
   for(portion = min_image_percent/100.0; portion <= max_image_percent/100.0; portion += percent_change){
@@ -107,32 +330,77 @@ int main(int argc, char** argv)
     roi_height = image_height*portion;
     for(int i=0; i<sample_rows; i++){
       for(int j=0; j<sample_cols; j++){
-	int x = i*(image_width- roi_width)/(sample_rows-1.0);
-	int y = j*(image_height-roi_height)/(sample_cols-1.0);
-	fprintf(fp,"-\n");
-	fprintf(fp,"    trigger: ROS_CAMERA_OBSERVER_TRIGGER\n");
-	fprintf(fp,"    trigger_parameters:\n");
-	fprintf(fp,"    -\n");
-	fprintf(fp,"         service_name: ObserverTrigger\n");
-	fprintf(fp,"         instructions: Center target within region of interest\n");
-	fprintf(fp,"         image_topic: %s\n", image_topic.c_str());
-	fprintf(fp,"         target_type: %d\n",target_type);
-	fprintf(fp,"         roi_min_x: %d\n", x);
-	fprintf(fp,"         roi_max_x: %d\n", x+roi_width);
-	fprintf(fp,"         roi_min_y: %d\n", y);
-	fprintf(fp,"         roi_max_y: %d\n", y+roi_height);
-	fprintf(fp,"    observations:\n");
-	fprintf(fp,"    -\n");
-	fprintf(fp,"        camera: %s\n", camera_name.c_str());
-	fprintf(fp,"        target: %s\n", target_name.c_str());
-	fprintf(fp,"        roi_x_min: %d\n", x);
-	fprintf(fp,"        roi_x_max: %d\n", x+roi_width);
-	fprintf(fp,"        roi_y_min: %d\n", y);
-	fprintf(fp,"        roi_y_max: %d\n", y+roi_height);
-	fprintf(fp,"        cost_type: %s\n", cost_type.c_str());
+	CandidateScene scene;
+	scene.x = i*(image_width- roi_width)/(sample_rows-1.0);
+	scene.y = j*(image_height-roi_height)/(sample_cols-1.0);
+	scene.roi_width = roi_width;
+	scene.roi_height = roi_height;
+	scene.tilt_axis = 'x';
+	scene.tilt = 0.0;
+	candidates.push_back(scene);
+	if(!plan_scenes) continue;
+	for(int k=0; k<(int)tilt_angles.size(); k++){
+	  if(tilt_angles[k] == 0.0) continue;
+	  for(int sign=-1; sign<=1; sign+=2){
+	    scene.tilt = sign*tilt_angles[k];
+	    scene.tilt_axis = 'x';
+	    candidates.push_back(scene);
+	    scene.tilt_axis = 'y';
+	    candidates.push_back(scene);
+	  }
+	}
       }//end each column
     }// end each row
   }// end each layer
+
+  std::vector<int> selected;
+  if(plan_scenes){
+    std::vector<Point3d> points;
+    for(int i=0; i<target_rows; i++){
+      for(int j=0; j<target_cols; j++){
+	Point3d point;
+	point.x = j*target_spacing;
+	point.y = (target_rows -1 -i)*target_spacing;
+	point.z = 0.0;
+	points.push_back(point);
+      }
+    }
+    double intrinsics[9] = {focal_length, focal_length, image_width/2.0, image_height/2.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    std::vector<CandidateScene> usable;
+    for(int i=0; i<(int)candidates.size(); i++){
+      if(sceneInformation(candidates[i], points, intrinsics, image_width, image_height, image_noise)){
+	usable.push_back(candidates[i]);
+      }
+    }
+    candidates.swap(usable);
+
+    // a weak prior keeps the information matrix invertible before the intrinsics are observable
+    IntrinsicInformation prior = IntrinsicInformation::Zero();
+    double prior_sigma[9] = {focal_length, focal_length, (double) image_width, (double) image_height, 1.0, 1.0, 1.0, 1.0, 1.0};
+    for(int i=0; i<9; i++){
+      prior(i,i) = 1.0/(prior_sigma[i]*prior_sigma[i]);
+    }
+    double max_sigma[9] = {max_focal_sigma, max_focal_sigma, max_center_sigma, max_center_sigma,
+			   max_distortion_sigma, max_distortion_sigma, max_distortion_sigma, max_distortion_sigma,
+			   max_distortion_sigma};
+    if(!planScenes(candidates, prior, max_sigma, selected)){
+      ROS_WARN("the candidate scenes can not meet the requested covariance, writing the %d most informative",
+	       (int)selected.size());
+    }
+    IntrinsicInformation M = prior;
+    for(int i=0; i<(int)selected.size(); i++) M += candidates[selected[i]].information;
+    IntrinsicInformation covariance = M.ldlt().solve(IntrinsicInformation::Identity());
+    ROS_INFO("planned %d of %d candidate scenes, predicted sigma fx %f fy %f cx %f cy %f k1 %f",
+	     (int)selected.size(), (int)candidates.size(), sqrt(covariance(0,0)), sqrt(covariance(1,1)),
+	     sqrt(covariance(2,2)), sqrt(covariance(3,3)), sqrt(covariance(4,4)));
+  }
+  else{
+    for(int i=0; i<(int)candidates.size(); i++) selected.push_back(i);
+  }
+
+  for(int i=0; i<(int)selected.size(); i++){
+    writeScene(fp, candidates[selected[i]], image_topic, target_type, camera_name, target_name, cost_type);
+  }
   fprintf(fp,"optimization_parameters: xx\n");
   fclose(fp);
 }
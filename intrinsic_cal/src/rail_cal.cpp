@@ -30,6 +30,12 @@
 #include <industrial_extrinsic_cal/ceres_costs_utils.h> 
 #include <industrial_extrinsic_cal/ceres_costs_utils.hpp> 
 #include <intrinsic_cal/rail_ical_run.h>
+#include <std_srvs/Empty.h>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
 #include "ceres/types.h"
@@ -57,10 +63,19 @@ public:
   bool executeCallBack( intrinsic_cal::rail_ical_run::Request &req, intrinsic_cal::rail_ical_run::Response &res);
   void  initMCircleTarget(int rows, int cols, double circle_dia, double spacing);
   void cameraCallback(const sensor_msgs::Image& image);
+  bool cameraReadyCallBack(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res);
 
 private:
+  void waitForCameraReady();
+  void processObservations(Problem* problem, double rail_position, int location, int* total_observations);
+
   ros::NodeHandle nh_;
   ros::ServiceServer rail_cal_server_;
+  ros::ServiceServer camera_ready_server_;
+  boost::mutex ready_mutex_;
+  boost::condition_variable ready_condition_;
+  bool camera_ready_;
+  int partial_solve_iterations_;
   ros::Subscriber rgb_sub_;
   ros::Publisher rgb_pub_;
   shared_ptr<Target> target_;
@@ -144,6 +159,9 @@ RailCalService::RailCalService(ros::NodeHandle nh)
     }
   }
 
+  // number of solver iterations run after each rail position to keep the final solve short, 0 to disable
+  pnh.param("partial_solve_iterations", partial_solve_iterations_, 20);
+
   u_int32_t queue_size = 5;
   rgb_sub_ = nh_.subscribe("color_image", queue_size, &RailCalService::cameraCallback, this);
   rgb_pub_ = nh_.advertise<sensor_msgs::Image>("color_image_center", 1);
@@ -187,6 +205,64 @@ RailCalService::RailCalService(ros::NodeHandle nh)
             
   initMCircleTarget(target_rows_, target_cols_, circle_diameter_, circle_spacing_);
   rail_cal_server_ = nh_.advertiseService( "RailCalService", &RailCalService::executeCallBack, this);
+  camera_ready_ = false;
+  camera_ready_server_ = pnh.advertiseService( "camera_ready", &RailCalService::cameraReadyCallBack, this);
+}
+
+bool RailCalService::cameraReadyCallBack(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res)
+{
+  boost::lock_guard<boost::mutex> lock(ready_mutex_);
+  camera_ready_ = true;
+  ready_condition_.notify_all();
+  return true;
+}
+
+void RailCalService::waitForCameraReady()
+{
+  // the camera is ready once the ~camera_ready service is called, or the ~camera_ready parameter is set for compatibility
+  ros::NodeHandle pnh("~");
+  bool param_ready = false;
+  boost::unique_lock<boost::mutex> lock(ready_mutex_);
+  while(!camera_ready_ && ros::ok()){
+    ready_condition_.timed_wait(lock, boost::posix_time::milliseconds(100));
+    if(!camera_ready_ && pnh.getParam("camera_ready", param_ready) && param_ready){
+      camera_ready_ = true;
+    }
+  }
+  camera_ready_ = false;
+}
+
+void RailCalService::processObservations(Problem* problem, double rail_position, int location, int* total_observations)
+{
+  CameraObservations camera_observations;
+  camera_->camera_observer_->getObservations(camera_observations);
+  ROS_INFO("Found %d observations",(int) camera_observations.size());
+  int num_observations = (int) camera_observations.size();
+  if(num_observations != target_rows_* target_cols_){
+    ROS_ERROR("Target Locator could not find target %d", num_observations);
+  }
+
+  // add a new cost to the problem for each observation
+  *total_observations += num_observations;
+  for(int i=0; i<num_observations; i++){
+    double image_x = camera_observations[i].image_loc_x;
+    double image_y = camera_observations[i].image_loc_y;
+    Point3d point = target_->pts_[i]; // assume correct ordering from camera observer
+    CostFunction* cost_function = industrial_extrinsic_cal::RailICal::Create(image_x, image_y, rail_position, point);
+    problem->AddResidualBlock(cost_function, NULL ,
+           camera_->camera_parameters_.pb_intrinsics,
+           target_->pose_.pb_pose);
+  } // for each observation at this camera_location
+
+  // a short solve, warm started from the previous one, so the final solve starts close to the solution
+  if(partial_solve_iterations_ > 0 && location > 0 && *total_observations > 0){
+    Solver::Options options;
+    Solver::Summary summary;
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+    options.max_num_iterations = partial_solve_iterations_;
+    ceres::Solve(options, problem, &summary);
+    ROS_INFO("Partial solve after location %d, cost per observation = %lf", location, summary.final_cost/(*total_observations));
+  }
 }
 
 void RailCalService::cameraCallback(const sensor_msgs::Image &image)
@@ -206,8 +282,6 @@ void RailCalService::cameraCallback(const sensor_msgs::Image &image)
 bool RailCalService::executeCallBack( intrinsic_cal::rail_ical_run::Request &req, intrinsic_cal::rail_ical_run::Response &res)
 {
   ros::NodeHandle nh;
-  CameraObservations camera_observations;
-  int num_observations ;
   int total_observations=0;
   double rxry[2]; // pitch and yaw of camera relative to rail
   rxry[0] = 0.0;
@@ -231,50 +305,42 @@ bool RailCalService::executeCallBack( intrinsic_cal::rail_ical_run::Request &req
   target_->pose_.setQuaternion(qx_, qy_, qz_, qw_);
   target_->pose_.setOrigin(0.011, 0.05, D0_);
   target_->pose_.show("initial target pose");
+  {
+    boost::lock_guard<boost::mutex> lock(ready_mutex_);
+    camera_ready_ = false;
+  }
   ros::NodeHandle pnh("~");
-  bool camera_ready = false;
-  pnh.setParam("camera_ready", camera_ready);
+  pnh.setParam("camera_ready", false);
+
+  // detection and partial solve of location i run on a worker while the camera moves to location i+1
+  boost::thread detection_thread;
   for(int i=0; i<num_camera_locations_; i++){
     double rail_position = i*camera_spacing_;
-    ROS_WARN("Move Camera to location %d which should be %lf meters from start. Then set camera_ready", i, i*camera_spacing_);
+    ROS_WARN("Move Camera to location %d which should be %lf meters from start. Then call ~camera_ready", i, i*camera_spacing_);
 
     // wait for camera to be moved
-    camera_ready = false;
-    pnh.setParam("camera_ready", camera_ready);
-    while(camera_ready == false){
-      if(!pnh.getParam("camera_ready", camera_ready)){
-        ROS_ERROR_THROTTLE(1, "parameter camera_ready does not exists");
-        ros::Duration(0.25).sleep();
-      }
+    waitForCameraReady();
+    pnh.setParam("camera_ready", false);
+
+    // the observer holds a single image, so the previous detection must be done before the next capture
+    if(detection_thread.joinable()){
+      detection_thread.join();
     }
+
     // gather next image
     camera_->camera_observer_->clearTargets();
     camera_->camera_observer_->clearObservations();
     camera_->camera_observer_->addTarget(target_, roi, cost_type);
     camera_->camera_observer_->triggerCamera();
-    while (!camera_->camera_observer_->observationsDone()) ;
-    camera_->camera_observer_->getObservations(camera_observations);
-    ROS_INFO("Found %d observations",(int) camera_observations.size());
-    num_observations = (int) camera_observations.size();
-    if(num_observations != target_rows_* target_cols_){
-      ROS_ERROR("Target Locator could not find target %d", num_observations);
+    while (!camera_->camera_observer_->observationsDone()){
+      ros::Duration(0.001).sleep();
     }
-    
-    // add a new cost to the problem for each observation
-    CostFunction* cost_function[num_observations]; // not sure I need a new cost function each time, but this just uses memory
-    total_observations += num_observations;
-    for(int i=0; i<num_observations; i++){
-      double image_x = camera_observations[i].image_loc_x;
-      double image_y = camera_observations[i].image_loc_y;
-      Point3d point = target_->pts_[i]; // assume correct ordering from camera observer
-      cost_function[i] = industrial_extrinsic_cal::RailICal::Create(image_x, image_y, rail_position, point);
-      problem.AddResidualBlock(cost_function[i], NULL ,
-             camera_->camera_parameters_.pb_intrinsics,
-             target_->pose_.pb_pose);
-      double residual[2];
-      industrial_extrinsic_cal::RailICal RC(image_x, image_y, rail_position, point);
-    } // for each observation at this camera_location
+    detection_thread = boost::thread(boost::bind(&RailCalService::processObservations, this, &problem, rail_position, i,
+                                                 &total_observations));
   }// for each camera_location
+  if(detection_thread.joinable()){
+    detection_thread.join();
+  }
 
   // set up and solve the problem
   Solver::Options options;
@@ -363,7 +429,9 @@ int main(int argc, char** argv)
   ros::init(argc, argv, "rail_cal_service");
   ros::NodeHandle node_handle;
   RailCalService rail_cal(node_handle);
-  ros::spin();
+  // a second thread serves ~camera_ready while the calibration service call is running
+  ros::AsyncSpinner spinner(2);
+  spinner.start();
   ros::waitForShutdown();
   return 0;
 }
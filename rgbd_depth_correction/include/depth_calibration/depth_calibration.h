@@ -38,6 +38,10 @@
 
 #include "ceres/ceres.h"
 
+#include <depth_calibration/depth_cloud_store.h>
+#include <depth_calibration/plane_fitting.h>
+#include <tf/tf.h>
+
 template<typename T> void calculateResidualError(T& a, T& b, T& c, T& d, T& dk,
                                                  T pt[3], T dp[2], T& error);
 template<typename T> inline void calculateResidualError(T& a, T& b, T& c, T& d, T& dk,
@@ -116,6 +120,118 @@ public:
 
 };
 
+/**
+ * @brief Depth error for a chunk of pixels sharing the same depth coefficients
+ *
+ * Evaluates the same residual as DepthError for many samples at once with analytic derivatives, so that the
+ * full-resolution fit has a few hundred residual blocks rather than one per pixel per cloud.  Residual blocks are
+ * independent, which lets Ceres evaluate them on all threads given in the solver options.
+ */
+class DepthErrorChunk : public ceres::CostFunction
+{
+public:
+
+  /** @brief One pixel observation, a plane from its cloud's target pose, its pixel depth error and measured point */
+  struct Sample
+  {
+    double plane[4]; /** plane equation parameters a, b, c, d */
+    double dk;       /** depth correction value */
+    double x, y, z;  /** point cloud (x,y,z) location */
+  };
+
+  explicit DepthErrorChunk(const std::vector<Sample>& samples) : samples_(samples)
+  {
+    set_num_residuals(samples_.size());
+    mutable_parameter_block_sizes()->push_back(2);
+  }
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+  {
+    double* jacobian = (jacobians != NULL) ? jacobians[0] : NULL;
+    for(size_t i = 0; i < samples_.size(); ++i)
+    {
+      const Sample& s = samples_[i];
+      evaluateSample(s.plane, s.dk, s.x, s.y, s.z, parameters[0], residuals[i], jacobian ? jacobian + 2*i : NULL);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Residual |z_plane - (z + dk*e^(d1 + d2*z))| of one sample and, if jacobian is not NULL, its derivative
+   */
+  static inline void evaluateSample(const double plane[4], double dk, double x, double y, double z,
+                                    const double dp[2], double& residual, double* jacobian)
+  {
+    double dc = dk * exp(dp[0] + dp[1] * z);
+    double e = (-plane[3] - plane[0]*x - plane[1]*y) / plane[2] - (z + dc);
+    double sign = (e < 0.0) ? -1.0 : 1.0;
+    if(z == 0.0)
+    {
+      e = sign = 0.0;
+    }
+    residual = sign * e;
+    if(jacobian != NULL)
+    {
+      // d|e|/d(d1) = -sign(e) * dc, d|e|/d(d2) = -sign(e) * dc * z
+      jacobian[0] = -sign * dc;
+      jacobian[1] = -sign * dc * z;
+    }
+  }
+
+private:
+  std::vector<Sample> samples_; /** pixel samples evaluated by this block */
+};
+
+/**
+ * @brief Depth error for a range of pixels of one cloud in a DepthCloudStore
+ *
+ * Reads the pixels straight from the memory mapped store on every evaluation instead of holding a copy, so the fit
+ * over stored clouds needs memory for the residual blocks only.  The store must stay mapped while solving.
+ */
+class StoredDepthErrorChunk : public ceres::CostFunction
+{
+public:
+
+  StoredDepthErrorChunk(const DepthCloudStore& store, const pcl::PointCloud<pcl::PointXYZ>& correction_cloud,
+                        size_t cloud, size_t begin, size_t end) :
+    store_(store), correction_cloud_(correction_cloud), cloud_(cloud), begin_(begin), end_(end)
+  {
+    int num_valid = 0;
+    for(size_t i = begin_; i < end_; ++i)
+    {
+      num_valid += store_.isValid(cloud_, i);
+    }
+    set_num_residuals(num_valid);
+    mutable_parameter_block_sizes()->push_back(2);
+  }
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+  {
+    double* jacobian = (jacobians != NULL) ? jacobians[0] : NULL;
+    const double* plane = store_.plane(cloud_);
+    int k = 0;
+    for(size_t i = begin_; i < end_; ++i)
+    {
+      if(!store_.isValid(cloud_, i))
+      {
+        continue;
+      }
+      pcl::PointXYZ pt = store_.point(cloud_, i);
+      DepthErrorChunk::evaluateSample(plane, correction_cloud_.points[i].z, pt.x, pt.y, pt.z, parameters[0],
+                                      residuals[k], jacobian ? jacobian + 2*k : NULL);
+      ++k;
+    }
+    return true;
+  }
+
+private:
+  const DepthCloudStore& store_;  /** store holding the cloud */
+  const pcl::PointCloud<pcl::PointXYZ>& correction_cloud_;  /** pixel depth correction values */
+  size_t cloud_;  /** index of the cloud in the store */
+  size_t begin_;  /** first pixel of the range */
+  size_t end_;    /** one past the last pixel of the range */
+};
+
 
 class DepthCalibrator
 {
@@ -197,6 +313,14 @@ private:
 
   double std_dev_error_;  /**< @brief The standard deviation error allowed for finding the target pose */
   double depth_error_threshold_; /**< @brief The depth error allowed for calculating the pixel depth error map */
+  int fit_chunk_size_;  /**< @brief Number of pixels per residual block in the depth coefficient fit, 0 uses one block per pixel */
+  int fit_num_threads_;  /**< @brief Number of threads used to evaluate residuals in the depth coefficient fit */
+  std::string plane_source_;  /**< @brief Source of the plane equations, "target" for target pose averaging or "depth" for a fit to the cloud */
+  double target_region_radius_;  /**< @brief Radius around the target origin of the points used for the depth plane fit */
+  double plane_angle_tolerance_;  /**< @brief Largest angle (rad) between a target pose normal and the depth plane normal before the pose is rejected */
+  depth_calibration::PlaneFitOptions plane_fit_options_;  /**< @brief RANSAC options of the depth plane fit */
+  std::string store_file_;  /**< @brief If not empty, clouds for the depth coefficient fit are kept in this file instead of saved_clouds_ */
+  DepthCloudStore cloud_store_;  /**< @brief Disk backed storage of the clouds when store_file_ is set */
   boost::mutex data_lock_; /**< @brief Lock for data subscription */
   sensor_msgs::Image last_image_;  /**< @brief The last color image received */
   pcl::PointCloud<pcl::PointXYZ> last_cloud_;  /**< @brief The last point cloud received */
@@ -227,6 +351,11 @@ private:
   /**
      * @brief Calls the findTarget function multiple times (num_views) and returns the average plane equation and the last target pose found
      *
+     * Target poses whose plane normal differs from the plane fit to the measured cloud by more than plane_angle_tolerance_
+     * count as failed attempts and are left out of the average.  When plane_source_ is "depth", the plane fit to the
+     * cloud around the first target found is returned directly.  Note that such a plane follows the measured depth, so
+     * it leaves out any depth offset common to the whole target region.
+     *
      * @param[out] plane_eq The average plane equation results found from averaging the results from all of the target poses found
      * @param[out] target_pose The pose of the target found from the last service call
      * @return True if the target was successfully found before the number of failures (num_attempts) was reached
@@ -234,6 +363,35 @@ private:
   bool findAveragePlane(std::vector<double> &plane_eq, geometry_msgs::Pose& target_pose);
 
   bool findAveragePointCloud(pcl::PointCloud<pcl::PointXYZ>& final_cloud);
+
+  /**
+     * @brief Fits a plane with RANSAC to the points of the last cloud near the target found at the given pose
+     *
+     * @param[in] target The pose of the target, defining the region of the cloud used
+     * @param[out] plane_eq The plane equation fit to the measured depth, with its normal along the target z-axis
+     * @return True if enough inliers were found
+     */
+  bool fitDepthPlane(const tf::Transform& target, std::vector<double>& plane_eq);
+
+  /**
+     * @brief Adds the residuals of the depth coefficient fit over all saved clouds to the problem
+     *
+     * Pixels are batched into DepthErrorChunk blocks of fit_chunk_size_ samples.  When fit_chunk_size_ is zero,
+     * one DepthError block is added per valid pixel per cloud.  Clouds in cloud_store_ are read by
+     * StoredDepthErrorChunk blocks of fit_chunk_size_ pixels, or of a single pixel when it is zero, which requires
+     * the store to be mapped.
+     *
+     * @param[in,out] problem The problem to add residual blocks to
+     * @param[in] dp The depth correction coefficients being solved for
+     * @return The number of pixel samples added, -1 if the cloud store can't be mapped
+     */
+  int addDepthResiduals(ceres::Problem& problem, double dp[2]);
+
+  /** @brief The number of clouds stored for the depth coefficient fit, in saved_clouds_ or cloud_store_ */
+  size_t numStoredClouds() const;
+
+  /** @brief Clears the clouds stored for the depth coefficient fit */
+  void clearStoredClouds();
 };
 
 #endif // DEPTH_CALIBRATION_H
@@ -0,0 +1,108 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEPTH_CLOUD_STORE_H
+#define DEPTH_CLOUD_STORE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/**
+ * @brief Disk backed storage for the averaged point clouds used by the depth coefficient fit
+ *
+ * Each stored cloud is written as a record holding its plane equation, a validity bitmask and the depth of every
+ * pixel as a 16 bit float.  The x and y coordinates of an organized cloud lie on a fixed ray per pixel, so they are
+ * kept once for the whole file as x/z and y/z and reconstructed from the depth on read.  For reading, the file is
+ * memory mapped, letting the kernel page clouds in and out as the fit streams over them.
+ *
+ * Half precision keeps 11 significant bits, i.e. about 1mm resolution at 1-2m and 2mm at 2-4m.
+ */
+class DepthCloudStore
+{
+public:
+
+  DepthCloudStore();
+  ~DepthCloudStore();
+
+  /**
+     * @brief Creates (or truncates) the store file for organized clouds of the given size
+     *
+     * @param[in] file The name and pathway of the store file
+     * @param[in] width The width of the clouds to be stored
+     * @param[in] height The height of the clouds to be stored
+     * @return True if the file was created
+     */
+  bool open(const std::string& file, int width, int height);
+
+  /**
+     * @brief Appends a cloud and its plane equation to the store, the store must not be mapped
+     *
+     * @param[in] cloud The organized cloud to store, must match the width and height given to open()
+     * @param[in] plane_eq The plane equation (a, b, c, d) of the target for this cloud
+     * @return True if the cloud was written
+     */
+  bool append(const pcl::PointCloud<pcl::PointXYZ>& cloud, const std::vector<double>& plane_eq);
+
+  /**
+     * @brief Memory maps the store file for reading
+     * @return True if the file was mapped
+     */
+  bool map();
+
+  /** @brief Releases the memory mapping, if any */
+  void unmap();
+
+  /** @brief Unmaps and closes the store and removes its file */
+  void clear();
+
+  bool isOpen() const { return fd_ >= 0; }
+  size_t size() const { return num_clouds_; }
+  size_t numPixels() const { return size_t(width_) * height_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  /**
+     * @brief The following accessors require the store to be mapped
+     */
+  bool isValid(size_t cloud, size_t pixel) const;
+  pcl::PointXYZ point(size_t cloud, size_t pixel) const;
+  const double* plane(size_t cloud) const;
+
+private:
+  std::string file_;   /**< @brief Name and pathway of the store file */
+  int fd_;             /**< @brief File descriptor of the store file, -1 when closed */
+  int width_;          /**< @brief Width of the stored clouds */
+  int height_;         /**< @brief Height of the stored clouds */
+  size_t num_clouds_;  /**< @brief Number of clouds written to the file */
+  std::vector<float> rays_;  /**< @brief x/z and y/z of each pixel, NaN until the pixel has been valid once */
+  uint8_t* data_;      /**< @brief Start of the mapping, NULL when not mapped */
+  size_t data_size_;   /**< @brief Size of the mapping */
+
+  size_t maskBytes() const;
+  size_t recordBytes() const;
+  size_t raysOffset() const;
+  size_t recordOffset(size_t cloud) const;
+  bool writeAll(const void* buf, size_t count, size_t offset);
+};
+
+#endif // DEPTH_CLOUD_STORE_H
@@ -0,0 +1,125 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEPTH_CORRECTION_MODEL_H
+#define DEPTH_CORRECTION_MODEL_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace rgbd_depth_correction
+{
+
+/**
+ * @brief Depth correction parameters of one camera, as written by the depth calibration node
+ *
+ * The per-pixel correction values are read from a memory mapped cache file holding the z values of the .pcd
+ * correction cloud as raw floats.  The cache is (re)generated next to the .pcd whenever it is missing or older than
+ * the .pcd, so only the first start after a calibration pays for parsing the point cloud.
+ */
+class DepthCorrectionModel
+{
+public:
+  DepthCorrectionModel();
+  ~DepthCorrectionModel();
+
+  /**
+     * @brief Reads the version, coefficients and correction values of the calibration files <file>.yaml and <file>.pcd
+     *
+     * @param[in] file The pathway and name of the calibration files, without extension
+     * @return True if the files were read and their version is known
+     */
+  bool load(const std::string& file);
+
+  int version() const { return version_; }
+  double d1() const { return d1_; }
+  double d2() const { return d2_; }
+  size_t size() const { return size_; }
+  const float* correction() const { return correction_; }
+
+  /**
+     * @brief Applies the depth correction to a cloud of the same size as the correction values
+     *
+     * @param[in,out] cloud The cloud to correct
+     * @param[in] use_depth_exp Whether to scale the correction values with the depth coefficients
+     * @return False if the cloud size does not match or the version is unknown, in which case the cloud is unchanged
+     */
+  bool correct(pcl::PointCloud<pcl::PointXYZ>& cloud, bool use_depth_exp) const;
+
+private:
+  int version_;          /**< @brief The version number found in the YAML file */
+  double d1_, d2_;       /**< @brief The depth coefficients */
+  const float* correction_;  /**< @brief The per-pixel depth correction values, in the mapping or in values_ */
+  size_t size_;          /**< @brief Number of correction values */
+  std::vector<float> values_;  /**< @brief Correction values when the cache file could not be used */
+  void* mapping_;        /**< @brief Memory mapping of the cache file, NULL if not mapped */
+  size_t mapping_size_;  /**< @brief Size of the memory mapping */
+
+  bool mapCache(const std::string& cache_file, long pcd_mtime);
+  void writeCache(const std::string& cache_file, long pcd_mtime) const;
+
+  // not copyable, the mapping is owned
+  DepthCorrectionModel(const DepthCorrectionModel&);
+  DepthCorrectionModel& operator=(const DepthCorrectionModel&);
+};
+
+typedef boost::shared_ptr<const DepthCorrectionModel> DepthCorrectionModelConstPtr;
+
+/**
+ * @brief Process wide cache of depth correction models keyed by camera file name (usually the serial number)
+ *
+ * All nodelets loaded in the same manager share one instance, so a model is loaded once no matter how many streams use
+ * it.  Concurrent requests for the same model wait for a single load, requests for different models load in parallel.
+ */
+class DepthCorrectionModelCache
+{
+public:
+  static DepthCorrectionModelCache& instance();
+
+  /**
+     * @brief Returns the model of the calibration files <filepath><name>.yaml/.pcd, loading it on first use
+     *
+     * @param[in] filepath The pathway to the calibration files
+     * @param[in] name The name of the calibration files, without extension
+     * @return The model, or an empty pointer if it could not be loaded
+     */
+  DepthCorrectionModelConstPtr get(const std::string& filepath, const std::string& name);
+
+private:
+  struct Entry
+  {
+    boost::mutex load_lock;
+    DepthCorrectionModelConstPtr model;
+  };
+
+  boost::mutex lock_;  /**< @brief Lock for entries_ */
+  std::map<std::string, boost::shared_ptr<Entry> > entries_;  /**< @brief Entries keyed by pathway and name */
+
+  DepthCorrectionModelCache() {}
+};
+
+} // namespace rgbd_depth_correction
+
+#endif // DEPTH_CORRECTION_MODEL_H
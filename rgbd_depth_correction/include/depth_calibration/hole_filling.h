@@ -0,0 +1,54 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOLE_FILLING_H
+#define HOLE_FILLING_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace depth_calibration
+{
+
+/**
+ * @brief Fills the NaN points of an organized depth correction cloud with push-pull pyramid interpolation
+ *
+ * The valid z values are averaged down a pyramid of 2x2 blocks until the coarsest level is covered, then each level
+ * fills its holes by bilinear interpolation of the level above on the way back up.  Every level is visited twice, so
+ * the cost is linear in the number of points regardless of the size of the holes.  Filled points get x = y = 0 and the
+ * interpolated correction value in z, valid points are left untouched.
+ *
+ * @param[in,out] cloud The organized cloud to fill, a point is a hole when its x is NaN
+ * @return False if the cloud has no valid point to fill from, in which case it is left unchanged
+ */
+bool fillHolesPushPull(pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+/**
+ * @brief Fills the NaN points of an organized depth correction cloud by repeated averaging of 4-neighbors
+ *
+ * Each pass replaces the holes that have at least one valid neighbor, passes repeat until no hole remains.  The
+ * number of passes grows with the size of the largest hole, so this is quadratic for large invalid regions.
+ *
+ * @param[in,out] cloud The organized cloud to fill, a point is a hole when its x is NaN
+ * @return False if the cloud has no valid point to fill from, in which case it is left unchanged
+ */
+bool fillHolesIterative(pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+} // namespace depth_calibration
+
+#endif // HOLE_FILLING_H
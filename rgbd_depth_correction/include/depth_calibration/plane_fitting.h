@@ -0,0 +1,77 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLANE_FITTING_H
+#define PLANE_FITTING_H
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace depth_calibration
+{
+
+/** @brief Parameters of fitPlaneRansac() */
+struct PlaneFitOptions
+{
+  PlaneFitOptions() :
+    inlier_threshold(0.01), max_iterations(500), max_time(0.05), confidence(0.999), num_threads(1), seed(0)
+  {
+  }
+
+  double inlier_threshold;  /**< @brief Largest point to plane distance of an inlier (m) */
+  int max_iterations;       /**< @brief Upper bound on the number of hypotheses over all threads */
+  double max_time;          /**< @brief Upper bound on the time spent generating hypotheses (s) */
+  double confidence;        /**< @brief Probability of having drawn an outlier free sample before stopping early */
+  int num_threads;          /**< @brief Number of threads generating hypotheses */
+  unsigned int seed;        /**< @brief Seed of the sampling, each thread uses seed + thread index */
+};
+
+/**
+ * @brief Fits a plane to points with RANSAC followed by a least squares refit on the inliers
+ *
+ * Hypotheses are drawn from three random points on several threads, each scoring its hypotheses against all points at
+ * once.  Sampling stops after max_iterations hypotheses, after max_time seconds, or once the best inlier ratio gives
+ * the requested confidence, whichever comes first.
+ *
+ * @param[in] points The points to fit, one per column
+ * @param[in] options Bounds and thresholds of the fit
+ * @param[out] plane The plane (a, b, c, d) with a*x + b*y + c*z + d = 0 and a unit normal (a, b, c)
+ * @param[out] num_inliers The number of points within inlier_threshold of the refit plane
+ * @return False if there are fewer than three points or no hypothesis could be formed
+ */
+bool fitPlaneRansac(const Eigen::Matrix3Xf& points, const PlaneFitOptions& options, Eigen::Vector4d& plane,
+                    int& num_inliers);
+
+/**
+ * @brief Collects the valid points of a cloud lying near the target plane and within a radius of the target origin
+ *
+ * @param[in] cloud The cloud to select points from
+ * @param[in] target_plane The plane (a, b, c, d) of the target, with a unit normal
+ * @param[in] target_origin The origin of the target in the cloud frame
+ * @param[in] radius The largest distance from the origin along the plane
+ * @param[in] max_distance The largest distance from the plane
+ * @param[out] points The selected points, one per column
+ */
+void selectTargetRegion(const pcl::PointCloud<pcl::PointXYZ>& cloud, const Eigen::Vector4d& target_plane,
+                        const Eigen::Vector3d& target_origin, double radius, double max_distance,
+                        Eigen::Matrix3Xf& points);
+
+} // namespace depth_calibration
+
+#endif // PLANE_FITTING_H
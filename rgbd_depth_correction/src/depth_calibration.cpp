@@ -17,8 +17,11 @@
  */
 
 #include <depth_calibration/depth_calibration.h>
+#include <depth_calibration/hole_filling.h>
 #include <target_finder/target_locater.h>
 #include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
 #include <sstream>
 
 #include <tf/tf.h>
@@ -84,6 +87,28 @@ DepthCalibrator::DepthCalibrator(ros::NodeHandle& nh)
   pnh.param<int>("num_views", num_views_, 30);
   pnh.param<int>("num_attempts", num_attempts_, 10);
   pnh.param<int>("point_cloud_history", num_point_clouds_, 30);
+  pnh.param<int>("fit_chunk_size", fit_chunk_size_, 4096);
+  pnh.param<int>("fit_num_threads", fit_num_threads_, std::max(1, int(boost::thread::hardware_concurrency())));
+  pnh.param<std::string>("store_file", store_file_, "");
+
+  double angle_tolerance;
+  pnh.param<std::string>("plane_source", plane_source_, "target");
+  pnh.param<double>("target_region_radius", target_region_radius_, 0.25);
+  pnh.param<double>("plane_angle_tolerance", angle_tolerance, 2.0);
+  pnh.param<double>("ransac_inlier_threshold", plane_fit_options_.inlier_threshold, 0.01);
+  pnh.param<int>("ransac_max_iterations", plane_fit_options_.max_iterations, 500);
+  pnh.param<double>("ransac_max_time", plane_fit_options_.max_time, 0.05);
+  plane_angle_tolerance_ = angle_tolerance * M_PI / 180.0;
+  plane_fit_options_.num_threads = fit_num_threads_;
+  if(plane_source_ != "target" && plane_source_ != "depth")
+  {
+    ROS_WARN("Unknown plane_source '%s'.  Defaulting to 'target'.", plane_source_.c_str());
+    plane_source_ = "target";
+  }
+  if(!store_file_.empty())
+  {
+    ROS_INFO_STREAM("Stored point clouds will be kept on disk in " << store_file_);
+  }
 
 
   //Create Subscribers and Services
@@ -122,12 +147,13 @@ bool DepthCalibrator::calibrateCameraDepth(std_srvs::Empty::Request &request, st
 {
   boost::lock_guard<boost::mutex> lock(data_lock_);
 
-  if(saved_clouds_.size() > 0)
+  if(numStoredClouds() > 0)
   {
-    if( !(saved_clouds_[0].points.size() == correction_cloud_.points.size()) )
+    size_t saved_size = store_file_.empty() ? saved_clouds_[0].points.size() : cloud_store_.numPixels();
+    if( !(saved_size == correction_cloud_.points.size()) )
     {
       ROS_ERROR("Point cloud pixel depth correction cloud size (%lu) not the same size as saved cloud size (%lu). Aborting depth calibration.",
-                correction_cloud_.points.size(), saved_clouds_[0].points.size());
+                correction_cloud_.points.size(), saved_size);
       return false;
     }
   }
@@ -142,27 +168,20 @@ bool DepthCalibrator::calibrateCameraDepth(std_srvs::Empty::Request &request, st
   double dp[2];
   dp[0] = dp[1] = 0;
 
-  // Add each point in all point clouds as a new cost
-  for(int i = 0; i < saved_clouds_[0].points.size(); ++i)
+  int num_samples = addDepthResiduals(problem, dp);
+  if(num_samples < 0)
   {
-    for(int j = 0; j < saved_clouds_.size(); ++j)
-    {
-      if(isnan(saved_clouds_[j].points.at(i).x) || saved_clouds_[j].points.at(i).z == 0)
-      {
-        continue;
-      }
-      std::vector<double> eq;
-      eq = plane_equations_[j];
-      ceres::CostFunction* cost_function = DepthError::Create(eq[0], eq[1], eq[2], eq[3],
-                                                              correction_cloud_.points.at(i).z, saved_clouds_[j].points.at(i)) ;
-      problem.AddResidualBlock(cost_function, NULL, dp);
-    }
+    ROS_ERROR("Stored point cloud data is not readable.  Aborting depth calibration");
+    return false;
   }
+  ROS_INFO("Fitting depth coefficients to %d pixel samples in %d residual blocks using %d threads",
+           num_samples, problem.NumResidualBlocks(), fit_num_threads_);
 
   //Create Ceres problem to optimize depth correction coefficients
   ceres::Solver::Options options;
   ceres::Solver::Summary summary;
-  options.linear_solver_type = ceres::DENSE_SCHUR;
+  options.linear_solver_type = ceres::DENSE_QR;
+  options.num_threads = fit_num_threads_;
   options.minimizer_progress_to_stdout = false;
   options.max_num_iterations = 1000;
   ceres::Solve(options, &problem, &summary);
@@ -176,9 +195,109 @@ bool DepthCalibrator::calibrateCameraDepth(std_srvs::Empty::Request &request, st
   {
     storeCalibration((filepath_ + "/" +filename_ + ".yaml"), dp);
   }
+  clearStoredClouds();
+  return true;
+}
+
+size_t DepthCalibrator::numStoredClouds() const
+{
+  return store_file_.empty() ? saved_clouds_.size() : cloud_store_.size();
+}
+
+void DepthCalibrator::clearStoredClouds()
+{
   saved_clouds_.clear();
   plane_equations_.clear();
   saved_images_.clear();
+  cloud_store_.clear();
+}
+
+int DepthCalibrator::addDepthResiduals(ceres::Problem& problem, double dp[2])
+{
+  int num_samples = 0;
+
+  if(!store_file_.empty())
+  {
+    // Stream the points of the stored clouds from disk, in chunks of fit_chunk_size_ pixels
+    if(!cloud_store_.map())
+    {
+      return -1;
+    }
+    size_t chunk_size = (fit_chunk_size_ > 0) ? fit_chunk_size_ : 1; // zero means one block per pixel, as in memory
+    for(size_t j = 0; j < cloud_store_.size(); ++j)
+    {
+      for(size_t begin = 0; begin < cloud_store_.numPixels(); begin += chunk_size)
+      {
+        size_t end = std::min(begin + chunk_size, cloud_store_.numPixels());
+        StoredDepthErrorChunk* cost_function = new StoredDepthErrorChunk(cloud_store_, correction_cloud_, j, begin, end);
+        if(cost_function->num_residuals() == 0)
+        {
+          delete cost_function;
+          continue;
+        }
+        num_samples += cost_function->num_residuals();
+        problem.AddResidualBlock(cost_function, NULL, dp);
+      }
+    }
+    return num_samples;
+  }
+
+  if(fit_chunk_size_ <= 0)
+  {
+    // Add each point in all point clouds as a new cost
+    for(int i = 0; i < saved_clouds_[0].points.size(); ++i)
+    {
+      for(int j = 0; j < saved_clouds_.size(); ++j)
+      {
+        if(isnan(saved_clouds_[j].points.at(i).x) || saved_clouds_[j].points.at(i).z == 0)
+        {
+          continue;
+        }
+        std::vector<double> eq;
+        eq = plane_equations_[j];
+        ceres::CostFunction* cost_function = DepthError::Create(eq[0], eq[1], eq[2], eq[3],
+                                                                correction_cloud_.points.at(i).z, saved_clouds_[j].points.at(i)) ;
+        problem.AddResidualBlock(cost_function, NULL, dp);
+        ++num_samples;
+      }
+    }
+    return num_samples;
+  }
+
+  // Batch the points of all point clouds into chunks of fit_chunk_size_ samples
+  std::vector<DepthErrorChunk::Sample> chunk;
+  chunk.reserve(fit_chunk_size_);
+  for(int j = 0; j < saved_clouds_.size(); ++j)
+  {
+    const std::vector<double>& eq = plane_equations_[j];
+    for(int i = 0; i < saved_clouds_[j].points.size(); ++i)
+    {
+      const pcl::PointXYZ& pt = saved_clouds_[j].points[i];
+      if(isnan(pt.x) || pt.z == 0)
+      {
+        continue;
+      }
+      DepthErrorChunk::Sample sample;
+      std::copy(eq.begin(), eq.begin() + 4, sample.plane);
+      sample.dk = correction_cloud_.points[i].z;
+      sample.x = pt.x;
+      sample.y = pt.y;
+      sample.z = pt.z;
+      chunk.push_back(sample);
+      ++num_samples;
+
+      if(chunk.size() == static_cast<size_t>(fit_chunk_size_))
+      {
+        problem.AddResidualBlock(new DepthErrorChunk(chunk), NULL, dp);
+        chunk.clear();
+      }
+    }
+  }
+  if(!chunk.empty())
+  {
+    problem.AddResidualBlock(new DepthErrorChunk(chunk), NULL, dp);
+  }
+  return num_samples;
 }
 
 bool DepthCalibrator::findAveragePointCloud(pcl::PointCloud<pcl::PointXYZ>& final_cloud)
@@ -328,73 +447,11 @@ bool DepthCalibrator::calibrateCameraPixelDepth(std_srvs::Empty::Request &reques
     }
   }
 
-  // Iterate through depth correction cloud and replace all NaNs with average value of neighbors
-  // Repeat until no NaNs remain
-  bool done = false;
-  while(!done)
+  // Replace all NaNs by interpolating the surrounding correction values
+  if(!depth_calibration::fillHolesPushPull(correction_cloud_))
   {
-    int num_nan = 0;
-    bool nan_found = false;
-    for(int i = 0; i < correction_cloud_.points.size(); ++i)
-    {
-
-
-      // If value is NaN, find average of neighbors
-      if(isnan(correction_cloud_.points.at(i).x))
-      {
-
-        ++num_nan;
-        nan_found = true;
-        double val = 0.0;
-        int count = 0;
-
-        if((i+1) % (correction_cloud_.width) > 0 || i == 0) // add point to the right except when at the far right side
-        {
-          if(isnan(correction_cloud_.points.at(i+1).z) == 0)
-          {
-            val += correction_cloud_.points.at(i+1).z;
-            ++count;
-          }
-        }
-
-        if(i % correction_cloud_.width > 0 ) // add point to the left except when at the far left side
-        {
-          if(isnan(correction_cloud_.points.at(i-1).z) == 0)
-          {
-            val += correction_cloud_.points.at(i-1).z;
-            ++count;
-          }
-        }
-
-        if(i > (correction_cloud_.width - 1) ) // add point to the top except when at the top row
-        {
-          if(isnan(correction_cloud_.points.at(i-correction_cloud_.width).z) == 0)
-          {
-            val += correction_cloud_.points.at(i-correction_cloud_.width).z;
-            ++count;
-          }
-        }
-
-        if((i+1) < correction_cloud_.height * correction_cloud_.width - correction_cloud_.width ) // add point to the bottom except when at the bottom row
-        {
-          if(isnan(correction_cloud_.points.at(i+correction_cloud_.width).z) == 0)
-          {
-            val += correction_cloud_.points.at(i+correction_cloud_.width).z;
-            ++count;
-          }
-        }
-
-        if(count > 0)
-        {
-          pcl::PointXYZ pt;
-          pt.x = 0;
-          pt.y = 0;
-          pt.z = val / double(count);
-          correction_cloud_.points.at(i) = pt;
-        }
-      }
-    }
-    done = !nan_found;
+    ROS_ERROR("No valid pixel depth error found.  Aborting depth calibration");
+    return false;
   }
 
   correction_cloud_.is_dense = false;
@@ -431,12 +488,33 @@ bool DepthCalibrator::setStoreCloud(std_srvs::Empty::Request &request, std_srvs:
     }
     else
     {
-      plane_equations_.push_back(plane_eq);
       saved_target_poses_.push_back(target_pose);
       avg_cloud.is_dense = false;
-      saved_clouds_.push_back(avg_cloud);
       cv_bridge::CvImagePtr bridge = cv_bridge::toCvCopy(last_image_, sensor_msgs::image_encodings::BGR8);
-      saved_images_.push_back(bridge->image);
+      if(store_file_.empty())
+      {
+        plane_equations_.push_back(plane_eq);
+        saved_clouds_.push_back(avg_cloud);
+        saved_images_.push_back(bridge->image);
+      }
+      else
+      {
+        if(!cloud_store_.isOpen() && !cloud_store_.open(store_file_, avg_cloud.width, avg_cloud.height))
+        {
+          ROS_ERROR("Failed to open point cloud store.  Not storing depth data");
+          return false;
+        }
+        // the fit needs the cloud and plane only, images go to disk next to the store
+        cloud_store_.unmap();
+        if(!cloud_store_.append(avg_cloud, plane_eq))
+        {
+          ROS_ERROR("Failed to write point cloud to store.  Not storing depth data");
+          return false;
+        }
+        std::stringstream image_file;
+        image_file << store_file_ << "_" << cloud_store_.size() << ".png";
+        cv::imwrite(image_file.str(), bridge->image);
+      }
 
       ROS_INFO("Point cloud and image successfully collected");
     }
@@ -467,7 +545,7 @@ bool DepthCalibrator::findAveragePlane(std::vector<double>& plane_eq, geometry_m
 
   plane_eq.clear();
   geometry_msgs::Pose temp_pose;
-  std::vector<double> a, b, c, d;
+  std::vector<double> a, b, c, d, depth_plane;
   int error = 0;
 
   // Find the target multiple times or until the error limit is reached
@@ -491,6 +569,34 @@ bool DepthCalibrator::findAveragePlane(std::vector<double>& plane_eq, geometry_m
     pb = transform.getBasis().getColumn(2)[1];
     pc = transform.getBasis().getColumn(2)[2];
 
+    // Cross-check the target plane against the measured depth data
+    if(depth_plane.empty() && !fitDepthPlane(transform, depth_plane))
+    {
+      ROS_WARN("Could not fit a plane to the point cloud around the target");
+      depth_plane.clear();
+    }
+    if(plane_source_ == "depth")
+    {
+      if(depth_plane.empty())
+      {
+        ++error;
+        continue;
+      }
+      target_pose = temp_pose;
+      plane_eq = depth_plane;
+      return true;
+    }
+    if(!depth_plane.empty())
+    {
+      double angle = acos(std::min(1.0, fabs(pa*depth_plane[0] + pb*depth_plane[1] + pc*depth_plane[2])));
+      if(angle > plane_angle_tolerance_)
+      {
+        ROS_WARN("Target plane differs from the measured depth plane by %.2f degrees, rejecting target pose", angle * 180.0 / M_PI);
+        ++error;
+        continue;
+      }
+    }
+
     a.push_back(pa);
     b.push_back(pb);
     c.push_back(pc);
@@ -550,6 +656,36 @@ bool DepthCalibrator::findAveragePlane(std::vector<double>& plane_eq, geometry_m
   return rtn;
 }
 
+bool DepthCalibrator::fitDepthPlane(const tf::Transform& target, std::vector<double>& plane_eq)
+{
+  tf::Vector3 z_axis = target.getBasis().getColumn(2);
+  tf::Vector3 origin = target.getOrigin();
+  Eigen::Vector4d target_plane(z_axis.x(), z_axis.y(), z_axis.z(), -z_axis.dot(origin));
+
+  Eigen::Matrix3Xf points;
+  {
+    boost::lock_guard<boost::mutex> lock(data_lock_);
+    depth_calibration::selectTargetRegion(last_cloud_, target_plane, Eigen::Vector3d(origin.x(), origin.y(), origin.z()),
+                                          target_region_radius_, depth_error_threshold_, points);
+  }
+
+  Eigen::Vector4d plane;
+  int num_inliers;
+  if(!depth_calibration::fitPlaneRansac(points, plane_fit_options_, plane, num_inliers) || num_inliers < points.cols() / 2)
+  {
+    return false;
+  }
+  if(plane.head<3>().dot(target_plane.head<3>()) < 0.0)
+  {
+    plane = -plane;
+  }
+  ROS_INFO("Depth plane fit to %d of %ld points around the target: (%.4f, %.4f, %.4f, %.4f)", num_inliers, points.cols(),
+           plane(0), plane(1), plane(2), plane(3));
+
+  plane_eq.assign(plane.data(), plane.data() + 4);
+  return true;
+}
+
 bool DepthCalibrator::findTarget(const double &final_cost, geometry_msgs::Pose& target_pose)
 {
   bool rtn = true;
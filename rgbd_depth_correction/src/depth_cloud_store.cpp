@@ -0,0 +1,307 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <depth_calibration/depth_cloud_store.h>
+
+#include <ros/console.h>
+
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+const char STORE_MAGIC[8] = {'R', 'G', 'B', 'D', 'S', 'T', 'O', 'R'};
+const uint32_t STORE_VERSION = 1;
+
+struct StoreHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved;
+};
+
+size_t pad8(size_t n)
+{
+  return (n + 7) & ~size_t(7);
+}
+
+// IEEE 754 binary16 conversion, rounding to nearest.  Depths are positive and well inside the half range, but
+// overflow and subnormals are handled for completeness
+uint16_t floatToHalf(float value)
+{
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+  uint32_t sign = (f >> 16) & 0x8000;
+  int32_t exponent = int32_t((f >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = f & 0x7fffff;
+
+  if(exponent <= 0)
+  {
+    if(exponent < -10)
+    {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - exponent;
+    return sign | ((mantissa + (1 << (shift - 1))) >> shift);
+  }
+  if(exponent >= 31)
+  {
+    return sign | 0x7c00;
+  }
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  // round to nearest, a carry into the exponent is the correct result
+  if(mantissa & 0x1000)
+  {
+    ++half;
+  }
+  return half;
+}
+
+float halfToFloat(uint16_t half)
+{
+  uint32_t sign = uint32_t(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  uint32_t f;
+
+  if(exponent == 0)
+  {
+    float value = std::ldexp(float(mantissa), -24);
+    return sign ? -value : value;
+  }
+  else if(exponent == 31)
+  {
+    f = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else
+  {
+    f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+  float value;
+  std::memcpy(&value, &f, sizeof(value));
+  return value;
+}
+}
+
+DepthCloudStore::DepthCloudStore() :
+  fd_(-1), width_(0), height_(0), num_clouds_(0), data_(NULL), data_size_(0)
+{
+}
+
+DepthCloudStore::~DepthCloudStore()
+{
+  unmap();
+  if(fd_ >= 0)
+  {
+    close(fd_);
+  }
+}
+
+size_t DepthCloudStore::maskBytes() const
+{
+  return pad8((numPixels() + 7) / 8);
+}
+
+size_t DepthCloudStore::recordBytes() const
+{
+  return 4 * sizeof(double) + maskBytes() + pad8(numPixels() * sizeof(uint16_t));
+}
+
+size_t DepthCloudStore::raysOffset() const
+{
+  return pad8(sizeof(StoreHeader));
+}
+
+size_t DepthCloudStore::recordOffset(size_t cloud) const
+{
+  return raysOffset() + pad8(rays_.size() * sizeof(float)) + cloud * recordBytes();
+}
+
+bool DepthCloudStore::writeAll(const void* buf, size_t count, size_t offset)
+{
+  const char* p = static_cast<const char*>(buf);
+  while(count > 0)
+  {
+    ssize_t n = pwrite(fd_, p, count, offset);
+    if(n <= 0)
+    {
+      return false;
+    }
+    p += n;
+    count -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool DepthCloudStore::open(const std::string& file, int width, int height)
+{
+  clear();
+
+  fd_ = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd_ < 0)
+  {
+    ROS_ERROR("Could not create depth cloud store file %s", file.c_str());
+    return false;
+  }
+  file_ = file;
+  width_ = width;
+  height_ = height;
+  num_clouds_ = 0;
+  rays_.assign(2 * numPixels(), NAN);
+
+  StoreHeader header;
+  std::memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+  header.version = STORE_VERSION;
+  header.width = width;
+  header.height = height;
+  header.reserved = 0;
+  if(!writeAll(&header, sizeof(header), 0) ||
+     !writeAll(&rays_[0], rays_.size() * sizeof(float), raysOffset()))
+  {
+    ROS_ERROR("Could not write depth cloud store header to %s", file.c_str());
+    clear();
+    return false;
+  }
+  return true;
+}
+
+bool DepthCloudStore::append(const pcl::PointCloud<pcl::PointXYZ>& cloud, const std::vector<double>& plane_eq)
+{
+  if(!isOpen() || data_ != NULL)
+  {
+    ROS_ERROR("Depth cloud store is not open for writing");
+    return false;
+  }
+  if(cloud.points.size() != numPixels() || plane_eq.size() < 4)
+  {
+    ROS_ERROR("Cloud size (%lu) does not match depth cloud store size (%lu)", cloud.points.size(), numPixels());
+    return false;
+  }
+
+  std::vector<uint8_t> record(recordBytes(), 0);
+  std::memcpy(&record[0], &plane_eq[0], 4 * sizeof(double));
+  uint8_t* mask = &record[4 * sizeof(double)];
+  uint16_t* depth = reinterpret_cast<uint16_t*>(mask + maskBytes());
+
+  bool rays_changed = false;
+  for(size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    const pcl::PointXYZ& pt = cloud.points[i];
+    if(std::isnan(pt.x) || pt.z == 0)
+    {
+      continue;
+    }
+    mask[i / 8] |= uint8_t(1 << (i % 8));
+    depth[i] = floatToHalf(pt.z);
+    if(std::isnan(rays_[2*i]))
+    {
+      rays_[2*i] = pt.x / pt.z;
+      rays_[2*i + 1] = pt.y / pt.z;
+      rays_changed = true;
+    }
+  }
+
+  if(!writeAll(&record[0], record.size(), recordOffset(num_clouds_)) ||
+     (rays_changed && !writeAll(&rays_[0], rays_.size() * sizeof(float), raysOffset())))
+  {
+    ROS_ERROR("Could not write cloud %lu to depth cloud store %s", num_clouds_, file_.c_str());
+    return false;
+  }
+  ++num_clouds_;
+  return true;
+}
+
+bool DepthCloudStore::map()
+{
+  if(data_ != NULL)
+  {
+    return true;
+  }
+  if(!isOpen() || num_clouds_ == 0)
+  {
+    return false;
+  }
+  data_size_ = recordOffset(num_clouds_);
+  void* addr = mmap(NULL, data_size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if(addr == MAP_FAILED)
+  {
+    ROS_ERROR("Could not memory map depth cloud store %s", file_.c_str());
+    data_size_ = 0;
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(addr);
+  madvise(data_, data_size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void DepthCloudStore::unmap()
+{
+  if(data_ != NULL)
+  {
+    munmap(data_, data_size_);
+    data_ = NULL;
+    data_size_ = 0;
+  }
+}
+
+void DepthCloudStore::clear()
+{
+  unmap();
+  if(fd_ >= 0)
+  {
+    close(fd_);
+    unlink(file_.c_str());
+    fd_ = -1;
+  }
+  num_clouds_ = 0;
+  rays_.clear();
+}
+
+bool DepthCloudStore::isValid(size_t cloud, size_t pixel) const
+{
+  const uint8_t* mask = data_ + recordOffset(cloud) + 4 * sizeof(double);
+  return (mask[pixel / 8] >> (pixel % 8)) & 1;
+}
+
+pcl::PointXYZ DepthCloudStore::point(size_t cloud, size_t pixel) const
+{
+  pcl::PointXYZ pt;
+  if(!isValid(cloud, pixel))
+  {
+    pt.x = pt.y = pt.z = NAN;
+    return pt;
+  }
+  const uint16_t* depth = reinterpret_cast<const uint16_t*>(data_ + recordOffset(cloud) + 4 * sizeof(double) + maskBytes());
+  const float* rays = reinterpret_cast<const float*>(data_ + raysOffset());
+  pt.z = halfToFloat(depth[pixel]);
+  pt.x = rays[2*pixel] * pt.z;
+  pt.y = rays[2*pixel + 1] * pt.z;
+  return pt;
+}
+
+const double* DepthCloudStore::plane(size_t cloud) const
+{
+  return reinterpret_cast<const double*>(data_ + recordOffset(cloud));
+}
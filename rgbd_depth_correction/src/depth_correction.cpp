@@ -21,14 +21,11 @@
 #include <sensor_msgs/PointCloud2.h>
 #include "pcl_ros/transforms.h"
 #include <pcl_ros/point_cloud.h>
-#include <pcl/io/pcd_io.h>
-
-#include <yaml-cpp/yaml.h>
 
 #include "pluginlib/class_list_macros.h"
 #include <nodelet/nodelet.h>
 
-#include <industrial_extrinsic_cal/yaml_utils.h>
+#include <depth_calibration/depth_correction_model.h>
 #include <openni2_camera/GetSerial.h>
 
 
@@ -39,10 +36,8 @@ class DepthCorrectionNodelet : public nodelet::Nodelet
 private:
 
   bool use_depth_exp_;  /**< @brief Flag to determine whether to use the depth coefficients or not */
-  double d1_, d2_;      /**< @brief The depth coefficients */
 
-  int version_;  /**< @brief The version number found in the YAML file */
-  pcl::PointCloud<pcl::PointXYZ> correction_cloud_;  /**< @brief The depth correction point cloud containing the depth correction values */
+  DepthCorrectionModelConstPtr model_;  /**< @brief The depth correction parameters, shared with other nodelets using the same files */
 
   ros::Subscriber pcl_sub_;          /**< @brief PCL point cloud subscriber */
   ros::Publisher pcl_pub_;           /**< @brief PCL point cloud publisher for the corrected point cloud */
@@ -55,29 +50,6 @@ private:
      */
   void pointcloudCallback(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& cloud);
 
-  /**
-     * @brief Give a pathway and file name, reads the version number and loads the appropriate depth correction parameters
-     *
-     * @param[in] pathway The pathway to the file to be read
-     * @param[in] yaml_file The name of the file to be read
-     * @return True if the YAML file was read correctly, false if there was an error or the file is not of the correct version
-     */
-  bool readYamlFile(const std::string & pathway, const std::string & yaml_file);
-
-  /**
-     * @brief Reads and loads the parameters for depth correction version one
-     *
-     * @param[in] doc The YAML document to read from
-     * @param[in] file The file name used to the open similarly named point cloud depth correction file
-     */
-  void loadVersionOne(const YAML::Node& doc, const std::string& file);
-  /**
-     * @brief Peforms point cloud depth correction using the version one parameters and equations, then republishes the corrected cloud
-     *
-     * @param[in] cloud The point cloud to be corrected and republished
-     */
-  void correctionVersionOne(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud);
-
 public:
 
   /**
@@ -142,7 +114,8 @@ public:
 
     ROS_INFO_STREAM("Reading in yaml file " << filepath << filename << ".yaml");
 
-    if(!readYamlFile(filepath, filename))
+    model_ = DepthCorrectionModelCache::instance().get(filepath, filename);
+    if(!model_)
     {
       ROS_ERROR("Error reading YAML config file.  Closing depth correction node.");
       return;
@@ -159,92 +132,13 @@ public:
 };
 
 void DepthCorrectionNodelet::pointcloudCallback(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud)
-{
-  switch(version_)
-  {
-    case 1:
-      correctionVersionOne(cloud);
-      break;
-    default:
-      ROS_ERROR_STREAM_THROTTLE(120, "Depth calibration file version does not match any known versions.  Not performing depth correction");
-      break;
-  }
-}
-
-bool DepthCorrectionNodelet::readYamlFile(const std::string &pathway, const std::string &yaml_file)
-{
-  bool rtn = true;
-  std::string file;
-  file = pathway + yaml_file + ".yaml";
-  YAML::Node doc;
-  if(!industrial_extrinsic_cal::yamlNodeFromFileName(file, doc)){
-    ROS_ERROR("could not open yaml file %s", file.c_str());
-    rtn = false;
-  }
-  else if(!industrial_extrinsic_cal::parseInt(doc, "version", version_))
-  {
-    ROS_ERROR("Yaml file did not contain depth correction version information");
-    rtn = false;
-  }
-  else
-  {
-    switch (version_)
-    {
-      case 1:
-        loadVersionOne(doc, pathway + yaml_file);
-        break;
-      default:
-        ROS_ERROR("Version in YAML file did not match any known versions");
-        rtn = false;
-        break;
-    }
-  }
-  return rtn;
-}
-
-void DepthCorrectionNodelet::loadVersionOne(const YAML::Node &doc, const std::string &file)
-{
-  if(!industrial_extrinsic_cal::parseDouble(doc, "d1", d1_) )
-  {
-    ROS_ERROR("Yaml file did not contain depth correction parameter d1, setting to zero");
-    d1_ = 0;
-  }
-  if(!industrial_extrinsic_cal::parseDouble(doc, "d2", d2_))
-  {
-    ROS_ERROR("Yaml file did not contain depth correction parameter d2, setting to zero");
-    d2_ = 0;
-  }
-
-  std::string pcd_file;
-  pcd_file = file + ".pcd";
-
-  ROS_INFO_STREAM("loading pcd " << pcd_file);
-  pcl::io::loadPCDFile(pcd_file, correction_cloud_);
-}
-
-void DepthCorrectionNodelet::correctionVersionOne(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud)
 {
   pcl::PointCloud<pcl::PointXYZ> corrected_cloud = *cloud;
-  if(correction_cloud_.points.size() == cloud->points.size())
+  if(model_->version() != 1)
   {
-    for(int i = 0; i < corrected_cloud.points.size(); ++i)
-    {
-      if(isnan(corrected_cloud.points.at(i).x) || isnan(correction_cloud_.points.at(i).z))
-      {
-        continue;
-      }
-
-      if(use_depth_exp_)
-      {
-        corrected_cloud.points.at(i).z += correction_cloud_.points.at(i).z * exp(d1_ + d2_ * corrected_cloud.points.at(i).z);
-      }
-      else
-      {
-        corrected_cloud.points.at(i).z += correction_cloud_.points.at(i).z;
-      }
-    }
+    ROS_ERROR_STREAM_THROTTLE(120, "Depth calibration file version does not match any known versions.  Not performing depth correction");
   }
-  else
+  else if(!model_->correct(corrected_cloud, use_depth_exp_))
   {
     ROS_ERROR_STREAM_THROTTLE(30, "Depth correction cloud size and input point cloud size do not match.  Not performing depth correction");
   }
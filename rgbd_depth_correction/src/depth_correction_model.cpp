@@ -0,0 +1,245 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <depth_calibration/depth_correction_model.h>
+
+#include <ros/ros.h>
+#include <pcl/io/pcd_io.h>
+#include <industrial_extrinsic_cal/yaml_utils.h>
+
+#include <boost/make_shared.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rgbd_depth_correction
+{
+
+namespace
+{
+const char CACHE_MAGIC[8] = {'R', 'G', 'B', 'D', 'C', 'O', 'R', 'R'};
+
+struct CacheHeader
+{
+  char magic[8];
+  uint64_t size;      // number of correction values following the header
+  int64_t pcd_mtime;  // modification time of the .pcd the values were read from
+};
+}
+
+DepthCorrectionModel::DepthCorrectionModel() :
+  version_(0), d1_(0), d2_(0), correction_(NULL), size_(0), mapping_(NULL), mapping_size_(0)
+{
+}
+
+DepthCorrectionModel::~DepthCorrectionModel()
+{
+  if(mapping_ != NULL)
+  {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+bool DepthCorrectionModel::load(const std::string& file)
+{
+  std::string yaml_file = file + ".yaml";
+  YAML::Node doc;
+  if(!industrial_extrinsic_cal::yamlNodeFromFileName(yaml_file, doc))
+  {
+    ROS_ERROR("could not open yaml file %s", yaml_file.c_str());
+    return false;
+  }
+  if(!industrial_extrinsic_cal::parseInt(doc, "version", version_))
+  {
+    ROS_ERROR("Yaml file did not contain depth correction version information");
+    return false;
+  }
+  if(version_ != 1)
+  {
+    ROS_ERROR("Version in YAML file did not match any known versions");
+    return false;
+  }
+
+  if(!industrial_extrinsic_cal::parseDouble(doc, "d1", d1_) )
+  {
+    ROS_ERROR("Yaml file did not contain depth correction parameter d1, setting to zero");
+    d1_ = 0;
+  }
+  if(!industrial_extrinsic_cal::parseDouble(doc, "d2", d2_))
+  {
+    ROS_ERROR("Yaml file did not contain depth correction parameter d2, setting to zero");
+    d2_ = 0;
+  }
+
+  std::string pcd_file = file + ".pcd";
+  std::string cache_file = file + ".pcd.cache";
+  struct stat pcd_stat;
+  if(stat(pcd_file.c_str(), &pcd_stat) != 0)
+  {
+    ROS_ERROR_STREAM("Depth correction cloud " << pcd_file << " not found");
+    return false;
+  }
+  if(mapCache(cache_file, pcd_stat.st_mtime))
+  {
+    ROS_INFO_STREAM("mapped depth correction cache " << cache_file);
+    return true;
+  }
+
+  ROS_INFO_STREAM("loading pcd " << pcd_file);
+  pcl::PointCloud<pcl::PointXYZ> correction_cloud;
+  if(pcl::io::loadPCDFile(pcd_file, correction_cloud) < 0)
+  {
+    ROS_ERROR_STREAM("Could not read depth correction cloud " << pcd_file);
+    return false;
+  }
+  values_.resize(correction_cloud.points.size());
+  for(size_t i = 0; i < correction_cloud.points.size(); ++i)
+  {
+    values_[i] = correction_cloud.points[i].z;
+  }
+  correction_ = values_.empty() ? NULL : &values_[0];
+  size_ = values_.size();
+  writeCache(cache_file, pcd_stat.st_mtime);
+  return true;
+}
+
+bool DepthCorrectionModel::mapCache(const std::string& cache_file, long pcd_mtime)
+{
+  int fd = open(cache_file.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    return false;
+  }
+
+  CacheHeader header;
+  struct stat cache_stat;
+  bool valid = fstat(fd, &cache_stat) == 0 &&
+               pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) &&
+               std::memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+               header.pcd_mtime == pcd_mtime &&
+               size_t(cache_stat.st_size) == sizeof(header) + header.size * sizeof(float);
+  if(valid)
+  {
+    mapping_size_ = cache_stat.st_size;
+    mapping_ = mmap(NULL, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+    if(mapping_ == MAP_FAILED)
+    {
+      mapping_ = NULL;
+      valid = false;
+    }
+    else
+    {
+      correction_ = reinterpret_cast<const float*>(static_cast<const char*>(mapping_) + sizeof(header));
+      size_ = header.size;
+    }
+  }
+  close(fd);
+  return valid;
+}
+
+void DepthCorrectionModel::writeCache(const std::string& cache_file, long pcd_mtime) const
+{
+  // write to a temporary file and rename, so that a reader never maps a partial cache
+  std::string tmp_file = cache_file + ".tmp";
+  FILE* fp = fopen(tmp_file.c_str(), "wb");
+  if(fp == NULL)
+  {
+    ROS_WARN_STREAM("Could not write depth correction cache " << cache_file);
+    return;
+  }
+  CacheHeader header;
+  std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.size = size_;
+  header.pcd_mtime = pcd_mtime;
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            (size_ == 0 || fwrite(correction_, sizeof(float), size_, fp) == size_);
+  ok = (fclose(fp) == 0) && ok;
+  if(!ok || rename(tmp_file.c_str(), cache_file.c_str()) != 0)
+  {
+    ROS_WARN_STREAM("Could not write depth correction cache " << cache_file);
+    unlink(tmp_file.c_str());
+  }
+}
+
+bool DepthCorrectionModel::correct(pcl::PointCloud<pcl::PointXYZ>& cloud, bool use_depth_exp) const
+{
+  if(version_ != 1 || cloud.points.size() != size_)
+  {
+    return false;
+  }
+
+  for(size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    pcl::PointXYZ& pt = cloud.points[i];
+    if(std::isnan(pt.x) || std::isnan(correction_[i]))
+    {
+      continue;
+    }
+
+    if(use_depth_exp)
+    {
+      pt.z += correction_[i] * exp(d1_ + d2_ * pt.z);
+    }
+    else
+    {
+      pt.z += correction_[i];
+    }
+  }
+  return true;
+}
+
+DepthCorrectionModelCache& DepthCorrectionModelCache::instance()
+{
+  static DepthCorrectionModelCache cache;
+  return cache;
+}
+
+DepthCorrectionModelConstPtr DepthCorrectionModelCache::get(const std::string& filepath, const std::string& name)
+{
+  std::string file = filepath + name;
+  boost::shared_ptr<Entry> entry;
+  {
+    boost::lock_guard<boost::mutex> lock(lock_);
+    boost::shared_ptr<Entry>& slot = entries_[file];
+    if(!slot)
+    {
+      slot = boost::make_shared<Entry>();
+    }
+    entry = slot;
+  }
+
+  boost::lock_guard<boost::mutex> load_lock(entry->load_lock);
+  if(!entry->model)
+  {
+    boost::shared_ptr<DepthCorrectionModel> model = boost::make_shared<DepthCorrectionModel>();
+    if(model->load(file))
+    {
+      entry->model = model;
+    }
+  }
+  return entry->model;
+}
+
+} // namespace rgbd_depth_correction
@@ -0,0 +1,235 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <depth_calibration/hole_filling.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace depth_calibration
+{
+
+namespace
+{
+/** One level of the push-pull pyramid, weights are 1 for known values and 0 for holes */
+struct PyramidLevel
+{
+  int width;
+  int height;
+  std::vector<float> value;
+  std::vector<float> weight;
+};
+
+/** Averages 2x2 blocks of the fine level into the coarse level, returns true when the coarse level has no hole */
+bool push(const PyramidLevel& fine, PyramidLevel& coarse)
+{
+  coarse.width = (fine.width + 1) / 2;
+  coarse.height = (fine.height + 1) / 2;
+  coarse.value.assign(coarse.width * coarse.height, 0.0f);
+  coarse.weight.assign(coarse.width * coarse.height, 0.0f);
+
+  bool covered = true;
+  for(int y = 0; y < coarse.height; ++y)
+  {
+    int fy0 = 2 * y;
+    int fy1 = std::min(fy0 + 1, fine.height - 1);
+    const float* v0 = &fine.value[fy0 * fine.width];
+    const float* v1 = &fine.value[fy1 * fine.width];
+    const float* w0 = &fine.weight[fy0 * fine.width];
+    const float* w1 = &fine.weight[fy1 * fine.width];
+    float* cv = &coarse.value[y * coarse.width];
+    float* cw = &coarse.weight[y * coarse.width];
+    for(int x = 0; x < coarse.width; ++x)
+    {
+      int fx0 = 2 * x;
+      int fx1 = std::min(fx0 + 1, fine.width - 1);
+      float sw = w0[fx0] + w0[fx1] + w1[fx0] + w1[fx1];
+      float sv = w0[fx0]*v0[fx0] + w0[fx1]*v0[fx1] + w1[fx0]*v1[fx0] + w1[fx1]*v1[fx1];
+      cv[x] = (sw > 0.0f) ? sv / sw : 0.0f;
+      cw[x] = std::min(sw, 1.0f);
+      covered = covered && (sw > 0.0f);
+    }
+  }
+  return covered;
+}
+
+/** Fills the holes of the fine level by bilinear interpolation of the (hole free) coarse level */
+void pull(const PyramidLevel& coarse, PyramidLevel& fine)
+{
+  for(int y = 0; y < fine.height; ++y)
+  {
+    float cy = std::min(std::max((y + 0.5f) * 0.5f - 0.5f, 0.0f), float(coarse.height - 1));
+    int y0 = int(cy);
+    int y1 = std::min(y0 + 1, coarse.height - 1);
+    float fy = cy - y0;
+    const float* c0 = &coarse.value[y0 * coarse.width];
+    const float* c1 = &coarse.value[y1 * coarse.width];
+    float* v = &fine.value[y * fine.width];
+    float* w = &fine.weight[y * fine.width];
+    for(int x = 0; x < fine.width; ++x)
+    {
+      float cx = std::min(std::max((x + 0.5f) * 0.5f - 0.5f, 0.0f), float(coarse.width - 1));
+      int x0 = int(cx);
+      int x1 = std::min(x0 + 1, coarse.width - 1);
+      float fx = cx - x0;
+      float interp = (1.0f - fy) * ((1.0f - fx) * c0[x0] + fx * c0[x1]) + fy * ((1.0f - fx) * c1[x0] + fx * c1[x1]);
+      v[x] = w[x] * v[x] + (1.0f - w[x]) * interp;
+      w[x] = 1.0f;
+    }
+  }
+}
+}
+
+bool fillHolesPushPull(pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  if(cloud.points.empty() || cloud.points.size() != size_t(cloud.width) * cloud.height)
+  {
+    return false;
+  }
+
+  std::vector<PyramidLevel> pyramid(1);
+  PyramidLevel& base = pyramid[0];
+  base.width = cloud.width;
+  base.height = cloud.height;
+  base.value.resize(cloud.points.size());
+  base.weight.resize(cloud.points.size());
+  bool covered = true;
+  for(size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    bool valid = !std::isnan(cloud.points[i].x);
+    base.value[i] = valid ? cloud.points[i].z : 0.0f;
+    base.weight[i] = valid ? 1.0f : 0.0f;
+    covered = covered && valid;
+  }
+  if(covered)
+  {
+    return true;
+  }
+
+  // push: build coarser levels until one of them has no hole left
+  while(!covered)
+  {
+    const PyramidLevel& fine = pyramid.back();
+    if(fine.width == 1 && fine.height == 1)
+    {
+      // the whole cloud collapsed into one hole
+      return false;
+    }
+    PyramidLevel coarse;
+    covered = push(fine, coarse);
+    pyramid.push_back(coarse);
+  }
+
+  // pull: fill each level from the one above it
+  for(int level = int(pyramid.size()) - 2; level >= 0; --level)
+  {
+    pull(pyramid[level + 1], pyramid[level]);
+  }
+
+  for(size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    if(std::isnan(cloud.points[i].x))
+    {
+      cloud.points[i].x = 0;
+      cloud.points[i].y = 0;
+      cloud.points[i].z = pyramid[0].value[i];
+    }
+  }
+  return true;
+}
+
+bool fillHolesIterative(pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  bool has_valid = false;
+  for(size_t i = 0; i < cloud.points.size() && !has_valid; ++i)
+  {
+    has_valid = !std::isnan(cloud.points[i].z);
+  }
+  if(!has_valid)
+  {
+    return false;
+  }
+
+  // Iterate through depth correction cloud and replace all NaNs with average value of neighbors
+  // Repeat until no NaNs remain
+  bool done = false;
+  while(!done)
+  {
+    bool nan_found = false;
+    for(int i = 0; i < cloud.points.size(); ++i)
+    {
+      // If value is NaN, find average of neighbors
+      if(std::isnan(cloud.points.at(i).x))
+      {
+        nan_found = true;
+        double val = 0.0;
+        int count = 0;
+
+        if((i+1) % (cloud.width) > 0 || i == 0) // add point to the right except when at the far right side
+        {
+          if(std::isnan(cloud.points.at(i+1).z) == 0)
+          {
+            val += cloud.points.at(i+1).z;
+            ++count;
+          }
+        }
+
+        if(i % cloud.width > 0 ) // add point to the left except when at the far left side
+        {
+          if(std::isnan(cloud.points.at(i-1).z) == 0)
+          {
+            val += cloud.points.at(i-1).z;
+            ++count;
+          }
+        }
+
+        if(i > (cloud.width - 1) ) // add point to the top except when at the top row
+        {
+          if(std::isnan(cloud.points.at(i-cloud.width).z) == 0)
+          {
+            val += cloud.points.at(i-cloud.width).z;
+            ++count;
+          }
+        }
+
+        if((i+1) < cloud.height * cloud.width - cloud.width ) // add point to the bottom except when at the bottom row
+        {
+          if(std::isnan(cloud.points.at(i+cloud.width).z) == 0)
+          {
+            val += cloud.points.at(i+cloud.width).z;
+            ++count;
+          }
+        }
+
+        if(count > 0)
+        {
+          pcl::PointXYZ pt;
+          pt.x = 0;
+          pt.y = 0;
+          pt.z = val / double(count);
+          cloud.points.at(i) = pt;
+        }
+      }
+    }
+    done = !nan_found;
+  }
+  return true;
+}
+
+} // namespace depth_calibration
@@ -0,0 +1,118 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times the hole filling of synthetic 640x480 depth correction clouds with increasingly large invalid regions.
+// usage: hole_filling_benchmark [repetitions]
+
+#include <depth_calibration/hole_filling.h>
+
+#include <ros/time.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+const int WIDTH = 640;
+const int HEIGHT = 480;
+
+/** Smooth correction surface with a centered disc of the given radius and a band along the left edge left invalid */
+void makeCloud(int hole_radius, pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  cloud.width = WIDTH;
+  cloud.height = HEIGHT;
+  cloud.is_dense = false;
+  cloud.points.resize(WIDTH * HEIGHT);
+  for(int v = 0; v < HEIGHT; ++v)
+  {
+    for(int u = 0; u < WIDTH; ++u)
+    {
+      pcl::PointXYZ& pt = cloud.points[v * WIDTH + u];
+      double du = u - WIDTH / 2;
+      double dv = v - HEIGHT / 2;
+      if(du*du + dv*dv < hole_radius*hole_radius || u < hole_radius / 4)
+      {
+        pt.x = pt.y = pt.z = NAN;
+      }
+      else
+      {
+        pt.x = du * 0.002;
+        pt.y = dv * 0.002;
+        pt.z = 0.01 * sin(u * 0.01) * cos(v * 0.013);
+      }
+    }
+  }
+}
+
+double rmsError(const pcl::PointCloud<pcl::PointXYZ>& filled)
+{
+  double sum = 0.0;
+  for(int v = 0; v < HEIGHT; ++v)
+  {
+    for(int u = 0; u < WIDTH; ++u)
+    {
+      double e = filled.points[v * WIDTH + u].z - 0.01 * sin(u * 0.01) * cos(v * 0.013);
+      sum += e * e;
+    }
+  }
+  return sqrt(sum / (WIDTH * HEIGHT));
+}
+
+/** Returns the mean time in ms of one fill, and the rms error of the filled surface */
+double timeFill(bool (*fill)(pcl::PointCloud<pcl::PointXYZ>&), int hole_radius, int repetitions, double& rms)
+{
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  double total = 0.0;
+  for(int i = 0; i < repetitions; ++i)
+  {
+    makeCloud(hole_radius, cloud);
+    ros::WallTime start = ros::WallTime::now();
+    fill(cloud);
+    total += (ros::WallTime::now() - start).toSec();
+  }
+  rms = rmsError(cloud);
+  return 1000.0 * total / repetitions;
+}
+}
+
+int main(int argc, char** argv)
+{
+  int repetitions = (argc > 1) ? atoi(argv[1]) : 5;
+  const int radii[] = {0, 10, 40, 80, 160, 240};
+
+  printf("%-12s %-12s %-16s %-16s %-12s %-12s\n", "hole_radius", "invalid_%", "iterative_ms", "push_pull_ms",
+         "iter_rms", "pp_rms");
+  for(size_t i = 0; i < sizeof(radii) / sizeof(radii[0]); ++i)
+  {
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    makeCloud(radii[i], cloud);
+    int invalid = 0;
+    for(size_t j = 0; j < cloud.points.size(); ++j)
+    {
+      invalid += std::isnan(cloud.points[j].x);
+    }
+
+    double iter_rms, pp_rms;
+    double iter_ms = timeFill(depth_calibration::fillHolesIterative, radii[i], repetitions, iter_rms);
+    double pp_ms = timeFill(depth_calibration::fillHolesPushPull, radii[i], repetitions, pp_rms);
+    printf("%-12d %-12.1f %-16.3f %-16.3f %-12.2e %-12.2e\n", radii[i], 100.0 * invalid / cloud.points.size(),
+           iter_ms, pp_ms, iter_rms, pp_rms);
+  }
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ros/ros.h>
+#include <std_srvs/Empty.h>
+#include <pcl_ros/point_cloud.h>
+
+#include "pluginlib/class_list_macros.h"
+#include <nodelet/nodelet.h>
+
+#include <depth_calibration/depth_correction_model.h>
+#include <openni2_camera/GetSerial.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+
+
+namespace rgbd_depth_correction{
+
+/**
+ * @brief Depth correction of several cameras in one nodelet
+ *
+ * The private parameter "cameras" lists the camera namespaces to serve.  Each camera subscribes to <camera>/in_cloud and
+ * publishes <camera>/out_cloud.  Its calibration file name is taken from the private parameter <camera>/filename, or
+ * else from the <camera>/get_serial service of the camera driver.  Models are loaded in the background from the shared
+ * DepthCorrectionModelCache, and clouds received before a camera's model is ready are dropped.  Corrections of all
+ * cameras run on one pool of "num_worker_threads" threads, with at most one cloud in flight and one waiting per camera
+ * so that a slow stream can not flood the pool.
+ */
+class MultiDepthCorrectionNodelet : public nodelet::Nodelet
+{
+private:
+
+  /** @brief State of one served camera */
+  struct Camera
+  {
+    std::string name;  /**< @brief The camera namespace */
+    boost::mutex lock;  /**< @brief Lock for model, pending and busy */
+    DepthCorrectionModelConstPtr model;  /**< @brief The depth correction parameters, empty until loaded */
+    pcl::PointCloud<pcl::PointXYZ>::ConstPtr pending;  /**< @brief The latest cloud waiting for a worker */
+    bool busy;  /**< @brief Whether a worker is correcting clouds of this camera */
+    ros::Subscriber pcl_sub;  /**< @brief PCL point cloud subscriber */
+    ros::Publisher pcl_pub;   /**< @brief PCL point cloud publisher for the corrected point cloud */
+  };
+
+  bool use_depth_exp_;  /**< @brief Flag to determine whether to use the depth coefficients or not */
+  boost::mutex use_depth_exp_lock_;  /**< @brief Lock for use_depth_exp_, read by the workers and toggled by a service */
+  std::string filepath_;  /**< @brief Pathway to the calibration files */
+  std::vector<boost::shared_ptr<Camera> > cameras_;  /**< @brief The served cameras */
+  boost::asio::io_service workers_;  /**< @brief Queue of the shared worker pool */
+  boost::shared_ptr<boost::asio::io_service::work> work_;  /**< @brief Keeps the worker pool running */
+  boost::thread_group worker_threads_;  /**< @brief Threads of the shared worker pool */
+  boost::thread_group loader_threads_;  /**< @brief Threads loading the camera models */
+  ros::ServiceServer depth_change_;  /**< @brief The service server for changing whether to use the depth coefficients or not */
+
+  /**
+     * @brief Resolves the calibration file name of a camera and loads its model
+     *
+     * @param[in] camera The camera to load the model for
+     */
+  void loadModel(boost::shared_ptr<Camera> camera)
+  {
+    ros::NodeHandle nh = getMTNodeHandle();
+    ros::NodeHandle priv_nh = getMTPrivateNodeHandle();
+    std::string filename;
+
+    if(priv_nh.getParam(camera->name + "/filename", filename))
+    {
+      ROS_INFO("Using provided camera file name argument '%s' for depth correction of %s", filename.c_str(), camera->name.c_str());
+    }
+    else
+    {
+      ros::ServiceClient get_serial_no = nh.serviceClient<openni2_camera::GetSerial>(camera->name + "/get_serial");
+      openni2_camera::GetSerial msg;
+      if(!get_serial_no.waitForExistence(ros::Duration(30.0)) || !get_serial_no.call(msg.request, msg.response))
+      {
+        ROS_ERROR("File name for %s not provided and camera 'get_serial' service not available.  Not correcting %s.",
+                  camera->name.c_str(), camera->name.c_str());
+        return;
+      }
+      filename = msg.response.serial;
+      ROS_INFO("Using camera serial number '%s' from camera driver service for depth correction of %s", filename.c_str(), camera->name.c_str());
+    }
+
+    DepthCorrectionModelConstPtr model = DepthCorrectionModelCache::instance().get(filepath_, filename);
+    if(!model)
+    {
+      ROS_ERROR("Error reading YAML config file %s%s.yaml.  Not correcting %s.", filepath_.c_str(), filename.c_str(), camera->name.c_str());
+      return;
+    }
+
+    boost::lock_guard<boost::mutex> lock(camera->lock);
+    camera->model = model;
+    ROS_INFO("Depth correction model for %s ready", camera->name.c_str());
+  }
+
+  /**
+     * @brief PCL raw point cloud subscriber callback, hands the cloud to the worker pool
+     *
+     * @param[in] cloud Latest point cloud received
+     * @param[in] camera The camera the cloud belongs to
+     */
+  void pointcloudCallback(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& cloud, boost::shared_ptr<Camera> camera)
+  {
+    boost::lock_guard<boost::mutex> lock(camera->lock);
+    if(!camera->model)
+    {
+      ROS_INFO_STREAM_THROTTLE(10, "Depth correction model for " << camera->name << " not loaded yet, dropping cloud");
+      return;
+    }
+    camera->pending = cloud;
+    if(!camera->busy)
+    {
+      camera->busy = true;
+      workers_.post(boost::bind(&MultiDepthCorrectionNodelet::correctPending, this, camera));
+    }
+  }
+
+  /**
+     * @brief Corrects and publishes the waiting clouds of a camera until none is left
+     *
+     * @param[in] camera The camera to correct clouds of
+     */
+  void correctPending(boost::shared_ptr<Camera> camera)
+  {
+    while(true)
+    {
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr cloud;
+      DepthCorrectionModelConstPtr model;
+      bool use_depth_exp;
+      {
+        boost::lock_guard<boost::mutex> lock(use_depth_exp_lock_);
+        use_depth_exp = use_depth_exp_;
+      }
+      {
+        boost::lock_guard<boost::mutex> lock(camera->lock);
+        if(!camera->pending)
+        {
+          camera->busy = false;
+          return;
+        }
+        cloud.swap(camera->pending);
+        model = camera->model;
+      }
+
+      pcl::PointCloud<pcl::PointXYZ>::Ptr corrected_cloud = boost::make_shared<pcl::PointCloud<pcl::PointXYZ> >(*cloud);
+      if(!model->correct(*corrected_cloud, use_depth_exp))
+      {
+        ROS_ERROR_STREAM_THROTTLE(30, "Depth correction cloud size and input point cloud size do not match for "
+                                  << camera->name << ".  Not performing depth correction");
+      }
+      camera->pcl_pub.publish(corrected_cloud);
+    }
+  }
+
+public:
+
+  virtual ~MultiDepthCorrectionNodelet()
+  {
+    loader_threads_.interrupt_all();
+    loader_threads_.join_all();
+    work_.reset();
+    workers_.stop();
+    worker_threads_.join_all();
+  }
+
+  /**
+     * @brief For debug testing, turns off/on the use of the depth correction coefficients on all cameras
+     *
+     * @param[in] request Empty
+     * @param[out] response Empty
+     * @return always returns true
+     */
+  bool setEnableDepth(std_srvs::Empty::Request &request, std_srvs::Empty::Response &response)
+  {
+    boost::lock_guard<boost::mutex> lock(use_depth_exp_lock_);
+    use_depth_exp_ = !use_depth_exp_;
+    ROS_INFO_STREAM("Using depth exponential correction: " << use_depth_exp_);
+    return true;
+  }
+
+  /**
+     * @brief On startup of nodelet, starts the worker pool, the model loading and the publishers/subscribers of all cameras
+     */
+  virtual void onInit()
+  {
+    use_depth_exp_ = true;
+    ros::NodeHandle nh = getMTNodeHandle();
+    ros::NodeHandle priv_nh = getMTPrivateNodeHandle();
+
+    std::vector<std::string> camera_names;
+    if(!priv_nh.getParam("filepath", filepath_))
+    {
+      ROS_ERROR("File pathway not provided.  Closing depth correction node.");
+      return;
+    }
+    if(!priv_nh.getParam("cameras", camera_names) || camera_names.empty())
+    {
+      ROS_ERROR("List of cameras not provided.  Closing depth correction node.");
+      return;
+    }
+
+    int num_threads;
+    priv_nh.param<int>("num_worker_threads", num_threads, std::max(1, int(boost::thread::hardware_concurrency())));
+    work_ = boost::make_shared<boost::asio::io_service::work>(boost::ref(workers_));
+    for(int i = 0; i < num_threads; ++i)
+    {
+      worker_threads_.create_thread(boost::bind(&boost::asio::io_service::run, &workers_));
+    }
+
+    for(size_t i = 0; i < camera_names.size(); ++i)
+    {
+      boost::shared_ptr<Camera> camera = boost::make_shared<Camera>();
+      camera->name = camera_names[i];
+      camera->busy = false;
+      camera->pcl_pub = nh.advertise<pcl::PointCloud<pcl::PointXYZ> >(camera->name + "/out_cloud", 1);
+      camera->pcl_sub = nh.subscribe<pcl::PointCloud<pcl::PointXYZ> >(camera->name + "/in_cloud", 1,
+          boost::bind(&MultiDepthCorrectionNodelet::pointcloudCallback, this, _1, camera));
+      cameras_.push_back(camera);
+      loader_threads_.create_thread(boost::bind(&MultiDepthCorrectionNodelet::loadModel, this, camera));
+    }
+    ROS_INFO("Serving depth correction of %lu cameras on %d worker threads", cameras_.size(), num_threads);
+
+    depth_change_ = nh.advertiseService("change_depth_factor", &MultiDepthCorrectionNodelet::setEnableDepth, this);
+  }
+};
+
+PLUGINLIB_DECLARE_CLASS(rgbd_depth_correction, MultiDepthCorrectionNodelet, rgbd_depth_correction::MultiDepthCorrectionNodelet, nodelet::Nodelet);
+}
@@ -0,0 +1,206 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2015, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <depth_calibration/plane_fitting.h>
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace depth_calibration
+{
+
+namespace
+{
+/** Best hypothesis found so far, shared by all sampling threads */
+struct RansacState
+{
+  boost::mutex lock;
+  Eigen::Vector4f best_plane;
+  int best_inliers;
+  int iterations;
+  int required_iterations;
+  boost::posix_time::ptime deadline;
+};
+
+int countInliers(const Eigen::Matrix3Xf& points, const Eigen::Vector4f& plane, float threshold)
+{
+  return (((plane.head<3>().transpose() * points).array() + plane(3)).abs() < threshold).count();
+}
+
+void sampleHypotheses(const Eigen::Matrix3Xf& points, const PlaneFitOptions& options, unsigned int seed,
+                      RansacState& state)
+{
+  boost::random::mt19937 rng(seed);
+  boost::random::uniform_int_distribution<int> pick(0, points.cols() - 1);
+  const double log_outlier_free = std::log(1.0 - options.confidence);
+
+  while(true)
+  {
+    {
+      boost::lock_guard<boost::mutex> guard(state.lock);
+      if(state.iterations >= state.required_iterations ||
+         boost::posix_time::microsec_clock::universal_time() > state.deadline)
+      {
+        return;
+      }
+      ++state.iterations;
+    }
+
+    Eigen::Vector3f p0 = points.col(pick(rng));
+    Eigen::Vector3f normal = (points.col(pick(rng)) - p0).cross(points.col(pick(rng)) - p0);
+    float norm = normal.norm();
+    if(norm < 1e-9f)
+    {
+      continue;
+    }
+    normal /= norm;
+    Eigen::Vector4f plane;
+    plane << normal, -normal.dot(p0);
+    int inliers = countInliers(points, plane, options.inlier_threshold);
+
+    boost::lock_guard<boost::mutex> guard(state.lock);
+    if(inliers > state.best_inliers)
+    {
+      state.best_inliers = inliers;
+      state.best_plane = plane;
+      // adaptive bound on the number of hypotheses for the current inlier ratio
+      double ratio = double(inliers) / points.cols();
+      double p_good = ratio * ratio * ratio;
+      if(p_good >= 1.0)
+      {
+        state.required_iterations = state.iterations;
+      }
+      else if(p_good > 0.0)
+      {
+        double needed = log_outlier_free / std::log(1.0 - p_good);
+        if(needed < state.required_iterations)
+        {
+          state.required_iterations = int(std::ceil(needed));
+        }
+      }
+    }
+  }
+}
+}
+
+bool fitPlaneRansac(const Eigen::Matrix3Xf& points, const PlaneFitOptions& options, Eigen::Vector4d& plane,
+                    int& num_inliers)
+{
+  num_inliers = 0;
+  if(points.cols() < 3)
+  {
+    return false;
+  }
+
+  RansacState state;
+  state.best_inliers = 0;
+  state.iterations = 0;
+  state.required_iterations = options.max_iterations;
+  state.deadline = boost::posix_time::microsec_clock::universal_time() +
+      boost::posix_time::microseconds(static_cast<long>(options.max_time * 1e6));
+
+  boost::thread_group workers;
+  for(int i = 1; i < options.num_threads; ++i)
+  {
+    workers.create_thread(boost::bind(&sampleHypotheses, boost::cref(points), boost::cref(options), options.seed + i,
+                                      boost::ref(state)));
+  }
+  sampleHypotheses(points, options, options.seed, state);
+  workers.join_all();
+
+  if(state.best_inliers < 3)
+  {
+    return false;
+  }
+
+  // least squares refit: the normal is the direction of least variance of the inliers
+  Eigen::Array<bool, 1, Eigen::Dynamic> mask =
+      ((state.best_plane.head<3>().transpose() * points).array() + state.best_plane(3)).abs() < options.inlier_threshold;
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+  int count = 0;
+  for(int i = 0; i < points.cols(); ++i)
+  {
+    if(mask(i))
+    {
+      centroid += points.col(i).cast<double>();
+      ++count;
+    }
+  }
+  centroid /= count;
+  Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+  for(int i = 0; i < points.cols(); ++i)
+  {
+    if(mask(i))
+    {
+      Eigen::Vector3d d = points.col(i).cast<double>() - centroid;
+      scatter += d * d.transpose();
+    }
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(scatter);
+  Eigen::Vector3d normal = solver.eigenvectors().col(0);
+  if(normal.dot(state.best_plane.head<3>().cast<double>()) < 0.0)
+  {
+    normal = -normal;
+  }
+  plane << normal, -normal.dot(centroid);
+  num_inliers = countInliers(points, plane.cast<float>(), options.inlier_threshold);
+  return true;
+}
+
+void selectTargetRegion(const pcl::PointCloud<pcl::PointXYZ>& cloud, const Eigen::Vector4d& target_plane,
+                        const Eigen::Vector3d& target_origin, double radius, double max_distance,
+                        Eigen::Matrix3Xf& points)
+{
+  std::vector<int> selected;
+  selected.reserve(cloud.points.size());
+  Eigen::Vector3d normal = target_plane.head<3>();
+  for(size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    const pcl::PointXYZ& pt = cloud.points[i];
+    if(std::isnan(pt.x) || pt.z == 0)
+    {
+      continue;
+    }
+    Eigen::Vector3d p(pt.x, pt.y, pt.z);
+    double distance = normal.dot(p) + target_plane(3);
+    Eigen::Vector3d in_plane = (p - target_origin) - distance * normal;
+    if(std::fabs(distance) < max_distance && in_plane.squaredNorm() < radius * radius)
+    {
+      selected.push_back(i);
+    }
+  }
+
+  points.resize(3, selected.size());
+  for(size_t i = 0; i < selected.size(); ++i)
+  {
+    const pcl::PointXYZ& pt = cloud.points[selected[i]];
+    points.col(i) << pt.x, pt.y, pt.z;
+  }
+}
+
+} // namespace depth_calibration
@@ -24,7 +24,9 @@
 #include <ros/package.h>
 #include <ros/console.h>
 #include <target_finder/target_locater.h> 
+#include <target_finder/dual_target_locater.h> 
 #include <tf/transform_broadcaster.h>
+#include <tf/transform_datatypes.h>
 
 using std::string;
 using std::vector;
@@ -37,18 +39,26 @@ public:
 
     ros::NodeHandle pnh("~") ;
     std::string c1_cs, c2_cs;// the call service names for each camera
-    if(!pnh.getParam("camera1_target_locate_service", c1_cs)){
-      ROS_ERROR("must define camera1_target_locate_service parameter");
-      exit(1);
+    std::string dual_cs; // a service locating the target in both cameras at once
+    fused_ = pnh.getParam("dual_target_locate_service", dual_cs);
+    if(fused_){
+      ROS_INFO("dual service = %s",dual_cs.c_str());
+      dual_client_ = nh_.serviceClient<target_finder::dual_target_locater>(dual_cs.c_str());
     }
-    if(!pnh.getParam("camera2_target_locate_service", c2_cs)){
-      ROS_ERROR("must define camera1_target_locate_service parameter");
-      exit(1);
+    else{
+      if(!pnh.getParam("camera1_target_locate_service", c1_cs)){
+	ROS_ERROR("must define camera1_target_locate_service parameter");
+	exit(1);
+      }
+      if(!pnh.getParam("camera2_target_locate_service", c2_cs)){
+	ROS_ERROR("must define camera1_target_locate_service parameter");
+	exit(1);
+      }
+      ROS_INFO("C1 service = %s",c1_cs.c_str());
+      ROS_INFO("C2 service = %s",c2_cs.c_str());
+      c1_client_ = nh_.serviceClient<target_finder::target_locater>(c1_cs.c_str());
+      c2_client_ = nh_.serviceClient<target_finder::target_locater>(c2_cs.c_str());
     }
-    ROS_INFO("C1 service = %s",c1_cs.c_str());
-    ROS_INFO("C2 service = %s",c2_cs.c_str());
-    c1_client_ = nh_.serviceClient<target_finder::target_locater>(c1_cs.c_str());
-    c2_client_ = nh_.serviceClient<target_finder::target_locater>(c2_cs.c_str());
 
     if(!pnh.getParam("c1_roi_width", c1_roi_width_)){
      c1_roi_width_ = 1280;
@@ -74,16 +84,22 @@ public:
     if(!pnh.getParam("c2_target_frame", c2_target_frame_)){
       c2_target_frame_ = "c2_target_frame";
     }
+    camera1_to_camera2_.setIdentity();
     setRequest();
   }
   bool callTheService();
   void copyResponseToRequest();
   void setRequest();
   bool resetC2();
+  bool callDualService(bool solve_camera2_pose);
 private:
+  void sendTargetTransforms(const geometry_msgs::Pose &c1_pose, const geometry_msgs::Pose &c2_pose);
   ros::NodeHandle nh_;
   ros::ServiceClient c1_client_, c2_client_;
   target_finder::target_locater c1_srv_, c2_srv_;
+  bool fused_; // both cameras are served by one dual target locator
+  ros::ServiceClient dual_client_;
+  target_finder::dual_target_locater dual_srv_;
   tf::TransformBroadcaster tf_broadcaster_;
   int c1_roi_width_, c2_roi_width_;
   int c1_roi_height_, c2_roi_height_;
@@ -116,7 +132,10 @@ bool callService::callTheService()
   bool c1_target_found=false;
   bool c2_target_found=false;
 
-  if(c1_client_.call(c1_srv_)){
+  if(fused_){
+    c1_target_found = c2_target_found = callDualService(false);
+  }
+  else if(c1_client_.call(c1_srv_)){
     double x,y,z,qx,qy,qz,qw;
     x = c1_srv_.response.final_pose.position.x;
     y = c1_srv_.response.final_pose.position.y;
@@ -142,7 +161,7 @@ bool callService::callTheService()
     tf_broadcaster_.sendTransform(stf);
     c1_target_found = 1;
   }
-  if(c2_client_.call(c2_srv_)){
+  if(!fused_ && c2_client_.call(c2_srv_)){
     double x,y,z,qx,qy,qz,qw;
     x = c2_srv_.response.final_pose.position.x;
     y = c2_srv_.response.final_pose.position.y;
@@ -194,6 +213,14 @@ bool callService::resetC2()
   tf::Transform c1_to_target;
   tf::Transform c2_to_target;
 
+  if(fused_){ // target and camera2 poses are solved together
+    while(!callDualService(true)){
+      ROS_ERROR("dual call failed");
+      sleep(1);
+    }
+    return(true);
+  }
+
   while(!c1_client_.call(c1_srv_)){
     ROS_ERROR("C1 call failed");
     sleep(1);
@@ -236,6 +263,49 @@ bool callService::resetC2()
   }
   return(false);
 }
+bool callService::callDualService(bool solve_camera2_pose)
+{
+  dual_srv_.request.c1_roi.x_offset =0;
+  dual_srv_.request.c1_roi.y_offset =0;
+  dual_srv_.request.c1_roi.width = c1_roi_width_;
+  dual_srv_.request.c1_roi.height = c1_roi_height_;
+  dual_srv_.request.c2_roi.x_offset =0;
+  dual_srv_.request.c2_roi.y_offset =0;
+  dual_srv_.request.c2_roi.width = c2_roi_width_;
+  dual_srv_.request.c2_roi.height = c2_roi_height_;
+  dual_srv_.request.allowable_cost_per_observation = 7.0;
+  dual_srv_.request.solve_camera2_pose = solve_camera2_pose;
+  tf::poseTFToMsg(camera1_to_camera2_, dual_srv_.request.camera1_to_camera2);
+  if(!dual_client_.call(dual_srv_)){
+    return(false);
+  }
+  ROS_INFO("Dual Pose: tx= %5.4lf  %5.4lf  %5.4lf quat= %5.3lf  %5.3lf  %5.3lf %5.3lf, cost= %5.3lf",
+	   dual_srv_.response.c1_final_pose.position.x,
+	   dual_srv_.response.c1_final_pose.position.y,
+	   dual_srv_.response.c1_final_pose.position.z,
+	   dual_srv_.response.c1_final_pose.orientation.x,
+	   dual_srv_.response.c1_final_pose.orientation.y,
+	   dual_srv_.response.c1_final_pose.orientation.z,
+	   dual_srv_.response.c1_final_pose.orientation.w,
+	   dual_srv_.response.final_cost_per_observation);
+  if(solve_camera2_pose){
+    tf::poseMsgToTF(dual_srv_.response.camera1_to_camera2, camera1_to_camera2_);
+  }
+  sendTargetTransforms(dual_srv_.response.c1_final_pose, dual_srv_.response.c2_final_pose);
+  return(true);
+}
+
+void callService::sendTargetTransforms(const geometry_msgs::Pose &c1_pose, const geometry_msgs::Pose &c2_pose)
+{
+  tf::Transform camera_to_target;
+  tf::poseMsgToTF(c1_pose, camera_to_target);
+  tf::StampedTransform stf1(camera_to_target.inverse(), ros::Time::now(), c1_target_frame_.c_str(), c1_optical_frame_.c_str() );
+  tf_broadcaster_.sendTransform(stf1);
+  tf::poseMsgToTF(c2_pose, camera_to_target);
+  tf::StampedTransform stf2(camera_to_target, ros::Time::now(),  c2_optical_frame_.c_str(), c2_target_frame_.c_str());
+  tf_broadcaster_.sendTransform(stf2);
+}
+
 void callService::setRequest()
 {
     c1_srv_.request.roi.x_offset =0;
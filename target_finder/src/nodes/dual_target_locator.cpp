@@ -0,0 +1,299 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2014, Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <industrial_extrinsic_cal/ros_camera_observer.h>
+#include <industrial_extrinsic_cal/basic_types.h>
+#include <industrial_extrinsic_cal/ceres_costs_utils.h> 
+#include <industrial_extrinsic_cal/ceres_costs_utils.hpp> 
+#include <industrial_extrinsic_cal/pose_initializer.h>
+#include <target_finder/dual_target_locater.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "ceres/types.h"
+
+using std::string;
+using boost::shared_ptr;
+using boost::make_shared;
+using ceres::Problem;
+using ceres::Solver;
+using industrial_extrinsic_cal::Target;
+using industrial_extrinsic_cal::CameraObservations;
+using industrial_extrinsic_cal::ROSCameraObserver;
+using industrial_extrinsic_cal::Roi;
+using industrial_extrinsic_cal::Pose6d;
+using industrial_extrinsic_cal::Point3d;
+using industrial_extrinsic_cal::CameraReprjErrorPK;
+using industrial_extrinsic_cal::TargetCameraReprjErrorPK;
+using target_finder::dual_target_locater;
+
+/** one of the two cameras, observed concurrently */
+struct LocatorCamera
+{
+  shared_ptr<ROSCameraObserver> observer;
+  bool have_camera_info; /**< true once the intrinsics were read from the camera info topic */
+  double fx, fy, cx, cy;
+  int width, height;
+  Roi roi;
+  CameraObservations observations;
+  bool found; /**< set by the capture when every target point was observed */
+};
+
+/** Locates one target seen by two cameras in a single optimization. The target's pose in camera 1's optical frame and,
+ *  when requested, camera 2's pose relative to camera 1 are solved together from the observations of both cameras,
+ *  which are captured concurrently.
+ */
+class DualTargetLocatorService 
+{
+public:
+  DualTargetLocatorService(ros::NodeHandle nh);
+  ~DualTargetLocatorService()  {  } ;
+  bool executeCallBack( dual_target_locater::Request &req, dual_target_locater::Response &res);
+  void  initMCircleTarget(int rows, int cols, double circle_dia, double spacing);
+
+private:
+  void initCamera(LocatorCamera &camera, const string &image_topic, const string &camera_name);
+  bool getCameraInfo(LocatorCamera &camera);
+  void capture(LocatorCamera *camera);
+
+  ros::NodeHandle nh_;
+  ros::ServiceServer target_locate_server_;
+  shared_ptr<Target> target_;
+  LocatorCamera camera1_, camera2_;
+  Solver::Options options_;
+};
+
+DualTargetLocatorService::DualTargetLocatorService(ros::NodeHandle nh)
+{
+  nh_ = nh;
+  ros::NodeHandle pnh("~");
+
+  string c1_topic, c1_name, c2_topic, c2_name;
+  if(!pnh.getParam( "camera1_image_topic", c1_topic)){
+    ROS_ERROR("Must set param:  camera1_image_topic");
+  }
+  if(!pnh.getParam( "camera1_name", c1_name)){
+    ROS_ERROR("Must set param:  camera1_name");
+  }
+  if(!pnh.getParam( "camera2_image_topic", c2_topic)){
+    ROS_ERROR("Must set param:  camera2_image_topic");
+  }
+  if(!pnh.getParam( "camera2_name", c2_name)){
+    ROS_ERROR("Must set param:  camera2_name");
+  }
+
+  int rows, cols;
+  double diameter, spacing;
+  if(!pnh.getParam( "target_rows", rows)){
+    ROS_ERROR("Must set param:  target_rows");
+  }
+  if(!pnh.getParam( "target_cols", cols)){
+    ROS_ERROR("Must set param:  target_cols");
+  }
+  if(!pnh.getParam( "target_circle_dia", diameter)){
+    ROS_ERROR("Must set param:  target_circle_dia");
+  }
+  if(!pnh.getParam( "target_spacing", spacing)){
+    ROS_ERROR("Must set param:  target_spacing");
+  }
+  initMCircleTarget(rows, cols, diameter, spacing);
+
+  initCamera(camera1_, c1_topic, c1_name);
+  initCamera(camera2_, c2_topic, c2_name);
+  options_.linear_solver_type = ceres::DENSE_SCHUR;
+  options_.minimizer_progress_to_stdout = false;
+  options_.max_num_iterations = 1000;
+
+  std::string service_name;
+  if(!pnh.getParam("service_name", service_name)){
+    service_name = "DualTargetLocateService";
+  }
+  target_locate_server_ = nh_.advertiseService( service_name.c_str(), &DualTargetLocatorService::executeCallBack, this);
+}
+
+void DualTargetLocatorService::initCamera(LocatorCamera &camera, const string &image_topic, const string &camera_name)
+{
+  camera.observer = make_shared<ROSCameraObserver>(image_topic, camera_name);
+  camera.have_camera_info = false;
+  camera.found = false;
+}
+
+bool DualTargetLocatorService::getCameraInfo(LocatorCamera &camera)
+{
+  if(!camera.have_camera_info){
+    double k1,k2,k3,p1,p2;// unused 
+    camera.have_camera_info = camera.observer->pullCameraInfo(camera.fx, camera.fy, camera.cx, camera.cy,
+							       k1, k2, k3, p1, p2, camera.width, camera.height);
+    if(!camera.have_camera_info){
+      ROS_ERROR("could not access camera info");
+    }
+  }
+  return(camera.have_camera_info);
+}
+
+void DualTargetLocatorService::capture(LocatorCamera *camera)
+{
+  industrial_extrinsic_cal::Cost_function cost_type;
+  camera->observations.clear();
+  camera->observer->clearTargets();
+  camera->observer->clearObservations();
+  camera->observer->addTarget(target_, camera->roi, cost_type);
+  camera->observer->triggerCamera();
+  camera->observer->getObservations(camera->observations);
+  camera->found = ((int) camera->observations.size() == target_->num_points_);
+}
+
+/** @brief copies a pose into a pose message */
+static void poseToMsg(const Pose6d &pose, geometry_msgs::Pose &msg)
+{
+  msg.position.x = pose.x;
+  msg.position.y = pose.y;
+  msg.position.z = pose.z;
+  pose.getQuaternion(msg.orientation.x, msg.orientation.y, msg.orientation.z, msg.orientation.w);
+}
+
+/** @brief copies a pose message into a pose */
+static Pose6d msgToPose(const geometry_msgs::Pose &msg)
+{
+  Pose6d pose;
+  pose.setQuaternion(msg.orientation.x, msg.orientation.y, msg.orientation.z, msg.orientation.w);
+  pose.setOrigin(msg.position.x, msg.position.y, msg.position.z);
+  return(pose);
+}
+
+/** @brief converts a region of interest message */
+static Roi roiFromMsg(const sensor_msgs::RegionOfInterest &msg)
+{
+  Roi roi;
+  roi.x_min = msg.x_offset;
+  roi.y_min = msg.y_offset;
+  roi.x_max = msg.x_offset + msg.width;
+  roi.y_max = msg.y_offset + msg.height;
+  return(roi);
+}
+
+bool DualTargetLocatorService::executeCallBack( dual_target_locater::Request &req, dual_target_locater::Response &res)
+{
+  if(!getCameraInfo(camera1_) || !getCameraInfo(camera2_)){
+    return(false);
+  }
+
+  // capture and detect in both cameras at once
+  camera1_.roi = roiFromMsg(req.c1_roi);
+  camera2_.roi = roiFromMsg(req.c2_roi);
+  boost::thread c2_capture(boost::bind(&DualTargetLocatorService::capture, this, &camera2_));
+  capture(&camera1_);
+  c2_capture.join();
+  if(!camera1_.found || !camera2_.found){
+    ROS_ERROR("Target Locator could not find target camera1 %d camera2 %d", (int) camera1_.observations.size(),
+	      (int) camera2_.observations.size());
+    return(false);
+  }
+
+  // closed form starting points, camera2 maps camera1 coordinates into camera2's frame
+  Pose6d c1_target, c2_target;
+  Pose6d camera2 = msgToPose(req.camera1_to_camera2).getInverse();
+  if(!industrial_extrinsic_cal::initialTargetPose(*target_, camera1_.observations, camera1_.fx, camera1_.fy,
+						   camera1_.cx, camera1_.cy, c1_target) ||
+     !industrial_extrinsic_cal::initialTargetPose(*target_, camera2_.observations, camera2_.fx, camera2_.fy,
+						   camera2_.cx, camera2_.cy, c2_target)){
+    ROS_ERROR("could not initialize the target pose");
+    return(false);
+  }
+  if(req.solve_camera2_pose){
+    camera2 = c2_target * c1_target.getInverse();
+  }
+
+  Problem problem;
+  for(int i=0; i<(int) camera1_.observations.size(); i++){
+    Point3d point = target_->pts_[camera1_.observations[i].point_id];
+    problem.AddResidualBlock(CameraReprjErrorPK::Create(camera1_.observations[i].image_loc_x,
+							camera1_.observations[i].image_loc_y,
+							camera1_.fx, camera1_.fy, camera1_.cx, camera1_.cy, point),
+			     NULL, c1_target.pb_pose);
+  }
+  for(int i=0; i<(int) camera2_.observations.size(); i++){
+    Point3d point = target_->pts_[camera2_.observations[i].point_id];
+    problem.AddResidualBlock(TargetCameraReprjErrorPK::Create(camera2_.observations[i].image_loc_x,
+							      camera2_.observations[i].image_loc_y,
+							      camera2_.fx, camera2_.fy, camera2_.cx, camera2_.cy, point),
+			     NULL, camera2.pb_pose, c1_target.pb_pose);
+  }
+  if(!req.solve_camera2_pose){
+    problem.SetParameterBlockConstant(camera2.pb_pose);
+  }
+
+  Solver::Summary summary;
+  ceres::Solve(options_, &problem, &summary);
+  int num_observations = (int) (camera1_.observations.size() + camera2_.observations.size());
+  double error_per_observation = summary.final_cost/num_observations;
+  res.final_cost_per_observation  = error_per_observation;
+  if(summary.termination_type == ceres::NO_CONVERGENCE){
+    ROS_ERROR("dual target locator did not converge");
+    return(false);
+  }
+  if(error_per_observation > req.allowable_cost_per_observation){
+    ROS_ERROR("allowable cost exceeded %f > %f", error_per_observation, req.allowable_cost_per_observation);
+    return(false);
+  }
+
+  c2_target = camera2 * c1_target;
+  Pose6d camera1_to_camera2 = camera2.getInverse();
+  poseToMsg(c1_target, res.c1_final_pose);
+  poseToMsg(c2_target, res.c2_final_pose);
+  poseToMsg(camera1_to_camera2, res.camera1_to_camera2);
+  return(true);
+}
+
+void DualTargetLocatorService::initMCircleTarget(int rows, int cols, double circle_dia, double spacing)
+{
+  target_ =  make_shared<industrial_extrinsic_cal::Target>();
+  target_->is_moving_ = true;
+  target_->target_name_ = "modified_circle_target";
+  target_->target_frame_ = "target_frame";
+  target_->target_type_ =  2;
+  target_->circle_grid_parameters_.pattern_rows =rows;
+  target_->circle_grid_parameters_.pattern_cols = cols;
+  target_->circle_grid_parameters_.circle_diameter = circle_dia;
+  target_->circle_grid_parameters_.is_symmetric = true; 
+  // create a grid of points
+  target_->pts_.clear();
+  target_->num_points_ = rows*cols;
+  for(int i=0; i<rows; i++){
+    for(int j=0; j<cols; j++){
+      Point3d point;
+      point.x = j*spacing;
+      point.y = (rows -1 -i)*spacing;
+      point.z = 0.0;
+      target_->pts_.push_back(point);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "dual_target_locator_service");
+  ros::NodeHandle node_handle;
+  DualTargetLocatorService dual_target_locator(node_handle);
+  ros::spin();
+  ros::waitForShutdown();
+  return 0;
+}
@@ -25,7 +25,10 @@
 #include <industrial_extrinsic_cal/basic_types.h>
 #include <industrial_extrinsic_cal/ceres_costs_utils.h> 
 #include <industrial_extrinsic_cal/ceres_costs_utils.hpp> 
+#include <industrial_extrinsic_cal/pose_initializer.h>
 #include <target_finder/target_locater.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <sensor_msgs/Image.h>
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
 #include "ceres/types.h"
@@ -42,6 +45,7 @@ using industrial_extrinsic_cal::ROSCameraObserver;
 using industrial_extrinsic_cal::Roi;
 using industrial_extrinsic_cal::Pose6d;
 using industrial_extrinsic_cal::Point3d;
+using industrial_extrinsic_cal::CameraReprjErrorPK;
 using target_finder::target_locater;
 class TargetLocatorService 
 {
@@ -49,10 +53,18 @@ public:
   TargetLocatorService(ros::NodeHandle nh);
   ~TargetLocatorService()  {  } ;
   bool executeCallBack( target_locater::Request &req, target_locater::Response &res);
+  void imageCallBack(const sensor_msgs::ImageConstPtr &image);
   void  initMCircleTarget(int rows, int cols, double circle_dia, double spacing);
   void initBallsTarget();
 
 private:
+  bool getCameraInfo();
+  bool observeTarget(Roi &roi, const sensor_msgs::ImageConstPtr &image, CameraObservations &camera_observations);
+  bool initialPose(CameraObservations &camera_observations);
+  bool solvePose(CameraObservations &camera_observations, double &cost_per_observation);
+  bool locateTarget(CameraObservations &camera_observations, double allowable_cost_per_observation,
+		    const geometry_msgs::Pose *default_pose, double &cost_per_observation);
+
   ros::NodeHandle nh_;
   ros::ServiceServer target_locate_server_;
   shared_ptr<Target> target_;
@@ -62,9 +74,23 @@ private:
   int target_rows_;
   int target_cols_;
 
+  shared_ptr<ROSCameraObserver> camera_observer_; /**< kept between calls, so its publishers and detector are set up once */
+  bool have_camera_info_; /**< true once the intrinsics below were read from the camera info topic */
+  double fx_, fy_, cx_, cy_; /**< cached focal lengths and optical center */
+  int width_, height_; /**< cached image size */
+  bool have_last_pose_; /**< true when target_->pose_ holds the last successfully located pose */
+  shared_ptr<Problem> problem_; /**< reprojection errors of all target points, built on the first solve */
+  std::vector<CameraReprjErrorPK*> reprojection_errors_; /**< owned by problem_, observed location of each point */
+  Solver::Options options_;
+
+  ros::Subscriber image_sub_; /**< images located in streaming mode */
+  ros::Publisher pose_pub_; /**< the target pose found in each streamed image */
+  string optical_frame_; /**< frame of the published poses, the image's frame when empty */
+  double stream_allowable_cost_; /**< largest cost per observation of a published pose */
 };
 
-TargetLocatorService::TargetLocatorService(ros::NodeHandle nh)
+TargetLocatorService::TargetLocatorService(ros::NodeHandle nh) :
+  have_camera_info_(false), have_last_pose_(false)
 {
   
   nh_ = nh;
@@ -109,29 +135,120 @@ TargetLocatorService::TargetLocatorService(ros::NodeHandle nh)
     ROS_ERROR("Target type not supported, check your launch file, only 2, and 4 for MCircle, and Balls type targets");
   }
 
+  camera_observer_ = make_shared<ROSCameraObserver>(image_topic_, camera_name_);
+  options_.linear_solver_type = ceres::DENSE_SCHUR;
+  options_.minimizer_progress_to_stdout = false;
+  options_.max_num_iterations = 1000;
+
   std::string service_name;
   if(!pnh.getParam("service_name", service_name)){
     service_name = "TargetLocateService";
   }
   target_locate_server_ = nh_.advertiseService( service_name.c_str(), &TargetLocatorService::executeCallBack, this);
+
+  // in streaming mode, every image is located and its pose published
+  bool stream;
+  pnh.param<bool>("stream", stream, false);
+  pnh.param<std::string>("optical_frame", optical_frame_, "");
+  pnh.param<double>("stream_allowable_cost_per_observation", stream_allowable_cost_, 1.0);
+  if(stream){
+    pose_pub_ = nh_.advertise<geometry_msgs::PoseStamped>("target_pose", 1);
+    image_sub_ = nh_.subscribe(image_topic_, 1, &TargetLocatorService::imageCallBack, this);
+  }
 }
 
-bool TargetLocatorService::executeCallBack( target_locater::Request &req, target_locater::Response &res)
+bool TargetLocatorService::getCameraInfo()
 {
-  ros::NodeHandle nh;
-  CameraObservations camera_observations;
+  // the intrinsics do not change while the node runs, so the camera info topic is only read once
+  if(!have_camera_info_){
+    double k1,k2,k3,p1,p2;// unused 
+    have_camera_info_ = camera_observer_->pullCameraInfo(fx_, fy_, cx_, cy_, k1, k2, k3, p1, p2, width_, height_);
+    if(!have_camera_info_){
+      ROS_ERROR("could not access camera info");
+    }
+  }
+  return have_camera_info_;
+}
+
+bool TargetLocatorService::observeTarget(Roi &roi, const sensor_msgs::ImageConstPtr &image,
+					 CameraObservations &camera_observations)
+{
+  industrial_extrinsic_cal::Cost_function cost_type;
+  camera_observer_->clearTargets();
+  camera_observer_->clearObservations();
+  camera_observer_->addTarget(target_, roi, cost_type);
+  if(image){
+    if(!camera_observer_->setImage(image)) return(false);
+  }
+  else{
+    camera_observer_->triggerCamera();
+  }
+  camera_observer_->getObservations(camera_observations);
+  int num_observations = (int) camera_observations.size();
+  if(num_observations != target_->num_points_){
+    ROS_ERROR("Target Locator could not find target %d", num_observations);
+    return(false);
+  }
+  return(true);
+}
+
+bool TargetLocatorService::initialPose(CameraObservations &camera_observations)
+{
+  return(industrial_extrinsic_cal::initialTargetPose(*target_, camera_observations, fx_, fy_, cx_, cy_, target_->pose_));
+}
+
+bool TargetLocatorService::solvePose(CameraObservations &camera_observations, double &cost_per_observation)
+{
+  int num_observations = (int) camera_observations.size();
+  if(!problem_){
+    // the target points and intrinsics never change, later solves only update the observed locations
+    problem_ = make_shared<Problem>();
+    for(int i=0; i<num_observations; i++){
+      Point3d point = target_->pts_[i]; // assume the correct ordering
+      CameraReprjErrorPK *error = new CameraReprjErrorPK(0.0, 0.0, fx_, fy_, cx_, cy_, point);
+      problem_->AddResidualBlock(new ceres::AutoDiffCostFunction<CameraReprjErrorPK, 2, 6>(error), NULL,
+				 target_->pose_.pb_pose);
+      reprojection_errors_.push_back(error);
+    }
+  }
+  for(int i=0; i<num_observations; i++){
+    reprojection_errors_[i]->ox_ = camera_observations[i].image_loc_x;
+    reprojection_errors_[i]->oy_ = camera_observations[i].image_loc_y;
+  }
+
+  Solver::Summary summary;
+  ceres::Solve(options_, problem_.get(), &summary);
+  cost_per_observation = summary.final_cost/num_observations;
+  return(summary.termination_type != ceres::NO_CONVERGENCE);
+}
 
-  ROSCameraObserver camera_observer(image_topic_, camera_name_);
+bool TargetLocatorService::locateTarget(CameraObservations &camera_observations, double allowable_cost_per_observation,
+					const geometry_msgs::Pose *default_pose, double &cost_per_observation)
+{
+  // start from the last located pose, the target rarely moves far between images
+  bool warm_start = have_last_pose_;
+  if(!warm_start && !initialPose(camera_observations)){
+    if(default_pose == NULL) return(false);
+    target_->pose_.setQuaternion(default_pose->orientation.x, default_pose->orientation.y,
+				 default_pose->orientation.z, default_pose->orientation.w );
+    target_->pose_.setOrigin(default_pose->position.x, default_pose->position.y, default_pose->position.z );
+  }
+  bool converged = solvePose(camera_observations, cost_per_observation);
 
-  // get the focal length and optical center
-  double fx,fy,cx,cy; 
-  double k1,k2,k3,p1,p2;// unused 
-  int height, width; //unused
-  if(!camera_observer.pullCameraInfo(fx, fy, cx, cy, k1, k2, k3, p1, p2, width, height)){
-    ROS_ERROR("could not access camera info");
+  // the target may have moved a long way since the last pose, start over from the closed form estimate
+  if(warm_start && (!converged || cost_per_observation > allowable_cost_per_observation) &&
+     initialPose(camera_observations)){
+    converged = solvePose(camera_observations, cost_per_observation);
+  }
+  have_last_pose_ = converged && cost_per_observation <= allowable_cost_per_observation;
+  return(have_last_pose_);
+}
+
+bool TargetLocatorService::executeCallBack( target_locater::Request &req, target_locater::Response &res)
+{
+  if(!getCameraInfo()){
+    return(false);
   }
-  camera_observer.clearObservations();
-  camera_observer.clearTargets();
 
   // set the roi to the requested
   Roi roi;
@@ -140,60 +257,52 @@ bool TargetLocatorService::executeCallBack( target_locater::Request &req, target
   roi.x_max = req.roi.x_offset + req.roi.width;
   roi.y_max = req.roi.y_offset + req.roi.height;
 
-  industrial_extrinsic_cal::Cost_function cost_type;
-  
-  camera_observer.clearTargets();
-  camera_observer.clearObservations();
-
-  camera_observer.addTarget(target_, roi, cost_type);
-  camera_observer.triggerCamera();
-  while (!camera_observer.observationsDone()) ;
-  camera_observer.getObservations(camera_observations);
-  int num_observations = (int) camera_observations.size();
-  if(num_observations != target_rows_* target_cols_){
-    ROS_ERROR("Target Locator could not find target %d", num_observations);
+  CameraObservations camera_observations;
+  if(!observeTarget(roi, sensor_msgs::ImageConstPtr(), camera_observations)){
     return(false);
   }
 
-  // set initial conditions
-  target_->pose_.setQuaternion(req.initial_pose.orientation.x, req.initial_pose.orientation.y, req.initial_pose.orientation.z, req.initial_pose.orientation.w );
-  target_->pose_.setOrigin(req.initial_pose.position.x, req.initial_pose.position.y, req.initial_pose.position.z );
+  double error_per_observation;
+  bool located = locateTarget(camera_observations, req.allowable_cost_per_observation, &req.initial_pose,
+			      error_per_observation);
+  res.final_cost_per_observation  = error_per_observation;
+  if(located){
+    res.final_pose.position.x = target_->pose_.x;
+    res.final_pose.position.y = target_->pose_.y;
+    res.final_pose.position.z = target_->pose_.z;
+    target_->pose_.getQuaternion(res.final_pose.orientation.x, res.final_pose.orientation.y, res.final_pose.orientation.z, res.final_pose.orientation.w);
+    return true;
+  }
+  ROS_ERROR("allowable cost exceeded %f > %f", error_per_observation, req.allowable_cost_per_observation);
+  return(false);
+}
 
-  Problem problem;
-  for(int i=0; i<num_observations; i++){
-    double image_x = camera_observations[i].image_loc_x;
-    double image_y = camera_observations[i].image_loc_y;
-    Point3d point = target_->pts_[i]; // assume the correct ordering
-    CostFunction* cost_function =
-      industrial_extrinsic_cal::CameraReprjErrorPK::Create(image_x, image_y, fx, fy, cx, cy, point);
-    problem.AddResidualBlock(cost_function, NULL , target_->pose_.pb_pose);
-  }
-  Solver::Options options;
-  Solver::Summary summary;
-  options.linear_solver_type = ceres::DENSE_SCHUR;
-  options.minimizer_progress_to_stdout = false;
-  options.max_num_iterations = 1000;
-  ceres::Solve(options, &problem, &summary);
-
-  if(summary.termination_type != ceres::NO_CONVERGENCE
-     ){
-
-    double error_per_observation = summary.final_cost/num_observations;
-    if(error_per_observation <= req.allowable_cost_per_observation){
-      res.final_pose.position.x = target_->pose_.x;
-      res.final_pose.position.y = target_->pose_.y;
-      res.final_pose.position.z = target_->pose_.z;
-      res.final_cost_per_observation  = error_per_observation;
-      target_->pose_.getQuaternion(res.final_pose.orientation.x, res.final_pose.orientation.y, res.final_pose.orientation.z, res.final_pose.orientation.w);
-
-      return true;
-    }
-    else{
-      res.final_cost_per_observation  = error_per_observation;
-      ROS_ERROR("allowable cost exceeded %f > %f", error_per_observation, req.allowable_cost_per_observation);
-      return(false);
-    }
+void TargetLocatorService::imageCallBack(const sensor_msgs::ImageConstPtr &image)
+{
+  if(!getCameraInfo()){
+    return;
   }
+  Roi roi;
+  roi.x_min = 0;
+  roi.y_min = 0;
+  roi.x_max = image->width;
+  roi.y_max = image->height;
+
+  CameraObservations camera_observations;
+  double error_per_observation;
+  if(!observeTarget(roi, image, camera_observations) ||
+     !locateTarget(camera_observations, stream_allowable_cost_, NULL, error_per_observation)){
+    return;
+  }
+
+  geometry_msgs::PoseStamped pose;
+  pose.header.stamp = image->header.stamp;
+  pose.header.frame_id = optical_frame_.empty() ? image->header.frame_id : optical_frame_;
+  pose.pose.position.x = target_->pose_.x;
+  pose.pose.position.y = target_->pose_.y;
+  pose.pose.position.z = target_->pose_.z;
+  target_->pose_.getQuaternion(pose.pose.orientation.x, pose.pose.orientation.y, pose.pose.orientation.z, pose.pose.orientation.w);
+  pose_pub_.publish(pose);
 }
 
 void TargetLocatorService::initMCircleTarget(int rows, int cols, double circle_dia, double spacing)
@@ -237,6 +346,7 @@ void TargetLocatorService::initBallsTarget()
   target_->pts_.push_back(point_2);
   target_->pts_.push_back(point_3);
   target_->pts_.push_back(point_4);
+  target_->num_points_ = 4;
 }
 
 int main(int argc, char** argv)